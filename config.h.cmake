@@ -23,6 +23,7 @@
 #cmakedefine HAVE_ARPA_INET_H
 #cmakedefine HAVE_NETDB_H
 #cmakedefine HAVE_NETINET_TCP_H
+#cmakedefine HAVE_LINUX_TLS_H
 #cmakedefine HAVE_VALGRIND_H
 #cmakedefine HAVE_STDDEF_H
 #cmakedefine HAVE_STDALIGN_H
@@ -64,6 +65,7 @@
 #cmakedefine HAVE_SOCKADDR_STORAGE
 #cmakedefine HAVE_MAX_ALIGN_T
 #cmakedefine HAVE_ALIGNOF
+#cmakedefine HAVE___THREAD
 #cmakedefine HAVE_ACCEPT4
 #cmakedefine HAVE_PIPE2
 
@@ -78,6 +80,9 @@
 #cmakedefine HAVE_PTHREAD_YIELD
 #cmakedefine HAVE_PTHREAD_RWLOCK_INIT
 #cmakedefine HAVE_PTHREAD_RWLOCKATTR_SETKIND_NP
+#cmakedefine HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+#cmakedefine HAVE_SCHED_GETAFFINITY
+#cmakedefine HAVE_LINUX_FUTEX_H
 
 #cmakedefine PTHREAD_SLEEP_USE_POLL
 #cmakedefine PTHREAD_SLEEP_USE_SELECT
@@ -0,0 +1,269 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __M_CORO_H__
+#define __M_CORO_H__
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include <mstdlib/base/m_defs.h>
+#include <mstdlib/base/m_types.h>
+#include <mstdlib/io/m_io.h>
+#include <mstdlib/io/m_event.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+__BEGIN_DECLS
+
+/*! \addtogroup m_coro Coroutines scheduled by event loops
+ *  \ingroup m_eventio
+ *
+ *  Stackful coroutines which run inside of an event loop thread.
+ *
+ *  A coroutine is a function with its own (small) stack that is started by an
+ *  event loop.  Instead of blocking the OS thread, the M_io_coro_*() functions
+ *  suspend the coroutine and return control to the event loop.  Once the io
+ *  object signals the event being waited on, the coroutine is resumed where it
+ *  left off.  This allows straight-line protocol code, like what would be written
+ *  with the M_io_block_*() functions, to be used for thousands of concurrent
+ *  sessions without an OS thread for each.
+ *
+ *  A coroutine is bound to a single event loop for its entire life.  If an event
+ *  pool is given when creating a coroutine, one of the pool's event loops is
+ *  chosen, the same way as when adding an io object to a pool.  Every io object
+ *  used by a coroutine is added to the coroutine's event loop automatically if it
+ *  is not already part of one.  io objects already added to a different event loop
+ *  cannot be used with the M_io_coro_*() functions.
+ *
+ *  Stacks are taken from a process wide pool and returned to it when a coroutine
+ *  finishes, so creating a coroutine per connection is cheap.  Stacks are
+ *  #M_CORO_STACK_SIZE bytes and are not grown, so coroutines should not place
+ *  large buffers on the stack or recurse deeply.
+ *
+ *  The M_io_coro_*() functions, M_coro_yield() and M_coro_sleep() may only be
+ *  called from within the coroutine itself.  All coroutines on an event loop
+ *  must complete before the event loop is destroyed.
+ *
+ *  Coroutines are not available on every platform.  M_coro_create() will return
+ *  NULL when the platform does not provide a way to switch stacks.
+ *
+ * \code{.c}
+ *      static void session(M_coro_t *coro, void *arg)
+ *      {
+ *          M_io_t        *io = arg;
+ *          unsigned char  buf[256];
+ *          size_t         len;
+ *          size_t         written;
+ *
+ *          while (M_io_coro_read(coro, io, buf, sizeof(buf), &len, 30000) == M_IO_ERROR_SUCCESS) {
+ *              if (M_io_coro_write(coro, io, buf, len, &written, 30000) != M_IO_ERROR_SUCCESS)
+ *                  break;
+ *          }
+ *          M_io_coro_disconnect(coro, io);
+ *          M_io_destroy(io);
+ *      }
+ *
+ *      static void listener(M_coro_t *coro, void *arg)
+ *      {
+ *          M_io_t *server = arg;
+ *          M_io_t *io;
+ *
+ *          while (M_io_coro_accept(coro, &io, server, M_TIMEOUT_INF) == M_IO_ERROR_SUCCESS) {
+ *              M_coro_create(M_event_get_pool(M_coro_event(coro)), session, io);
+ *          }
+ *      }
+ * \endcode
+ *
+ * @{
+ */
+
+struct M_coro;
+typedef struct M_coro M_coro_t;
+
+/*! Size of the stack given to each coroutine. */
+#define M_CORO_STACK_SIZE (sizeof(void *) * 16 * 1024)
+
+/*! Coroutine entry point.
+ *
+ * The coroutine ends, and its resources are released, when this returns.
+ *
+ * \param[in] coro Coroutine being run.
+ * \param[in] arg  User supplied argument.
+ */
+typedef void (*M_coro_func_t)(M_coro_t *coro, void *arg);
+
+
+/*! Create a coroutine and schedule it to be started by an event loop.
+ *
+ * The coroutine does not start running until the event loop processes
+ * its next set of events.  This is thread safe.
+ *
+ * \param[in] event Event loop or event pool to run the coroutine in.
+ * \param[in] func  Function to run as the coroutine.
+ * \param[in] arg   Argument to pass to the function.
+ *
+ * \return Coroutine handle, or NULL on error or if coroutines are not supported.
+ *         The handle is only valid until the coroutine function returns.
+ */
+M_API M_coro_t *M_coro_create(M_event_t *event, M_coro_func_t func, void *arg);
+
+
+/*! Event loop the coroutine is bound to.
+ *
+ * \param[in] coro Coroutine.
+ *
+ * \return Event loop (never an event pool).
+ */
+M_API M_event_t *M_coro_event(M_coro_t *coro);
+
+
+/*! Give other events and coroutines on the event loop a chance to run.
+ *
+ * The coroutine is resumed on the next pass through the event loop.
+ *
+ * \param[in] coro Coroutine, must be the caller.
+ */
+M_API void M_coro_yield(M_coro_t *coro);
+
+
+/*! Suspend the coroutine for a period of time without blocking the event loop.
+ *
+ * \param[in] coro       Coroutine, must be the caller.
+ * \param[in] timeout_ms Amount of time in milliseconds to sleep.
+ */
+M_API void M_coro_sleep(M_coro_t *coro, M_uint64 timeout_ms);
+
+
+/*! Connect the io object to the remote end point.
+ *
+ * \param[in] coro Coroutine, must be the caller.
+ * \param[in] io   io object.
+ *
+ * \return Result.
+ */
+M_API M_io_error_t M_io_coro_connect(M_coro_t *coro, M_io_t *io);
+
+
+/*! Accept an io connection.
+ *
+ * The new io object is not associated with any event loop, it can be handed
+ * to a new coroutine or added to an event loop as normal.
+ *
+ * \param[in]  coro       Coroutine, must be the caller.
+ * \param[out] io_out     io object created from the accept.
+ * \param[in]  server_io  io object which was listening.
+ * \param[in]  timeout_ms Amount of time in milliseconds to wait for a connection.
+ *
+ * \return Result. M_IO_ERROR_WOULDBLOCK on timeout.
+ */
+M_API M_io_error_t M_io_coro_accept(M_coro_t *coro, M_io_t **io_out, M_io_t *server_io, M_uint64 timeout_ms);
+
+
+/*! Read from an io object.
+ *
+ * \param[in]  coro       Coroutine, must be the caller.
+ * \param[in]  io         io object.
+ * \param[out] buf        Buffer to store data read from io object.
+ * \param[in]  buf_len    Length of provided buffer.
+ * \param[out] len_read   Number of bytes read from the io object.
+ * \param[in]  timeout_ms Amount of time in milliseconds to wait for data.
+ *
+ * \return Result. M_IO_ERROR_WOULDBLOCK on timeout.
+ */
+M_API M_io_error_t M_io_coro_read(M_coro_t *coro, M_io_t *io, unsigned char *buf, size_t buf_len, size_t *len_read, M_uint64 timeout_ms);
+
+
+/*! Read from an io object into an M_buf_t.
+ *
+ * This will read all available data into the buffer.
+ *
+ * \param[in]  coro       Coroutine, must be the caller.
+ * \param[in]  io         io object.
+ * \param[out] buf        Buffer to store data read from io object.
+ * \param[in]  timeout_ms Amount of time in milliseconds to wait for data.
+ *
+ * \return Result. M_IO_ERROR_WOULDBLOCK on timeout.
+ */
+M_API M_io_error_t M_io_coro_read_into_buf(M_coro_t *coro, M_io_t *io, M_buf_t *buf, M_uint64 timeout_ms);
+
+
+/*! Read from an io object into an M_parser_t.
+ *
+ * This will read all available data into the parser.
+ *
+ * \param[in]  coro       Coroutine, must be the caller.
+ * \param[in]  io         io object.
+ * \param[out] parser     Parser to store data read from io object.
+ * \param[in]  timeout_ms Amount of time in milliseconds to wait for data.
+ *
+ * \return Result. M_IO_ERROR_WOULDBLOCK on timeout.
+ */
+M_API M_io_error_t M_io_coro_read_into_parser(M_coro_t *coro, M_io_t *io, M_parser_t *parser, M_uint64 timeout_ms);
+
+
+/*! Write data to an io object.
+ *
+ * This function will attempt to write as much data as possible. If not all data
+ * is written the application should try again.
+ *
+ * \param[in]  coro        Coroutine, must be the caller.
+ * \param[in]  io          io object.
+ * \param[in]  buf         Buffer to write from.
+ * \param[in]  buf_len     Number of bytes in buffer to write.
+ * \param[out] len_written Number of bytes from the buffer written.
+ * \param[in]  timeout_ms  Amount of time in milliseconds to wait for buffer space.
+ *
+ * \return Result. M_IO_ERROR_WOULDBLOCK on timeout.
+ */
+M_API M_io_error_t M_io_coro_write(M_coro_t *coro, M_io_t *io, const unsigned char *buf, size_t buf_len, size_t *len_written, M_uint64 timeout_ms);
+
+
+/*! Write data to an io object from an M_buf_t.
+ *
+ * This function will attempt to write as much data as possible. If not all data
+ * is written the application should try again.
+ *
+ * \param[in] coro       Coroutine, must be the caller.
+ * \param[in] io         io object.
+ * \param[in] buf        Buffer to write from.
+ * \param[in] timeout_ms Amount of time in milliseconds to wait for buffer space.
+ *
+ * \return Result. M_IO_ERROR_WOULDBLOCK on timeout.
+ */
+M_API M_io_error_t M_io_coro_write_from_buf(M_coro_t *coro, M_io_t *io, M_buf_t *buf, M_uint64 timeout_ms);
+
+
+/*! Gracefully issue a disconnect to the communications object.
+ *
+ * \param[in] coro Coroutine, must be the caller.
+ * \param[in] io   io object.
+ *
+ * \return Result.
+ */
+M_API M_io_error_t M_io_coro_disconnect(M_coro_t *coro, M_io_t *io);
+
+/*! @} */
+
+__END_DECLS
+
+#endif /* __M_CORO_H__ */
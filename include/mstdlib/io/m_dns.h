@@ -41,6 +41,17 @@ __BEGIN_DECLS
 struct M_dns;
 typedef struct M_dns M_dns_t;
 
+/*! DNS cache statistics as returned by M_dns_get_cache_stats() */
+typedef struct {
+	M_uint64 hits;          /*!< Lookups answered from a fresh cache entry */
+	M_uint64 stale_hits;    /*!< Lookups answered from an expired entry while it was being refreshed */
+	M_uint64 negative_hits; /*!< Lookups answered from a cached "not found" result */
+	M_uint64 misses;        /*!< Lookups that had to wait on a DNS server */
+	M_uint64 prefetches;    /*!< Background refreshes started for entries about to expire */
+	M_uint64 refreshes;     /*!< Background refreshes started for expired entries */
+	size_t   entries;       /*!< Number of hostnames currently in the cache */
+} M_dns_cache_stats_t;
+
 /*! Create a DNS resolver handle.
  *
  * This resolver handle is responsible for caching DNS results as well as
@@ -100,6 +111,73 @@ M_API M_bool M_dns_set_query_timeout(M_dns_t *dns, M_uint64 timeout_ms);
  */
 M_API M_bool M_dns_set_cache_timeout(M_dns_t *dns, M_uint64 timeout_s, M_uint64 max_timeout_s);
 
+
+/*! Allow expired cache entries to be served while they are refreshed in the background.
+ *
+ * Without this, the first lookup after an entry expires has to wait on the DNS
+ * server.  With a stale window, that lookup instead returns the expired results
+ * immediately and a background query is started to refresh the entry.  Only a
+ * single background query per hostname will be outstanding at a time.
+ *
+ * Prefetch starts the background refresh for entries that are still being used
+ * shortly before they expire so that they never go stale to begin with.
+ *
+ * The background query is run on the event handle passed to the lookup which
+ * triggered it.  Both are disabled by default.
+ *
+ *  \param[in] dns        Initialized DNS object
+ *  \param[in] stale_s    Number of seconds past the cache timeout an entry may still be
+ *                        served while being refreshed.  Never extends past the maximum
+ *                        timeout set via M_dns_set_cache_timeout().  0 to disable.
+ *  \param[in] prefetch_s Number of seconds before the cache timeout that a lookup of the
+ *                        entry will start a background refresh.  0 to disable.
+ *
+ *  \return M_TRUE if set successfully, M_FALSE otherwise
+ */
+M_API M_bool M_dns_set_cache_revalidate(M_dns_t *dns, M_uint64 stale_s, M_uint64 prefetch_s);
+
+
+/*! Cache results where the DNS server said the hostname does not exist.
+ *
+ * Lookups for the hostname during this time will fail immediately with a not
+ * found error rather than querying the server again.  Disabled by default.
+ *
+ *  \param[in] dns       Initialized DNS object
+ *  \param[in] timeout_s Number of seconds to cache a not found result.  0 to disable.
+ *
+ *  \return M_TRUE if set successfully, M_FALSE otherwise
+ */
+M_API M_bool M_dns_set_cache_negative(M_dns_t *dns, M_uint64 timeout_s);
+
+
+/*! Use specific DNS servers rather than the ones configured on the system.
+ *
+ *  The cache is not cleared, results already cached continue to be served
+ *  until they expire.
+ *
+ *  \param[in] dns     Initialized DNS object
+ *  \param[in] servers Comma separated list of servers in the form of host[:port].  IPv6
+ *                     addresses with a port need to be enclosed in brackets,
+ *                     e.g. [::1]:5353.  NULL or empty to use the system configuration.
+ *
+ *  \return M_TRUE if set successfully, M_FALSE if the list could not be parsed in
+ *          which case the previous servers remain in use
+ */
+M_API M_bool M_dns_set_servers(M_dns_t *dns, const char *servers);
+
+
+/*! Retrieve cache statistics.
+ *
+ * Counters start at zero when the DNS object is created.  Lookups of IP
+ * addresses and localhost never touch the cache and are not counted.
+ *
+ *  \param[in]  dns   Initialized DNS object
+ *  \param[out] stats Statistics
+ *
+ *  \return M_TRUE on success, M_FALSE on invalid use
+ */
+M_API M_bool M_dns_get_cache_stats(M_dns_t *dns, M_dns_cache_stats_t *stats);
+
 /*! @} */
 
 __END_DECLS
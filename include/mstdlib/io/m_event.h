@@ -29,6 +29,7 @@
 #include <mstdlib/base/m_defs.h>
 #include <mstdlib/base/m_types.h>
 #include <mstdlib/io/m_io.h>
+#include <mstdlib/thread/m_threadpool.h>
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -279,6 +280,35 @@ M_API M_event_t *M_event_create(M_uint32 flags);
 M_API M_event_t *M_event_pool_create(size_t max_threads);
 
 
+/*! Possible list of flags that can be used when creating an event pool */
+enum M_EVENT_POOL_FLAGS {
+	M_EVENT_POOL_FLAG_NONE        = 0,      /*!< Pool threads may run on any core */
+	M_EVENT_POOL_FLAG_PIN_CPU     = 1 << 0, /*!< Bind each pool thread to its own core */
+	M_EVENT_POOL_FLAG_NUMA_SPREAD = 1 << 1  /*!< When pinning, alternate threads between NUMA nodes rather
+	                                             than filling one node first */
+};
+
+
+/*! Create a pool of M_event_t objects with control over where pool threads run.
+ *
+ *  Same as M_event_pool_create() but allows each event thread to be bound to its
+ *  own CPU core, see M_thread_cpu_for_index() for how cores are assigned.
+ *  Connection state handled by a loop then stays in one core's cache, and on
+ *  NUMA systems memory allocated while processing events is local to that core.
+ *  This is useful when network card queues are bound to specific cores.
+ *
+ *  When pinning, M_event_loop() will not run any of the event loops on the calling
+ *  thread, as it can't be bound, instead it waits for the pool threads to exit.
+ *
+ *  \param[in] max_threads See M_event_pool_create().
+ *  \param[in] flags       One or more enum M_EVENT_POOL_FLAGS
+ *
+ *  \return Initialized event pool, or in the case only a single thread would be used,
+ *          a normal event object.
+ */
+M_API M_event_t *M_event_pool_create_ex(size_t max_threads, M_uint32 flags);
+
+
 /*! Retrieve the distributed pool handle for balancing the load across an event pool, or
  *  self if not part of a pool.
  *
@@ -580,6 +610,42 @@ M_API M_bool M_event_timer_remove(M_event_timer_t *timer);
  */
 M_API M_bool M_event_queue_task(M_event_t *event, M_event_callback_t callback, void *cb_data);
 
+
+/*! Callback for the completion of a threadpool future delivered to an event loop.
+ *
+ *  \param[in] event   Event handle the callback is running on.
+ *  \param[in] result  Value returned by the threadpool task.
+ *  \param[in] cb_data User-specified data supplied to M_event_queue_future().
+ */
+typedef void (*M_event_future_callback_t)(M_event_t *event, void *result, void *cb_data);
+
+
+/*! Queue a task to run in the same thread as the event loop once a threadpool
+ *  future completes.
+ *
+ *  Allows CPU intensive work to be offloaded to a M_threadpool_t while the
+ *  result is handled by the event loop without additional locking.  This registers
+ *  the continuation for the future so M_threadpool_future_then() can't also be
+ *  used on the same future.
+ *
+ *  The future may be destroyed at any time after calling this, including from
+ *  within the callback.
+ *
+ *  The callback is always called exactly once.  If the task can't be queued to the
+ *  event loop when the future completes, the callback is run directly from the
+ *  thread that completed the future instead.
+ *
+ *  \param[in] event    Event handle to add task to.  Does not make sense to hand an event
+ *                      pool object since the purpose is to choose the event loop to use.
+ *  \param[in] future   Future returned by M_threadpool_dispatch_future().
+ *  \param[in] callback User-specified callback to call
+ *  \param[in] cb_data  Optional. User-specified data supplied to user-specified callback when
+ *                      executed.
+ *
+ *  \return M_TRUE on success, M_FALSE on failure.
+ */
+M_API M_bool M_event_queue_future(M_event_t *event, M_threadpool_future_t *future, M_event_future_callback_t callback, void *cb_data);
+
 /*! Possible event status codes for an event loop or pool */
 enum M_event_status {
 	M_EVENT_STATUS_RUNNING = 0, /*!< The event loop is current running and processing events */
@@ -42,6 +42,11 @@ __BEGIN_DECLS
  *  is not required. This allows the stacked layers to be utilized with a more
  *  traditional blocking design.
  *
+ *  Internally each io object used in blocking mode is given its own private
+ *  event handle.  These are cached per thread once the io object is destroyed,
+ *  so threads which repeatedly open and close blocking connections do not pay
+ *  the cost of creating a new event handle for each one.
+ *
  *  Here is an example of the system using the loopback io back end to simulate
  *  a network connection to a remote server.
  * 
@@ -392,6 +392,37 @@ M_API M_bool M_io_net_set_keepalives(M_io_t *io, M_uint64 idle_time_s, M_uint64
 M_API M_bool M_io_net_set_nagle(M_io_t *io, M_bool nagle_enabled);
 
 
+/*! Hand record protection for one direction of a connection to the kernel (kTLS).
+ *
+ * Intended for use by a TLS layer sitting directly on top of the network layer once
+ * a handshake has produced traffic keys. Only supported on Linux, and only if the
+ * kernel tls module is available.
+ *
+ * \param[in] io              io object.
+ * \param[in] is_tx           M_TRUE to offload transmit, M_FALSE to offload receive.
+ * \param[in] crypto_info     Kernel crypto info structure (struct tls12_crypto_info_*).
+ * \param[in] crypto_info_len Length of crypto_info.
+ *
+ * \return M_TRUE if the kernel accepted the keys, M_FALSE if offload is not possible
+ *         and the caller should continue handling record protection itself.
+ */
+M_API M_bool M_io_net_ktls_start(M_io_t *io, M_bool is_tx, const void *crypto_info, size_t crypto_info_len);
+
+
+/*! Write a non application data record on a connection with kTLS transmit offload enabled.
+ *
+ * \param[in]     io          io object.
+ * \param[in]     record_type TLS record content type (e.g. 21 for alert, 22 for handshake).
+ * \param[in]     buf         Record payload.
+ * \param[in,out] write_len   Length of payload on input, length written on output.
+ *
+ * \return Result.
+ *
+ * \see M_io_net_ktls_start
+ */
+M_API M_io_error_t M_io_net_ktls_write_record(M_io_t *io, M_uint8 record_type, const unsigned char *buf, size_t *write_len);
+
+
 /*! Set connect timeout.
  *
  * This is the timeout to wait for a connection to finish.
@@ -68,6 +68,28 @@ typedef enum {
 typedef M_bool (*M_async_write_cb_t)(char *msg, M_uint64 cmd, void *thunk);
 
 
+/*! Callback that will be called to write a batch of messages at once.
+ *
+ * Same as M_async_write_cb_t, except that all messages queued at the time the internal thread wakes up
+ * (up to the batch size given to M_async_writer_create_batch()) are passed in one call, so the callback
+ * can write them with a single system call.
+ *
+ * Messages are concatenated in the order they were written, with no separators added between them. A
+ * batch always contains at least one message if \a num_msgs is non-zero, even if that message alone is
+ * larger than the batch size.
+ *
+ * It is possible for the callback to be called with \a num_msgs set to 0 and a non-zero command, for the same
+ * reasons as M_async_write_cb_t. In this case \a msgs is empty.
+ *
+ * \param[in] msgs     concatenated messages that need to be written. Must not be modified if M_FALSE is returned.
+ * \param[in] num_msgs number of messages in \a msgs. May be 0, for command-only calls.
+ * \param[in] cmd      command flag passed into M_async_writer_set_command(). May be 0, if no command sent.
+ * \param[in] thunk    object passed into \a write_thunk parameter of M_async_writer_create_batch().
+ * \return             M_TRUE if messages were consumed, M_FALSE if messages should be returned to queue (if possible).
+ */
+typedef M_bool (*M_async_write_batch_cb_t)(M_buf_t *msgs, size_t num_msgs, M_uint64 cmd, void *thunk);
+
+
 /* Callback that will be used to stop any asynchronous operations owned by the write thunk.
  *
  * This is an optional extra callback. Only use this if you have an extra async operation running
@@ -110,6 +132,24 @@ M_API M_async_writer_t *M_async_writer_create(size_t max_bytes, M_async_write_cb
 	M_async_writer_line_end_mode_t mode);
 
 
+/*! Create a writer object that delivers messages in batches.
+ *
+ * Same as M_async_writer_create(), except that the internal thread passes every queued message (up to
+ * \a max_batch_bytes of text) to \a batch_cb in a single call, instead of calling back once per message.
+ *
+ * \param[in] max_bytes       maximum bytes that can be queued before messages start getting dropped
+ * \param[in] max_batch_bytes maximum bytes passed to the callback in one batch, or 0 to use the default (64 KB)
+ * \param[in] batch_cb        callback that will be called by an internal thread to write batches of messages
+ * \param[in] write_thunk     object that can be used to preserve callback state between writes
+ * \param[in] stop_cb         optional callback that will be called during a stop request
+ * \param[in] destroy_cb      callback that will be used to destroy the thunk when writer is destroyed
+ * \param[in] mode            line-end mode for internally generated error messages
+ */
+M_API M_async_writer_t *M_async_writer_create_batch(size_t max_bytes, size_t max_batch_bytes,
+	M_async_write_batch_cb_t batch_cb, void *write_thunk, M_async_thunk_stop_cb_t stop_cb,
+	M_async_thunk_destroy_cb_t destroy_cb, M_async_writer_line_end_mode_t mode);
+
+
 /*! Destroy the writer (non-blocking).
  *
  * This is a non-blocking operation - the worker thread is commanded to destroy itself, then immediately orphaned. The
@@ -278,6 +318,22 @@ M_API M_bool M_async_writer_set_command_block(M_async_writer_t *writer, M_uint64
 M_API void M_async_writer_set_max_bytes(M_async_writer_t *writer, size_t max_bytes);
 
 
+/*! Delay delivery of batches until enough data has been queued (group commit).
+ *
+ * Only applies to writers created with M_async_writer_create_batch(). When set, the internal thread waits after
+ * the first message arrives until either \a flush_bytes of text are queued or \a delay_ms has passed, whichever
+ * comes first, so that many small messages are delivered to the callback as one large batch. Commands sent with
+ * the force flag, stops and flushes are not delayed.
+ *
+ * Messages waiting to be delivered still count against the queue's maximum size.
+ *
+ * \param[in] writer      object we're operating on
+ * \param[in] flush_bytes deliver as soon as this many bytes are queued. Capped at the writer's maximum batch size.
+ * \param[in] delay_ms    maximum time to wait for \a flush_bytes to be queued, or 0 to deliver immediately (default)
+ */
+M_API void M_async_writer_set_batch_delay(M_async_writer_t *writer, size_t flush_bytes, M_uint64 delay_ms);
+
+
 /*! Write a message to the writer (non-blocking).
  *
  * The message will be added to a work queue, to be passed later to write_callback by an internal worker thread.
@@ -467,6 +467,65 @@ M_API M_uint64 M_log_get_tag(M_log_t *log, const char *name);
 M_API M_log_error_t M_log_set_tag_names_padded(M_log_t *log, M_bool padded);
 
 
+/*! Enable deferred formatting for all future log messages.
+ *
+ * By default, M_log_printf() formats the message, builds the timestamp and passes the message to each module
+ * on the calling thread. With deferred formatting enabled, the calling thread only records the tag, a timestamp,
+ * the format string pointer and a copy of the arguments into a buffer owned by that thread. A background thread
+ * picks the messages up, formats them and passes them on to the modules. This takes almost all of the cost of
+ * logging off of the calling thread.
+ *
+ * Messages from different threads are written in timestamp order. Messages are picked up within a few
+ * milliseconds of being logged, use M_log_deferred_flush() to force everything logged so far to be written.
+ *
+ * \warning
+ * The format string is NOT copied, only the pointer is kept. It must remain valid until the message has been
+ * written, in practice this means it must be a string literal. String arguments (%%s) are copied and don't have
+ * this restriction.
+ *
+ * \warning
+ * Messages are filtered and prefixed on the background thread, after M_log_printf() has returned. The per-message
+ * thunk can't be used at that point, so filter and prefix callbacks will always receive NULL for it.
+ *
+ * If a thread's buffer fills up, the thread will wait for the background thread to make room. Messages too large
+ * to fit in the buffer are written synchronously, after any messages already queued.
+ *
+ * Must be called before any messages are written. Deferred formatting can't be turned off once enabled.
+ *
+ * \param log             logger object
+ * \param thread_buf_size size of each thread's buffer in bytes, rounded up to a power of two. 0 for the default (64 KB)
+ * \return                error code
+ */
+M_API M_log_error_t M_log_set_deferred(M_log_t *log, size_t thread_buf_size);
+
+
+/*! Write all deferred messages logged so far (BLOCKING).
+ *
+ * Does nothing if deferred formatting isn't enabled.
+ *
+ * \see M_log_set_deferred()
+ *
+ * \param log logger object
+ */
+M_API void M_log_deferred_flush(M_log_t *log);
+
+
+/*! Check whether any module will accept messages with the given tag.
+ *
+ * This doesn't take any locks, it only checks the combined accepted tags of all modules, so it's cheap
+ * enough to call before every message. Messages with tags that no module accepts are dropped by M_log_printf(),
+ * M_log_vprintf() and M_log_write() before any formatting is done, but the arguments still have to be evaluated.
+ * Use this, or the M_LOG_PRINTF() and M_LOG_WRITE() macros, to skip that as well.
+ *
+ * A module's filter callback isn't taken into account, so M_TRUE doesn't mean the message will be written.
+ *
+ * \param log logger object
+ * \param tag user-defined tag (may contain multiple tags, M_TRUE if any is accepted)
+ * \return    M_TRUE if at least one module accepts the tag, M_FALSE otherwise
+ */
+M_API M_bool M_log_tag_enabled(M_log_t *log, M_uint64 tag);
+
+
 /*! Write a formatted message to the log.
  *
  * Multi-line messages will be split into a separate log message for each line.
@@ -523,6 +582,46 @@ M_API M_log_error_t M_log_vprintf(M_log_t *log, M_uint64 tag, void *msg_thunk, c
 M_API M_log_error_t M_log_write(M_log_t *log, M_uint64 tag, void *msg_thunk, const char *msg);
 
 
+/*! Write a formatted message to the log, only if some module accepts the tag.
+ *
+ * Same as M_log_printf(), but the format arguments aren't evaluated at all if no module accepts the tag.
+ * This makes it safe to leave verbose logging with expensive arguments in place and turn it on
+ * with M_log_module_set_accepted_tags() when needed.
+ *
+ * The error code from M_log_printf() is discarded.
+ *
+ * \param[in] log       logger object
+ * \param[in] tag       user-defined tag attached to this message (must be a single power-of-two tag)
+ * \param[in] msg_thunk per-message thunk to pass to filter and prefix callbacks
+ * \param[in] ...       format string and arguments, same as M_log_printf()
+ */
+#define M_LOG_PRINTF(log, tag, msg_thunk, ...) \
+	do { \
+		if (M_log_tag_enabled((log), (tag))) { \
+			M_log_printf((log), (tag), (msg_thunk), __VA_ARGS__); \
+		} \
+	} while (0)
+
+
+/*! Write a message directly to the log, only if some module accepts the tag.
+ *
+ * Same as M_log_write(), but msg isn't evaluated at all if no module accepts the tag.
+ *
+ * The error code from M_log_write() is discarded.
+ *
+ * \param[in] log       logger object
+ * \param[in] tag       user-defined tag attached to this message (must be a single power-of-two tag)
+ * \param[in] msg_thunk per-message thunk to pass to filter and prefix callbacks
+ * \param[in] msg       message string
+ */
+#define M_LOG_WRITE(log, tag, msg_thunk, msg) \
+	do { \
+		if (M_log_tag_enabled((log), (tag))) { \
+			M_log_write((log), (tag), (msg_thunk), (msg)); \
+		} \
+	} while (0)
+
+
 /*! Perform an emergency message write, to all modules that allow such writes.
  *
  * \warning
@@ -853,6 +952,28 @@ M_API M_log_error_t M_log_module_android_set_tag_priority(M_log_t *log, M_log_mo
  * @{
  */
 
+/*! Policy for syncing the log file to disk (fsync).
+ *
+ * \see M_log_module_file_set_sync
+ */
+typedef enum {
+	M_LOG_FILE_SYNC_NEVER = 0, /*!< Never sync, leave it up to the OS (default). */
+	M_LOG_FILE_SYNC_INTERVAL,  /*!< Sync after a write if the given number of milliseconds passed since the last sync. */
+	M_LOG_FILE_SYNC_BYTES,     /*!< Sync after a write once the given number of bytes were written since the last sync. */
+	M_LOG_FILE_SYNC_ROTATE     /*!< Only sync when the file is closed (rotate, reopen, suspend or shutdown). */
+} M_log_file_sync_t;
+
+
+/*! How rotated log files are compressed.
+ *
+ * \see M_log_module_file_set_compress
+ */
+typedef enum {
+	M_LOG_FILE_COMPRESS_EXTERNAL = 0, /*!< Run the archive command given to M_log_module_add_file(), if any (default). */
+	M_LOG_FILE_COMPRESS_GZIP          /*!< Compress in-process with gzip on a background thread, adds ".gz". */
+} M_log_file_compress_t;
+
+
 /*! Add a module to output to a rotating list of files on disk.
  *
  * When archiving a file, the uncompressed file name will be appended directly onto whatever archive command is
@@ -897,6 +1018,66 @@ M_API M_log_error_t M_log_module_add_file(M_log_t *log, const char *log_file_pat
  */
 M_API M_log_error_t M_log_module_file_rotate(M_log_t *log, M_log_module_t *module);
 
+
+/*! Batch up writes to the log file (group commit).
+ *
+ * By default, the internal worker thread writes messages as soon as they arrive. Under heavy logging this results
+ * in lots of tiny writes. With a write delay set, the worker waits after the first message arrives until either
+ * \a flush_bytes of messages are queued or \a delay_ms has passed, then writes everything queued with a single call.
+ *
+ * Messages waiting to be written still count against the module's \a max_queue_bytes, so \a flush_bytes should be
+ * well under that limit.
+ *
+ * \param[in] log         logger object
+ * \param[in] module      handle of module to operate on
+ * \param[in] flush_bytes write as soon as this many bytes are queued, or 0 to use the max write size (256 KB)
+ * \param[in] delay_ms    max time to hold messages before writing them, or 0 to write immediately (default)
+ * \return                error code
+ */
+M_API M_log_error_t M_log_module_file_set_write_delay(M_log_t *log, M_log_module_t *module, size_t flush_bytes,
+	M_uint64 delay_ms);
+
+
+/*! Set how often the log file is synced to disk.
+ *
+ * Syncing trades throughput for durability: without it, messages that were written but are still in the OS cache
+ * are lost if the machine goes down. The policy is checked after every write. Every policy except
+ * M_LOG_FILE_SYNC_NEVER also syncs the file before it's closed.
+ *
+ * \param[in] log    logger object
+ * \param[in] module handle of module to operate on
+ * \param[in] policy when to sync
+ * \param[in] value  milliseconds for M_LOG_FILE_SYNC_INTERVAL, bytes for M_LOG_FILE_SYNC_BYTES, ignored otherwise
+ * \return           error code
+ */
+M_API M_log_error_t M_log_module_file_set_sync(M_log_t *log, M_log_module_t *module, M_log_file_sync_t policy,
+	M_uint64 value);
+
+
+/*! Set how rotated log files are compressed.
+ *
+ * By default, rotated files are compressed by running the \a archive_cmd passed to M_log_module_add_file() in a
+ * separate process. Starting a process can be expensive when the logging process is large. With
+ * M_LOG_FILE_COMPRESS_GZIP, the file is instead compressed by a background thread inside the process, and
+ * \a archive_cmd is ignored.
+ *
+ * Compression reads the file in chunks and can be rate limited, so it doesn't compete too hard with the rest of the
+ * process for CPU and disk. If a rotate happens before the previous file is done compressing, the rotate waits
+ * for it.
+ *
+ * The new setting takes effect on the next rotate. Old files archived with a different extension are not renamed
+ * or deleted by later rotations.
+ *
+ * \param[in] log             logger object
+ * \param[in] module          handle of module to operate on
+ * \param[in] type            how to compress rotated files
+ * \param[in] max_bytes_per_s max rate at which a rotated file is read and compressed, or 0 for no limit
+ * \return                    error code. M_LOG_MODULE_UNSUPPORTED if gzip was requested, but the library was built
+ *                            without zlib.
+ */
+M_API M_log_error_t M_log_module_file_set_compress(M_log_t *log, M_log_module_t *module, M_log_file_compress_t type,
+	M_uint64 max_bytes_per_s);
+
 /*! @} */ /* End of file group */
 
 
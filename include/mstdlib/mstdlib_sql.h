@@ -22,6 +22,7 @@
 #include <mstdlib/sql/m_sql_trans.h>
 #include <mstdlib/sql/m_sql_table.h>
 #include <mstdlib/sql/m_sql_trace.h>
+#include <mstdlib/sql/m_sql_bulkload.h>
 
 #endif /* __MSTDLIB_SQL_H__ */
 
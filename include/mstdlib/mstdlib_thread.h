@@ -14,7 +14,11 @@
  */
 
 #include <mstdlib/thread/m_atomic.h>
+#include <mstdlib/thread/m_epoch.h>
+#include <mstdlib/thread/m_hash_strvp_rcu.h>
 #include <mstdlib/thread/m_popen.h>
+#include <mstdlib/thread/m_ringbuf.h>
+#include <mstdlib/thread/m_rwlock_striped.h>
 #include <mstdlib/thread/m_thread.h>
 #include <mstdlib/thread/m_threadpool.h>
 
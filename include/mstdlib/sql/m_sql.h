@@ -432,6 +432,29 @@ M_API M_sql_error_t M_sql_connpool_add_readonly_pool(M_sql_connpool_t *pool, con
 M_API void M_sql_connpool_set_timeouts(M_sql_connpool_t *pool, M_time_t reconnect_time_s, M_time_t max_idle_time_s, M_time_t fallback_s);
 
 
+/*! Set how long statements created with M_sql_stmt_groupinsert_prepare() wait
+ *  for other callers to join before executing.
+ *
+ *  By default a grouped insert only picks up rows from callers that arrive while
+ *  it yields and waits for a connection, so under moderate load groups stay small.
+ *  With a linger window the first caller waits up to max_wait_ms for others to
+ *  join, trading that much latency for fewer, larger multi-row inserts.  Each
+ *  caller still receives the result of the group it joined.
+ *
+ *  Once a group reaches max_rows it executes immediately and the next caller
+ *  starts a new group.
+ *
+ *  Only affects groups started after this is called.  Safe to call on an active pool.
+ *
+ *  \param[in] pool        Initialized connection pool object
+ *  \param[in] max_wait_ms Maximum time in milliseconds the first caller waits for others.
+ *                         Set to 0 to disable lingering.  Default is 0.
+ *  \param[in] max_rows    Maximum number of callers grouped together, 0 for no limit.
+ *                         Default is 0.
+ */
+M_API void M_sql_connpool_set_groupinsert_linger(M_sql_connpool_t *pool, M_uint64 max_wait_ms, size_t max_rows);
+
+
 /*! Start the connection pool and make it ready for use.
  *
  *  At least one connection from the primary pool, and optionally the read-only pool will be
@@ -0,0 +1,190 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __M_SQL_BULKLOAD_H__
+#define __M_SQL_BULKLOAD_H__
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include <mstdlib/base/m_defs.h>
+#include <mstdlib/base/m_types.h>
+#include <mstdlib/sql/m_sql.h>
+#include <mstdlib/sql/m_sql_stmt.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+__BEGIN_DECLS
+
+/*! \addtogroup m_sql_bulkload SQL Bulk Loading
+ *  \ingroup m_sql
+ *
+ * SQL Bulk Loading
+ *
+ * Streams a large number of rows into a single table using the fastest mechanism
+ * the database driver supports.  PostgreSQL uses COPY FROM STDIN, other drivers
+ * use a prepared multi-row INSERT.  The entire load is performed within a single
+ * transaction, so either all rows are loaded or none are.
+ *
+ * Rows are accepted incrementally and are sent to the server whenever the number
+ * of rows or bytes buffered reaches the configured limits, so memory use stays
+ * bounded no matter how many rows are loaded.
+ *
+ * Values for each row are bound to the statement returned by M_sql_bulkload_stmt()
+ * using the \link m_sql_stmt_bind M_sql_stmt_bind_*() \endlink functions, in the
+ * same order the columns were added, followed by a call to M_sql_bulkload_row_finish().
+ *
+ * Example:
+ *
+ * \code{.c}
+ *     M_sql_bulkload_t *bl = M_sql_bulkload_create(pool, "foo");
+ *     M_sql_stmt_t     *stmt;
+ *     M_sql_error_t     err = M_SQL_ERROR_SUCCESS;
+ *     size_t            i;
+ *
+ *     M_sql_bulkload_add_col(bl, "id");
+ *     M_sql_bulkload_add_col(bl, "name");
+ *     stmt = M_sql_bulkload_stmt(bl);
+ *
+ *     for (i=0; i<num_rows && !M_sql_error_is_error(err); i++) {
+ *         M_sql_stmt_bind_int64(stmt, rows[i].id);
+ *         M_sql_stmt_bind_text_const(stmt, rows[i].name, 0);
+ *         err = M_sql_bulkload_row_finish(bl);
+ *     }
+ *
+ *     if (!M_sql_error_is_error(err))
+ *         err = M_sql_bulkload_finish(bl);
+ *
+ *     if (M_sql_error_is_error(err))
+ *         M_printf("Load failed: %s: %s\n", M_sql_error_string(err), M_sql_bulkload_get_error_string(bl));
+ *
+ *     M_sql_bulkload_destroy(bl);
+ * \endcode
+ *
+ * @{
+ */
+
+struct M_sql_bulkload;
+/*! Object holding the state of a bulk load */
+typedef struct M_sql_bulkload M_sql_bulkload_t;
+
+
+/*! Create a bulk load into a table.
+ *
+ *  No connection is acquired until the first rows are sent to the server.
+ *
+ *  \param[in] pool  Initialized and started connection pool.
+ *  \param[in] table Name of table to load.
+ *  \return Bulk load object, or NULL on misuse.
+ */
+M_API M_sql_bulkload_t *M_sql_bulkload_create(M_sql_connpool_t *pool, const char *table);
+
+
+/*! Add a column that will be loaded.
+ *
+ *  Must be called for each column before any rows are added.  Columns not added
+ *  take their default value.
+ *
+ *  \param[in] bl   Bulk load object.
+ *  \param[in] name Name of column.
+ *  \return M_TRUE on success, M_FALSE on misuse.
+ */
+M_API M_bool M_sql_bulkload_add_col(M_sql_bulkload_t *bl, const char *name);
+
+
+/*! Set the limits on rows buffered before they are sent to the server.
+ *
+ *  Defaults to 10000 rows or 4MB of text and binary data, whichever is reached first.
+ *
+ *  \param[in] bl        Bulk load object.
+ *  \param[in] max_rows  Maximum number of rows to buffer, 0 for the default.
+ *  \param[in] max_bytes Maximum text and binary data to buffer, 0 for the default.
+ *  \return M_TRUE on success, M_FALSE on misuse.
+ */
+M_API M_bool M_sql_bulkload_set_flush(M_sql_bulkload_t *bl, size_t max_rows, size_t max_bytes);
+
+
+/*! Retrieve the statement handle used to bind values for the current row.
+ *
+ *  Only the M_sql_stmt_bind_*() functions may be used on the returned handle,
+ *  it must not be prepared, executed, or destroyed.
+ *
+ *  \param[in] bl Bulk load object.
+ *  \return Statement handle, or NULL on misuse.
+ */
+M_API M_sql_stmt_t *M_sql_bulkload_stmt(M_sql_bulkload_t *bl);
+
+
+/*! Complete the current row of bound values.
+ *
+ *  The row must have a value bound for every column.  Buffered rows will be sent
+ *  to the server if a flush limit has been reached.
+ *
+ *  \param[in] bl Bulk load object.
+ *  \return #M_SQL_ERROR_SUCCESS on success, or one of the #M_sql_error_t values on failure.
+ *          Once an error is returned the load is rolled back and all further calls will
+ *          return the same error.
+ */
+M_API M_sql_error_t M_sql_bulkload_row_finish(M_sql_bulkload_t *bl);
+
+
+/*! Send any remaining rows and commit the load.
+ *
+ *  \param[in] bl Bulk load object.
+ *  \return #M_SQL_ERROR_SUCCESS on success, or one of the #M_sql_error_t values on failure.
+ *          On failure the load is rolled back.
+ */
+M_API M_sql_error_t M_sql_bulkload_finish(M_sql_bulkload_t *bl);
+
+
+/*! Retrieve the number of rows sent to the server.
+ *
+ *  Rows aren't durable until M_sql_bulkload_finish() returns success.
+ *
+ *  \param[in] bl Bulk load object.
+ *  \return Number of rows.
+ */
+M_API M_uint64 M_sql_bulkload_rows_loaded(M_sql_bulkload_t *bl);
+
+
+/*! Retrieve the error message for the last failure.
+ *
+ *  \param[in] bl Bulk load object.
+ *  \return Error message, or empty string if no error.
+ */
+M_API const char *M_sql_bulkload_get_error_string(M_sql_bulkload_t *bl);
+
+
+/*! Destroy a bulk load.
+ *
+ *  If M_sql_bulkload_finish() was not called successfully, any rows sent to the
+ *  server are rolled back.
+ *
+ *  \param[in] bl Bulk load object.
+ */
+M_API void M_sql_bulkload_destroy(M_sql_bulkload_t *bl);
+
+/*! @} */
+
+__END_DECLS
+
+#endif /* __M_SQL_BULKLOAD_H__ */
@@ -54,7 +54,7 @@ __BEGIN_DECLS
  */
 
 /*! Current subsystem versioning for module compatibility tracking */
-#define M_SQL_DRIVER_VERSION 0x0100
+#define M_SQL_DRIVER_VERSION 0x0102
 
 /*! Private connection object structure from pool */
 struct M_sql_conn;
@@ -317,6 +317,51 @@ typedef void (*M_sql_driver_cb_append_updlock_t)(M_sql_connpool_t *pool, M_buf_t
 typedef M_bool (*M_sql_driver_cb_append_bitop_t)(M_sql_connpool_t *pool, M_buf_t *query, M_sql_query_bitop_t op, const char *exp1, const char *exp2);
 
 
+/*! Load rows of bound parameters into a table using the fastest native mechanism
+ *  the database provides (e.g. COPY), rather than INSERT statements.
+ *
+ *  Always called within a transaction.  All rows bound to the statement must be
+ *  loaded, or an error returned.  The values for each row are bound in the same
+ *  order as the column names.
+ *
+ *  \param[in]  conn       Initialized connection object, use M_sql_driver_conn_get_conn() to get driver-specific
+ *                         private connection handle.
+ *  \param[in]  table      Name of table to load.
+ *  \param[in]  cols       Names of columns to load.
+ *  \param[in]  stmt       Statement handle holding rows of bound parameters, use M_sql_driver_stmt_bind_rows()
+ *                         and the M_sql_driver_stmt_bind_get_*() functions to retrieve them.
+ *  \param[in]  error      User-supplied error message buffer
+ *  \param[in]  error_size Size of user-supplied error message buffer
+ *  \return one of the M_sql_error_t conditions
+ */
+typedef M_sql_error_t (*M_sql_driver_cb_bulkload_t)(M_sql_conn_t *conn, const char *table, const M_list_str_t *cols, M_sql_stmt_t *stmt, char *error, size_t error_size);
+
+
+/*! Execute a sequence of statements, sending all of them to the server before
+ *  waiting on any result, to avoid a network round trip per statement.
+ *
+ *  Each statement has already been prepared via the driver's prepare callback and has
+ *  at most one row of bound parameters.  The same query may appear more than once, in
+ *  which case the statements share a driver statement handle, so parameters must be
+ *  bound from each statement as it is sent.  Statements must be executed in order, and
+ *  any result set must be loaded completely using the M_sql_driver_stmt_result_*()
+ *  functions, as the fetch callback will not be called for these statements.
+ *
+ *  \param[in]  conn          Initialized connection object, use M_sql_driver_conn_get_conn() to get driver-specific
+ *                            private connection handle.
+ *  \param[in]  stmts         Array of statement handles to execute, use M_sql_driver_stmt_get_stmt() to get each
+ *                            driver-specific prepared statement handle.
+ *  \param[in]  num_stmts     Number of statement handles.
+ *  \param[out] num_executed  Number of statements executed successfully.  On failure, this is the index
+ *                            of the statement that failed.
+ *  \param[in]  error         User-supplied error message buffer
+ *  \param[in]  error_size    Size of user-supplied error message buffer
+ *  \return M_SQL_ERROR_SUCCESS if all statements were executed, otherwise the error for the first
+ *          statement that failed.
+ */
+typedef M_sql_error_t (*M_sql_driver_cb_execute_batch_t)(M_sql_conn_t *conn, M_sql_stmt_t * const *stmts, size_t num_stmts, size_t *num_executed, char *error, size_t error_size);
+
+
 /*! Structure to be implemented by SQL drivers with information about the database in use */
 typedef struct  {
 	M_uint16                      driver_sys_version; /*!< Driver/Module subsystem version, use M_SQL_DRIVER_VERSION */
@@ -346,6 +391,12 @@ typedef struct  {
 	M_sql_driver_cb_append_updlock_t     cb_append_updlock;     /*!< Optional. Callback used to append row-level locking data */
 	M_sql_driver_cb_append_bitop_t       cb_append_bitop;       /*!< Required. Callback used to append a bit operation */
 	M_module_handle_t                    handle;                /*!< Handle for loaded driver - must be initialized to NULL in the driver structure */
+
+	/* Added in subsystem version 0x0101, only referenced for drivers reporting at least that version */
+	M_sql_driver_cb_bulkload_t           cb_bulkload;           /*!< Optional. Callback used to load rows using a native bulk mechanism */
+
+	/* Added in subsystem version 0x0102, only referenced for drivers reporting at least that version */
+	M_sql_driver_cb_execute_batch_t      cb_execute_batch;      /*!< Optional. Callback used to execute a sequence of statements in a single round trip */
 } M_sql_driver_t;
 
 
@@ -598,6 +649,25 @@ M_API M_bool M_sql_driver_stmt_result_set_col_type(M_sql_stmt_t *stmt, size_t co
  */
 M_API M_buf_t *M_sql_driver_stmt_result_col_start(M_sql_stmt_t *stmt);
 
+/*! Store the column most recently started with M_sql_driver_stmt_result_col_start()
+ *  as a native integer rather than as text.
+ *
+ *  Drivers that receive integers (or booleans, as 0 or 1) in binary form should
+ *  use this instead of converting them to text.  The integer accessors then
+ *  return the value directly, and the text version is only generated if the
+ *  caller asks for it.
+ *
+ *  Nothing may be written to the buffer returned by
+ *  M_sql_driver_stmt_result_col_start() for this column, not even a NULL
+ *  terminator.
+ *
+ *  \param[in] stmt Statement handle
+ *  \param[in] val  Integer value of the column
+ *  \return M_TRUE on success, M_FALSE if no column was started or data was
+ *          already written to it.
+ */
+M_API M_bool M_sql_driver_stmt_result_col_int(M_sql_stmt_t *stmt, M_int64 val);
+
 /*! Finish a row worth of data.
  *
  *  This is required to be called after all the columns for a row are written using 
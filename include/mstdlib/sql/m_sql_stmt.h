@@ -29,6 +29,7 @@
 #include <mstdlib/base/m_defs.h>
 #include <mstdlib/base/m_types.h>
 #include <mstdlib/sql/m_sql.h>
+#include <mstdlib/io/m_event.h>
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -173,6 +174,51 @@ M_API M_sql_stmt_t *M_sql_stmt_groupinsert_prepare_buf(M_sql_connpool_t *pool, M
 M_API M_sql_error_t M_sql_stmt_execute(M_sql_connpool_t *pool, M_sql_stmt_t *stmt);
 
 
+/*! Callback for completion of M_sql_stmt_execute_threaded().
+ *
+ *  \param[in] event  Event handle the callback is running on.
+ *  \param[in] stmt   Statement handle passed to M_sql_stmt_execute_threaded().  Results
+ *                    can be read exactly as if M_sql_stmt_execute() had returned.
+ *  \param[in] err    Result of the execution, same as M_sql_stmt_execute() would return.
+ *  \param[in] thunk  User-specified data supplied to M_sql_stmt_execute_threaded().
+ */
+typedef void (*M_sql_stmt_threaded_cb_t)(M_event_t *event, M_sql_stmt_t *stmt, M_sql_error_t err, void *thunk);
+
+
+/*! Execute a single query against the database on a worker thread, delivering
+ *  the result to an event loop.
+ *
+ *  This is M_sql_stmt_execute(), including auto-commit and retry on rollback,
+ *  run on worker threads owned by the pool.  The driver still executes the
+ *  query with blocking calls, the worker thread is what blocks instead of the
+ *  caller.  Once complete the callback is queued to run in the event loop's
+ *  thread.  The pool keeps at most one worker per connection, so executions
+ *  beyond that are queued until a worker is available rather than blocking
+ *  the caller.
+ *
+ *  The statement must not be touched by the caller until the callback is called.
+ *  If the statement has M_sql_stmt_set_max_fetch_rows() set, M_sql_stmt_fetch()
+ *  may be called from the callback but will block the event loop while doing so.
+ *
+ *  The event loop must be run until all callbacks have been delivered.
+ *  M_sql_connpool_destroy() will return #M_SQL_ERROR_INUSE while any
+ *  executions are outstanding.
+ *
+ *  Statements created with M_sql_stmt_groupinsert_prepare() are not supported
+ *  as grouping relies on the calling thread blocking.
+ *
+ * \param[in] pool     Initialized and started #M_sql_connpool_t object
+ * \param[in] stmt     Initialized and prepared #M_sql_stmt_t object
+ * \param[in] event    Event handle to deliver the result to.  Does not make sense to hand
+ *                     an event pool object since the purpose is to choose the event loop to use.
+ * \param[in] callback Callback to call with the result.
+ * \param[in] thunk    Optional. User-specified data supplied to the callback.
+ * \return M_TRUE if the execution was queued and the callback will be called,
+ *         M_FALSE on invalid use in which case the callback will not be called.
+ */
+M_API M_bool M_sql_stmt_execute_threaded(M_sql_connpool_t *pool, M_sql_stmt_t *stmt, M_event_t *event, M_sql_stmt_threaded_cb_t callback, void *thunk);
+
+
 /*! Set the maximum number of rows to fetch/cache in the statement handle.
  *
  *  By default, all available rows are cached, if this is called, only
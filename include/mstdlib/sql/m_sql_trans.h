@@ -108,6 +108,8 @@ M_API M_sql_error_t M_sql_trans_rollback(M_sql_trans_t *trans);
  *
  *  Any statements executed against the transaction handle will not be applied to the
  *  database until this command is called.
+ *  Any statements still queued via M_sql_trans_queue() are executed first, and if
+ *  any fail the transaction is rolled back.
  *
  *  The associated transaction handle will be automatically destroyed regardless if
  *  this function returns success or fail.  If a failure occurs, the caller must assume
@@ -144,6 +146,42 @@ M_API M_sql_error_t M_sql_trans_commit(M_sql_trans_t *trans, char *error, size_t
 M_API M_sql_error_t M_sql_trans_execute(M_sql_trans_t *trans, M_sql_stmt_t *stmt);
 
 
+/*! Queue a query to be executed as part of an open transaction.  Queued queries are
+ *  not executed until M_sql_trans_flush() or M_sql_trans_commit() is called, or
+ *  another query is executed via M_sql_trans_execute().
+ *
+ *  Deferring execution allows the SQL driver to send all queued queries to the server
+ *  at once rather than waiting for each result before sending the next query, which
+ *  avoids a network round trip per query.  Currently only PostgreSQL supports this,
+ *  for other databases queued queries are executed one at a time.  Only queries with
+ *  at most one row of bound parameters are sent together.
+ *
+ *  The statement handle must not be destroyed or modified until it has been executed.
+ *  Statements using M_sql_stmt_set_max_fetch_rows() or prepared with
+ *  M_sql_stmt_groupinsert_prepare() cannot be queued.
+ *
+ *  \param[in]  trans      Initialized #M_sql_trans_t object.
+ *  \param[in]  stmt       Initialized and prepared #M_sql_stmt_t object
+ *  \return #M_SQL_ERROR_SUCCESS on success, or #M_SQL_ERROR_INVALID_USE if the statement
+ *          cannot be queued.
+ */
+M_API M_sql_error_t M_sql_trans_queue(M_sql_trans_t *trans, M_sql_stmt_t *stmt);
+
+
+/*! Execute all queries queued via M_sql_trans_queue(), in the order they were queued.
+ *
+ *  Execution stops at the first failure, the statement that failed records the error
+ *  and any statements after it record the same error without being executed.  Results
+ *  for each statement are available from its statement handle as with
+ *  M_sql_trans_execute().
+ *
+ *  \param[in]  trans      Initialized #M_sql_trans_t object.
+ *  \return #M_SQL_ERROR_SUCCESS if all queued statements were executed, or the
+ *          #M_sql_error_t value of the first failure.
+ */
+M_API M_sql_error_t M_sql_trans_flush(M_sql_trans_t *trans);
+
+
 /*! Function prototype called by M_sql_trans_process(). 
  *
  *  Inside the function created, the integrator should perform each step of the SQL
@@ -38,9 +38,44 @@ __BEGIN_DECLS
  *
  * Operations which are guaranteed to be atomic.
  *
+ * Unless noted otherwise operations are full barriers (sequentially consistent).
+ * The _explicit variants take a M_atomic_order_t and map to the C11 memory
+ * orders on platforms that support them. On platforms that don't, a stronger
+ * order than requested is used, never a weaker one.
+ *
+ * Typical use of acquire/release is publishing data to another thread:
+ *
+ * \code{.c}
+ *     // Writer
+ *     data->val = 5;
+ *     M_atomic_store_u32_explicit(&data->ready, 1, M_ATOMIC_ORDER_RELEASE);
+ *
+ *     // Reader
+ *     if (M_atomic_load_u32_explicit(&data->ready, M_ATOMIC_ORDER_ACQUIRE) == 1)
+ *         use(data->val);
+ * \endcode
+ *
+ * Statistics counters which are only read for reporting can use
+ * M_ATOMIC_ORDER_RELAXED.
+ *
  * @{
  */
 
+/*! Memory ordering for the _explicit functions.
+ *
+ * Orders that don't apply to an operation are strengthened, an acquire store
+ * is treated as sequentially consistent for example.
+ */
+typedef enum {
+	M_ATOMIC_ORDER_RELAXED = 0, /*!< Atomic, no ordering of other memory operations. */
+	M_ATOMIC_ORDER_ACQUIRE,     /*!< Later reads and writes can't move before this operation. */
+	M_ATOMIC_ORDER_RELEASE,     /*!< Earlier reads and writes can't move after this operation. */
+	M_ATOMIC_ORDER_ACQ_REL,     /*!< Both acquire and release. */
+	M_ATOMIC_ORDER_SEQ_CST      /*!< Acquire and release plus a single total order of all sequentially
+	                                 consistent operations. Same as the non-explicit functions. */
+} M_atomic_order_t;
+
+
 /*! Compare and swap 32bit integer.
  * 
  * \param[in,out] ptr      Pointer to var to operate on
@@ -141,6 +176,227 @@ M_API M_uint32 M_atomic_sub_u32(volatile M_uint32 *ptr, M_uint32 val);
  */
 M_API M_uint64 M_atomic_sub_u64(volatile M_uint64 *ptr, M_uint64 val);
 
+
+/*! Bitwise OR u32.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Bits to set.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint32 M_atomic_or_u32(volatile M_uint32 *ptr, M_uint32 val);
+
+
+/*! Bitwise OR u64.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Bits to set.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint64 M_atomic_or_u64(volatile M_uint64 *ptr, M_uint64 val);
+
+
+/*! Bitwise AND u32.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Mask of bits to keep.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint32 M_atomic_and_u32(volatile M_uint32 *ptr, M_uint32 val);
+
+
+/*! Bitwise AND u64.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Mask of bits to keep.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint64 M_atomic_and_u64(volatile M_uint64 *ptr, M_uint64 val);
+
+
+/*! Exchange u32.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Value to store.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint32 M_atomic_exchange_u32(volatile M_uint32 *ptr, M_uint32 val);
+
+
+/*! Exchange u64.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Value to store.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint64 M_atomic_exchange_u64(volatile M_uint64 *ptr, M_uint64 val);
+
+
+/*! Load u32.
+ *
+ * \param[in] ptr Pointer to var to read.
+ *
+ * \return The value of pointer.
+ */
+M_API M_uint32 M_atomic_load_u32(volatile M_uint32 *ptr);
+
+
+/*! Load u64.
+ *
+ * Unlike a plain read this is never torn on 32bit platforms.
+ *
+ * \param[in] ptr Pointer to var to read.
+ *
+ * \return The value of pointer.
+ */
+M_API M_uint64 M_atomic_load_u64(volatile M_uint64 *ptr);
+
+
+/*! Store u32.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Value to store.
+ */
+M_API void M_atomic_store_u32(volatile M_uint32 *ptr, M_uint32 val);
+
+
+/*! Store u64.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Value to store.
+ */
+M_API void M_atomic_store_u64(volatile M_uint64 *ptr, M_uint64 val);
+
+
+/*! Load u32 with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to read.
+ * \param[in] order Memory order. Release is treated as sequentially consistent.
+ *
+ * \return The value of pointer.
+ */
+M_API M_uint32 M_atomic_load_u32_explicit(volatile M_uint32 *ptr, M_atomic_order_t order);
+
+
+/*! Load u64 with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to read.
+ * \param[in] order Memory order. Release is treated as sequentially consistent.
+ *
+ * \return The value of pointer.
+ */
+M_API M_uint64 M_atomic_load_u64_explicit(volatile M_uint64 *ptr, M_atomic_order_t order);
+
+
+/*! Store u32 with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to operate on.
+ * \param[in] val   Value to store.
+ * \param[in] order Memory order. Acquire is treated as sequentially consistent.
+ */
+M_API void M_atomic_store_u32_explicit(volatile M_uint32 *ptr, M_uint32 val, M_atomic_order_t order);
+
+
+/*! Store u64 with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to operate on.
+ * \param[in] val   Value to store.
+ * \param[in] order Memory order. Acquire is treated as sequentially consistent.
+ */
+M_API void M_atomic_store_u64_explicit(volatile M_uint64 *ptr, M_uint64 val, M_atomic_order_t order);
+
+
+/*! Add a given value to u32 with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to operate on.
+ * \param[in] val   Value to modify ptr with.
+ * \param[in] order Memory order.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint32 M_atomic_add_u32_explicit(volatile M_uint32 *ptr, M_uint32 val, M_atomic_order_t order);
+
+
+/*! Add a given value to u64 with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to operate on.
+ * \param[in] val   Value to modify ptr with.
+ * \param[in] order Memory order.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API M_uint64 M_atomic_add_u64_explicit(volatile M_uint64 *ptr, M_uint64 val, M_atomic_order_t order);
+
+
+/*! Compare and swap pointer.
+ *
+ * \param[in,out] ptr      Pointer to var to operate on
+ * \param[in]     expected Expected value of var before completing operation
+ * \param[in]     newval   Value to set var to
+ * \return M_TRUE on success, M_FALSE on failure
+ */
+M_API M_bool M_atomic_cas_ptr(void * volatile *ptr, void *expected, void *newval);
+
+
+/*! Exchange pointer.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Value to store.
+ *
+ * \return The value of pointer before operation.
+ */
+M_API void *M_atomic_exchange_ptr(void * volatile *ptr, void *val);
+
+
+/*! Load pointer.
+ *
+ * \param[in] ptr Pointer to var to read.
+ *
+ * \return The value of pointer.
+ */
+M_API void *M_atomic_load_ptr(void * volatile *ptr);
+
+
+/*! Store pointer.
+ *
+ * \param[in] ptr Pointer to var to operate on.
+ * \param[in] val Value to store.
+ */
+M_API void M_atomic_store_ptr(void * volatile *ptr, void *val);
+
+
+/*! Load pointer with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to read.
+ * \param[in] order Memory order. Release is treated as sequentially consistent.
+ *
+ * \return The value of pointer.
+ */
+M_API void *M_atomic_load_ptr_explicit(void * volatile *ptr, M_atomic_order_t order);
+
+
+/*! Store pointer with a given memory order.
+ *
+ * \param[in] ptr   Pointer to var to operate on.
+ * \param[in] val   Value to store.
+ * \param[in] order Memory order. Acquire is treated as sequentially consistent.
+ */
+M_API void M_atomic_store_ptr_explicit(void * volatile *ptr, void *val, M_atomic_order_t order);
+
+
+/*! Memory fence.
+ *
+ * Orders memory operations around the fence without operating on a variable.
+ *
+ * \param[in] order Memory order. Relaxed is a no-op.
+ */
+M_API void M_atomic_fence(M_atomic_order_t order);
+
 /*! @} */
 
 __END_DECLS
@@ -0,0 +1,141 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __M_EPOCH_H__
+#define __M_EPOCH_H__
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include <mstdlib/base/m_defs.h>
+#include <mstdlib/base/m_types.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+__BEGIN_DECLS
+
+/*! \addtogroup m_epoch Epoch Based Reclamation
+ *  \ingroup    m_thread
+ *
+ * Deferred freeing of memory shared with lock free readers (read-copy-update).
+ *
+ * Readers wrap access to shared data in M_epoch_enter() and M_epoch_exit().
+ * These never block and never wait on writers. Writers, which still need to
+ * serialize among themselves, publish a new version of the data with an atomic
+ * pointer store and hand the old version to M_epoch_defer(). The old version is
+ * freed once every reader that could have seen it has exited its read section.
+ *
+ * Threads do not need to register. Reader sections are tracked with counters
+ * spread across multiple cache lines based on the calling thread, so readers on
+ * different threads rarely touch the same line.
+ *
+ * Read sections can be nested. A thread must not call M_epoch_synchronize(), or
+ * M_epoch_defer() which may call it, while inside a read section of the same
+ * epoch, as it will wait for itself forever.
+ *
+ * Example:
+ *
+ * \code{.c}
+ *     static M_epoch_t *epoch;
+ *     static config_t  *config;
+ *
+ *     // Reader
+ *     M_uint32 token = M_epoch_enter(epoch);
+ *     cfg = M_atomic_load_ptr_explicit((void * volatile *)&config, M_ATOMIC_ORDER_ACQUIRE);
+ *     use(cfg);
+ *     M_epoch_exit(epoch, token);
+ *
+ *     // Writer
+ *     old = M_atomic_exchange_ptr((void * volatile *)&config, new_config);
+ *     M_epoch_defer(epoch, config_destroy, old);
+ * \endcode
+ *
+ * @{
+ */
+
+struct M_epoch;
+typedef struct M_epoch M_epoch_t;
+
+
+/*! Create an epoch.
+ *
+ * \return Epoch.
+ */
+M_API M_epoch_t *M_epoch_create(void);
+
+
+/*! Destroy an epoch.
+ *
+ * All deferred callbacks are run. There must not be any readers.
+ *
+ * \param[in] epoch Epoch.
+ */
+M_API void M_epoch_destroy(M_epoch_t *epoch);
+
+
+/*! Enter a read section.
+ *
+ * Data protected by the epoch and read after this call will not be freed until
+ * M_epoch_exit() is called with the returned token. This is wait-free.
+ *
+ * \param[in] epoch Epoch.
+ *
+ * \return Token to pass to M_epoch_exit().
+ */
+M_API M_uint32 M_epoch_enter(M_epoch_t *epoch);
+
+
+/*! Exit a read section.
+ *
+ * \param[in] epoch Epoch.
+ * \param[in] token Token returned by M_epoch_enter().
+ */
+M_API void M_epoch_exit(M_epoch_t *epoch, M_uint32 token);
+
+
+/*! Free data once all current readers have exited.
+ *
+ * The data must already be unreachable for new readers. Callbacks are run in
+ * batches, when enough have been queued this will call M_epoch_synchronize()
+ * and block until current readers have exited.
+ *
+ * \param[in] epoch   Epoch.
+ * \param[in] free_cb Callback to free the data.
+ * \param[in] ptr     Data passed to free_cb.
+ */
+M_API void M_epoch_defer(M_epoch_t *epoch, void (*free_cb)(void *), void *ptr);
+
+
+/*! Wait for all current readers to exit and run deferred callbacks.
+ *
+ * Any read section that was entered before this call will have exited when
+ * this returns. Callbacks deferred before this call are run.
+ *
+ * \param[in] epoch Epoch.
+ */
+M_API void M_epoch_synchronize(M_epoch_t *epoch);
+
+/*! @} */
+
+__END_DECLS
+
+#endif /* __M_EPOCH_H__ */
@@ -0,0 +1,174 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __M_HASH_STRVP_RCU_H__
+#define __M_HASH_STRVP_RCU_H__
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include <mstdlib/base/m_defs.h>
+#include <mstdlib/base/m_types.h>
+#include <mstdlib/base/m_hash_strvp.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+__BEGIN_DECLS
+
+/*! \addtogroup m_hash_strvp_rcu Read Mostly Hashtable - String/Void Pointer
+ *  \ingroup    m_thread
+ *
+ * Thread safe hashtable meant for data that is read far more often than it is
+ * modified.
+ *
+ * Lookups never take a lock and never wait on writers. Modifications are
+ * serialized with an internal lock, and removed entries and replaced values are
+ * freed once no reader can still be using them (see \ref m_epoch).
+ *
+ * A value returned by a lookup is only guaranteed to stay valid until it is
+ * removed or replaced. When another thread may do that, wrap the lookup and
+ * all use of the value between M_hash_strvp_rcu_read_lock() and
+ * M_hash_strvp_rcu_read_unlock().
+ *
+ * Keys are duplicated. Values are not duplicated.
+ *
+ * @{
+ */
+
+struct M_hash_strvp_rcu;
+typedef struct M_hash_strvp_rcu M_hash_strvp_rcu_t;
+
+
+/*! Create a new hashtable.
+ *
+ * \param[in] size         Initial number of buckets. Rounded up to a power of 2.
+ * \param[in] fillpct      The maximum fill percentage before the hash table is expanded. If
+ *                         0 is specified, the hashtable will never expand, otherwise the
+ *                         value must be between 1 and 99 (recommended: 75).
+ * \param[in] flags        M_hash_strvp_flags_t flags. Only M_HASH_STRVP_CASECMP is supported.
+ * \param[in] destroy_func The function to be called to destroy a value when it is removed,
+ *                         replaced or the hashtable is destroyed. Can be NULL.
+ *
+ * \return Allocated hashtable.
+ */
+M_API M_hash_strvp_rcu_t *M_hash_strvp_rcu_create(size_t size, M_uint8 fillpct, M_uint32 flags, void (*destroy_func)(void *)) M_MALLOC_ALIASED;
+
+
+/*! Destroy the hashtable.
+ *
+ * No other thread may be using the hashtable.
+ *
+ * \param[in] h            Hashtable to destroy.
+ * \param[in] destroy_vals M_TRUE if the values held by the hashtable should be destroyed.
+ */
+M_API void M_hash_strvp_rcu_destroy(M_hash_strvp_rcu_t *h, M_bool destroy_vals) M_FREE(1);
+
+
+/*! Insert an entry into the hashtable.
+ *
+ * If the key already exists the value is replaced and the old value will be
+ * destroyed once no reader can be using it.
+ *
+ * \param[in,out] h     Hashtable being referenced.
+ * \param[in]     key   Key to insert.
+ * \param[in]     value Value to insert into hashtable. Value will not be duplicated.
+ *
+ * \return M_TRUE on success, or M_FALSE on failure.
+ */
+M_API M_bool M_hash_strvp_rcu_insert(M_hash_strvp_rcu_t *h, const char *key, void *value);
+
+
+/*! Remove an entry from the hashtable.
+ *
+ * \param[in,out] h            Hashtable being referenced.
+ * \param[in]     key          Key to remove from the hashtable.
+ * \param[in]     destroy_vals M_TRUE if the value should be destroyed once no reader can be using it.
+ *
+ * \return M_TRUE on success, or M_FALSE if key does not exist.
+ */
+M_API M_bool M_hash_strvp_rcu_remove(M_hash_strvp_rcu_t *h, const char *key, M_bool destroy_vals);
+
+
+/*! Remove all entries from the hashtable.
+ *
+ * \param[in,out] h            Hashtable being referenced.
+ * \param[in]     destroy_vals M_TRUE if the values should be destroyed once no reader can be using them.
+ */
+M_API void M_hash_strvp_rcu_clear(M_hash_strvp_rcu_t *h, M_bool destroy_vals);
+
+
+/*! Retrieve the value for a key from the hashtable.
+ *
+ * Does not lock or wait.
+ *
+ * \param[in]  h     Hashtable being referenced.
+ * \param[in]  key   Key for value.
+ * \param[out] value Pointer to value stored in the hashtable. Optional, pass NULL if not needed.
+ *
+ * \return M_TRUE if value retrieved, M_FALSE if key does not exist.
+ */
+M_API M_bool M_hash_strvp_rcu_get(M_hash_strvp_rcu_t *h, const char *key, void **value);
+
+
+/*! Retrieve the value for a key from the hashtable, and return it directly as the return value.
+ *
+ * \param[in] h   Hashtable being referenced.
+ * \param[in] key Key for value.
+ *
+ * \return NULL if key doesn't exist, otherwise the value.
+ */
+M_API void *M_hash_strvp_rcu_get_direct(M_hash_strvp_rcu_t *h, const char *key);
+
+
+/*! Start a section where values returned from lookups will not be destroyed.
+ *
+ * Does not lock or wait. Sections can be nested. The hashtable must not be
+ * modified by the same thread inside the section.
+ *
+ * \param[in] h Hashtable being referenced.
+ *
+ * \return Token to pass to M_hash_strvp_rcu_read_unlock().
+ */
+M_API M_uint32 M_hash_strvp_rcu_read_lock(M_hash_strvp_rcu_t *h);
+
+
+/*! End a section started with M_hash_strvp_rcu_read_lock().
+ *
+ * \param[in] h     Hashtable being referenced.
+ * \param[in] token Token returned by M_hash_strvp_rcu_read_lock().
+ */
+M_API void M_hash_strvp_rcu_read_unlock(M_hash_strvp_rcu_t *h, M_uint32 token);
+
+
+/*! Retrieve the current number of keys.
+ *
+ * \param[in] h Hashtable being referenced.
+ *
+ * \return Number of keys.
+ */
+M_API size_t M_hash_strvp_rcu_num_keys(M_hash_strvp_rcu_t *h);
+
+/*! @} */
+
+__END_DECLS
+
+#endif /* __M_HASH_STRVP_RCU_H__ */
@@ -0,0 +1,183 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __M_RINGBUF_H__
+#define __M_RINGBUF_H__
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include <mstdlib/base/m_defs.h>
+#include <mstdlib/base/m_types.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+__BEGIN_DECLS
+
+/*! \addtogroup m_ringbuf Ring Buffer
+ *  \ingroup    m_thread
+ *
+ * Bounded lock-free queue of pointers for passing data between threads.
+ *
+ * The capacity is fixed at creation and is rounded up to a power of two. Pushing
+ * into a full buffer or popping from an empty one fails immediately instead of
+ * blocking; the caller decides whether to retry, yield or drop.
+ *
+ * Two variants are available:
+ * - Multi producer, multi consumer (default). Any number of threads may push and
+ *   pop concurrently.
+ * - Single producer, single consumer (M_RINGBUF_SPSC). Exactly one thread may push
+ *   and exactly one (other) thread may pop. This avoids all compare and swap
+ *   operations and is the fastest option for a 1:1 pipeline.
+ *
+ * The producer and consumer positions are kept on separate cache lines so a
+ * producer and consumer running on different cores do not invalidate each
+ * other's line on every operation. The batch functions move multiple entries
+ * while only publishing the position once.
+ *
+ * The buffer does not take ownership of the pointers stored in it. NULL may be
+ * stored.
+ *
+ * Example:
+ *
+ * \code{.c}
+ *     M_ringbuf_t *rb;
+ *     void        *val;
+ *
+ *     rb = M_ringbuf_create(1024, M_RINGBUF_SPSC);
+ *
+ *     // Producer thread.
+ *     while (!M_ringbuf_push(rb, data))
+ *         M_thread_yield(M_TRUE);
+ *
+ *     // Consumer thread.
+ *     if (M_ringbuf_pop(rb, &val)) {
+ *         ...
+ *     }
+ *
+ *     M_ringbuf_destroy(rb);
+ * \endcode
+ *
+ * @{
+ */
+
+struct M_ringbuf;
+typedef struct M_ringbuf M_ringbuf_t;
+
+
+/*! Flags controlling ring buffer behavior. */
+typedef enum {
+	M_RINGBUF_NONE = 0,      /*!< Multi producer, multi consumer. */
+	M_RINGBUF_SPSC = 1 << 0  /*!< Single producer, single consumer. */
+} M_ringbuf_flags_t;
+
+
+/*! Create a ring buffer.
+ *
+ * \param[in] capacity Maximum number of entries. Rounded up to the next power of two
+ *                     with a minimum of 2.
+ * \param[in] flags    M_ringbuf_flags_t flags.
+ *
+ * \return Ring buffer on success, otherwise NULL if capacity is 0 or too large.
+ */
+M_API M_ringbuf_t *M_ringbuf_create(size_t capacity, M_uint32 flags);
+
+
+/*! Destroy a ring buffer.
+ *
+ * No other thread may be using the buffer. Any pointers still in the buffer
+ * are not freed.
+ *
+ * \param[in] rb Ring buffer.
+ */
+M_API void M_ringbuf_destroy(M_ringbuf_t *rb);
+
+
+/*! Add an entry.
+ *
+ * \param[in] rb  Ring buffer.
+ * \param[in] ptr Pointer to store.
+ *
+ * \return M_TRUE if stored, M_FALSE if the buffer is full.
+ */
+M_API M_bool M_ringbuf_push(M_ringbuf_t *rb, void *ptr);
+
+
+/*! Remove the oldest entry.
+ *
+ * \param[in]  rb  Ring buffer.
+ * \param[out] ptr Stored pointer.
+ *
+ * \return M_TRUE if an entry was removed, M_FALSE if the buffer is empty.
+ */
+M_API M_bool M_ringbuf_pop(M_ringbuf_t *rb, void **ptr);
+
+
+/*! Add multiple entries.
+ *
+ * Entries are added in order. Fewer than requested will be added if there is not
+ * enough space.
+ *
+ * \param[in] rb   Ring buffer.
+ * \param[in] ptrs Pointers to store.
+ * \param[in] cnt  Number of pointers in ptrs.
+ *
+ * \return Number of entries added.
+ */
+M_API size_t M_ringbuf_push_batch(M_ringbuf_t *rb, void * const *ptrs, size_t cnt);
+
+
+/*! Remove multiple entries.
+ *
+ * \param[in]  rb   Ring buffer.
+ * \param[out] ptrs Array to fill with removed pointers, oldest first.
+ * \param[in]  cnt  Maximum number of entries to remove, size of ptrs.
+ *
+ * \return Number of entries removed.
+ */
+M_API size_t M_ringbuf_pop_batch(M_ringbuf_t *rb, void **ptrs, size_t cnt);
+
+
+/*! Maximum number of entries the buffer can hold.
+ *
+ * \param[in] rb Ring buffer.
+ *
+ * \return Capacity.
+ */
+M_API size_t M_ringbuf_capacity(const M_ringbuf_t *rb);
+
+
+/*! Number of entries in the buffer.
+ *
+ * This is only a snapshot when other threads are using the buffer.
+ *
+ * \param[in] rb Ring buffer.
+ *
+ * \return Count.
+ */
+M_API size_t M_ringbuf_len(M_ringbuf_t *rb);
+
+/*! @} */
+
+__END_DECLS
+
+#endif /* __M_RINGBUF_H__ */
@@ -0,0 +1,103 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __M_RWLOCK_STRIPED_H__
+#define __M_RWLOCK_STRIPED_H__
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#include <mstdlib/base/m_defs.h>
+#include <mstdlib/base/m_types.h>
+#include <mstdlib/thread/m_thread.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+__BEGIN_DECLS
+
+/*! \addtogroup m_rwlock_striped Striped Read/Write locks
+ *  \ingroup    m_thread
+ *
+ * Read/Write lock optimized for data that is read far more often than written.
+ *
+ * M_thread_rwlock_t keeps all of its state in a single location which every
+ * reader must modify, so readers on different cores contend with each other
+ * even when there are no writers. This lock spreads readers across counters
+ * on separate cache lines based on the calling thread. Acquiring and releasing
+ * a read lock when no writer is present is a single atomic increment and
+ * decrement on a line that is rarely shared.
+ *
+ * Writers pay for this. A writer must check every reader counter and waits for
+ * them to drain by yielding. Use M_thread_rwlock_t when writes are frequent or
+ * write locks are held while readers are expected to be waiting.
+ *
+ * Once a writer is waiting new readers wait for it, so writers will not starve.
+ * Read locks cannot be taken recursively, a writer waiting between the two
+ * read locks will deadlock. A lock must be released by the thread that
+ * acquired it.
+ *
+ * @{
+ */
+
+struct M_rwlock_striped;
+typedef struct M_rwlock_striped M_rwlock_striped_t;
+
+
+/*! Create a striped read/write lock.
+ *
+ * \return Read/Write lock.
+ */
+M_API M_rwlock_striped_t *M_rwlock_striped_create(void);
+
+
+/*! Destroy a striped read/write lock.
+ *
+ * \param[in] rwlock The lock.
+ */
+M_API void M_rwlock_striped_destroy(M_rwlock_striped_t *rwlock);
+
+
+/*! Lock a striped read/write lock.
+ *
+ * The thread will block waiting to acquire the lock.
+ *
+ * \param[in] rwlock The lock.
+ * \param[in] type   The type of lock to acquire.
+ *
+ * \return M_TRUE If the lock was acquired. Otherwise M_FALSE.
+ */
+M_API M_bool M_rwlock_striped_lock(M_rwlock_striped_t *rwlock, M_thread_rwlock_type_t type);
+
+
+/*! Unlock a striped read/write lock.
+ *
+ * \param[in] rwlock The lock.
+ *
+ * \return M_TRUE If on success. Otherwise M_FALSE.
+ */
+M_API M_bool M_rwlock_striped_unlock(M_rwlock_striped_t *rwlock);
+
+/*! @} */
+
+__END_DECLS
+
+#endif /* __M_RWLOCK_STRIPED_H__ */
@@ -205,6 +205,46 @@ M_API size_t M_thread_count(void);
 M_API size_t M_thread_num_cpu_cores(void);
 
 
+/*! Retrieve the count of NUMA nodes in the system.
+ *
+ *  Systems without NUMA, or where the layout can't be determined, report
+ *  a single node.
+ *
+ * \return count of nodes, always at least 1.
+ */
+M_API size_t M_thread_num_numa_nodes(void);
+
+
+/*! Retrieve the NUMA node a CPU core belongs to.
+ *
+ * \param[in] cpu CPU core index, 0 to M_thread_num_cpu_cores() - 1.
+ *
+ * \return Node index, 0 if unknown.
+ */
+M_API size_t M_thread_cpu_numa_node(size_t cpu);
+
+
+/*! Choose the CPU core to pin the Nth thread of a group of threads to.
+ *
+ *  Used to give each thread in a pool its own core.  Cores are handed out in
+ *  order and wrap around when there are more threads than cores.  Only cores
+ *  the process is allowed to run on are considered, so a process restricted
+ *  to a subset of cores (e.g. by a cpuset) only pins threads within it.
+ *
+ *  When spreading across NUMA nodes, consecutive threads are placed on
+ *  different nodes so a group smaller than the core count still uses the
+ *  memory bandwidth and caches of every node.  Otherwise cores are handed
+ *  out in order, which fills one node before moving to the next, keeping a
+ *  small group local to a single node.
+ *
+ * \param[in] idx         Index of the thread within its group.
+ * \param[in] numa_spread M_TRUE to alternate between NUMA nodes.
+ *
+ * \return CPU core index.
+ */
+M_API int M_thread_cpu_for_index(size_t idx, M_bool numa_spread);
+
+
 /*! @} */
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -326,6 +366,15 @@ M_API size_t M_thread_attr_get_stack_size(const M_thread_attr_t *attr);
 M_API int M_thread_attr_get_priority(const M_thread_attr_t *attr);
 
 
+/*! Get the CPU core a given thread should be bound to.
+ *
+ * \param[in] attr Attribute object.
+ *
+ * \return The CPU core index, or -1 if the thread may run on any core.
+ */
+M_API int M_thread_attr_get_cpu_affinity(const M_thread_attr_t *attr);
+
+
 /*! Set whether a given thread should be created joinable.
  *
  * The default is to create threads detached (not joinable) unless this is called
@@ -352,6 +401,22 @@ M_API void M_thread_attr_set_stack_size(M_thread_attr_t *attr, size_t val);
  */
 M_API void M_thread_attr_set_priority(M_thread_attr_t *attr, int val);
 
+
+/*! Set the CPU core a given thread should be bound to.
+ *
+ * Binding a thread keeps the data it works with in that core's caches and,
+ * on NUMA systems, memory it allocates local to the core's node.  The default
+ * is to let the OS schedule the thread on any core.
+ *
+ * This is only honored by native threading models that support it, it is
+ * ignored otherwise.  Threads will still be created if binding fails.
+ *
+ * \param[in] attr Attribute object.
+ * \param[in] cpu  CPU core index, 0 to M_thread_num_cpu_cores() - 1, or -1 to
+ *                 not bind.
+ */
+M_API void M_thread_attr_set_cpu_affinity(M_thread_attr_t *attr, int cpu);
+
 /*! @} */
 
 
@@ -373,8 +438,13 @@ typedef struct M_thread_mutex M_thread_mutex_t;
 /*! Mutex attributes.
  * Used for mutex creation. */
 typedef enum {
-	M_THREAD_MUTEXATTR_NONE      = 0,     /*!< None. */
-	M_THREAD_MUTEXATTR_RECURSIVE = 1 << 0 /*!< Mutex is recursive. */
+	M_THREAD_MUTEXATTR_NONE      = 0,      /*!< None. */
+	M_THREAD_MUTEXATTR_RECURSIVE = 1 << 0, /*!< Mutex is recursive. */
+	M_THREAD_MUTEXATTR_ADAPTIVE  = 1 << 1  /*!< Spin briefly when the mutex is locked before sleeping. Avoids
+	                                            context switches for mutexes that are only held for short periods
+	                                            but contended. Spinning is skipped when it can't help, such as on
+	                                            a single core system. Not all threading models support spinning,
+	                                            those that don't treat this as a normal mutex. */
 } M_thread_mutexattr_t;
 
 
@@ -42,6 +42,12 @@ __BEGIN_DECLS
  * A maximum number of threads will be created by the pool. Workers are assigned to
  * parents which can be used to logically separate workers by tasks.
  *
+ * Tasks are dispatched into a shared queue.  Each thread takes tasks from the
+ * shared queue in batches into its own small local queue, and threads that run
+ * out of work steal from the local queues of other threads.  Tasks are started
+ * roughly in the order they were dispatched, but no strict ordering is
+ * guaranteed between threads.
+ *
  * Example:
  *
  * \code{.c}
@@ -85,6 +91,63 @@ typedef struct M_threadpool M_threadpool_t;
 struct M_threadpool_parent;
 typedef struct M_threadpool_parent M_threadpool_parent_t;
 
+struct M_threadpool_future;
+typedef struct M_threadpool_future M_threadpool_future_t;
+
+/*! Flags controlling threadpool behavior */
+enum M_THREADPOOL_FLAGS {
+	M_THREADPOOL_FLAG_NONE        = 0,      /*!< Threads may run on any core */
+	M_THREADPOOL_FLAG_PIN_CPU     = 1 << 0, /*!< Bind each thread to its own core, see M_thread_cpu_for_index() */
+	M_THREADPOOL_FLAG_NUMA_SPREAD = 1 << 1, /*!< When pinning, alternate threads between NUMA nodes rather than
+	                                             filling one node first */
+	M_THREADPOOL_FLAG_TIMING      = 1 << 2  /*!< Record queue wait, run and blocked dispatch time histograms,
+	                                             see M_threadpool_stats().  Counters are always kept. */
+};
+
+/*! Number of buckets in a M_threadpool_histogram_t */
+#define M_THREADPOOL_HISTOGRAM_BUCKETS 32
+
+/*! Latency histogram.
+ *
+ * Bucket 0 counts durations under 1 microsecond.  Bucket N counts durations
+ * of at least 2^(N-1) and less than 2^N microseconds.  The last bucket also
+ * counts everything longer. */
+typedef struct {
+	M_uint64 count;                                   /*!< Number of samples */
+	M_uint64 total_us;                                /*!< Sum of all samples in microseconds */
+	M_uint64 max_us;                                  /*!< Largest sample in microseconds */
+	M_uint64 buckets[M_THREADPOOL_HISTOGRAM_BUCKETS]; /*!< Sample counts by power of 2 microseconds */
+} M_threadpool_histogram_t;
+
+/*! Snapshot of threadpool statistics.
+ *
+ * Counters and histograms are cumulative from pool creation.  To look at a
+ * period of time, take a snapshot at the start and end and subtract. */
+typedef struct {
+	size_t                   num_threads;        /*!< Current number of threads */
+	size_t                   num_idle_threads;   /*!< Current number of threads waiting for work */
+	size_t                   queue_len;          /*!< Current number of tasks in the shared queue */
+	size_t                   queue_max_size;     /*!< Configured maximum size of the shared queue */
+
+	size_t                   peak_threads;       /*!< Largest number of threads running at once */
+	size_t                   peak_queue_len;     /*!< Largest number of tasks in the shared queue at once */
+
+	M_uint64                 tasks_dispatched;   /*!< Tasks put into the queue */
+	M_uint64                 tasks_completed;    /*!< Tasks that have finished running */
+	M_uint64                 dispatch_blocked;   /*!< Times M_threadpool_dispatch() had to wait for a
+	                                                  queue slot */
+	M_uint64                 threads_spawned;    /*!< Threads started, including the minimum threads */
+	M_uint64                 threads_idle_exit;  /*!< Threads that exited after being idle */
+
+	M_threadpool_histogram_t queue_wait;         /*!< Time from being dispatched to starting to run.
+	                                                  Only with M_THREADPOOL_FLAG_TIMING. */
+	M_threadpool_histogram_t run_time;           /*!< Time spent running a task.
+	                                                  Only with M_THREADPOOL_FLAG_TIMING. */
+	M_threadpool_histogram_t dispatch_wait;      /*!< Time a M_threadpool_dispatch() call spent waiting
+	                                                  for queue slots, only calls that had to wait.
+	                                                  Only with M_THREADPOOL_FLAG_TIMING. */
+} M_threadpool_stats_t;
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /*! Initializes a new threadpool and spawns the minimum number of threads requested.
@@ -115,6 +178,27 @@ typedef struct M_threadpool_parent M_threadpool_parent_t;
 M_API M_threadpool_t *M_threadpool_create(size_t min_threads, size_t max_threads, M_uint64 idle_time_ms, size_t queue_max_size);
 
 
+/*! Initializes a new threadpool with control over where threads run.
+ *
+ * Same as M_threadpool_create() but allows threads to be bound to CPU cores.
+ * Pinned threads keep the data their tasks work with in a single core's cache
+ * and allocate memory local to that core's NUMA node.  Threads are assigned
+ * cores by their position in the pool, so a replacement for a thread that
+ * exited after being idle takes the same core.
+ *
+ * Also allows enabling timing of tasks, which costs a few clock reads per task.
+ *
+ * \param[in] min_threads    See M_threadpool_create().
+ * \param[in] max_threads    See M_threadpool_create().
+ * \param[in] idle_time_ms   See M_threadpool_create().
+ * \param[in] queue_max_size See M_threadpool_create().
+ * \param[in] flags          M_THREADPOOL_FLAGS.
+ *
+ * \return initialized threadpool or NULL on failure
+ */
+M_API M_threadpool_t *M_threadpool_create_ex(size_t min_threads, size_t max_threads, M_uint64 idle_time_ms, size_t queue_max_size, M_uint32 flags);
+
+
 /*! Shuts down the thread pool, waits for all threads to exit.
  *
  * \param[in] pool initialized threadpool.
@@ -199,6 +283,20 @@ M_API void M_threadpool_wait_available_thread(M_threadpool_parent_t *parent);
 M_API size_t M_threadpool_num_threads(const M_threadpool_t *pool);
 
 
+/*! Take a snapshot of the threadpool's statistics.
+ *
+ * Useful for deciding on the thread and queue limits for a pool.  Long queue
+ * waits with short run times and a queue that is often full means more
+ * threads are needed.  Long run times with idle threads means tasks
+ * themselves are slow.  Frequent idle exits followed by spawns means the
+ * idle time is too short.
+ *
+ * \param[in]  pool  Initialized pool handle.
+ * \param[out] stats Statistics.
+ */
+M_API void M_threadpool_stats(const M_threadpool_t *pool, M_threadpool_stats_t *stats);
+
+
 /*! Wait for all queued tasks to complete then return.
  *
  * This is a blocking function with no return value.  It is not recommended to
@@ -209,6 +307,111 @@ M_API size_t M_threadpool_num_threads(const M_threadpool_t *pool);
 M_API void M_threadpool_parent_wait(M_threadpool_parent_t *parent);
 
 
+/*! Dispatch a task which returns a result to the threadpool.
+ *
+ * The returned future is used to retrieve the result of the task either by
+ * waiting on it via M_threadpool_future_wait() or by registering a
+ * continuation via M_threadpool_future_then().  The task is accounted for
+ * under the parent like any other so M_threadpool_parent_wait() will also
+ * wait on it.
+ *
+ * This may take a while to complete if there are no queue slots available.
+ *
+ * \param[in,out] parent   Initialized parent handle.
+ * \param[in]     task     Task callback.  The value returned is the result of the future.
+ * \param[in]     task_arg Argument passed to the task.
+ *
+ * \return Future which must be destroyed with M_threadpool_future_destroy(),
+ *         or NULL on invalid use.
+ */
+M_API M_threadpool_future_t *M_threadpool_dispatch_future(M_threadpool_parent_t *parent, void *(*task)(void *task_arg), void *task_arg);
+
+
+/*! Check if the task associated with a future has completed.
+ *
+ * \param[in] future Future returned by M_threadpool_dispatch_future().
+ *
+ * \return M_TRUE if complete, otherwise M_FALSE.
+ */
+M_API M_bool M_threadpool_future_is_done(M_threadpool_future_t *future);
+
+
+/*! Wait for the task associated with a future to complete.
+ *
+ * Must not be called from within a task running on the same pool, if all
+ * threads are waiting the task will never run.
+ *
+ * \param[in] future Future returned by M_threadpool_dispatch_future().
+ *
+ * \return Value returned by the task.  Ownership of the value is up to the task
+ *         and caller, it is not touched by the future.
+ */
+M_API void *M_threadpool_future_wait(M_threadpool_future_t *future);
+
+
+/*! Register a continuation to be called when the task associated with a future
+ *  completes.
+ *
+ * The continuation is called from the thread which ran the task.  If the task
+ * has already completed it is called immediately from the calling thread
+ * before this function returns.  Only one continuation can be registered per
+ * future.
+ *
+ * Use M_event_queue_future() to have the continuation run on an event loop
+ * instead.
+ *
+ * It is safe to call M_threadpool_future_destroy() from within the continuation.
+ *
+ * \param[in] future   Future returned by M_threadpool_dispatch_future().
+ * \param[in] callback Continuation to call with the result of the task.
+ * \param[in] thunk    Argument passed to the continuation.
+ *
+ * \return M_TRUE on success, M_FALSE if a continuation is already registered or on
+ *         invalid use.
+ */
+M_API M_bool M_threadpool_future_then(M_threadpool_future_t *future, void (*callback)(void *result, void *thunk), void *thunk);
+
+
+/*! Destroy a future.
+ *
+ * Does not cancel the task.  If the task has not yet completed the future will be
+ * cleaned up once it does, and any registered continuation is still called.
+ * If the result needs to be cleaned up, retrieve it first via
+ * M_threadpool_future_wait() or a continuation.
+ *
+ * \param[in] future Future returned by M_threadpool_dispatch_future().
+ */
+M_API void M_threadpool_future_destroy(M_threadpool_future_t *future);
+
+
+/*! Process a range in parallel on the threadpool.
+ *
+ * The range is split in half recursively, with one half handed off to the
+ * threadpool, until pieces are no larger than the grain size.  The callback
+ * is called once for each piece, pieces never overlap and together cover
+ * the entire range.  The calling thread processes pieces as well rather than
+ * sitting idle.  If the threadpool queue is full, pieces are processed in the
+ * thread which would have handed them off instead of waiting for a slot.
+ *
+ * This blocks until the entire range has been processed.  Tasks are accounted
+ * for under the parent but only the tasks for this range are waited on.
+ *
+ * Must not be called from within a task running on the same pool.
+ *
+ * \param[in,out] parent Initialized parent handle.
+ * \param[in]     start  Start of range (inclusive).
+ * \param[in]     end    End of range (exclusive).
+ * \param[in]     grain  Largest piece to pass to the callback.  Use 0 to choose a size
+ *                       based on the number of threads in the pool.
+ * \param[in]     func   Callback to process a piece of the range from start (inclusive)
+ *                       to end (exclusive).
+ * \param[in]     thunk  Argument passed to the callback.
+ *
+ * \return M_TRUE once the range has been processed, M_FALSE on invalid use.
+ */
+M_API M_bool M_threadpool_parallel_for(M_threadpool_parent_t *parent, size_t start, size_t end, size_t grain, void (*func)(size_t start, size_t end, void *thunk), void *thunk);
+
+
 /*! @} */
 
 __END_DECLS
@@ -57,6 +57,20 @@ typedef enum {
 } M_tls_protocols_t;
 
 
+/*! Session cache statistics.
+ *
+ * Counters are cumulative for the life of the context.
+ */
+typedef struct {
+	M_uint64 hits;    /*!< Connections that resumed a cached session */
+	M_uint64 misses;  /*!< Connections that required a full handshake */
+	M_uint64 stored;  /*!< Sessions added to the cache */
+	M_uint64 expired; /*!< Sessions discarded because they expired or were no longer resumable */
+	M_uint64 evicted; /*!< Entries discarded to stay within the size limit */
+	size_t   entries; /*!< Entries currently cached. Hosts for a client, sessions for a server */
+} M_tls_session_stats_t;
+
+
 /*! Certificate verification level.
  *
  * Used by client connections to control how they decide to trust
@@ -303,6 +317,33 @@ M_API M_bool M_tls_clientctx_set_verify_level(M_tls_clientctx_t *ctx, M_tls_veri
 M_API M_bool M_tls_clientctx_set_session_resumption(M_tls_clientctx_t *ctx, M_bool enable);
 
 
+/*! Set the limits of the session cache.
+ *
+ * Sessions are cached per host and port.  A few sessions are kept per host as TLS 1.3
+ * servers typically issue multiple single use tickets per connection.  When the
+ * cache is full the least recently used host is discarded.
+ *
+ * Sessions are never used past the lifetime given by the server, regardless of the ttl.
+ *
+ * \param[in] ctx       Client context.
+ * \param[in] max_hosts Maximum number of hosts to cache sessions for. 0 for the default of 1024.
+ * \param[in] ttl_s     Maximum time in seconds to keep a session. 0 to use only the server's lifetime.
+ *
+ * \return M_TRUE on success, otherwise M_FALSE on error.
+ */
+M_API M_bool M_tls_clientctx_set_session_cache(M_tls_clientctx_t *ctx, size_t max_hosts, M_uint64 ttl_s);
+
+
+/*! Get session cache statistics.
+ *
+ * \param[in]  ctx   Client context.
+ * \param[out] stats Statistics.
+ *
+ * \return M_TRUE on success, otherwise M_FALSE on error.
+ */
+M_API M_bool M_tls_clientctx_get_session_stats(M_tls_clientctx_t *ctx, M_tls_session_stats_t *stats);
+
+
 /*! Retrieves a colon separated list of ciphers that are enabled.
  *
  * \param[in] ctx Client context.
@@ -334,6 +375,24 @@ M_API M_bool M_tls_clientctx_set_applications(M_tls_clientctx_t *ctx, M_list_str
 M_API M_bool M_tls_clientctx_set_negotiation_timeout_ms(M_tls_clientctx_t *ctx, M_uint64 timeout_ms);
 
 
+/*! Enable kernel TLS (kTLS) offload.
+ *
+ * When enabled and the TLS layer sits directly on top of a network connection, record
+ * encryption for outbound data is handed to the kernel once the handshake completes.
+ * If the kernel or negotiated cipher doesn't support offload the connection silently
+ * continues to encrypt in userspace. Disabled by default.
+ *
+ * \param[in] ctx    Client context.
+ * \param[in] enable M_TRUE to enable, M_FALSE to disable.
+ *
+ * \return M_TRUE on success, M_FALSE on error or if enabling and kTLS isn't supported on this platform
+ *         or by the OpenSSL version in use.
+ *
+ * \see M_tls_get_ktls_offload
+ */
+M_API M_bool M_tls_clientctx_set_ktls(M_tls_clientctx_t *ctx, M_bool enable);
+
+
 /*! Wrap existing IO channel with TLS.
  *
  * \param[in]  io       io object.
@@ -625,6 +684,33 @@ M_API M_bool M_tls_serverctx_set_dhparam_file(M_tls_serverctx_t *ctx, const char
 M_API M_bool M_tls_serverctx_set_session_resumption(M_tls_serverctx_t *ctx, M_bool enable);
 
 
+/*! Set the limits of the server session cache.
+ *
+ * Sessions are always stored in the parent context's cache, even if an SNI child was
+ * used for the connection, so a single cache is shared by the parent and its children.
+ * Can only be set on the parent context.
+ *
+ * \param[in] ctx          Server context.
+ * \param[in] max_sessions Maximum number of sessions to cache. 0 for OpenSSL's default.
+ * \param[in] ttl_s        Time in seconds a session can be resumed for. 0 for OpenSSL's default.
+ *
+ * \return M_TRUE on success, otherwise M_FALSE on error.
+ */
+M_API M_bool M_tls_serverctx_set_session_cache(M_tls_serverctx_t *ctx, size_t max_sessions, M_uint64 ttl_s);
+
+
+/*! Get server session cache statistics.
+ *
+ * Includes connections using SNI children.  Can only be called on the parent context.
+ *
+ * \param[in]  ctx   Server context.
+ * \param[out] stats Statistics.
+ *
+ * \return M_TRUE on success, otherwise M_FALSE on error.
+ */
+M_API M_bool M_tls_serverctx_get_session_stats(M_tls_serverctx_t *ctx, M_tls_session_stats_t *stats);
+
+
 /*! Retrieves a colon separated list of ciphers that are enabled.
  *
  * \param[in] ctx Server context.
@@ -654,6 +740,49 @@ M_API M_bool M_tls_serverctx_set_applications(M_tls_serverctx_t *ctx, M_list_str
  */
 M_API M_bool M_tls_serverctx_set_negotiation_timeout_ms(M_tls_serverctx_t *ctx, M_uint64 timeout_ms);
 
+
+/*! Enable kernel TLS (kTLS) offload.
+ *
+ * Can only be set on the parent context, SNI children use the parent's setting.
+ *
+ * Not used for connections whose handshake runs in a pool set by
+ * M_tls_serverctx_set_handshake_pool(), as the final handshake flight is still
+ * buffered when the keys become available.
+ *
+ * \param[in] ctx    Server context.
+ * \param[in] enable M_TRUE to enable, M_FALSE to disable.
+ *
+ * \return M_TRUE on success, M_FALSE on error or if enabling and kTLS isn't supported on this platform
+ *         or by the OpenSSL version in use.
+ *
+ * \see M_tls_clientctx_set_ktls
+ * \see M_tls_get_ktls_offload
+ */
+M_API M_bool M_tls_serverctx_set_ktls(M_tls_serverctx_t *ctx, M_bool enable);
+
+
+/*! Run server handshakes in a thread pool.
+ *
+ * By default the handshake runs on the event loop the connection belongs to, and the
+ * private key operations involved can stall every other connection on that loop.  When
+ * a pool is set, each handshake step is run in the pool and the result is handed back to
+ * the connection's event loop.  Data is still only read from and written to the connection
+ * by the event loop.
+ *
+ * The pool is not owned by the context and must not be destroyed until the context and all
+ * connections using it have been destroyed.  The pool should be created with an unbounded
+ * queue (SIZE_MAX), otherwise the event loop will block when the queue is full.
+ *
+ * Can only be set once, and only on the parent context.  SNI children use the parent's pool.
+ * Only connections accepted after this is set are affected.
+ *
+ * \param[in] ctx  Server context.
+ * \param[in] pool Thread pool to run handshakes in.
+ *
+ * \return M_TRUE on success, otherwise M_FALSE on error or if a pool is already set.
+ */
+M_API M_bool M_tls_serverctx_set_handshake_pool(M_tls_serverctx_t *ctx, M_threadpool_t *pool);
+
 /*! Wrap existing IO channel with TLS.
  *
  * \param[in]  io       io object.
@@ -730,6 +859,18 @@ M_API char *M_tls_get_application(M_io_t *io, size_t id);
 M_API char *M_tls_get_peer_cert(M_io_t *io, size_t id);
 
 
+/*! Whether the kernel is performing record encryption for outbound data (kTLS).
+ *
+ * Only valid once the connection has been established.
+ *
+ * \param[in] io io object.
+ * \param[in] id Layer id.
+ *
+ * \return M_TRUE if offloaded, otherwise M_FALSE.
+ */
+M_API M_bool M_tls_get_ktls_offload(M_io_t *io, size_t id);
+
+
 /*! How long negotiated took.
  *
  * \param[in] io io object.
@@ -0,0 +1,893 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "m_config.h"
+#include "mstdlib/mstdlib_io.h"
+#include "m_event_int.h"
+#include "m_io_int.h"
+#include "base/m_defs_int.h"
+
+/* Stacks are switched the same way as the cooperative thread model: fibers on
+ * Windows, get/make/swapcontext elsewhere.  OS X has get/swapcontext but it is
+ * deprecated so coroutines are not offered there. */
+#if defined(_WIN32)
+#  define M_CORO_FIBER 1
+#elif defined(HAVE_GETCONTEXT) && !defined(__APPLE__)
+#  define M_CORO_UCONTEXT 1
+#  include <ucontext.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#  if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#    define MAP_ANONYMOUS MAP_ANON
+#  endif
+#  ifdef HAVE_VALGRIND_H
+#    include "valgrind/valgrind.h"
+#  else
+#    define VALGRIND_STACK_REGISTER(start,end) (0)
+#    define VALGRIND_STACK_DEREGISTER(id)
+#  endif
+#endif
+
+#if defined(M_CORO_FIBER) || defined(M_CORO_UCONTEXT)
+#  define M_CORO_SUPPORTED 1
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Number of unused stacks kept around for reuse */
+#define M_CORO_STACK_POOL_MAX 256
+
+typedef struct M_coro_stack {
+#if defined(M_CORO_FIBER)
+	void          *fiber;    /* Fiber which runs every coroutine given this stack */
+	M_coro_t      *coro;     /* Coroutine the fiber should run next */
+#elif defined(M_CORO_UCONTEXT)
+	unsigned char *map;      /* Start of the mapping, including the guard page */
+	size_t         map_len;
+	unsigned char *base;     /* Usable stack */
+	unsigned int   vg_stackid;
+#endif
+} M_coro_stack_t;
+
+enum M_coro_request {
+	M_CORO_REQUEST_READUCHAR  = 1,
+	M_CORO_REQUEST_READBUF    = 2,
+	M_CORO_REQUEST_READPARSER = 3,
+	M_CORO_REQUEST_WRITEUCHAR = 4,
+	M_CORO_REQUEST_WRITEBUF   = 5,
+	M_CORO_REQUEST_ACCEPT     = 6
+};
+typedef enum M_coro_request M_coro_request_t;
+
+typedef struct {
+	M_coro_request_t     request;
+	M_io_t              *newconn;     /* Used for ACCEPT */
+	M_buf_t             *buf_buf;     /* Used for read_into_buf and write_from_buf */
+	M_parser_t          *buf_parser;  /* Used for read_into_parser */
+	unsigned char       *buf_uchar;   /* Used for read */
+	const unsigned char *buf_cuchar;  /* Used for write */
+	size_t               buf_len;     /* Used for read/write */
+	size_t               out_len;     /* Used for read/write output length */
+} M_coro_io_data_t;
+
+struct M_coro {
+	M_event_t       *event;      /* Event loop (never a pool) the coroutine runs on */
+	M_coro_func_t    func;
+	void            *arg;
+	M_coro_stack_t  *stack;
+	M_bool           done;       /* func returned, clean up once back on the loop's stack */
+
+#if defined(M_CORO_FIBER)
+	void            *loop_ctx;   /* Fiber of the event loop thread that resumed us */
+#elif defined(M_CORO_UCONTEXT)
+	ucontext_t       ctx;
+	ucontext_t       loop_ctx;
+#endif
+
+	/* What the coroutine is suspended on */
+	M_bool           waiting;
+	M_io_t          *wait_io;    /* NULL if only waiting on the timer */
+	M_uint32         wait_mask;  /* Bitmap of (1 << M_event_type_t) that will wake us */
+	M_event_type_t   wait_type;  /* Event type that woke us */
+	M_event_timer_t *wait_timer;
+	M_bool           timed_out;
+
+	M_list_t        *ios;        /* io objects we have added to the event loop */
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#ifdef M_CORO_SUPPORTED
+
+static M_thread_once_t   M_coro_once       = M_THREAD_ONCE_STATIC_INITIALIZER;
+static M_thread_mutex_t *M_coro_pool_lock  = NULL;
+static M_coro_stack_t   *M_coro_pool[M_CORO_STACK_POOL_MAX];
+static size_t            M_coro_pool_cnt   = 0;
+
+
+static void M_coro_stack_destroy(M_coro_stack_t *stack)
+{
+	if (stack == NULL)
+		return;
+
+#if defined(M_CORO_FIBER)
+	DeleteFiber(stack->fiber);
+#elif defined(M_CORO_UCONTEXT)
+	VALGRIND_STACK_DEREGISTER(stack->vg_stackid);
+	munmap(stack->map, stack->map_len);
+#endif
+	M_free(stack);
+}
+
+
+static void M_coro_deinit(void *arg)
+{
+	size_t i;
+
+	(void)arg;
+
+	if (!M_thread_once_reset(&M_coro_once))
+		return;
+
+	for (i=0; i<M_coro_pool_cnt; i++)
+		M_coro_stack_destroy(M_coro_pool[i]);
+	M_coro_pool_cnt = 0;
+
+	M_thread_mutex_destroy(M_coro_pool_lock);
+	M_coro_pool_lock = NULL;
+}
+
+
+static void M_coro_init_run(M_uint64 flags)
+{
+	(void)flags;
+	M_coro_pool_lock = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	M_library_cleanup_register(M_coro_deinit, NULL);
+}
+
+
+static void M_coro_switch_to_loop(M_coro_t *coro);
+static void M_coro_run(M_coro_t *coro)
+{
+	coro->func(coro, coro->arg);
+	coro->done = M_TRUE;
+	M_coro_switch_to_loop(coro);
+}
+
+
+#if defined(M_CORO_FIBER)
+
+static VOID CALLBACK M_coro_fiber_entry(LPVOID arg)
+{
+	M_coro_stack_t *stack = arg;
+
+	/* The fiber is kept with the stack in the pool, each time it is handed a new
+	 * coroutine it picks up here again. */
+	while (1) {
+		M_coro_run(stack->coro);
+	}
+}
+
+
+static M_coro_stack_t *M_coro_stack_create(void)
+{
+	M_coro_stack_t *stack = M_malloc_zero(sizeof(*stack));
+
+	stack->fiber = CreateFiberEx(M_CORO_STACK_SIZE, M_CORO_STACK_SIZE, FIBER_FLAG_FLOAT_SWITCH, M_coro_fiber_entry, stack);
+	if (stack->fiber == NULL) {
+		M_free(stack);
+		return NULL;
+	}
+	return stack;
+}
+
+
+static M_bool M_coro_prepare(M_coro_t *coro)
+{
+	coro->stack->coro = coro;
+	return M_TRUE;
+}
+
+
+static void M_coro_switch_to_coro(M_coro_t *coro)
+{
+	/* The event loop thread must be a fiber itself to switch to one */
+	if (!IsThreadAFiber())
+		ConvertThreadToFiber(NULL);
+	coro->loop_ctx = GetCurrentFiber();
+	SwitchToFiber(coro->stack->fiber);
+}
+
+
+static void M_coro_switch_to_loop(M_coro_t *coro)
+{
+	SwitchToFiber(coro->loop_ctx);
+}
+
+#elif defined(M_CORO_UCONTEXT)
+
+/* makecontext() only passes int arguments, split the pointer in two. */
+static void M_coro_entry(int ptr_high, int ptr_low)
+{
+	M_uintptr ptr;
+
+	ptr = ((M_uintptr)((M_uint32)ptr_high) << 16) << 16;
+	ptr |= (M_uint32)ptr_low;
+
+	M_coro_run((M_coro_t *)ptr);
+}
+
+
+static M_coro_stack_t *M_coro_stack_create(void)
+{
+	M_coro_stack_t *stack;
+	long            pagesize;
+	unsigned char  *map;
+	size_t          map_len;
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize <= 0)
+		pagesize = 4096;
+
+	/* Extra page at the bottom is a guard so overflowing the stack faults
+	 * instead of scribbling over someone else's memory */
+	map_len = M_CORO_STACK_SIZE + (size_t)pagesize;
+	map     = mmap(NULL, map_len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	mprotect(map, (size_t)pagesize, PROT_NONE);
+
+	stack             = M_malloc_zero(sizeof(*stack));
+	stack->map        = map;
+	stack->map_len    = map_len;
+	stack->base       = map + pagesize;
+	stack->vg_stackid = VALGRIND_STACK_REGISTER(stack->base, stack->base + M_CORO_STACK_SIZE);
+	return stack;
+}
+
+
+static M_bool M_coro_prepare(M_coro_t *coro)
+{
+	M_uintptr ptr = (M_uintptr)coro;
+
+	if (getcontext(&coro->ctx) != 0)
+		return M_FALSE;
+
+	coro->ctx.uc_stack.ss_sp   = coro->stack->base;
+	coro->ctx.uc_stack.ss_size = M_CORO_STACK_SIZE;
+	coro->ctx.uc_link          = NULL;
+	makecontext(&coro->ctx, (void (*)(void))M_coro_entry, 2,
+	            (int)((ptr >> 16) >> 16),
+	            (int)(ptr & 0xFFFFFFFF));
+	return M_TRUE;
+}
+
+
+static void M_coro_switch_to_coro(M_coro_t *coro)
+{
+	swapcontext(&coro->loop_ctx, &coro->ctx);
+}
+
+
+static void M_coro_switch_to_loop(M_coro_t *coro)
+{
+	swapcontext(&coro->ctx, &coro->loop_ctx);
+}
+
+#endif
+
+
+static M_coro_stack_t *M_coro_stack_get(void)
+{
+	M_coro_stack_t *stack = NULL;
+
+	M_thread_once(&M_coro_once, M_coro_init_run, 0);
+
+	M_thread_mutex_lock(M_coro_pool_lock);
+	if (M_coro_pool_cnt > 0) {
+		M_coro_pool_cnt--;
+		stack = M_coro_pool[M_coro_pool_cnt];
+	}
+	M_thread_mutex_unlock(M_coro_pool_lock);
+
+	if (stack == NULL)
+		stack = M_coro_stack_create();
+
+	return stack;
+}
+
+
+static void M_coro_stack_release(M_coro_stack_t *stack)
+{
+	M_thread_mutex_lock(M_coro_pool_lock);
+	if (M_coro_pool_cnt < M_CORO_STACK_POOL_MAX) {
+		M_coro_pool[M_coro_pool_cnt] = stack;
+		M_coro_pool_cnt++;
+		stack = NULL;
+	}
+	M_thread_mutex_unlock(M_coro_pool_lock);
+
+	M_coro_stack_destroy(stack);
+}
+
+
+static void M_coro_io_orphan(M_event_t *event, M_event_type_t type, M_io_t *io, void *cb_data)
+{
+	(void)event;
+	(void)type;
+	(void)io;
+	(void)cb_data;
+}
+
+
+static void M_coro_finish(M_coro_t *coro)
+{
+	size_t i;
+	size_t len;
+
+	/* Any io objects we added which are still on the event loop and still pointing
+	 * at us must stop doing so.  The io object itself may already be destroyed, so
+	 * only the event loop's registration table is consulted, which doesn't
+	 * dereference the io pointer. */
+	len = M_list_len(coro->ios);
+	if (len) {
+		M_event_lock(coro->event);
+		for (i=0; i<len; i++) {
+			M_event_io_t *ioev = NULL;
+			if (M_hashtable_get(coro->event->u.loop.reg_ios, M_list_at(coro->ios, i), (void **)&ioev) && ioev != NULL && ioev->cb_data == coro) {
+				ioev->callback = M_coro_io_orphan;
+				ioev->cb_data  = NULL;
+			}
+		}
+		M_event_unlock(coro->event);
+	}
+	M_list_destroy(coro->ios, M_FALSE);
+
+	M_coro_stack_release(coro->stack);
+	M_free(coro);
+}
+
+
+static void M_coro_resume(M_coro_t *coro)
+{
+	M_coro_switch_to_coro(coro);
+
+	/* Back on the loop's stack, if the coroutine finished it's now safe to
+	 * give its stack back */
+	if (coro->done)
+		M_coro_finish(coro);
+}
+
+
+static void M_coro_wake(M_coro_t *coro)
+{
+	coro->waiting = M_FALSE;
+	if (coro->wait_timer != NULL) {
+		M_event_timer_remove(coro->wait_timer);
+		coro->wait_timer = NULL;
+	}
+	M_coro_resume(coro);
+}
+
+
+static void M_coro_ready_cb(M_event_t *event, M_event_type_t type, M_io_t *io, void *cb_data)
+{
+	M_list_t *ready;
+	size_t    len;
+	size_t    i;
+
+	(void)type;
+	(void)io;
+	(void)cb_data;
+
+	/* Take everything that became ready before now.  Anything yielding while
+	 * these run goes on a new list for the next pass. */
+	M_event_lock(event);
+	ready                    = event->u.loop.coro_ready;
+	event->u.loop.coro_ready = NULL;
+	M_event_unlock(event);
+
+	len = M_list_len(ready);
+	for (i=0; i<len; i++) {
+		M_coro_t *coro = (M_coro_t *)M_list_at(ready, i);
+		coro->waiting  = M_FALSE;
+		M_coro_resume(coro);
+	}
+	M_list_destroy(ready, M_FALSE);
+}
+
+
+/* Queue the coroutine to be resumed on the next pass through the event loop.
+ * Individual tasks queued at the same time have no guaranteed order, so keep
+ * our own run queue to resume coroutines in the order they became ready. */
+static void M_coro_ready(M_coro_t *coro)
+{
+	M_bool schedule = M_FALSE;
+
+	M_event_lock(coro->event);
+	if (coro->event->u.loop.coro_ready == NULL) {
+		coro->event->u.loop.coro_ready = M_list_create(NULL, M_LIST_NONE);
+		schedule                       = M_TRUE;
+	}
+	M_list_insert(coro->event->u.loop.coro_ready, coro);
+	M_event_unlock(coro->event);
+
+	if (schedule)
+		M_event_queue_task(coro->event, M_coro_ready_cb, NULL);
+}
+
+
+static void M_coro_timer_cb(M_event_t *event, M_event_type_t type, M_io_t *io, void *cb_data)
+{
+	M_coro_t *coro = cb_data;
+
+	(void)event;
+	(void)type;
+	(void)io;
+
+	if (!coro->waiting)
+		return;
+
+	/* Oneshot timer removes itself */
+	coro->wait_timer = NULL;
+	coro->timed_out  = M_TRUE;
+	M_coro_wake(coro);
+}
+
+
+static void M_coro_io_cb(M_event_t *event, M_event_type_t type, M_io_t *io, void *cb_data)
+{
+	M_coro_t *coro = cb_data;
+
+	(void)event;
+
+	/* Events that arrive while the coroutine isn't waiting on them are dropped.
+	 * Every operation is attempted before waiting so nothing is lost. */
+	if (!coro->waiting || coro->wait_io != io || !(coro->wait_mask & (1U << type)))
+		return;
+
+	coro->wait_type = type;
+	M_coro_wake(coro);
+}
+
+
+/* Suspend until one of the events in mask is delivered for io, or the timeout
+ * elapses.  Returns M_FALSE on timeout. */
+static M_bool M_coro_wait(M_coro_t *coro, M_io_t *io, M_uint32 mask, M_uint64 timeout_ms)
+{
+	coro->wait_io    = io;
+	coro->wait_mask  = mask;
+	coro->timed_out  = M_FALSE;
+	coro->wait_timer = NULL;
+	if (timeout_ms != M_TIMEOUT_INF)
+		coro->wait_timer = M_event_timer_oneshot(coro->event, timeout_ms, M_TRUE, M_coro_timer_cb, coro);
+	coro->waiting    = M_TRUE;
+
+	M_coro_switch_to_loop(coro);
+
+	coro->wait_io    = NULL;
+	coro->wait_mask  = 0;
+	return coro->timed_out?M_FALSE:M_TRUE;
+}
+
+
+/* Make sure io delivers its events to this coroutine */
+static M_bool M_coro_io_attach(M_coro_t *coro, M_io_t *io)
+{
+	M_event_t *event;
+	M_bool     private_event;
+
+	M_io_lock(io);
+	event         = io->reg_event;
+	private_event = io->private_event;
+	M_io_unlock(io);
+
+	if (event == NULL) {
+		if (!M_event_add(coro->event, io, M_coro_io_cb, coro))
+			return M_FALSE;
+	} else {
+		if (event != coro->event || private_event)
+			return M_FALSE;
+		/* May have been handed over from another coroutine on this loop */
+		if (!M_event_edit_io_cb(io, M_coro_io_cb, coro))
+			return M_FALSE;
+	}
+
+	if (coro->ios == NULL)
+		coro->ios = M_list_create(NULL, M_LIST_SET_PTR);
+	M_list_insert(coro->ios, io);
+	return M_TRUE;
+}
+
+
+static M_io_error_t M_coro_io_attempt(M_io_t *io, M_coro_io_data_t *data)
+{
+	switch (data->request) {
+		case M_CORO_REQUEST_READUCHAR:
+			return M_io_read(io, data->buf_uchar, data->buf_len, &data->out_len);
+		case M_CORO_REQUEST_READBUF:
+			return M_io_read_into_buf(io, data->buf_buf);
+		case M_CORO_REQUEST_READPARSER:
+			return M_io_read_into_parser(io, data->buf_parser);
+		case M_CORO_REQUEST_WRITEUCHAR:
+			return M_io_write(io, data->buf_cuchar, data->buf_len, &data->out_len);
+		case M_CORO_REQUEST_WRITEBUF:
+			return M_io_write_from_buf(io, data->buf_buf);
+		case M_CORO_REQUEST_ACCEPT:
+			return M_io_accept(&data->newconn, io);
+	}
+	return M_IO_ERROR_ERROR;
+}
+
+
+static M_uint32 M_coro_io_wait_mask(M_coro_request_t request)
+{
+	M_uint32 mask = (1U << M_EVENT_TYPE_DISCONNECTED) | (1U << M_EVENT_TYPE_ERROR);
+
+	switch (request) {
+		case M_CORO_REQUEST_READUCHAR:
+		case M_CORO_REQUEST_READBUF:
+		case M_CORO_REQUEST_READPARSER:
+			return mask | (1U << M_EVENT_TYPE_READ);
+		case M_CORO_REQUEST_WRITEUCHAR:
+		case M_CORO_REQUEST_WRITEBUF:
+			return mask | (1U << M_EVENT_TYPE_WRITE);
+		case M_CORO_REQUEST_ACCEPT:
+			return mask | (1U << M_EVENT_TYPE_ACCEPT);
+	}
+	return mask;
+}
+
+
+static M_io_error_t M_coro_io_run(M_coro_t *coro, M_io_t *io, M_coro_io_data_t *data, M_uint64 timeout_ms)
+{
+	M_timeval_t  start_tv;
+	M_io_error_t err;
+	M_uint64     elapsed;
+
+	if (!M_coro_io_attach(coro, io))
+		return M_IO_ERROR_ERROR;
+
+	M_time_elapsed_start(&start_tv);
+	while (1) {
+		M_uint64 remaining = M_TIMEOUT_INF;
+
+		err = M_coro_io_attempt(io, data);
+		if (err != M_IO_ERROR_WOULDBLOCK)
+			return err;
+
+		if (timeout_ms != M_TIMEOUT_INF) {
+			elapsed = M_time_elapsed(&start_tv);
+			if (elapsed >= timeout_ms)
+				return M_IO_ERROR_WOULDBLOCK;
+			remaining = timeout_ms - elapsed;
+		}
+
+		if (!M_coro_wait(coro, io, M_coro_io_wait_mask(data->request), remaining))
+			return M_IO_ERROR_WOULDBLOCK;
+	}
+}
+
+
+/* Wait for the io object to reach a connected or closed state */
+static M_io_error_t M_coro_io_state_wait(M_coro_t *coro, M_io_t *io, M_bool want_connected)
+{
+	M_uint32 mask = (1U << M_EVENT_TYPE_CONNECTED) | (1U << M_EVENT_TYPE_DISCONNECTED) | (1U << M_EVENT_TYPE_ERROR);
+
+	while (1) {
+		switch (M_io_get_state(io)) {
+			case M_IO_STATE_CONNECTED:
+				if (want_connected)
+					return M_IO_ERROR_SUCCESS;
+				break;
+			case M_IO_STATE_DISCONNECTED:
+				return M_IO_ERROR_DISCONNECT;
+			case M_IO_STATE_ERROR:
+				return M_IO_ERROR_ERROR;
+			default:
+				break;
+		}
+
+		M_coro_wait(coro, io, mask, M_TIMEOUT_INF);
+		switch (coro->wait_type) {
+			case M_EVENT_TYPE_CONNECTED:
+				if (want_connected)
+					return M_IO_ERROR_SUCCESS;
+				break;
+			case M_EVENT_TYPE_DISCONNECTED:
+				return M_IO_ERROR_DISCONNECT;
+			case M_EVENT_TYPE_ERROR:
+				return M_IO_ERROR_ERROR;
+			default:
+				break;
+		}
+	}
+}
+
+#endif /* M_CORO_SUPPORTED */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+M_coro_t *M_coro_create(M_event_t *event, M_coro_func_t func, void *arg)
+{
+#ifdef M_CORO_SUPPORTED
+	M_coro_t *coro;
+
+	if (event == NULL || func == NULL)
+		return NULL;
+
+	coro        = M_malloc_zero(sizeof(*coro));
+	coro->event = M_event_distribute(event);
+	coro->func  = func;
+	coro->arg   = arg;
+	coro->stack = M_coro_stack_get();
+	if (coro->stack == NULL) {
+		M_free(coro);
+		return NULL;
+	}
+
+	if (!M_coro_prepare(coro)) {
+		M_coro_stack_release(coro->stack);
+		M_free(coro);
+		return NULL;
+	}
+
+	M_coro_ready(coro);
+	return coro;
+#else
+	(void)event;
+	(void)func;
+	(void)arg;
+	return NULL;
+#endif
+}
+
+
+M_event_t *M_coro_event(M_coro_t *coro)
+{
+	if (coro == NULL)
+		return NULL;
+	return coro->event;
+}
+
+
+void M_coro_yield(M_coro_t *coro)
+{
+#ifdef M_CORO_SUPPORTED
+	if (coro == NULL)
+		return;
+
+	coro->waiting = M_TRUE;
+	M_coro_ready(coro);
+	M_coro_switch_to_loop(coro);
+#else
+	(void)coro;
+#endif
+}
+
+
+void M_coro_sleep(M_coro_t *coro, M_uint64 timeout_ms)
+{
+#ifdef M_CORO_SUPPORTED
+	if (coro == NULL)
+		return;
+
+	M_coro_wait(coro, NULL, 0, timeout_ms);
+#else
+	(void)coro;
+	(void)timeout_ms;
+#endif
+}
+
+
+M_io_error_t M_io_coro_connect(M_coro_t *coro, M_io_t *io)
+{
+#ifdef M_CORO_SUPPORTED
+	if (coro == NULL || io == NULL)
+		return M_IO_ERROR_INVALID;
+
+	if (!M_coro_io_attach(coro, io))
+		return M_IO_ERROR_ERROR;
+
+	return M_coro_io_state_wait(coro, io, M_TRUE);
+#else
+	(void)coro;
+	(void)io;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
+M_io_error_t M_io_coro_accept(M_coro_t *coro, M_io_t **io_out, M_io_t *server_io, M_uint64 timeout_ms)
+{
+#ifdef M_CORO_SUPPORTED
+	M_coro_io_data_t data;
+	M_io_error_t     err;
+
+	if (coro == NULL || io_out == NULL || server_io == NULL || server_io->type != M_IO_TYPE_LISTENER)
+		return M_IO_ERROR_INVALID;
+
+	M_mem_set(&data, 0, sizeof(data));
+	data.request = M_CORO_REQUEST_ACCEPT;
+
+	err = M_coro_io_run(coro, server_io, &data, timeout_ms);
+	if (err == M_IO_ERROR_SUCCESS)
+		*io_out = data.newconn;
+	return err;
+#else
+	(void)coro;
+	(void)io_out;
+	(void)server_io;
+	(void)timeout_ms;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
+M_io_error_t M_io_coro_read(M_coro_t *coro, M_io_t *io, unsigned char *buf, size_t buf_len, size_t *len_read, M_uint64 timeout_ms)
+{
+#ifdef M_CORO_SUPPORTED
+	M_coro_io_data_t data;
+	M_io_error_t     err;
+
+	if (coro == NULL || io == NULL || buf == NULL || buf_len == 0 || len_read == NULL)
+		return M_IO_ERROR_INVALID;
+
+	M_mem_set(&data, 0, sizeof(data));
+	data.request   = M_CORO_REQUEST_READUCHAR;
+	data.buf_uchar = buf;
+	data.buf_len   = buf_len;
+
+	err = M_coro_io_run(coro, io, &data, timeout_ms);
+	if (err == M_IO_ERROR_SUCCESS)
+		*len_read = data.out_len;
+	return err;
+#else
+	(void)coro;
+	(void)io;
+	(void)buf;
+	(void)buf_len;
+	(void)len_read;
+	(void)timeout_ms;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
+M_io_error_t M_io_coro_read_into_buf(M_coro_t *coro, M_io_t *io, M_buf_t *buf, M_uint64 timeout_ms)
+{
+#ifdef M_CORO_SUPPORTED
+	M_coro_io_data_t data;
+
+	if (coro == NULL || io == NULL || buf == NULL)
+		return M_IO_ERROR_INVALID;
+
+	M_mem_set(&data, 0, sizeof(data));
+	data.request = M_CORO_REQUEST_READBUF;
+	data.buf_buf = buf;
+
+	return M_coro_io_run(coro, io, &data, timeout_ms);
+#else
+	(void)coro;
+	(void)io;
+	(void)buf;
+	(void)timeout_ms;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
+M_io_error_t M_io_coro_read_into_parser(M_coro_t *coro, M_io_t *io, M_parser_t *parser, M_uint64 timeout_ms)
+{
+#ifdef M_CORO_SUPPORTED
+	M_coro_io_data_t data;
+
+	if (coro == NULL || io == NULL || parser == NULL)
+		return M_IO_ERROR_INVALID;
+
+	M_mem_set(&data, 0, sizeof(data));
+	data.request    = M_CORO_REQUEST_READPARSER;
+	data.buf_parser = parser;
+
+	return M_coro_io_run(coro, io, &data, timeout_ms);
+#else
+	(void)coro;
+	(void)io;
+	(void)parser;
+	(void)timeout_ms;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
+M_io_error_t M_io_coro_write(M_coro_t *coro, M_io_t *io, const unsigned char *buf, size_t buf_len, size_t *len_written, M_uint64 timeout_ms)
+{
+#ifdef M_CORO_SUPPORTED
+	M_coro_io_data_t data;
+	M_io_error_t     err;
+
+	if (coro == NULL || io == NULL || buf == NULL || buf_len == 0 || len_written == NULL)
+		return M_IO_ERROR_INVALID;
+
+	M_mem_set(&data, 0, sizeof(data));
+	data.request    = M_CORO_REQUEST_WRITEUCHAR;
+	data.buf_cuchar = buf;
+	data.buf_len    = buf_len;
+
+	err = M_coro_io_run(coro, io, &data, timeout_ms);
+	if (err == M_IO_ERROR_SUCCESS)
+		*len_written = data.out_len;
+	return err;
+#else
+	(void)coro;
+	(void)io;
+	(void)buf;
+	(void)buf_len;
+	(void)len_written;
+	(void)timeout_ms;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
+M_io_error_t M_io_coro_write_from_buf(M_coro_t *coro, M_io_t *io, M_buf_t *buf, M_uint64 timeout_ms)
+{
+#ifdef M_CORO_SUPPORTED
+	M_coro_io_data_t data;
+
+	if (coro == NULL || io == NULL || buf == NULL)
+		return M_IO_ERROR_INVALID;
+
+	M_mem_set(&data, 0, sizeof(data));
+	data.request = M_CORO_REQUEST_WRITEBUF;
+	data.buf_buf = buf;
+
+	return M_coro_io_run(coro, io, &data, timeout_ms);
+#else
+	(void)coro;
+	(void)io;
+	(void)buf;
+	(void)timeout_ms;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
+M_io_error_t M_io_coro_disconnect(M_coro_t *coro, M_io_t *io)
+{
+#ifdef M_CORO_SUPPORTED
+	if (coro == NULL || io == NULL)
+		return M_IO_ERROR_INVALID;
+
+	if (!M_coro_io_attach(coro, io))
+		return M_IO_ERROR_ERROR;
+
+	M_io_disconnect(io);
+
+	return M_coro_io_state_wait(coro, io, M_FALSE);
+#else
+	(void)coro;
+	(void)io;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
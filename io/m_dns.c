@@ -81,9 +81,20 @@ struct M_dns_entry {
 	M_time_t      ipv4_cache_t;
 	M_list_str_t *ipv6_addrs;
 	M_time_t      ipv6_cache_t;
+	M_time_t      ipv4_negative_t; /*!< Time server said the name has no IPv4 addresses, 0 if it does */
+	M_time_t      ipv6_negative_t; /*!< Time server said the name has no IPv6 addresses, 0 if it does */
+	M_bool        refreshing;      /*!< Background query in progress to refresh this entry */
 };
 typedef struct M_dns_entry M_dns_entry_t;
 
+
+/*! Tracks a background cache refresh */
+struct M_dns_refresh {
+	M_dns_t *dns;
+	char    *hostname;
+};
+typedef struct M_dns_refresh M_dns_refresh_t;
+
 struct M_dns_sock_handle {
 	ares_socket_t       fd;
 	M_EVENT_HANDLE      handle;
@@ -135,7 +146,13 @@ struct M_dns {
 	M_uint64              query_cache_timeout_s;
 	M_uint64              query_cache_max_s;
 	M_uint64              happyeyeballs_cache_max_s;
+	M_uint64              query_cache_stale_s;
+	M_uint64              query_cache_prefetch_s;
+	M_uint64              query_cache_negative_s;
+	char                 *servers;          /*!< Servers to use instead of the system configuration, NULL if not set */
 
+	/* Statistics */
+	M_dns_cache_stats_t   stats;
 };
 
 
@@ -170,6 +187,11 @@ M_printf("ares_init_options failed (%d): %s\n", err, ares_strerror(err));
 		return M_TRUE;
 	}
 
+	if (dns->servers != NULL && ares_set_servers_ports_csv(channel, dns->servers) != ARES_SUCCESS) {
+		ares_destroy(channel);
+		return M_FALSE;
+	}
+
 	if (dns->base_channel != NULL)
 		ares_destroy(dns->base_channel);
 
@@ -415,6 +437,7 @@ M_bool M_dns_destroy(M_dns_t *dns)
 		return M_FALSE;
 
 	ares_destroy(dns->base_channel);
+	M_free(dns->servers);
 	M_queue_destroy(dns->cache);
 	M_hash_strvp_destroy(dns->cache_lookup, M_TRUE);
 
@@ -439,7 +462,9 @@ static void M_dns_purge_stale(M_dns_t *dns)
 	while (M_queue_foreach(dns->cache, &q_foreach, (void **)&entry)) {
 		/* If we hit an entry with a non-expired cache, we can stop */
 		if (entry->ipv6_cache_t + (M_time_t)dns->query_cache_max_s > t ||
-			entry->ipv4_cache_t + (M_time_t)dns->query_cache_max_s > t) {
+			entry->ipv4_cache_t + (M_time_t)dns->query_cache_max_s > t ||
+			entry->ipv4_negative_t + (M_time_t)dns->query_cache_negative_s > t ||
+			entry->ipv6_negative_t + (M_time_t)dns->query_cache_negative_s > t) {
 			break;
 		}
 		/* Delete the entry */
@@ -470,8 +495,10 @@ static M_dns_entry_t *M_dns_get_entry(M_dns_t *dns, const char *hostname, M_bool
 		M_hash_strvp_insert(dns->cache_lookup, hostname, entry);
 	} else {
 		if (!for_update) {
-			/* Check to see if we actually have results, if not, purge! */
-			if (!M_list_str_len(entry->ipv4_addrs) && !M_list_str_len(entry->ipv6_addrs)) {
+			/* Check to see if we actually have results, if not, purge!  Unless it's a
+			 * cached negative result or a refresh for it is in progress. */
+			if (!M_list_str_len(entry->ipv4_addrs) && !M_list_str_len(entry->ipv6_addrs) &&
+				entry->ipv4_negative_t == 0 && entry->ipv6_negative_t == 0 && !entry->refreshing) {
 				M_hash_strvp_remove(dns->cache_lookup, hostname, M_TRUE);
 				M_queue_take(dns->cache, entry);
 				return NULL;
@@ -837,9 +864,11 @@ static void M_io_dns_ares_host_callback(void *arg, int status, int timeouts, str
 			}
 
 			if (is_ipv6) {
-				entry->ipv6_cache_t = M_time();
+				entry->ipv6_cache_t    = M_time();
+				entry->ipv6_negative_t = 0;
 			} else {
-				entry->ipv4_cache_t = M_time();
+				entry->ipv4_cache_t    = M_time();
+				entry->ipv4_negative_t = 0;
 			}
 		} else {
 			/* Simulate host not found error for empty address list */
@@ -877,17 +906,23 @@ static void M_io_dns_ares_host_callback(void *arg, int status, int timeouts, str
 		}
 	}
 
-	/* Clear old entries only when we receive a response from the DNS server stating our cache can't be valid.  */
+	/* Clear old entries only when we receive a response from the DNS server stating our cache can't be valid.
+	 * Remember the server told us there are no addresses of this type so repeated lookups don't each have to
+	 * wait on the server.  This is tracked per address type since a name commonly has only one. */
 	if (status == ARES_EBADNAME || status == ARES_ENOTFOUND) {
-		entry = M_dns_get_entry(handle->dns, handle->hostname, M_FALSE);
+		entry = M_dns_get_entry(handle->dns, handle->hostname, handle->dns->query_cache_negative_s?M_TRUE:M_FALSE);
 		if (entry != NULL) {
 			if (is_ipv6) {
 				while (M_list_str_remove_first(entry->ipv6_addrs))
 					;
+				if (handle->dns->query_cache_negative_s)
+					entry->ipv6_negative_t = M_time();
 			}
 			if (!is_ipv6) {
 				while (M_list_str_remove_first(entry->ipv4_addrs))
 					;
+				if (handle->dns->query_cache_negative_s)
+					entry->ipv4_negative_t = M_time();
 			}
 		}
 	}
@@ -970,12 +1005,18 @@ static M_bool M_io_dns_init_cb(M_io_layer_t *layer)
 	M_io_t        *io     = M_io_layer_get_io(layer);
 	M_event_t     *event  = M_io_get_event(io);
 
-	/* Start IPv4 and IPv6 queries */
-	handle->num_queries = 1;
+	/* Start IPv4 and IPv6 queries.  All queries must be counted before any are
+	 * started as a result may be delivered immediately. */
+	handle->num_queries = 0;
+#ifdef AF_INET6
+	if (handle->type == M_IO_NET_ANY || handle->type == M_IO_NET_IPV6)
+		handle->num_queries++;
+#endif
+	if (handle->type == M_IO_NET_ANY || handle->type == M_IO_NET_IPV4)
+		handle->num_queries++;
 
 	if (handle->type == M_IO_NET_ANY || handle->type == M_IO_NET_IPV6) {
 #ifdef AF_INET6
-		handle->num_queries++;
 //M_printf("%s(): started query for ipv6\n", __FUNCTION__);
 		ares_gethostbyname(handle->channel, handle->hostname, AF_INET6, M_io_dns_ares_host_callback6, handle);
 #endif
@@ -1082,11 +1123,48 @@ static M_bool M_dns_host_is_addr(const char *host, int *type)
 }
 
 
+static void M_dns_refresh_cb(const M_list_str_t *ipaddrs, void *cb_data, M_dns_result_t result)
+{
+	M_dns_refresh_t *refresh = cb_data;
+	M_dns_entry_t   *entry;
+
+	(void)ipaddrs;
+	(void)result;
+
+	/* The cache itself was already updated by the query, all we need to do is
+	 * allow another refresh to be started.  The entry may have been purged
+	 * while we were waiting so don't use M_dns_get_entry() */
+	M_thread_mutex_lock(refresh->dns->lock);
+	entry = M_hash_strvp_get_direct(refresh->dns->cache_lookup, refresh->hostname);
+	if (entry != NULL)
+		entry->refreshing = M_FALSE;
+	M_thread_mutex_unlock(refresh->dns->lock);
+
+	M_free(refresh->hostname);
+	M_free(refresh);
+}
+
+
+static void M_dns_refresh_start(M_dns_t *dns, M_event_t *event, const char *hostname)
+{
+	M_dns_refresh_t *refresh;
+
+	refresh           = M_malloc_zero(sizeof(*refresh));
+	refresh->dns      = dns;
+	refresh->hostname = M_strdup(hostname);
+
+	/* Query is self cleaning, it will destroy itself after calling the callback */
+	if (M_io_dns_create(dns, event, hostname, 0, M_IO_NET_ANY, M_dns_refresh_cb, refresh) == NULL)
+		M_dns_refresh_cb(NULL, refresh, M_DNS_RESULT_INVALID);
+}
+
+
 M_io_t *M_dns_gethostbyname(M_dns_t *dns, M_event_t *event, const char *hostname, M_uint16 port, M_io_net_type_t type, M_io_dns_callback_t callback, void *cb_data)
 {
 	M_dns_entry_t *entry;
 	M_io_t        *io;
 	int            aftype;
+	M_time_t       now;
 
 	if (callback == NULL)
 		return NULL;
@@ -1164,15 +1242,60 @@ M_io_t *M_dns_gethostbyname(M_dns_t *dns, M_event_t *event, const char *hostname
 	}
 
 	M_thread_mutex_lock(dns->lock);
+	now   = M_time();
 	entry = M_dns_get_entry(dns, hostname, M_FALSE);
-	if (entry != NULL && (entry->ipv4_cache_t + (M_time_t)dns->query_cache_timeout_s > M_time() || entry->ipv6_cache_t + (M_time_t)dns->query_cache_timeout_s > M_time())) {
-		M_list_str_t *ipaddrs = M_dns_happyeyeballs_sort(dns, entry->ipv6_addrs, entry->ipv4_addrs, port);
-		M_thread_mutex_unlock(dns->lock);
+	if (entry != NULL) {
+		M_time_t cache_t     = M_MAX(entry->ipv4_cache_t, entry->ipv6_cache_t);
+		M_time_t stale_s     = (M_time_t)M_MIN(dns->query_cache_timeout_s + dns->query_cache_stale_s, dns->query_cache_max_s);
+		M_bool   has_addrs   = (M_list_str_len(entry->ipv4_addrs) || M_list_str_len(entry->ipv6_addrs))?M_TRUE:M_FALSE;
+		M_time_t neg_s       = (M_time_t)dns->query_cache_negative_s;
+		M_bool   ipv4_neg    = (entry->ipv4_negative_t != 0 && entry->ipv4_negative_t + neg_s > now)?M_TRUE:M_FALSE;
+		M_bool   ipv6_neg    = (entry->ipv6_negative_t != 0 && entry->ipv6_negative_t + neg_s > now)?M_TRUE:M_FALSE;
+		M_bool   refresh     = M_FALSE;
+		M_bool   cached      = M_FALSE;
+
+		if (cache_t + (M_time_t)dns->query_cache_timeout_s > now) {
+			/* Fresh, but if it's about to expire go ahead and refresh it now so the
+			 * next caller doesn't have to wait on the server */
+			dns->stats.hits++;
+			cached = M_TRUE;
+			if (dns->query_cache_prefetch_s && !entry->refreshing &&
+			    cache_t + (M_time_t)dns->query_cache_timeout_s - (M_time_t)dns->query_cache_prefetch_s <= now) {
+				dns->stats.prefetches++;
+				refresh = M_TRUE;
+			}
+		} else if (has_addrs && cache_t + stale_s > now) {
+			/* Expired, but still allowed to serve it while we refresh it */
+			dns->stats.stale_hits++;
+			cached = M_TRUE;
+			if (!entry->refreshing) {
+				dns->stats.refreshes++;
+				refresh = M_TRUE;
+			}
+		} else if (!has_addrs && (type == M_IO_NET_IPV6 || ipv4_neg) && (type == M_IO_NET_IPV4 || ipv6_neg)) {
+			/* Every address type asked for is known not to exist */
+			dns->stats.negative_hits++;
+			M_thread_mutex_unlock(dns->lock);
 
-		callback(ipaddrs, cb_data, M_DNS_RESULT_SUCCESS_CACHE);
-		M_list_str_destroy(ipaddrs);
-		return NULL;
+			callback(NULL, cb_data, M_DNS_RESULT_NOTFOUND);
+			return NULL;
+		}
+
+		if (cached) {
+			M_list_str_t *ipaddrs = M_dns_happyeyeballs_sort(dns, entry->ipv6_addrs, entry->ipv4_addrs, port);
+			if (refresh)
+				entry->refreshing = M_TRUE;
+			M_thread_mutex_unlock(dns->lock);
+
+			if (refresh)
+				M_dns_refresh_start(dns, event, hostname);
+
+			callback(ipaddrs, cb_data, M_DNS_RESULT_SUCCESS_CACHE);
+			M_list_str_destroy(ipaddrs);
+			return NULL;
+		}
 	}
+	dns->stats.misses++;
 	M_thread_mutex_unlock(dns->lock);
 
 	io = M_io_dns_create(dns, event, hostname, port, type, callback, cb_data);
@@ -1219,6 +1342,68 @@ M_bool M_dns_set_cache_timeout(M_dns_t *dns, M_uint64 timeout_s, M_uint64 max_ti
 }
 
 
+M_bool M_dns_set_cache_revalidate(M_dns_t *dns, M_uint64 stale_s, M_uint64 prefetch_s)
+{
+	if (dns == NULL)
+		return M_FALSE;
+
+	M_thread_mutex_lock(dns->lock);
+	dns->query_cache_stale_s    = stale_s;
+	dns->query_cache_prefetch_s = prefetch_s;
+	M_thread_mutex_unlock(dns->lock);
+	return M_TRUE;
+}
+
+
+M_bool M_dns_set_cache_negative(M_dns_t *dns, M_uint64 timeout_s)
+{
+	if (dns == NULL)
+		return M_FALSE;
+
+	M_thread_mutex_lock(dns->lock);
+	dns->query_cache_negative_s = timeout_s;
+	M_thread_mutex_unlock(dns->lock);
+	return M_TRUE;
+}
+
+
+M_bool M_dns_set_servers(M_dns_t *dns, const char *servers)
+{
+	char   *prev;
+	M_bool  ret;
+
+	if (dns == NULL)
+		return M_FALSE;
+
+	M_thread_mutex_lock(dns->lock);
+	prev         = dns->servers;
+	dns->servers = M_str_isempty(servers)?NULL:M_strdup(servers);
+	ret          = M_dns_reload_server(dns, M_TRUE);
+	if (!ret) {
+		/* Keep what we were using */
+		M_free(dns->servers);
+		dns->servers = prev;
+	} else {
+		M_free(prev);
+	}
+	M_thread_mutex_unlock(dns->lock);
+	return ret;
+}
+
+
+M_bool M_dns_get_cache_stats(M_dns_t *dns, M_dns_cache_stats_t *stats)
+{
+	if (dns == NULL || stats == NULL)
+		return M_FALSE;
+
+	M_thread_mutex_lock(dns->lock);
+	M_mem_copy(stats, &dns->stats, sizeof(*stats));
+	stats->entries = M_queue_len(dns->cache);
+	M_thread_mutex_unlock(dns->lock);
+	return M_TRUE;
+}
+
+
 M_bool M_dns_pton(int af, const char *src, void *dst)
 {
 	if (ares_inet_pton(af, src, dst) != 1)
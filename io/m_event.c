@@ -89,7 +89,7 @@ static void M_event_loop_init(M_event_t *event, M_uint32 flags)
 	M_thread_model_t threadmodel;
 
 	event->type                 = M_EVENT_BASE_TYPE_LOOP;
-	event->u.loop.lock          = M_thread_mutex_create(M_THREAD_MUTEXATTR_RECURSIVE);
+	event->u.loop.lock          = M_thread_mutex_create(M_THREAD_MUTEXATTR_RECURSIVE|M_THREAD_MUTEXATTR_ADAPTIVE);
 	event->u.loop.flags         = flags;
 	event->u.loop.status        = M_EVENT_STATUS_PAUSED;
 
@@ -137,6 +137,12 @@ M_event_t *M_event_create(M_uint32 flags)
 
 
 M_event_t *M_event_pool_create(size_t max_threads)
+{
+	return M_event_pool_create_ex(max_threads, M_EVENT_POOL_FLAG_NONE);
+}
+
+
+M_event_t *M_event_pool_create_ex(size_t max_threads, M_uint32 flags)
 {
 	size_t     num_threads;
 	size_t     i;
@@ -156,11 +162,13 @@ M_event_t *M_event_pool_create(size_t max_threads)
 	event                       = M_malloc_zero(sizeof(*event));
 	event->type                 = M_EVENT_BASE_TYPE_POOL;
 	event->u.pool.thread_count  = num_threads;
+	event->u.pool.flags         = flags;
 	event->u.pool.thread_ids    = M_malloc_zero(sizeof(*event->u.pool.thread_ids)    * num_threads);
 	event->u.pool.thread_evloop = M_malloc_zero(sizeof(*event->u.pool.thread_evloop) * num_threads);
 	for (i=0; i<num_threads; i++) {
-		M_event_loop_init(&event->u.pool.thread_evloop[i], M_EVENT_FLAG_NONE);
-		event->u.pool.thread_evloop[i].u.loop.parent = event;
+		event->u.pool.thread_evloop[i] = M_malloc_zero(sizeof(*event->u.pool.thread_evloop[i]));
+		M_event_loop_init(event->u.pool.thread_evloop[i], M_EVENT_FLAG_NONE);
+		event->u.pool.thread_evloop[i]->u.loop.parent = event;
 	}
 
 	return event;
@@ -194,6 +202,9 @@ static void M_event_destroy_loop(M_event_t *event)
 	M_queue_destroy(event->u.loop.timers);
 	event->u.loop.timers        = NULL;
 
+	M_list_destroy(event->u.loop.coro_ready, M_FALSE);
+	event->u.loop.coro_ready    = NULL;
+
 	if (event->u.loop.impl_data != NULL) {
 		if (event->u.loop.impl->data_free != NULL) {
 			event->u.loop.impl->data_free(event->u.loop.impl_data);
@@ -238,7 +249,8 @@ void M_event_destroy(M_event_t *event)
 	} else {
 		size_t i;
 		for (i=0; i<event->u.pool.thread_count; i++) {
-			M_event_destroy_loop(&event->u.pool.thread_evloop[i]);
+			M_event_destroy_loop(event->u.pool.thread_evloop[i]);
+			M_free(event->u.pool.thread_evloop[i]);
 		}
 		M_free(event->u.pool.thread_evloop);
 		M_free(event->u.pool.thread_ids);
@@ -538,12 +550,12 @@ M_event_t *M_event_distribute(M_event_t *event)
 
 	/* If a pool, choose the best thread */
 	for (i=0; i<event->u.pool.thread_count; i++) {
-		M_uint64 curr_time  = M_event_process_time_ms(&event->u.pool.thread_evloop[i]);
-		size_t   curr_count = M_event_num_objects(&event->u.pool.thread_evloop[i]);
+		M_uint64 curr_time  = M_event_process_time_ms(event->u.pool.thread_evloop[i]);
+		size_t   curr_count = M_event_num_objects(event->u.pool.thread_evloop[i]);
 
 		/* If the event loop has nothing, it automatically wins */
 		if (curr_count == 0)
-			return &event->u.pool.thread_evloop[i];
+			return event->u.pool.thread_evloop[i];
 
 		/* Worse match */
 		if (best_event != NULL && curr_time > best_event_time)
@@ -554,7 +566,7 @@ M_event_t *M_event_distribute(M_event_t *event)
 			continue;
 
 		/* Best so far */
-		best_event       = &event->u.pool.thread_evloop[i];
+		best_event       = event->u.pool.thread_evloop[i];
 		best_event_time  = curr_time;
 		best_event_count = curr_count;
 	}
@@ -581,7 +593,9 @@ M_bool M_event_add(M_event_t *event, M_io_t *comm, M_event_callback_t callback,
 	if (comm->reg_event != NULL) {
 		if (comm->private_event) {
 			/* Unassociate from sync event private handle */
-			M_event_destroy(comm->reg_event);
+			M_event_t *private_event = comm->reg_event;
+			M_event_remove(comm);
+			M_io_block_event_release(private_event);
 			comm->private_event = M_FALSE;
 			comm->reg_event     = NULL;
 		} else {
@@ -690,6 +704,59 @@ M_bool M_event_queue_task(M_event_t *event, M_event_callback_t callback, void *c
 }
 
 
+typedef struct {
+	M_event_t                 *event;
+	M_event_future_callback_t  callback;
+	void                      *cb_data;
+	void                      *result;
+} M_event_future_t;
+
+
+static void M_event_queue_future_deliver(M_event_t *event, M_event_type_t type, M_io_t *io, void *arg)
+{
+	M_event_future_t *ef = arg;
+
+	(void)type;
+	(void)io;
+
+	ef->callback(event, ef->result, ef->cb_data);
+	M_free(ef);
+}
+
+
+static void M_event_queue_future_then(void *result, void *thunk)
+{
+	M_event_future_t *ef = thunk;
+
+	/* Called from the threadpool thread, hand off to the event loop.  If that fails
+	 * run the callback here rather than lose it. */
+	ef->result = result;
+	if (!M_event_queue_task(ef->event, M_event_queue_future_deliver, ef))
+		M_event_queue_future_deliver(ef->event, M_EVENT_TYPE_OTHER, NULL, ef);
+}
+
+
+M_bool M_event_queue_future(M_event_t *event, M_threadpool_future_t *future, M_event_future_callback_t callback, void *cb_data)
+{
+	M_event_future_t *ef;
+
+	if (event == NULL || future == NULL || callback == NULL)
+		return M_FALSE;
+
+	ef           = M_malloc_zero(sizeof(*ef));
+	ef->event    = event;
+	ef->callback = callback;
+	ef->cb_data  = cb_data;
+
+	if (!M_threadpool_future_then(future, M_event_queue_future_then, ef)) {
+		M_free(ef);
+		return M_FALSE;
+	}
+
+	return M_TRUE;
+}
+
+
 static void M_event_queue_pending(M_event_t *event, M_io_t *io, size_t layer_id, M_event_type_t type)
 {
 	M_event_pending_t *entry  = NULL;
@@ -980,7 +1047,7 @@ void M_event_done_with_disconnect(M_event_t *event, M_uint64 timeout_ms)
 	if (event->type == M_EVENT_BASE_TYPE_POOL) {
 		size_t i;
 		for (i=0; i<event->u.pool.thread_count; i++)
-			M_event_done_with_disconnect_int(&event->u.pool.thread_evloop[i], timeout_ms);
+			M_event_done_with_disconnect_int(event->u.pool.thread_evloop[i], timeout_ms);
 		return;
 	}
 }
@@ -1015,7 +1082,7 @@ void M_event_done(M_event_t *event)
 	if (event->type == M_EVENT_BASE_TYPE_POOL) {
 		size_t i;
 		for (i=0; i<event->u.pool.thread_count; i++)
-			M_event_status_change(&event->u.pool.thread_evloop[i], M_EVENT_STATUS_DONE);
+			M_event_status_change(event->u.pool.thread_evloop[i], M_EVENT_STATUS_DONE);
 		return;
 	}
 }
@@ -1038,7 +1105,7 @@ void M_event_return(M_event_t *event)
 	if (event->type == M_EVENT_BASE_TYPE_POOL) {
 		size_t i;
 		for (i=0; i<event->u.pool.thread_count; i++)
-			M_event_status_change(&event->u.pool.thread_evloop[i], M_EVENT_STATUS_RETURN);
+			M_event_status_change(event->u.pool.thread_evloop[i], M_EVENT_STATUS_RETURN);
 		return;
 	}
 }
@@ -1053,12 +1120,10 @@ M_event_status_t M_event_get_status(M_event_t *event)
 
 	/* Status for all should be the same, just get the first */
 	if (event->type == M_EVENT_BASE_TYPE_POOL) {
-		event = &event->u.pool.thread_evloop[0];
+		event = event->u.pool.thread_evloop[0];
 	}
 
-	M_event_lock(event);
-	status = event->u.loop.status;
-	M_event_unlock(event);
+	status = (M_event_status_t)M_atomic_load_u32_explicit(&event->u.loop.status, M_ATOMIC_ORDER_ACQUIRE);
 
 	return status;
 }
@@ -1074,13 +1139,12 @@ M_uint64 M_event_process_time_ms(M_event_t *event)
 	if (event->type == M_EVENT_BASE_TYPE_POOL) {
 		size_t i;
 		for (i=0; i<event->u.pool.thread_count; i++)
-			ms += M_event_process_time_ms(&event->u.pool.thread_evloop[i]);
+			ms += M_event_process_time_ms(event->u.pool.thread_evloop[i]);
 		return ms;
 	}
 
-	M_event_lock(event);
-	ms = event->u.loop.process_time_ms;
-	M_event_unlock(event);
+	/* Only used as a load hint, no need to lock */
+	ms = M_atomic_load_u64_explicit(&event->u.loop.process_time_ms, M_ATOMIC_ORDER_RELAXED);
 
 	return ms;
 }
@@ -1096,7 +1160,7 @@ size_t M_event_num_objects(M_event_t *event)
 	if (event->type == M_EVENT_BASE_TYPE_POOL) {
 		size_t i;
 		for (i=0; i<event->u.pool.thread_count; i++) {
-			num_objects += M_event_num_objects(&event->u.pool.thread_evloop[i]);
+			num_objects += M_event_num_objects(event->u.pool.thread_evloop[i]);
 		}
 
 		return num_objects;
@@ -1135,7 +1199,7 @@ static M_event_err_t M_event_loop_loop(M_event_t *event, M_uint64 timeout_ms)
 		M_event_unlock(event);
 		return M_EVENT_ERR_MISUSE;
 	}
-	event->u.loop.status        = M_EVENT_STATUS_RUNNING;
+	M_atomic_store_u32_explicit(&event->u.loop.status, M_EVENT_STATUS_RUNNING, M_ATOMIC_ORDER_RELEASE);
 	event->u.loop.status_change = 0;
 	event->u.loop.timeout_ms    = timeout_ms;
 	event->u.loop.threadid      = M_thread_self();
@@ -1250,22 +1314,22 @@ static M_event_err_t M_event_loop_loop(M_event_t *event, M_uint64 timeout_ms)
 
 		
 		/* Record event processing time */
-		event->u.loop.process_time_ms += M_time_elapsed(&event_process_tv);
+		M_atomic_add_u64_explicit(&event->u.loop.process_time_ms, M_time_elapsed(&event_process_tv), M_ATOMIC_ORDER_RELAXED);
 		/* ----- End Process Events ----- */
 
 	} while ((elapsed = M_time_elapsed(&event->u.loop.start_tv)) < event->u.loop.timeout_ms);
 
 	/* Mark as paused */
 	if (event->u.loop.status == M_EVENT_STATUS_RUNNING)
-		event->u.loop.status = M_EVENT_STATUS_PAUSED;
+		M_atomic_store_u32_explicit(&event->u.loop.status, M_EVENT_STATUS_PAUSED, M_ATOMIC_ORDER_RELEASE);
 
 	/* Handle a status change event */
 	if (event->u.loop.status_change == M_EVENT_STATUS_DONE) {
-		event->u.loop.status        = event->u.loop.status_change;
+		M_atomic_store_u32_explicit(&event->u.loop.status, event->u.loop.status_change, M_ATOMIC_ORDER_RELEASE);
 		event->u.loop.status_change = 0;
 		retval                      = M_EVENT_ERR_DONE;
 	} else if (event->u.loop.status_change == M_EVENT_STATUS_RETURN) {
-		event->u.loop.status        = event->u.loop.status_change;
+		M_atomic_store_u32_explicit(&event->u.loop.status, event->u.loop.status_change, M_ATOMIC_ORDER_RELEASE);
 		event->u.loop.status_change = 0;
 		retval                      = M_EVENT_ERR_RETURN;
 	}
@@ -1312,27 +1376,40 @@ static void *M_event_pool_loop_thread(void *arg)
 static M_event_err_t M_event_pool_loop(M_event_t *event, M_uint64 timeout_ms)
 {
 	size_t           i;
-	M_thread_attr_t *attr = M_thread_attr_create();
-	M_event_err_t    rv;
+	size_t           start = 1;
+	M_thread_attr_t *attr  = M_thread_attr_create();
+	M_bool           pin   = (event->u.pool.flags & M_EVENT_POOL_FLAG_PIN_CPU) ? M_TRUE : M_FALSE;
+	M_bool           numa  = (event->u.pool.flags & M_EVENT_POOL_FLAG_NUMA_SPREAD) ? M_TRUE : M_FALSE;
+	M_event_err_t    rv    = M_EVENT_ERR_DONE;
 
 	M_thread_attr_set_create_joinable(attr, M_TRUE);
 
-	/* Create threads for 1->thread_count, 0 is run on the current thread */
-	for (i=1; i<event->u.pool.thread_count; i++) {
+	/* Create threads for 1->thread_count, 0 is run on the current thread.  When
+	 * pinning, the current thread isn't ours to bind so every loop gets its own
+	 * thread and this one just waits. */
+	if (pin)
+		start = 0;
+
+	for (i=start; i<event->u.pool.thread_count; i++) {
 		M_event_pool_loop_thread_arg_t *thread_arg = M_malloc_zero(sizeof(*thread_arg));
-		thread_arg->event                          = &event->u.pool.thread_evloop[i];
+		thread_arg->event                          = event->u.pool.thread_evloop[i];
 		thread_arg->timeout_ms                     = timeout_ms;
+		if (pin)
+			M_thread_attr_set_cpu_affinity(attr, M_thread_cpu_for_index(i, numa));
 		event->u.pool.thread_ids[i]                = M_thread_create(attr, M_event_pool_loop_thread, thread_arg);
 	}
 
 	M_thread_attr_destroy(attr);
 
-	rv = M_event_loop_loop(&event->u.pool.thread_evloop[0], timeout_ms);
+	if (!pin)
+		rv = M_event_loop_loop(event->u.pool.thread_evloop[0], timeout_ms);
 
 	/* Wait for all threads to exit */
-	for (i=1; i<event->u.pool.thread_count; i++) {
+	for (i=start; i<event->u.pool.thread_count; i++) {
 		void *val = NULL;
 		M_thread_join(event->u.pool.thread_ids[i], &val);
+		if (i == 0)
+			rv = (M_event_err_t)((M_uintptr)val);
 	}
 
 	/* All threads return values should be the same */
@@ -135,7 +135,7 @@ struct M_event_loop {
 	M_uint64            timeout_ms;           /*!< Cache variable for tracking the current event loop timeout */
 	M_timeval_t         start_tv;             /*!< Elapsed timer start of current event loop                  */
 	enum M_EVENT_FLAGS  flags;                /*!< Flags that control behavior */
-	M_event_status_t    status;               /*!< Status of event loop */
+	volatile M_uint32   status;               /*!< Status of event loop (M_event_status_t). Only changed with lock held, but may be read without it */
 	M_event_status_t    status_change;        /*!< Requested status change */
 
 	M_hash_u64vp_t     *evhandles;            /*!< Registered list of OS event handles. M_EVENT_HANDLE to M_event_evhandle_t (M_io_t, M_event_wait_type_t) */
@@ -148,8 +148,9 @@ struct M_event_loop {
 	M_llist_t          *soft_events;          /*!< Linked list of M_event_softevent_t which are M_event-generated events to turn edge-triggered events into resettable events */
 	M_hashtable_t      *reg_ios;              /*!< M_io_t * to M_event_io_t * for tracking M_io_t handles and associated user callbacks and soft events */
 	M_hashtable_t      *pending_events;       /*!< M_io_t * or M_event_timer_t * to M_event_pending_t * ordered hashtable (in insertion order for prioritization) */
+	M_list_t           *coro_ready;           /*!< M_coro_t * started or yielded, resumed in order on the next pass */
 
-	M_uint64            process_time_ms;      /*!< Number of milliseconds spent processing events (to track load) */
+	volatile M_uint64   process_time_ms;      /*!< Number of milliseconds spent processing events (to track load). Atomic, read without lock */
 	M_event_impl_cbs_t *impl_large;           /*!< Implementation callbacks when the event list is large (required) */
 	M_event_impl_cbs_t *impl_short;           /*!< Implementation callbacks when the event list is short (optional) */
 	M_event_impl_cbs_t *impl;                 /*!< Which callback is currently in use */
@@ -159,9 +160,11 @@ struct M_event_loop {
 typedef struct M_event_loop M_event_loop_t;
 
 struct M_event_pool {
-	M_event_t     *thread_evloop;       /*!< Array of event loop structures, one per thread */
+	M_event_t    **thread_evloop;       /*!< Array of event loop structures, one per thread, each allocated
+	                                         separately so loops don't share cache lines */
 	M_threadid_t  *thread_ids;          /*!< Array of thread ids */
 	size_t         thread_count;        /*!< Count of threads */
+	M_uint32       flags;               /*!< M_EVENT_POOL_FLAGS */
 };
 
 typedef struct M_event_pool M_event_pool_t;
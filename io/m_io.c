@@ -266,7 +266,7 @@ void M_io_destroy(M_io_t *comm)
 
 	/* Delay cleaning up event until last possible time */
 	if (event && destroy_event)
-		M_event_destroy(event);
+		M_io_block_event_release(event);
 }
 
 
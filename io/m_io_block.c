@@ -56,6 +56,160 @@ struct M_io_block_data {
 };
 
 
+/* Each io object used in blocking mode needs its own private event handle.  Creating
+ * one means a new epoll/kqueue handle and wake pipe, which is a noticeable cost when
+ * short lived connections are being churned through.  Once an io object is done with
+ * its private event handle it is handed back here and kept in a small per-thread
+ * cache for the next io object to use.
+ *
+ * Where the compiler supports it the cache is a native thread local so getting and
+ * releasing a handle never takes a lock.  Otherwise it falls back to the thread
+ * system's tls keys. */
+#define M_IO_BLOCK_EVENT_CACHE_MAX 16
+
+typedef struct {
+	M_event_t *events[M_IO_BLOCK_EVENT_CACHE_MAX];
+	size_t     cnt;
+} M_io_block_event_cache_t;
+
+static M_thread_once_t    M_io_block_once   = M_THREAD_ONCE_STATIC_INITIALIZER;
+static M_bool             M_io_block_active = M_FALSE;
+#ifdef HAVE___THREAD
+static __thread M_io_block_event_cache_t M_io_block_cache;
+#else
+static M_thread_tls_key_t M_io_block_key    = 0;
+#endif
+
+
+static void M_io_block_event_cache_flush(M_io_block_event_cache_t *cache)
+{
+	size_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i=0; i<cache->cnt; i++)
+		M_event_destroy(cache->events[i]);
+	cache->cnt = 0;
+}
+
+
+#ifdef HAVE___THREAD
+static void M_io_block_thread_exit(void)
+{
+	M_io_block_event_cache_flush(&M_io_block_cache);
+}
+
+
+static M_io_block_event_cache_t *M_io_block_event_cache(M_bool create)
+{
+	(void)create;
+	return &M_io_block_cache;
+}
+#else
+static void M_io_block_event_cache_destroy(void *arg)
+{
+	M_io_block_event_cache_flush(arg);
+	M_free(arg);
+}
+
+
+static M_io_block_event_cache_t *M_io_block_event_cache(M_bool create)
+{
+	M_io_block_event_cache_t *cache;
+
+	cache = M_thread_tls_getspecific(M_io_block_key);
+	if (cache == NULL && create) {
+		cache = M_malloc_zero(sizeof(*cache));
+		M_thread_tls_setspecific(M_io_block_key, cache);
+	}
+	return cache;
+}
+#endif
+
+
+static void M_io_block_deinit(void *arg)
+{
+	(void)arg;
+
+	if (!M_thread_once_reset(&M_io_block_once))
+		return;
+
+	M_io_block_active = M_FALSE;
+
+	/* Other threads clean up their own cache on exit, but the thread running the
+	 * library cleanup is most likely the main thread which never exits through
+	 * the thread system. */
+#ifdef HAVE___THREAD
+	M_thread_destructor_remove(M_io_block_thread_exit);
+	M_io_block_event_cache_flush(&M_io_block_cache);
+#else
+	/* Clearing the value runs the key destructor on the cache. */
+	M_thread_tls_setspecific(M_io_block_key, NULL);
+	M_io_block_key = 0;
+#endif
+}
+
+
+static void M_io_block_init_run(M_uint64 flags)
+{
+	(void)flags;
+#ifdef HAVE___THREAD
+	M_thread_destructor_insert(M_io_block_thread_exit);
+#else
+	M_io_block_key = M_thread_tls_key_create(M_io_block_event_cache_destroy);
+#endif
+	M_io_block_active = M_TRUE;
+	M_library_cleanup_register(M_io_block_deinit, NULL);
+}
+
+
+static M_event_t *M_io_block_event_get(void)
+{
+	M_io_block_event_cache_t *cache;
+
+	M_thread_once(&M_io_block_once, M_io_block_init_run, 0);
+
+	cache = M_io_block_event_cache(M_FALSE);
+	if (cache == NULL || cache->cnt == 0)
+		return M_event_create(M_EVENT_FLAG_NOWAKE);
+
+	cache->cnt--;
+	return cache->events[cache->cnt];
+}
+
+
+void M_io_block_event_release(M_event_t *event)
+{
+	M_io_block_event_cache_t *cache;
+	M_bool                    idle;
+
+	if (event == NULL)
+		return;
+
+	/* Only reuse the handle if nothing was left behind on it */
+	M_event_lock(event);
+	idle = (M_hashtable_num_keys(event->u.loop.reg_ios) == 0 &&
+	        M_queue_len(event->u.loop.timers) == 0 &&
+	        M_llist_len(event->u.loop.soft_events) == 0)?M_TRUE:M_FALSE;
+	M_event_unlock(event);
+
+	if (!idle || !M_io_block_active) {
+		M_event_destroy(event);
+		return;
+	}
+
+	cache = M_io_block_event_cache(M_TRUE);
+	if (cache->cnt == M_IO_BLOCK_EVENT_CACHE_MAX) {
+		M_event_destroy(event);
+		return;
+	}
+
+	cache->events[cache->cnt] = event;
+	cache->cnt++;
+}
+
+
 void M_io_block_data_free(M_io_t *io)
 {
 	M_free(io->sync_data);
@@ -172,7 +326,7 @@ static M_bool M_io_block_regevent(M_io_t *io, M_io_block_request_t request, M_io
 		}
 		data = io->sync_data;
 	} else {
-		event             = M_event_create(M_EVENT_FLAG_NOWAKE);
+		event             = M_io_block_event_get();
 		if (io->sync_data != NULL) {
 			data          = io->sync_data;
 		} else {
@@ -117,6 +117,10 @@ M_bool M_io_setnonblock(int fd);
 
 void M_io_block_data_free(M_io_t *io);
 
+/*! Hand back a private event handle no longer used by an io object so it can be
+ *  reused by M_io_block_*() calls on this thread.  Destroys it if it can't be. */
+void M_io_block_event_release(M_event_t *event);
+
 /* Here because DNS needs it instead of m_io_net_int.h */
 void M_io_net_init_system(void);
 
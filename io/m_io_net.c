@@ -34,6 +34,16 @@
 #  include <netinet/tcp.h>
 #  include <arpa/inet.h>
 #  include <netdb.h>
+#  include <sys/uio.h>
+#  ifdef HAVE_LINUX_TLS_H
+#    include <linux/tls.h>
+#    ifndef TCP_ULP
+#      define TCP_ULP 31
+#    endif
+#    ifndef SOL_TLS
+#      define SOL_TLS 282
+#    endif
+#  endif
 #    ifdef __sun__
 #        include <xti.h>
 #    endif
@@ -1432,6 +1442,132 @@ M_bool M_io_net_set_nagle(M_io_t *io, M_bool nagle_enabled)
 }
 
 
+M_bool M_io_net_ktls_start(M_io_t *io, M_bool is_tx, const void *crypto_info, size_t crypto_info_len)
+{
+#ifdef HAVE_LINUX_TLS_H
+	M_io_layer_t  *layer  = M_io_layer_acquire(io, 0, "NET");
+	M_io_handle_t *handle = M_io_layer_get_handle(layer);
+	M_bool         ret    = M_FALSE;
+
+	if (layer == NULL || handle == NULL)
+		return M_FALSE;
+
+	if (crypto_info == NULL || crypto_info_len == 0)
+		goto done;
+
+	if (handle->is_netdns) {
+		if (handle->data.netdns.io != NULL)
+			ret = M_io_net_ktls_start(handle->data.netdns.io, is_tx, crypto_info, crypto_info_len);
+		goto done;
+	}
+
+	if (handle->state != M_IO_NET_STATE_CONNECTED || handle->data.net.sock == M_EVENT_INVALID_SOCKET)
+		goto done;
+
+	/* The ULP can only be attached once per socket, but is shared by both directions.  This
+	 * will fail if the tls kernel module isn't available which is how we fall back. */
+	if (!handle->data.net.ktls_ulp) {
+		if (setsockopt(handle->data.net.sock, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+			goto done;
+		handle->data.net.ktls_ulp = M_TRUE;
+	}
+
+	if (setsockopt(handle->data.net.sock, SOL_TLS, is_tx?TLS_TX:TLS_RX, crypto_info, (socklen_t)crypto_info_len) != 0)
+		goto done;
+
+	ret = M_TRUE;
+
+done:
+	M_io_layer_release(layer);
+	return ret;
+#else
+	(void)io;
+	(void)is_tx;
+	(void)crypto_info;
+	(void)crypto_info_len;
+	return M_FALSE;
+#endif
+}
+
+
+M_io_error_t M_io_net_ktls_write_record(M_io_t *io, M_uint8 record_type, const unsigned char *buf, size_t *write_len)
+{
+#ifdef HAVE_LINUX_TLS_H
+	M_io_layer_t   *layer  = M_io_layer_acquire(io, 0, "NET");
+	M_io_handle_t  *handle = M_io_layer_get_handle(layer);
+	M_io_error_t    err    = M_IO_ERROR_ERROR;
+	size_t          request_len;
+	ssize_t         retval;
+	struct msghdr   msg;
+	struct iovec    iov;
+	struct cmsghdr *cmsg;
+	unsigned char   cbuf[CMSG_SPACE(sizeof(record_type))];
+
+	if (layer == NULL || handle == NULL)
+		return M_IO_ERROR_INVALID;
+
+	if (buf == NULL || write_len == NULL || *write_len == 0) {
+		err = M_IO_ERROR_INVALID;
+		goto done;
+	}
+
+	if (handle->is_netdns) {
+		if (handle->data.netdns.io != NULL)
+			err = M_io_net_ktls_write_record(handle->data.netdns.io, record_type, buf, write_len);
+		goto done;
+	}
+
+	if (handle->state != M_IO_NET_STATE_CONNECTED || !handle->data.net.ktls_ulp) {
+		err = M_IO_ERROR_NOTCONNECTED;
+		goto done;
+	}
+
+	/* Non application data records must be sent with their record type as
+	 * ancillary data so the kernel frames them properly. */
+	M_mem_set(&msg, 0, sizeof(msg));
+	M_mem_set(cbuf, 0, sizeof(cbuf));
+	msg.msg_control       = cbuf;
+	msg.msg_controllen    = sizeof(cbuf);
+	cmsg                  = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level      = SOL_TLS;
+	cmsg->cmsg_type       = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len        = CMSG_LEN(sizeof(record_type));
+	*CMSG_DATA(cmsg)      = record_type;
+	msg.msg_controllen    = cmsg->cmsg_len;
+	iov.iov_base          = (void *)((M_uintptr)buf); /* iov_base isn't const */
+	iov.iov_len           = *write_len;
+	msg.msg_iov           = &iov;
+	msg.msg_iovlen        = 1;
+
+	request_len = *write_len;
+	errno       = 0;
+	retval      = sendmsg(handle->data.net.sock, &msg, MSG_NOSIGNAL);
+	if (retval == 0) {
+		handle->data.net.last_error = M_IO_ERROR_DISCONNECT;
+		err = M_IO_ERROR_DISCONNECT;
+	} else if (retval < 0) {
+		M_io_net_resolve_error(handle);
+		err = handle->data.net.last_error;
+	} else {
+		*write_len = (size_t)retval;
+		err        = M_IO_ERROR_SUCCESS;
+	}
+
+	M_io_net_readwrite_err(io, layer, M_FALSE, err, request_len, *write_len);
+
+done:
+	M_io_layer_release(layer);
+	return err;
+#else
+	(void)io;
+	(void)record_type;
+	(void)buf;
+	(void)write_len;
+	return M_IO_ERROR_NOTIMPL;
+#endif
+}
+
+
 M_bool M_io_net_set_connect_timeout_ms(M_io_t *io, M_uint64 timeout_ms)
 {
 	M_io_layer_t  *layer  = M_io_layer_acquire(io, 0, "NET");
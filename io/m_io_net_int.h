@@ -64,6 +64,7 @@ struct M_io_handle_net {
 	int                  last_error_sys; /*!< Last recorded system error                                     */
 #endif
 	M_io_error_t         last_error;     /*!< Last recorded error mapped                                     */
+	M_bool               ktls_ulp;       /*!< Whether the kernel TLS upper layer protocol has been attached  */
 };
 
 struct M_io_handle_netdns {
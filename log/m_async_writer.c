@@ -41,6 +41,10 @@ struct M_async_writer {
 	const char         *line_end;
 
 	M_async_write_cb_t          write_cb;
+	M_async_write_batch_cb_t    batch_cb;    /* if set, used instead of write_cb. */
+	size_t                      max_batch_bytes; /* max text bytes passed to batch_cb at once (may go over for single msg). */
+	size_t                      batch_flush_bytes; /* stop delaying a batch once this many bytes are queued. */
+	M_uint64                    batch_delay_ms;    /* max time to delay a batch waiting for batch_flush_bytes, 0 to disable. */
 	void                       *write_thunk; /* thunk that gets passed to write_cb. */
 	M_async_thunk_stop_cb_t     stop_cb;
 	M_async_thunk_destroy_cb_t  destroy_cb;  /* destructor for thunk (may be NULL). */
@@ -51,11 +55,23 @@ struct M_async_writer {
 	M_thread_cond_t    *cond_done;      /* when triggered, indicates that the internal thread has finished a command, or exited. */
 	M_thread_cond_t    *cond_alive;     /* when triggered, indicates that the internal thread is still alive. */
 
-	/* Reset on start. */
-	M_llist_str_t      *msgs;
+	/* Reset on start. Messages are stored back to back (each NULL terminated) in a circular buffer, oldest at head.
+	 * This isn't an M_ringbuf_t: messages are variable length, the oldest are dropped to make room by byte count,
+	 * and a batch that failed to write is put back at the front, none of which a fixed size pointer queue can do.
+	 */
+	unsigned char      *ring;
+	size_t              ring_size;     /* allocated size of ring, grows as needed but never shrinks. */
+	size_t              ring_head;     /* offset of oldest message in ring. */
+	size_t              ring_used;     /* bytes used in ring (includes NULL terminators). */
+	size_t              num_msgs;      /* number of messages currently in queue. */
 	size_t              stored_bytes;  /* current number of text bytes stored in queue (does not include overhead). */
 	M_uint64            num_dropped;   /* number of messages that have been dropped since last call to pop(). */
 
+	/* Only used by internal thread. */
+	M_buf_t            *popped;        /* messages most recently popped off the queue, concatenated. */
+	size_t             *popped_lens;   /* length of each message in popped (batch mode only). */
+	size_t              popped_lens_size;
+
 	/* Reset only by explicit function call. */
 	writer_state_t      state;
 	M_bool              command_done;  /* used to indicate a command has completed, if the user sent a blocking command */
@@ -77,7 +93,9 @@ static void destroy_int(M_async_writer_t *writer)
 	M_thread_cond_destroy(writer->cond_done);
 	M_thread_cond_destroy(writer->cond_alive);
 
-	M_llist_str_destroy(writer->msgs);
+	M_free(writer->ring);
+	M_buf_cancel(writer->popped);
+	M_free(writer->popped_lens);
 
 	M_free(writer);
 }
@@ -94,20 +112,143 @@ static M_bool in_flush(M_async_writer_t *writer)
 	return M_FALSE;
 }
 
-/* Pull the oldest message off the queue. If no messages in queue, wait until there is one.
+/* Make sure the ring has room for len more bytes. Grows (and unwraps) the ring if needed. */
+static void ring_reserve(M_async_writer_t *writer, size_t len)
+{
+	unsigned char *ring;
+	size_t         size;
+	size_t         first;
+
+	if (writer->ring_size - writer->ring_used >= len) {
+		return;
+	}
+
+	size = (writer->ring_size == 0)? 256 : writer->ring_size;
+	while (size - writer->ring_used < len) {
+		size *= 2;
+	}
+
+	ring  = M_malloc(size);
+	first = M_MIN(writer->ring_used, writer->ring_size - writer->ring_head);
+	if (first > 0) {
+		M_mem_copy(ring, writer->ring + writer->ring_head, first);
+	}
+	if (writer->ring_used > first) {
+		M_mem_copy(ring + first, writer->ring, writer->ring_used - first);
+	}
+
+	M_free(writer->ring);
+	writer->ring      = ring;
+	writer->ring_size = size;
+	writer->ring_head = 0;
+}
+
+
+/* Copy bytes into the ring starting at offset, wrapping around the end if needed. */
+static void ring_put(M_async_writer_t *writer, size_t offset, const void *data, size_t len)
+{
+	size_t first = M_MIN(len, writer->ring_size - offset);
+
+	M_mem_copy(writer->ring + offset, data, first);
+	if (len > first) {
+		M_mem_copy(writer->ring, (const unsigned char *)data + first, len - first);
+	}
+}
+
+
+/* Add a message as the newest in the queue. */
+static void ring_push_back(M_async_writer_t *writer, const char *msg, size_t msg_len)
+{
+	size_t offset;
+
+	ring_reserve(writer, msg_len + 1);
+
+	offset = (writer->ring_head + writer->ring_used) % writer->ring_size;
+	ring_put(writer, offset, msg, msg_len);
+	writer->ring[(offset + msg_len) % writer->ring_size] = '\0';
+
+	writer->ring_used    += msg_len + 1;
+	writer->stored_bytes += msg_len;
+	writer->num_msgs++;
+}
+
+
+/* Put a message back as the oldest in the queue. */
+static void ring_push_front(M_async_writer_t *writer, const char *msg, size_t msg_len)
+{
+	ring_reserve(writer, msg_len + 1);
+
+	writer->ring_head = (writer->ring_head + writer->ring_size - (msg_len + 1)) % writer->ring_size;
+	ring_put(writer, writer->ring_head, msg, msg_len);
+	writer->ring[(writer->ring_head + msg_len) % writer->ring_size] = '\0';
+
+	writer->ring_used    += msg_len + 1;
+	writer->stored_bytes += msg_len;
+	writer->num_msgs++;
+}
+
+
+/* Length of the oldest message in the queue. Queue must not be empty. */
+static size_t ring_front_len(M_async_writer_t *writer)
+{
+	size_t                first = M_MIN(writer->ring_used, writer->ring_size - writer->ring_head);
+	const unsigned char  *end;
+
+	end = M_mem_chr(writer->ring + writer->ring_head, '\0', first);
+	if (end != NULL) {
+		return (size_t)(end - (writer->ring + writer->ring_head));
+	}
+
+	/* Message wraps around the end of the ring. */
+	end = M_mem_chr(writer->ring, '\0', writer->ring_used - first);
+	return first + (size_t)(end - writer->ring);
+}
+
+
+/* Remove the oldest message from the queue, appending it to out (if not NULL). Returns the message length. */
+static size_t ring_pop_front(M_async_writer_t *writer, M_buf_t *out)
+{
+	size_t len   = ring_front_len(writer);
+	size_t first = M_MIN(len, writer->ring_size - writer->ring_head);
+
+	if (out != NULL) {
+		M_buf_add_bytes(out, writer->ring + writer->ring_head, first);
+		if (len > first) {
+			M_buf_add_bytes(out, writer->ring, len - first);
+		}
+	}
+
+	writer->ring_head     = (writer->ring_head + len + 1) % writer->ring_size;
+	writer->ring_used    -= len + 1;
+	writer->stored_bytes -= len;
+	writer->num_msgs--;
+
+	return len;
+}
+
+
+/* Pull the oldest messages off the queue into writer->popped. If no messages in queue, wait until there is one.
+ *
+ * Without a batch callback only one message is popped at a time. With one, messages are popped until the next one
+ * would put the batch over max_batch_bytes (always at least one).
  *
  * If num_dropped isn't NULL, it will be set to the number of dropped messages since the last call to
  * pop().
  *
- * If this method returns NULL and sets cmd to 0, it means that we've received a stop request.
+ * Returns M_FALSE if we've received a stop request. Otherwise the number of messages popped is returned
+ * in num_popped, which may be 0 if there's only a command.
  */
-static char *pop_one(M_async_writer_t *writer, M_uint64 *num_dropped, M_uint64 *cmd)
+static M_bool pop_batch(M_async_writer_t *writer, size_t *num_popped, M_uint64 *num_dropped, M_uint64 *cmd)
 {
-	char *ret;
+	size_t batch_len = 0;
 
-	if (writer == NULL || cmd == NULL) {
-		return NULL;
+	*num_popped = 0;
+	*cmd        = 0;
+
+	if (writer->popped == NULL) {
+		writer->popped = M_buf_create();
 	}
+	M_buf_truncate(writer->popped, 0);
 
 	M_thread_mutex_lock(writer->lock);
 
@@ -122,7 +263,7 @@ static char *pop_one(M_async_writer_t *writer, M_uint64 *num_dropped, M_uint64 *
 	 *   (2) A stop or destroy request has been received.
 	 *   (3) A write command has been set, and force_command is true.
 	 */
-	while (M_llist_str_len(writer->msgs) == 0 && writer->state == M_ASYNC_WRITER_RUNNING
+	while (writer->num_msgs == 0 && writer->state == M_ASYNC_WRITER_RUNNING
 		&& (!writer->force_command || writer->write_command == 0)) {
 		M_thread_cond_wait(writer->cond_updated, writer->lock);
 
@@ -133,8 +274,30 @@ static char *pop_one(M_async_writer_t *writer, M_uint64 *num_dropped, M_uint64 *
 		}
 	}
 
+	/* Group commit: give writers a chance to fill up the batch before we deliver it. Don't delay stops, flushes or
+	 * forced commands.
+	 */
+	if (writer->batch_cb != NULL && writer->batch_delay_ms > 0 && writer->num_msgs > 0) {
+		M_timeval_t start;
+
+		M_time_elapsed_start(&start);
+		while (writer->state == M_ASYNC_WRITER_RUNNING && writer->stored_bytes < writer->batch_flush_bytes
+			&& (!writer->force_command || writer->write_command == 0)) {
+			M_uint64 elapsed = M_time_elapsed(&start);
+			if (elapsed >= writer->batch_delay_ms) {
+				break;
+			}
+			M_thread_cond_timedwait(writer->cond_updated, writer->lock, writer->batch_delay_ms - elapsed);
+
+			if (!writer->thread_alive) {
+				writer->thread_alive = M_TRUE;
+				M_thread_cond_broadcast(writer->cond_alive);
+			}
+		}
+	}
+
 	if (writer->state == M_ASYNC_WRITER_DESTROYING || writer->state == M_ASYNC_WRITER_STOPPED
-		|| (in_flush(writer) && M_llist_str_len(writer->msgs) == 0)) {
+		|| (in_flush(writer) && writer->num_msgs == 0)) {
 		if (num_dropped != NULL) {
 			if (writer->state == M_ASYNC_WRITER_STOPPED) {
 				/* If we're not destroying the writer, just leave number of dropped messages in writer. They can be
@@ -143,26 +306,45 @@ static char *pop_one(M_async_writer_t *writer, M_uint64 *num_dropped, M_uint64 *
 				*num_dropped = 0;
 			} else {
 				/* When exiting, include messages left in queue in number of dropped messages reported to caller. */
-				*num_dropped = writer->num_dropped + M_llist_str_len(writer->msgs);
+				*num_dropped = writer->num_dropped + writer->num_msgs;
 			}
 		}
 		M_thread_mutex_unlock(writer->lock);
-		/* Returning NULL and setting cmd to 0 tells the worker thread that we need to stop executing. */
-		*cmd = 0;
-		return NULL;
+		return M_FALSE;
 	}
 
-	if (M_llist_str_len(writer->msgs) > 0) {
-		ret = M_llist_str_take_node(M_llist_str_last(writer->msgs));
-		writer->stored_bytes -= M_str_len(ret);
+	while (writer->num_msgs > 0) {
+		size_t len;
+
+		if (*num_popped > 0) {
+			if (writer->batch_cb == NULL || batch_len + ring_front_len(writer) > writer->max_batch_bytes) {
+				break;
+			}
+		}
+
+		len = ring_pop_front(writer, writer->popped);
+		if (writer->batch_cb == NULL) {
+			break;
+		}
 
+		if (*num_popped == writer->popped_lens_size) {
+			writer->popped_lens_size = (writer->popped_lens_size == 0)? 64 : writer->popped_lens_size * 2;
+			writer->popped_lens      = M_realloc(writer->popped_lens, writer->popped_lens_size * sizeof(*writer->popped_lens));
+		}
+		writer->popped_lens[*num_popped] = len;
+		batch_len                       += len;
+		(*num_popped)++;
+	}
+	if (writer->batch_cb == NULL && M_buf_len(writer->popped) > 0) {
+		*num_popped = 1;
+	}
+
+	if (*num_popped > 0) {
 		/* Report number of dropped messages to caller, then reset the drop counter. */
 		if (num_dropped != NULL) {
 			*num_dropped = writer->num_dropped;
 		}
 		writer->num_dropped = 0;
-	} else {
-		ret = NULL;
 	}
 
 	/* Transfer any commands received by the message queue to the caller. */
@@ -170,43 +352,63 @@ static char *pop_one(M_async_writer_t *writer, M_uint64 *num_dropped, M_uint64 *
 	writer->write_command = 0;
 
 	M_thread_mutex_unlock(writer->lock);
-	return ret;
+	return M_TRUE;
 }
 
 
-/* If we popped a message, but then failed to write it, use this to add it back onto the back end of the queue,
+/* If we popped messages, but then failed to write them, use this to add them back onto the back end of the queue,
  * and update the number of dropped messages accordingly.
  */
-static void replace_one(M_async_writer_t *writer, char *msg, M_uint64 num_dropped)
+static void replace_batch(M_async_writer_t *writer, size_t num_popped, M_uint64 num_dropped)
 {
-	size_t msg_len = M_str_len(msg);
+	const char *msgs    = M_buf_peek(writer->popped);
+	size_t      msg_len = M_buf_len(writer->popped);
+	size_t      i;
 
-	if (writer == NULL || msg_len == 0) {
+	if (num_popped == 0) {
 		return;
 	}
 
 	M_thread_mutex_lock(writer->lock);
 
 	if (writer->num_dropped == 0 && writer->stored_bytes + msg_len <= writer->max_bytes) {
-		/* If no newer messages have been dropped in the time since we tried to write the old message,
-		 * and if we have room to add the old message back onto the tail end of the buffer:
+		/* If no newer messages have been dropped in the time since we tried to write the old messages,
+		 * and if we have room to add the old messages back onto the tail end of the buffer. Newest
+		 * goes back first so they end up in their original order.
 		 */
-		M_llist_str_insert_after(M_llist_str_last(writer->msgs), msg);
-		writer->stored_bytes += msg_len;
+		if (writer->batch_cb == NULL) {
+			ring_push_front(writer, msgs, msg_len);
+		} else {
+			for (i=num_popped; i-->0; ) {
+				msg_len -= writer->popped_lens[i];
+				ring_push_front(writer, msgs + msg_len, writer->popped_lens[i]);
+			}
+		}
 	} else {
-		/* If newer messages have been dropped, or if the old message won't fit in the queue,
-		 * just drop the old message.
+		/* If newer messages have been dropped, or if the old messages won't fit in the queue,
+		 * just drop the old messages.
 		 */
-		writer->num_dropped++;
+		writer->num_dropped += num_popped;
 	}
 
-	/* Add back the number of dropped messages present when we first tried to write the old message. */
+	/* Add back the number of dropped messages present when we first tried to write the old messages. */
 	writer->num_dropped += num_dropped;
 
 	M_thread_mutex_unlock(writer->lock);
 }
 
 
+/* Pass messages to whichever write callback we have. */
+static M_bool write_out(M_async_writer_t *writer, M_buf_t *msgs, size_t num_msgs, M_uint64 cmd)
+{
+	if (writer->batch_cb != NULL) {
+		return writer->batch_cb(msgs, num_msgs, cmd, writer->write_thunk);
+	}
+	/* Buffer is only read by the callback, it's just not declared const. */
+	return writer->write_cb((num_msgs == 0)? NULL : (char *)((M_uintptr)M_buf_peek(msgs)), cmd, writer->write_thunk);
+}
+
+
 static void *write_thread(void *arg)
 {
 	M_async_writer_t *writer      = arg;
@@ -214,41 +416,43 @@ static void *write_thread(void *arg)
 	M_bool            destroying;
 
 	while (M_TRUE) {
-		char     *msg;
+		size_t    num_popped   = 0;
 		M_uint64  cmd          = 0;
+		M_bool    running;
 		M_bool    msg_consumed = M_TRUE;
 
-		/* Wait until at least one message is available, then pop the oldest one from the queue.
+		/* Wait until at least one message is available, then pop the oldest ones from the queue.
 		 *
-		 * Returns the number of dropped messages before this message, and resets the internal dropped message
+		 * Returns the number of dropped messages before these messages, and resets the internal dropped message
 		 * counter to zero.
 		 */
 		num_dropped = 0;
-		msg         = pop_one(writer, &num_dropped, &cmd);
+		running     = pop_batch(writer, &num_popped, &num_dropped, &cmd);
 
 		/* If any messages were dropped, write a message about it. Do this before exit check so that we
 		 * can report any remaining messages in queue as dropped on exit.
 		 */
 		if (num_dropped > 0) {
-			char tmp[128];
-			M_snprintf(tmp, sizeof(tmp), "%llu messages were dropped (%s)%s", num_dropped,
-				(msg == NULL && cmd == 0)? "log shutdown" : "buffer full", writer->line_end);
-			msg_consumed = writer->write_cb(tmp, 0, writer->write_thunk);
+			M_buf_t *tmp = M_buf_create();
+			M_bprintf(tmp, "%llu messages were dropped (%s)%s", num_dropped,
+				(!running)? "log shutdown" : "buffer full", writer->line_end);
+			msg_consumed = write_out(writer, tmp, 1, 0);
+			M_buf_cancel(tmp);
 		}
 
-		/* NULL message and 0 command indicates that message queue wants us to stop processing. */
-		if (msg == NULL && cmd == 0) {
+		/* Message queue wants us to stop processing. */
+		if (!running) {
 			break;
 		}
 
-		/* Pass the next message to the writer. If we got a NULL message with an attached command, we need
+		/* Pass the next messages to the writer. If we got no messages but an attached command, we need
 		 * to call the writer in that case too.
 		 *
 		 * If we already tried sending a drop message and it wasn't accepted, don't bother trying to send
-		 * a message again.
+		 * messages again.
 		 */
 		if (msg_consumed) {
-			msg_consumed = writer->write_cb(msg, cmd, writer->write_thunk);
+			msg_consumed = write_out(writer, writer->popped, num_popped, cmd);
 			/* If a command was set, signal that it's done (in case anyone is blocking on it). */
 			if (cmd != 0) {
 				M_thread_mutex_lock(writer->lock);
@@ -258,14 +462,12 @@ static void *write_thread(void *arg)
 			}
 		}
 
-		/* If either the drop message wasn't accepted, or the main message wasn't accepted, replace the
-		 * message on the queue and correct the number of dropped messages.
+		/* If either the drop message wasn't accepted, or the main messages weren't accepted, replace the
+		 * messages on the queue and correct the number of dropped messages.
 		 */
-		if (!msg_consumed && msg != NULL) {
-			replace_one(writer, msg, num_dropped);
+		if (!msg_consumed) {
+			replace_batch(writer, num_popped, num_dropped);
 		}
-
-		M_free(msg);
 	}
 
 	/* Set flag and notify any listening threads that the internal thread has finished. */
@@ -299,16 +501,12 @@ static void *write_thread(void *arg)
 
 /* --------- PUBLIC API ------------ */
 
-M_async_writer_t *M_async_writer_create(size_t max_bytes, M_async_write_cb_t write_cb,
-	void *write_thunk, M_async_thunk_stop_cb_t stop_cb, M_async_thunk_destroy_cb_t destroy_cb,
+static M_async_writer_t *create_int(size_t max_bytes, M_async_write_cb_t write_cb, M_async_write_batch_cb_t batch_cb,
+	size_t max_batch_bytes, void *write_thunk, M_async_thunk_stop_cb_t stop_cb, M_async_thunk_destroy_cb_t destroy_cb,
 	M_async_writer_line_end_mode_t mode)
 {
 	M_async_writer_t *writer;
 
-	if (write_cb == NULL) {
-		return NULL;
-	}
-
 	writer = M_malloc_zero(sizeof(*writer));
 
 	writer->max_bytes      = max_bytes;
@@ -318,13 +516,14 @@ M_async_writer_t *M_async_writer_create(size_t max_bytes, M_async_write_cb_t wri
 	writer->cond_done      = M_thread_cond_create(M_THREAD_CONDATTR_NONE);
 	writer->cond_alive     = M_thread_cond_create(M_THREAD_CONDATTR_NONE);
 	writer->write_cb       = write_cb;
+	writer->batch_cb       = batch_cb;
 	writer->write_thunk    = write_thunk;
 	writer->stop_cb        = stop_cb;
 	writer->destroy_cb     = destroy_cb;
 	writer->state          = M_ASYNC_WRITER_STOPPED;
 	writer->command_done   = M_TRUE;
 
-	writer->msgs = M_llist_str_create(M_LLIST_STR_NONE);
+	writer->max_batch_bytes = (max_batch_bytes == 0)? 64 * 1024 : max_batch_bytes;
 
 	switch(mode) {
 		case M_LOG_LINE_END_WINDOWS:
@@ -346,6 +545,28 @@ M_async_writer_t *M_async_writer_create(size_t max_bytes, M_async_write_cb_t wri
 }
 
 
+M_async_writer_t *M_async_writer_create(size_t max_bytes, M_async_write_cb_t write_cb,
+	void *write_thunk, M_async_thunk_stop_cb_t stop_cb, M_async_thunk_destroy_cb_t destroy_cb,
+	M_async_writer_line_end_mode_t mode)
+{
+	if (write_cb == NULL) {
+		return NULL;
+	}
+	return create_int(max_bytes, write_cb, NULL, 0, write_thunk, stop_cb, destroy_cb, mode);
+}
+
+
+M_async_writer_t *M_async_writer_create_batch(size_t max_bytes, size_t max_batch_bytes,
+	M_async_write_batch_cb_t batch_cb, void *write_thunk, M_async_thunk_stop_cb_t stop_cb,
+	M_async_thunk_destroy_cb_t destroy_cb, M_async_writer_line_end_mode_t mode)
+{
+	if (batch_cb == NULL) {
+		return NULL;
+	}
+	return create_int(max_bytes, NULL, batch_cb, max_batch_bytes, write_thunk, stop_cb, destroy_cb, mode);
+}
+
+
 void M_async_writer_destroy(M_async_writer_t *writer, M_bool flush)
 {
 	if (writer == NULL) {
@@ -622,6 +843,24 @@ void M_async_writer_set_max_bytes(M_async_writer_t *writer, size_t max_bytes)
 }
 
 
+void M_async_writer_set_batch_delay(M_async_writer_t *writer, size_t flush_bytes, M_uint64 delay_ms)
+{
+	if (writer == NULL) {
+		return;
+	}
+
+	M_thread_mutex_lock(writer->lock);
+
+	writer->batch_flush_bytes = M_MIN(flush_bytes, writer->max_batch_bytes);
+	writer->batch_delay_ms    = delay_ms;
+
+	/* Wake up the worker, in case it's currently delaying a batch with the old settings. */
+	M_thread_cond_broadcast(writer->cond_updated);
+
+	M_thread_mutex_unlock(writer->lock);
+}
+
+
 M_bool M_async_writer_write(M_async_writer_t *writer, const char *msg)
 {
 	M_bool msg_added = M_FALSE;
@@ -651,34 +890,24 @@ M_bool M_async_writer_write(M_async_writer_t *writer, const char *msg)
 		goto done;
 	}
 
-	/* Insert message into queue. If insertion failed, drop the message. */
-	if (M_llist_str_insert_first(writer->msgs, msg) == NULL) {
+	/* If adding the new message will exceed our queue size limit, drop oldest messages until we have room. */
+	while (writer->stored_bytes + msg_len > writer->max_bytes) {
+		ring_pop_front(writer, NULL);
 		if (writer->num_dropped < M_UINT64_MAX) {
 			writer->num_dropped++;
 		}
-		goto done;
 	}
 
+	/* Insert message into queue. */
+	ring_push_back(writer, msg, msg_len);
 	msg_added = M_TRUE;
 
-	/* If adding the new message will exceed our queue size limit, drop oldest messages until we have room. */
-	writer->stored_bytes += msg_len;
-	while (writer->stored_bytes > writer->max_bytes) {
-		char   *old;
-		size_t  old_len;
-
-		old     = M_llist_str_take_node(M_llist_str_last(writer->msgs));
-		old_len = M_str_len(old);
-		M_free(old);
-
-		writer->stored_bytes -= old_len;
-		if (writer->num_dropped < M_UINT64_MAX) {
-			writer->num_dropped++;
-		}
-	};
-
 	done:
-	if (msg_added) {
+	/* Worker only waits on an empty queue, or while delaying a batch that hasn't reached the flush size yet. Don't
+	 * wake it up for every single message otherwise.
+	 */
+	if (msg_added && (writer->num_msgs == 1
+		|| (writer->batch_delay_ms > 0 && writer->stored_bytes >= writer->batch_flush_bytes))) {
 		M_thread_cond_broadcast(writer->cond_updated);
 	}
 	M_thread_mutex_unlock(writer->lock);
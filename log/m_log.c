@@ -108,11 +108,11 @@ static void log_module_destroy(void *modptr)
 }
 
 
-/* Returns NULL if the given time format was invalid.
+/* Returns NULL if the given time format was invalid. If tv is NULL, the current time is used.
  *
  * TODO: update M_time_to_str() to provide the functionality we need for this (will need to support useconds)
  */
-static char *get_current_time_str(const char *time_format, size_t *out_len)
+static char *get_current_time_str(const char *time_format, const M_timeval_t *tv_in, size_t *out_len)
 {
 	static const char *days_of_week[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 	static const char *months_of_year[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul",
@@ -138,7 +138,11 @@ static char *get_current_time_str(const char *time_format, size_t *out_len)
 
 	/* Get current time. Use gettimeofday so we have access to microseconds. */
 	M_mem_set(&tv, 0, sizeof(tv));
-	M_time_gettimeofday(&tv);
+	if (tv_in != NULL) {
+		M_mem_copy(&tv, tv_in, sizeof(tv));
+	} else {
+		M_time_gettimeofday(&tv);
+	}
 	M_time_tolocal(tv.tv_sec, &ltime, NULL);
 
 	abs_gmtoff = M_ABS(ltime.gmtoff);
@@ -278,7 +282,7 @@ M_log_t *M_log_create(M_log_line_end_mode_t mode, M_bool flush_on_destroy, M_eve
 	log->flush_on_destroy     = flush_on_destroy;
 	log->line_end_str         = line_end_to_str(mode);
 	log->time_format          = M_strdup("%a %D %H:%m:%s.%u %z");
-	log->lock                 = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	log->lock                 = M_thread_mutex_create(M_THREAD_MUTEXATTR_ADAPTIVE);
 	log->event                = event;
 
 	return log;
@@ -291,6 +295,10 @@ void M_log_destroy(M_log_t *log)
 		return;
 	}
 
+	/* Stop the formatter and write out anything it hasn't gotten to yet while the modules are still around. */
+	log_deferred_destroy(log->deferred);
+	log->deferred = NULL;
+
 	M_llist_destroy(log->modules, M_TRUE); /* calls log_module_destroy() on each module */
 	M_free(log->time_format);
 	M_thread_mutex_destroy(log->lock);
@@ -312,6 +320,10 @@ void M_log_destroy_blocking(M_log_t *log, M_uint64 timeout_ms)
 
 	M_time_elapsed_start(&t);
 
+	/* Deferred messages have to be written before the modules go away. */
+	log_deferred_destroy(log->deferred);
+	log->deferred = NULL;
+
 	M_thread_mutex_lock(log->lock);
 
 	/* Destroy each log module's thunk (blocking, if possible). */
@@ -358,7 +370,7 @@ M_log_error_t M_log_set_time_format(M_log_t *log, const char *fmt)
 	}
 
 	/* Only let the time format be changed if the new format is valid. */
-	test_str = get_current_time_str(fmt, NULL);
+	test_str = get_current_time_str(fmt, NULL, NULL);
 	if (test_str == NULL) {
 		return M_LOG_INVALID_TIME_FORMAT;
 	}
@@ -496,16 +508,55 @@ M_log_error_t M_log_set_tag_names_padded(M_log_t *log, M_bool padded)
 		return M_LOG_INVALID_PARAMS;
 	}
 
-	M_thread_mutex_lock(log->lock);
+	/* Only a flag, no need to wait for writers to finish with the lock. */
+	M_atomic_store_u32_explicit(&log->pad_names, padded ? 1 : 0, M_ATOMIC_ORDER_RELAXED);
 
-	log->pad_names = padded;
+	return M_LOG_SUCCESS;
+}
+
+
+M_bool M_log_tag_enabled(M_log_t *log, M_uint64 tag)
+{
+	if (log == NULL) {
+		return M_FALSE;
+	}
+
+	/* Lock free on purpose. A module changing its tags at the same time may or may not see this message. */
+	return (M_atomic_load_u64_explicit(&log->accepted_tags, M_ATOMIC_ORDER_RELAXED) & tag) != 0;
+}
 
-	M_thread_mutex_unlock(log->lock);
+
+M_log_error_t M_log_set_deferred(M_log_t *log, size_t thread_buf_size)
+{
+	if (log == NULL || log->deferred != NULL) {
+		return M_LOG_INVALID_PARAMS;
+	}
+
+	if (thread_buf_size == 0) {
+		thread_buf_size = 64 * 1024;
+	} else if (thread_buf_size < 4096) {
+		thread_buf_size = 4096;
+	}
+
+	log->deferred = log_deferred_create(log, thread_buf_size);
+	if (log->deferred == NULL) {
+		return M_LOG_GENERIC_FAIL;
+	}
 
 	return M_LOG_SUCCESS;
 }
 
 
+void M_log_deferred_flush(M_log_t *log)
+{
+	if (log == NULL || log->deferred == NULL) {
+		return;
+	}
+
+	log_deferred_flush(log->deferred);
+}
+
+
 M_log_error_t M_log_printf(M_log_t *log, M_uint64 tag, void *msg_thunk, const char *fmt, ...)
 {
 	M_log_error_t ret;
@@ -524,6 +575,24 @@ M_log_error_t M_log_vprintf(M_log_t *log, M_uint64 tag, void *msg_thunk, const c
 	M_log_error_t  ret;
 	char          *msg;
 
+	if (log == NULL || fmt == NULL) {
+		return M_LOG_INVALID_PARAMS;
+	}
+
+	if (!M_uint64_is_power_of_two(tag)) {
+		return M_LOG_INVALID_TAG;
+	}
+
+	/* Nothing wants this tag, don't bother formatting it. */
+	if (!M_log_tag_enabled(log, tag)) {
+		return M_LOG_SUCCESS;
+	}
+
+	/* Hand the raw arguments off, formatting happens on the formatter thread. */
+	if (log->deferred != NULL) {
+		return log_deferred_vprintf(log->deferred, tag, fmt, ap);
+	}
+
 	/* Expand message string for this log entry from the format string. */
 	M_vasprintf(&msg, fmt, ap);
 
@@ -536,6 +605,28 @@ M_log_error_t M_log_vprintf(M_log_t *log, M_uint64 tag, void *msg_thunk, const c
 
 
 M_log_error_t M_log_write(M_log_t *log, M_uint64 tag, void *msg_thunk, const char *msg)
+{
+	if (log == NULL || msg == NULL) {
+		return M_LOG_INVALID_PARAMS;
+	}
+
+	if (!M_uint64_is_power_of_two(tag)) {
+		return M_LOG_INVALID_TAG;
+	}
+
+	if (!M_log_tag_enabled(log, tag)) {
+		return M_LOG_SUCCESS;
+	}
+
+	if (log->deferred != NULL) {
+		return log_deferred_write(log->deferred, tag, msg);
+	}
+
+	return log_write_at(log, tag, msg_thunk, msg, NULL);
+}
+
+
+M_log_error_t log_write_at(M_log_t *log, M_uint64 tag, void *msg_thunk, const char *msg, const M_timeval_t *tv)
 {
 	M_log_error_t   ret          = M_LOG_SUCCESS;
 	M_llist_node_t *node         = NULL;
@@ -560,7 +651,7 @@ M_log_error_t M_log_write(M_log_t *log, M_uint64 tag, void *msg_thunk, const cha
 	M_thread_mutex_lock(log->lock);
 
 	/* Construct time string for this log message (log must be locked when we do this, format string can change). */
-	time_str = get_current_time_str(log->time_format, &time_str_len);
+	time_str = get_current_time_str(log->time_format, tv, &time_str_len);
 	if (time_str == NULL) {
 		ret = M_LOG_INVALID_TIME_FORMAT;
 		goto done;
@@ -610,6 +701,7 @@ M_log_error_t M_log_write(M_log_t *log, M_uint64 tag, void *msg_thunk, const cha
 					expired_mods = M_llist_create(NULL, M_LLIST_NONE);
 				}
 				M_llist_insert(expired_mods, mod);
+				log_update_accepted_tags_locked(log);
 
 				continue;
 			}
@@ -630,7 +722,7 @@ M_log_error_t M_log_write(M_log_t *log, M_uint64 tag, void *msg_thunk, const cha
 				M_buf_add_str(buf, " [");
 				M_buf_add_bytes(buf, name_str, name_str_len);
 				M_buf_add_str(buf, "]");
-				if (log->pad_names && mod->allow_tag_padding && name_str_len < log->max_name_width) {
+				if (M_atomic_load_u32_explicit(&log->pad_names, M_ATOMIC_ORDER_RELAXED) && mod->allow_tag_padding && name_str_len < log->max_name_width) {
 					M_buf_add_fill(buf, ' ', log->max_name_width - name_str_len);
 				}
 			}
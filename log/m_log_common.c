@@ -44,6 +44,27 @@ M_bool module_present_locked(M_log_t *log, M_log_module_t *module)
 void module_remove_locked(M_log_t *log, M_log_module_t *module)
 {
 	M_llist_remove_val(log->modules, module, M_LLIST_MATCH_VAL);
+	log_update_accepted_tags_locked(log);
+}
+
+
+void log_update_accepted_tags_locked(M_log_t *log)
+{
+	M_llist_node_t *node;
+	M_uint64        tags = 0;
+
+	node = M_llist_first(log->modules);
+	while (node != NULL) {
+		M_log_module_t *mod = M_llist_node_val(node);
+
+		if (mod->module_write_cb != NULL) {
+			tags |= mod->accepted_tags;
+		}
+		node = M_llist_node_next(node);
+	}
+
+	/* Readers only use this to skip messages early, they don't need to see it right away. */
+	M_atomic_store_u64_explicit(&log->accepted_tags, tags, M_ATOMIC_ORDER_RELAXED);
 }
 
 
@@ -104,6 +125,7 @@ M_log_error_t M_log_module_set_accepted_tags(M_log_t *log, M_log_module_t *modul
 	}
 
 	module->accepted_tags = tags;
+	log_update_accepted_tags_locked(log);
 
 	M_thread_mutex_unlock(log->lock);
 	return M_LOG_SUCCESS;
@@ -0,0 +1,938 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Deferred formatting for M_log.
+ *
+ * Callers don't format anything. The tag, timestamp, format string pointer and the raw
+ * arguments are serialized into a byte ring owned by the calling thread. A background
+ * thread drains the rings, merges them by timestamp, formats each message and hands it
+ * to the normal write path.
+ *
+ * Each thread gets its own ring so the only shared state on the hot path is the
+ * ring's head and tail (single producer, single consumer). Rings are found by thread
+ * id in a fixed open addressed table. When a thread exits, its ring is drained and
+ * freed and the slot is marked free (not empty, so probing for other threads doesn't
+ * stop there) for the next new thread to claim. A producer that finds its ring full
+ * sleeps until the formatter has made room.
+ *
+ * Arguments are decoded with the same rules as M_str_fmt uses so the va_list is
+ * consumed exactly as M_vasprintf would. At format time each conversion is rebuilt
+ * into its own small format string ('*' replaced by the captured value) and printed
+ * with its single argument.
+ */
+#include "m_config.h"
+#include <m_log_int.h>
+
+/* Record types. A pad record fills the end of the ring when the next record doesn't fit. */
+typedef enum {
+	M_LOG_DEFERRED_REC_PAD = 0,
+	M_LOG_DEFERRED_REC_FMT,     /* Format string + serialized args. */
+	M_LOG_DEFERRED_REC_STR      /* Preformatted message (M_log_write). */
+} M_log_deferred_rec_type_t;
+
+/* Argument classes. These are the types pulled off the va_list. */
+typedef enum {
+	M_LOG_DEFERRED_ARG_NONE = 0, /* %%, or a malformed conversion (no value consumed). */
+	M_LOG_DEFERRED_ARG_INT,
+	M_LOG_DEFERRED_ARG_LONG,
+	M_LOG_DEFERRED_ARG_LONGLONG,
+	M_LOG_DEFERRED_ARG_SIZET,
+	M_LOG_DEFERRED_ARG_VOIDP,
+	M_LOG_DEFERRED_ARG_DOUBLE,
+	M_LOG_DEFERRED_ARG_STR
+} M_log_deferred_arg_t;
+
+/* Length modifiers, mirrors M_str_fmt's data types. */
+typedef enum {
+	M_LOG_DEFERRED_LEN_INT = 0,
+	M_LOG_DEFERRED_LEN_SHORT,
+	M_LOG_DEFERRED_LEN_CHAR,
+	M_LOG_DEFERRED_LEN_LONG,
+	M_LOG_DEFERRED_LEN_LONGLONG,
+	M_LOG_DEFERRED_LEN_SIZET
+} M_log_deferred_len_t;
+
+/* Fixed part of a record. Records are copied in and out with M_mem_copy, so the ring
+ * doesn't need to care about alignment. len is the total size of the record including
+ * payload, rounded up to M_LOG_DEFERRED_ALIGN. */
+typedef struct {
+	M_uint32     len;
+	M_uint32     type;
+	M_uint64     tag;
+	M_timeval_t  tv;
+	const char  *fmt;
+} M_log_deferred_rec_t;
+
+#define M_LOG_DEFERRED_ALIGN     8
+#define M_LOG_DEFERRED_CACHELINE 64
+
+/* Thread table slot ids. 0 has never been used, FREE belonged to a thread that has exited. */
+#define M_LOG_DEFERRED_ID_EMPTY  0
+#define M_LOG_DEFERRED_ID_FREE   M_UINT64_MAX
+
+typedef struct {
+	unsigned char      pad0[M_LOG_DEFERRED_CACHELINE];
+
+	/* Producer side. */
+	volatile M_uint64  tail;
+	M_uint64           head_cache;
+	M_buf_t           *scratch;     /* Serialized args are built here before being copied into the ring. */
+	unsigned char      pad1[M_LOG_DEFERRED_CACHELINE - (sizeof(M_uint64) * 2) - sizeof(M_buf_t *)];
+
+	/* Consumer side. */
+	volatile M_uint64  head;
+	unsigned char      pad2[M_LOG_DEFERRED_CACHELINE - sizeof(M_uint64)];
+
+	/* Read only after create. */
+	size_t             size;
+	unsigned char     *data;
+} M_log_deferred_ring_t;
+
+struct M_log_deferred {
+	M_log_t                        *log;
+	size_t                          ring_size;
+
+	/* Thread id -> ring. Slots are claimed with a CAS on the id and released when the
+	 * thread exits (under drain_lock). */
+	volatile M_uint64               ids[M_LOG_DEFERRED_MAX_THREADS];
+	M_log_deferred_ring_t * volatile rings[M_LOG_DEFERRED_MAX_THREADS];
+
+	/* Formatter thread. */
+	M_thread_mutex_t               *lock;
+	M_thread_cond_t                *cond;
+	M_bool                          stop;
+	M_bool                          wake;       /* A producer is waiting on room, drain now. */
+	M_threadid_t                    thread;
+
+	/* Producers waiting for room in their ring. Protected by lock, waiters is also read
+	 * without it by the drainer to skip the broadcast when nobody is waiting. */
+	M_thread_cond_t                *space_cond;
+	volatile M_uint32               waiters;
+
+	/* Only one drain at a time (formatter thread, an explicit flush or a message that
+	 * has to be written synchronously). Everything below is protected by it. */
+	M_thread_mutex_t               *drain_lock;
+	M_buf_t                        *msg;
+	M_log_deferred_ring_t          *drain_rings[M_LOG_DEFERRED_MAX_THREADS];
+	M_uint64                        drain_limits[M_LOG_DEFERRED_MAX_THREADS];
+
+	M_llist_node_t                 *registry_node; /* Protected by deferred_registry_lock. */
+};
+
+/* All deferred objects, so an exiting thread can release its rings. */
+static M_thread_once_t   deferred_registry_once = M_THREAD_ONCE_STATIC_INITIALIZER;
+static M_thread_mutex_t *deferred_registry_lock = NULL;
+static M_llist_t        *deferred_registry      = NULL;
+
+
+/* ---- PRIVATE: format parsing ---- */
+
+/* Scan a single conversion specification. fmt points just past the '%'.
+ *
+ * Follows M_str_fmt_handle_control() so that the same arguments are consumed, including
+ * its handling of malformed conversions. Returns the number of bytes the specification
+ * takes up. Each '*' in it consumes an int before the value.
+ */
+static size_t deferred_scan_spec(const char *fmt, M_log_deferred_arg_t *type)
+{
+	M_log_deferred_len_t len_type = M_LOG_DEFERRED_LEN_INT;
+	M_bool               have_len = M_FALSE;
+	size_t               i        = 0;
+	char                 b;
+
+	*type = M_LOG_DEFERRED_ARG_NONE;
+
+	if (fmt[0] == '\0') {
+		return 0;
+	}
+	if (fmt[0] == '%') {
+		return 1;
+	}
+
+	while (fmt[i] == '-' || fmt[i] == '+' || fmt[i] == '#' || fmt[i] == '0' || fmt[i] == ' ') {
+		i++;
+	}
+
+	while (fmt[i] != '\0') {
+		b = fmt[i++];
+		switch (b) {
+			case '.':
+				if (have_len) {
+					return i;
+				}
+				have_len = M_TRUE;
+				break;
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+			case '*':
+				break;
+			case 'h':
+				if (len_type != M_LOG_DEFERRED_LEN_INT && len_type != M_LOG_DEFERRED_LEN_SHORT) {
+					return i;
+				}
+				len_type = (len_type != M_LOG_DEFERRED_LEN_INT)? M_LOG_DEFERRED_LEN_SHORT : M_LOG_DEFERRED_LEN_CHAR;
+				break;
+			case 'l':
+				if (len_type != M_LOG_DEFERRED_LEN_INT && len_type != M_LOG_DEFERRED_LEN_LONG) {
+					return i;
+				}
+				len_type = (len_type == M_LOG_DEFERRED_LEN_LONG)? M_LOG_DEFERRED_LEN_LONGLONG : M_LOG_DEFERRED_LEN_LONG;
+				break;
+			case 'I':
+				if (fmt[i] != '\0' && fmt[i+1] != '\0') {
+					if (len_type != M_LOG_DEFERRED_LEN_INT) {
+						return i;
+					}
+					if (fmt[i] == '6' && fmt[i+1] == '4') {
+						len_type = M_LOG_DEFERRED_LEN_LONGLONG;
+						i       += 2;
+					} else if (fmt[i] == '3' && fmt[i+1] == '2') {
+						i       += 2;
+					}
+					break;
+				}
+				/* Falls through. */
+			case 'z':
+				if (len_type != M_LOG_DEFERRED_LEN_INT) {
+					return i;
+				}
+				len_type = M_LOG_DEFERRED_LEN_SIZET;
+				break;
+			case 'd': case 'i': case 'o': case 'O': case 'u': case 'x': case 'X':
+				switch (len_type) {
+					case M_LOG_DEFERRED_LEN_INT:
+					case M_LOG_DEFERRED_LEN_SHORT:
+					case M_LOG_DEFERRED_LEN_CHAR:
+						*type = M_LOG_DEFERRED_ARG_INT;
+						break;
+					case M_LOG_DEFERRED_LEN_LONG:
+						*type = M_LOG_DEFERRED_ARG_LONG;
+						break;
+					case M_LOG_DEFERRED_LEN_LONGLONG:
+						*type = M_LOG_DEFERRED_ARG_LONGLONG;
+						break;
+					case M_LOG_DEFERRED_LEN_SIZET:
+						*type = M_LOG_DEFERRED_ARG_SIZET;
+						break;
+				}
+				return i;
+			case 'p': case 'P':
+				*type = M_LOG_DEFERRED_ARG_VOIDP;
+				return i;
+			case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+				*type = M_LOG_DEFERRED_ARG_DOUBLE;
+				return i;
+			case 'c':
+				*type = M_LOG_DEFERRED_ARG_INT;
+				return i;
+			case 's':
+				*type = M_LOG_DEFERRED_ARG_STR;
+				return i;
+			default:
+				return i;
+		}
+	}
+
+	/* Format ended in the middle of a conversion. */
+	return i;
+}
+
+
+/* ---- PRIVATE: rings ---- */
+
+static M_log_deferred_ring_t *deferred_ring_create(size_t size)
+{
+	M_log_deferred_ring_t *ring;
+
+	ring          = M_malloc_zero(sizeof(*ring));
+	ring->size    = size;
+	ring->data    = M_malloc(size);
+	ring->scratch = M_buf_create();
+
+	return ring;
+}
+
+
+static void deferred_ring_destroy(M_log_deferred_ring_t *ring)
+{
+	if (ring == NULL) {
+		return;
+	}
+	M_buf_cancel(ring->scratch);
+	M_free(ring->data);
+	M_free(ring);
+}
+
+
+/* Find (or create) the calling thread's ring. Returns NULL if the table is full. */
+static M_log_deferred_ring_t *deferred_ring_get(M_log_deferred_t *d)
+{
+	M_uint64 id    = (M_uint64)M_thread_self();
+	size_t   start = (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 32) & (M_LOG_DEFERRED_MAX_THREADS - 1);
+	size_t   i;
+
+	while (1) {
+		size_t   claim     = M_LOG_DEFERRED_MAX_THREADS;
+		M_uint64 claim_val = M_LOG_DEFERRED_ID_EMPTY;
+
+		for (i=0; i<M_LOG_DEFERRED_MAX_THREADS; i++) {
+			size_t   idx  = (start + i) & (M_LOG_DEFERRED_MAX_THREADS - 1);
+			M_uint64 slot = M_atomic_load_u64(&d->ids[idx]);
+
+			/* Only the thread with this id ever claims or looks up this slot, and it set
+			 * the ring before returning, so it's always there. */
+			if (slot == id) {
+				return M_atomic_load_ptr((void * volatile *)&d->rings[idx]);
+			}
+
+			if (slot == M_LOG_DEFERRED_ID_FREE || slot == M_LOG_DEFERRED_ID_EMPTY) {
+				if (claim == M_LOG_DEFERRED_MAX_THREADS) {
+					claim     = idx;
+					claim_val = slot;
+				}
+				/* Slots never go back to empty so we can't be past here. */
+				if (slot == M_LOG_DEFERRED_ID_EMPTY) {
+					break;
+				}
+			}
+		}
+
+		if (claim == M_LOG_DEFERRED_MAX_THREADS) {
+			return NULL;
+		}
+
+		/* If someone else took it, look again. */
+		if (M_atomic_cas64(&d->ids[claim], claim_val, id)) {
+			M_log_deferred_ring_t *ring = deferred_ring_create(d->ring_size);
+			M_atomic_store_ptr((void * volatile *)&d->rings[claim], ring);
+			return ring;
+		}
+	}
+}
+
+
+/* Block until the formatter has made room for need bytes past tail. */
+static void deferred_ring_wait(M_log_deferred_t *d, M_log_deferred_ring_t *ring, M_uint64 tail, size_t need)
+{
+	M_thread_mutex_lock(d->lock);
+	M_atomic_inc_u32(&d->waiters);
+	d->wake = M_TRUE;
+	M_thread_cond_signal(d->cond);
+	while (ring->size - (tail - M_atomic_load_u64(&ring->head)) < need) {
+		M_thread_cond_wait(d->space_cond, d->lock);
+	}
+	M_atomic_dec_u32(&d->waiters);
+	M_thread_mutex_unlock(d->lock);
+}
+
+
+/* Copy a record into the ring. Returns M_FALSE if it's too big to be queued. */
+static M_bool deferred_ring_put(M_log_deferred_t *d, M_log_deferred_ring_t *ring, M_log_deferred_rec_t *rec, const unsigned char *payload, size_t payload_len)
+{
+	size_t   len  = (sizeof(*rec) + payload_len + (M_LOG_DEFERRED_ALIGN - 1)) & ~((size_t)M_LOG_DEFERRED_ALIGN - 1);
+	M_uint64 tail = ring->tail; /* Only written by us. */
+	size_t   off;
+	size_t   need;
+
+	/* Don't let a single message take more than half the ring, it would stall everyone. */
+	if (len > ring->size / 2) {
+		return M_FALSE;
+	}
+
+	off  = (size_t)(tail & (ring->size - 1));
+	need = len;
+	if (ring->size - off < len) {
+		need += ring->size - off;
+	}
+
+	while (ring->size - (tail - ring->head_cache) < need) {
+		ring->head_cache = M_atomic_load_u64(&ring->head);
+		if (ring->size - (tail - ring->head_cache) >= need) {
+			break;
+		}
+		/* Full, wake the formatter and wait for it to make room. */
+		deferred_ring_wait(d, ring, tail, need);
+	}
+
+	if (need != len) {
+		M_log_deferred_rec_t pad;
+
+		pad.len  = (M_uint32)(ring->size - off);
+		pad.type = M_LOG_DEFERRED_REC_PAD;
+		M_mem_copy(ring->data + off, &pad, sizeof(pad.len) + sizeof(pad.type));
+		tail += pad.len;
+		off   = 0;
+	}
+
+	rec->len = (M_uint32)len;
+	M_mem_copy(ring->data + off, rec, sizeof(*rec));
+	if (payload_len > 0) {
+		M_mem_copy(ring->data + off + sizeof(*rec), payload, payload_len);
+	}
+
+	/* Publish. */
+	M_atomic_store_u64(&ring->tail, tail + len);
+	return M_TRUE;
+}
+
+
+/* ---- PRIVATE: formatting ---- */
+
+static const unsigned char *deferred_get_u64(const unsigned char *p, M_uint64 *val)
+{
+	M_mem_copy(val, p, sizeof(*val));
+	return p + sizeof(*val);
+}
+
+
+/* Format a captured record into d->msg. */
+static void deferred_format(M_log_deferred_t *d, const char *fmt, const unsigned char *p)
+{
+	M_buf_t *msg = d->msg;
+
+	M_buf_truncate(msg, 0);
+
+	while (*fmt != '\0') {
+		const char           *start = fmt;
+		M_log_deferred_arg_t  type;
+		size_t                spec_len;
+		char                  spec[128];
+		size_t                spec_pos;
+		size_t                i;
+		M_uint64              val;
+
+		while (*fmt != '\0' && *fmt != '%') {
+			fmt++;
+		}
+		if (fmt != start) {
+			M_buf_add_bytes(msg, start, (size_t)(fmt - start));
+		}
+		if (*fmt == '\0') {
+			break;
+		}
+
+		fmt++;
+		spec_len = deferred_scan_spec(fmt, &type);
+
+		/* Rebuild the conversion with any '*' replaced by the captured value. */
+		spec[0]  = '%';
+		spec_pos = 1;
+		for (i=0; i<spec_len && spec_pos < sizeof(spec) - 24; i++) {
+			if (fmt[i] == '*') {
+				p = deferred_get_u64(p, &val);
+				/* Negative values are ignored, same as M_str_fmt. */
+				if ((M_int64)val > 0) {
+					spec_pos += M_snprintf(spec + spec_pos, sizeof(spec) - spec_pos, "%lld", (M_int64)val);
+				}
+			} else {
+				spec[spec_pos++] = fmt[i];
+			}
+		}
+		spec[spec_pos] = '\0';
+		fmt           += spec_len;
+
+		switch (type) {
+			case M_LOG_DEFERRED_ARG_NONE:
+				M_bprintf(msg, spec, NULL);
+				break;
+			case M_LOG_DEFERRED_ARG_INT:
+				p = deferred_get_u64(p, &val);
+				M_bprintf(msg, spec, (int)(M_int64)val);
+				break;
+			case M_LOG_DEFERRED_ARG_LONG:
+				p = deferred_get_u64(p, &val);
+				M_bprintf(msg, spec, (long)(M_int64)val);
+				break;
+			case M_LOG_DEFERRED_ARG_LONGLONG:
+				p = deferred_get_u64(p, &val);
+				M_bprintf(msg, spec, (M_int64)val);
+				break;
+			case M_LOG_DEFERRED_ARG_SIZET:
+				p = deferred_get_u64(p, &val);
+				M_bprintf(msg, spec, (size_t)val);
+				break;
+			case M_LOG_DEFERRED_ARG_VOIDP:
+				p = deferred_get_u64(p, &val);
+				M_bprintf(msg, spec, (void *)(M_uintptr)val);
+				break;
+			case M_LOG_DEFERRED_ARG_DOUBLE: {
+				double dval;
+				M_mem_copy(&dval, p, sizeof(dval));
+				p += sizeof(dval);
+				M_bprintf(msg, spec, dval);
+				break;
+			}
+			case M_LOG_DEFERRED_ARG_STR: {
+				M_uint32    slen;
+				const char *str;
+
+				M_mem_copy(&slen, p, sizeof(slen));
+				p += sizeof(slen);
+				if (slen == M_UINT32_MAX) {
+					str = NULL;
+				} else {
+					str = (const char *)p;
+					p  += slen + 1;
+				}
+				M_bprintf(msg, spec, str);
+				break;
+			}
+		}
+	}
+}
+
+
+/* Pull the next record off a ring. Pad records are skipped. Returns M_FALSE if the ring
+ * has nothing up to limit. */
+static M_bool deferred_ring_peek(M_log_deferred_ring_t *ring, M_uint64 limit, M_log_deferred_rec_t *rec, size_t *off)
+{
+	M_uint64 head = ring->head; /* Only written by the drainer, which holds drain_lock. */
+
+	while (head < limit) {
+		*off = (size_t)(head & (ring->size - 1));
+		M_mem_copy(rec, ring->data + *off, sizeof(rec->len) + sizeof(rec->type));
+		if (rec->type != M_LOG_DEFERRED_REC_PAD) {
+			M_mem_copy(rec, ring->data + *off, sizeof(*rec));
+			return M_TRUE;
+		}
+		head += rec->len;
+		M_atomic_store_u64(&ring->head, head);
+	}
+	return M_FALSE;
+}
+
+
+/* Format and write everything captured so far. Messages from different threads are
+ * merged by timestamp. Must hold drain_lock. */
+static void deferred_drain(M_log_deferred_t *d)
+{
+	M_log_deferred_ring_t **rings  = d->drain_rings;
+	M_uint64               *limits = d->drain_limits;
+	size_t                  cnt    = 0;
+	size_t                  i;
+
+	/* Snapshot what's there now. Anything written after this is picked up next time,
+	 * otherwise a busy thread could keep us here forever. */
+	for (i=0; i<M_LOG_DEFERRED_MAX_THREADS; i++) {
+		M_log_deferred_ring_t *ring = M_atomic_load_ptr((void * volatile *)&d->rings[i]);
+		if (ring == NULL) {
+			continue;
+		}
+		limits[cnt] = M_atomic_load_u64(&ring->tail);
+		if (limits[cnt] == ring->head) {
+			continue;
+		}
+		rings[cnt++] = ring;
+	}
+
+	while (cnt > 0) {
+		M_log_deferred_rec_t rec;
+		M_log_deferred_rec_t best_rec;
+		size_t               off;
+		size_t               best_off  = 0;
+		size_t               best      = 0;
+		M_bool               have_best = M_FALSE;
+		const unsigned char *payload;
+
+		/* Find the oldest pending message. Drop rings we've emptied, swapping in the last
+		 * one. That one is always past anything already picked as best. */
+		i = 0;
+		while (i < cnt) {
+			if (!deferred_ring_peek(rings[i], limits[i], &rec, &off)) {
+				cnt--;
+				rings[i]  = rings[cnt];
+				limits[i] = limits[cnt];
+				continue;
+			}
+			if (!have_best || rec.tv.tv_sec < best_rec.tv.tv_sec || (rec.tv.tv_sec == best_rec.tv.tv_sec && rec.tv.tv_usec < best_rec.tv.tv_usec)) {
+				best      = i;
+				best_rec  = rec;
+				best_off  = off;
+				have_best = M_TRUE;
+			}
+			i++;
+		}
+		if (!have_best) {
+			break;
+		}
+
+		payload = rings[best]->data + best_off + sizeof(best_rec);
+		if (best_rec.type == M_LOG_DEFERRED_REC_STR) {
+			log_write_at(d->log, best_rec.tag, NULL, (const char *)payload, &best_rec.tv);
+		} else {
+			deferred_format(d, best_rec.fmt, payload);
+			log_write_at(d->log, best_rec.tag, NULL, M_buf_peek(d->msg), &best_rec.tv);
+		}
+
+		/* Release the space back to the producer. */
+		M_atomic_store_u64(&rings[best]->head, rings[best]->head + best_rec.len);
+	}
+
+	/* Waiters register before checking for room, so either they see what we released
+	 * or we see them. */
+	if (M_atomic_load_u32(&d->waiters) != 0) {
+		M_thread_mutex_lock(d->lock);
+		M_thread_cond_broadcast(d->space_cond);
+		M_thread_mutex_unlock(d->lock);
+	}
+}
+
+
+static void *deferred_thread(void *arg)
+{
+	M_log_deferred_t *d = arg;
+
+	M_thread_mutex_lock(d->lock);
+	while (!d->stop) {
+		if (!d->wake) {
+			M_thread_cond_timedwait(d->cond, d->lock, M_LOG_DEFERRED_DELAY);
+		}
+		d->wake = M_FALSE;
+		M_thread_mutex_unlock(d->lock);
+
+		M_thread_mutex_lock(d->drain_lock);
+		deferred_drain(d);
+		M_thread_mutex_unlock(d->drain_lock);
+
+		M_thread_mutex_lock(d->lock);
+	}
+	M_thread_mutex_unlock(d->lock);
+
+	return NULL;
+}
+
+
+/* Write out and free the ring belonging to thread id. */
+static void deferred_ring_release(M_log_deferred_t *d, M_uint64 id)
+{
+	size_t start = (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 32) & (M_LOG_DEFERRED_MAX_THREADS - 1);
+	size_t i;
+
+	for (i=0; i<M_LOG_DEFERRED_MAX_THREADS; i++) {
+		size_t                 idx  = (start + i) & (M_LOG_DEFERRED_MAX_THREADS - 1);
+		M_uint64               slot = M_atomic_load_u64(&d->ids[idx]);
+		M_log_deferred_ring_t *ring;
+
+		if (slot == M_LOG_DEFERRED_ID_EMPTY) {
+			return;
+		}
+		if (slot != id) {
+			continue;
+		}
+
+		/* The drainer only looks at rings while holding drain_lock and we're the only
+		 * producer, so once it's drained nobody else can be using it. */
+		M_thread_mutex_lock(d->drain_lock);
+		deferred_drain(d);
+		ring = d->rings[idx];
+		M_atomic_store_ptr((void * volatile *)&d->rings[idx], NULL);
+		M_atomic_store_u64(&d->ids[idx], M_LOG_DEFERRED_ID_FREE);
+		M_thread_mutex_unlock(d->drain_lock);
+
+		deferred_ring_destroy(ring);
+		return;
+	}
+}
+
+
+/* Thread destructor, releases the exiting thread's rings so the slots can be reused. */
+static void deferred_thread_exit(void)
+{
+	M_uint64        id = (M_uint64)M_thread_self();
+	M_llist_node_t *node;
+
+	M_thread_mutex_lock(deferred_registry_lock);
+	for (node=M_llist_first(deferred_registry); node!=NULL; node=M_llist_node_next(node)) {
+		deferred_ring_release(M_llist_node_val(node), id);
+	}
+	M_thread_mutex_unlock(deferred_registry_lock);
+}
+
+
+static void deferred_registry_deinit(void *arg)
+{
+	(void)arg;
+
+	if (!M_thread_once_reset(&deferred_registry_once))
+		return;
+
+	M_thread_destructor_remove(deferred_thread_exit);
+	M_llist_destroy(deferred_registry, M_FALSE);
+	deferred_registry = NULL;
+	M_thread_mutex_destroy(deferred_registry_lock);
+	deferred_registry_lock = NULL;
+}
+
+
+static void deferred_registry_init(M_uint64 flags)
+{
+	(void)flags;
+
+	deferred_registry_lock = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	deferred_registry      = M_llist_create(NULL, M_LLIST_NONE);
+	M_thread_destructor_insert(deferred_thread_exit);
+	M_library_cleanup_register(deferred_registry_deinit, NULL);
+}
+
+
+/* ---- INTERNAL ---- */
+
+M_log_deferred_t *log_deferred_create(M_log_t *log, size_t ring_size)
+{
+	M_log_deferred_t *d;
+	M_thread_attr_t  *tattr;
+
+	d             = M_malloc_zero(sizeof(*d));
+	d->log        = log;
+	d->ring_size  = M_size_t_round_up_to_power_of_two(ring_size);
+	d->lock       = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	d->cond       = M_thread_cond_create(M_THREAD_CONDATTR_NONE);
+	d->space_cond = M_thread_cond_create(M_THREAD_CONDATTR_NONE);
+	d->drain_lock = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	d->msg        = M_buf_create();
+
+	M_thread_once(&deferred_registry_once, deferred_registry_init, 0);
+	M_thread_mutex_lock(deferred_registry_lock);
+	d->registry_node = M_llist_insert(deferred_registry, d);
+	M_thread_mutex_unlock(deferred_registry_lock);
+
+	tattr = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+	d->thread = M_thread_create(tattr, deferred_thread, d);
+	M_thread_attr_destroy(tattr);
+
+	if (d->thread == 0) {
+		log_deferred_destroy(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+
+void log_deferred_destroy(M_log_deferred_t *d)
+{
+	size_t i;
+
+	if (d == NULL) {
+		return;
+	}
+
+	/* Must be done before joining, the formatter exiting runs deferred_thread_exit(). */
+	M_thread_mutex_lock(deferred_registry_lock);
+	M_llist_remove_node(d->registry_node);
+	d->registry_node = NULL;
+	M_thread_mutex_unlock(deferred_registry_lock);
+
+	if (d->thread != 0) {
+		M_thread_mutex_lock(d->lock);
+		d->stop = M_TRUE;
+		M_thread_cond_signal(d->cond);
+		M_thread_mutex_unlock(d->lock);
+		M_thread_join(d->thread, NULL);
+	}
+
+	/* Write out whatever is left. */
+	log_deferred_flush(d);
+
+	for (i=0; i<M_LOG_DEFERRED_MAX_THREADS; i++) {
+		deferred_ring_destroy(d->rings[i]);
+	}
+	M_buf_cancel(d->msg);
+	M_thread_mutex_destroy(d->drain_lock);
+	M_thread_cond_destroy(d->space_cond);
+	M_thread_cond_destroy(d->cond);
+	M_thread_mutex_destroy(d->lock);
+	M_free(d);
+}
+
+
+void log_deferred_flush(M_log_deferred_t *d)
+{
+	M_thread_mutex_lock(d->drain_lock);
+	deferred_drain(d);
+	M_thread_mutex_unlock(d->drain_lock);
+}
+
+
+/* Write a message on the calling thread. Everything already queued is written first so
+ * nothing ends up out of order. Only used when a message can't be queued. */
+static M_log_error_t deferred_write_sync(M_log_deferred_t *d, M_uint64 tag, const char *fmt, const unsigned char *payload, const char *msg, const M_timeval_t *tv)
+{
+	M_log_error_t ret;
+
+	M_thread_mutex_lock(d->drain_lock);
+	deferred_drain(d);
+	if (fmt != NULL) {
+		deferred_format(d, fmt, payload);
+		msg = M_buf_peek(d->msg);
+	}
+	ret = log_write_at(d->log, tag, NULL, msg, tv);
+	M_thread_mutex_unlock(d->drain_lock);
+
+	return ret;
+}
+
+
+M_log_error_t log_deferred_vprintf(M_log_deferred_t *d, M_uint64 tag, const char *fmt, va_list ap)
+{
+	M_log_deferred_ring_t *ring;
+	M_log_deferred_rec_t   rec;
+	M_buf_t               *buf;
+	const char            *p;
+
+	ring = deferred_ring_get(d);
+	if (ring == NULL) {
+		/* Out of rings. Shouldn't happen unless there are an unreasonable number of threads. */
+		M_log_error_t  ret;
+		char          *msg;
+
+		M_vasprintf(&msg, fmt, ap);
+		ret = deferred_write_sync(d, tag, NULL, NULL, msg, NULL);
+		M_free(msg);
+		return ret;
+	}
+
+	buf = ring->scratch;
+	M_buf_truncate(buf, 0);
+
+	/* Pull the args off in the same order and with the same types M_str_fmt would. */
+	p = fmt;
+	while ((p = M_str_chr(p, '%')) != NULL) {
+		M_log_deferred_arg_t type;
+		size_t               spec_len;
+		size_t               i;
+		M_bool               have_prec = M_FALSE;
+		size_t               prec      = 0;
+		M_uint64             val;
+
+		p++;
+		spec_len = deferred_scan_spec(p, &type);
+
+		/* Pull off the '*' values. The precision is tracked the same way M_str_fmt does
+		 * it because strings must not be read past it, they don't have to be terminated. */
+		for (i=0; i<spec_len; i++) {
+			switch (p[i]) {
+				case '.':
+					have_prec = M_TRUE;
+					break;
+				case '0': case '1': case '2': case '3': case '4':
+				case '5': case '6': case '7': case '8': case '9':
+					if (have_prec) {
+						prec = prec * 10 + (size_t)(p[i] - '0');
+					}
+					break;
+				case 'I':
+					if (i + 2 < spec_len && ((p[i+1] == '6' && p[i+2] == '4') || (p[i+1] == '3' && p[i+2] == '2'))) {
+						i += 2;
+					}
+					break;
+				case '*': {
+					int sval = va_arg(ap, int);
+					if (have_prec && sval > 0) {
+						prec = (size_t)sval;
+					}
+					val = (M_uint64)(M_int64)sval;
+					M_buf_add_bytes(buf, &val, sizeof(val));
+					break;
+				}
+				default:
+					break;
+			}
+		}
+		p += spec_len;
+
+		switch (type) {
+			case M_LOG_DEFERRED_ARG_NONE:
+				break;
+			case M_LOG_DEFERRED_ARG_INT:
+				val = (M_uint64)(M_int64)va_arg(ap, int);
+				M_buf_add_bytes(buf, &val, sizeof(val));
+				break;
+			case M_LOG_DEFERRED_ARG_LONG:
+				val = (M_uint64)(M_int64)va_arg(ap, long);
+				M_buf_add_bytes(buf, &val, sizeof(val));
+				break;
+			case M_LOG_DEFERRED_ARG_LONGLONG:
+				val = (M_uint64)va_arg(ap, M_int64);
+				M_buf_add_bytes(buf, &val, sizeof(val));
+				break;
+			case M_LOG_DEFERRED_ARG_SIZET:
+				val = (M_uint64)va_arg(ap, size_t);
+				M_buf_add_bytes(buf, &val, sizeof(val));
+				break;
+			case M_LOG_DEFERRED_ARG_VOIDP:
+				val = (M_uint64)(M_uintptr)va_arg(ap, void *);
+				M_buf_add_bytes(buf, &val, sizeof(val));
+				break;
+			case M_LOG_DEFERRED_ARG_DOUBLE: {
+				double dval = va_arg(ap, double);
+				M_buf_add_bytes(buf, &dval, sizeof(dval));
+				break;
+			}
+			case M_LOG_DEFERRED_ARG_STR: {
+				/* Strings are copied, the caller's buffer may be gone by the time we format. */
+				const char *str  = va_arg(ap, const char *);
+				M_uint32    slen = M_UINT32_MAX;
+				if (str != NULL) {
+					slen = (M_uint32)(have_prec? M_str_len_max(str, prec) : M_str_len(str));
+				}
+				M_buf_add_bytes(buf, &slen, sizeof(slen));
+				if (str != NULL) {
+					M_buf_add_bytes(buf, str, slen);
+					M_buf_add_byte(buf, 0);
+				}
+				break;
+			}
+		}
+	}
+
+	M_mem_set(&rec, 0, sizeof(rec));
+	rec.type = M_LOG_DEFERRED_REC_FMT;
+	rec.tag  = tag;
+	rec.fmt  = fmt;
+	M_time_gettimeofday(&rec.tv);
+
+	if (!deferred_ring_put(d, ring, &rec, (const unsigned char *)M_buf_peek(buf), M_buf_len(buf))) {
+		return deferred_write_sync(d, tag, fmt, (const unsigned char *)M_buf_peek(buf), NULL, &rec.tv);
+	}
+	return M_LOG_SUCCESS;
+}
+
+
+M_log_error_t log_deferred_write(M_log_deferred_t *d, M_uint64 tag, const char *msg)
+{
+	M_log_deferred_ring_t *ring;
+	M_log_deferred_rec_t   rec;
+
+	M_mem_set(&rec, 0, sizeof(rec));
+	rec.type = M_LOG_DEFERRED_REC_STR;
+	rec.tag  = tag;
+	M_time_gettimeofday(&rec.tv);
+
+	ring = deferred_ring_get(d);
+	if (ring == NULL || !deferred_ring_put(d, ring, &rec, (const unsigned char *)msg, M_str_len(msg) + 1)) {
+		return deferred_write_sync(d, tag, NULL, NULL, msg, &rec.tv);
+	}
+	return M_LOG_SUCCESS;
+}
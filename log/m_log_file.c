@@ -26,6 +26,9 @@
  */
 #include "m_config.h"
 #include <m_log_int.h>
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
 
 /* TODO: make these config parameters? */
 #define M_FILE_RETRY_DELAY  1000 /* (ms) Amount of time to wait after file access failure before we try reopening
@@ -35,6 +38,166 @@
 #define M_POPEN_CLOSE_DELAY 15   /* (ms) Amount of time to wait for a popen call to finish when we're not
                                   *      allowed to block. Should be very short. (resolution is only about 15 ms)
                                   */
+#define M_FILE_WRITE_BUF    (256 * 1024) /* (bytes) Max amount of queued messages written to the file in one call. */
+#define M_FILE_COMPRESS_BUF (64 * 1024)  /* (bytes) Chunk size used when compressing rotated files in-process. */
+
+/* ---- PRIVATE: in-process compression of rotated log files. ---- */
+
+typedef struct {
+	char              *in_path;
+	char              *out_path;
+	M_uint64           max_bytes_per_s; /* Max rate at which in_path is read and compressed, 0 for no limit. */
+	volatile M_uint32  cancel;          /* Set to abandon the job (output is removed, input is left as-is). */
+} compress_job_t;
+
+
+static void compress_job_destroy(compress_job_t *job)
+{
+	if (job == NULL) {
+		return;
+	}
+	M_free(job->in_path);
+	M_free(job->out_path);
+	M_free(job);
+}
+
+
+#ifdef HAVE_ZLIB
+/* Sleep long enough that we don't go over the job's rate limit. */
+static void compress_throttle(compress_job_t *job, M_timeval_t *start, M_uint64 total_bytes)
+{
+	M_uint64 elapsed;
+	M_uint64 expected;
+
+	if (job->max_bytes_per_s == 0) {
+		/* No limit, but still give the rest of the process a chance to run between chunks. */
+		M_thread_yield(M_TRUE);
+		return;
+	}
+
+	elapsed  = M_time_elapsed(start);
+	expected = (total_bytes * 1000) / job->max_bytes_per_s;
+	if (expected > elapsed) {
+		M_thread_sleep((expected - elapsed) * 1000); /* function expects microseconds, not milliseconds */
+	}
+}
+
+
+/* Stream in_path through gzip into a temp file next to out_path, then move it into place and remove in_path.
+ *
+ * The temp file doesn't match the old log file glob pattern, so a partial archive is never picked up by rotation.
+ * On failure the uncompressed file is left where it is.
+ */
+static void *compress_thread(void *arg)
+{
+	compress_job_t *job      = arg;
+	M_fs_file_t    *in_fd    = NULL;
+	M_fs_file_t    *out_fd   = NULL;
+	unsigned char  *in_buf   = NULL;
+	unsigned char  *out_buf  = NULL;
+	char           *tmp_path = NULL;
+	M_uint64        total    = 0;
+	M_bool          success  = M_FALSE;
+	M_bool          z_init   = M_FALSE;
+	M_timeval_t     start;
+	z_stream        strm;
+	int             flush;
+
+	M_asprintf(&tmp_path, "%s.part", job->out_path);
+
+	if (M_fs_file_open(&in_fd, job->in_path, 0, M_FS_FILE_MODE_READ | M_FS_FILE_MODE_NOCREATE, NULL)
+		!= M_FS_ERROR_SUCCESS) {
+		goto done;
+	}
+	if (M_fs_file_open(&out_fd, tmp_path, 0, M_FS_FILE_MODE_WRITE | M_FS_FILE_MODE_OVERWRITE, NULL)
+		!= M_FS_ERROR_SUCCESS) {
+		goto done;
+	}
+
+	/* windowBits + 16 writes a gzip header and trailer instead of a zlib one. */
+	M_mem_set(&strm, 0, sizeof(strm));
+	if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		goto done;
+	}
+	z_init  = M_TRUE;
+	in_buf  = M_malloc(M_FILE_COMPRESS_BUF);
+	out_buf = M_malloc(M_FILE_COMPRESS_BUF);
+
+	M_time_elapsed_start(&start);
+	do {
+		size_t read_len = 0;
+
+		if (M_atomic_load_u32(&job->cancel) != 0) {
+			goto done;
+		}
+
+		if (M_fs_file_read(in_fd, in_buf, M_FILE_COMPRESS_BUF, &read_len, M_FS_FILE_RW_FULLBUF) != M_FS_ERROR_SUCCESS) {
+			goto done;
+		}
+		total         += read_len;
+		flush          = (read_len < M_FILE_COMPRESS_BUF)? Z_FINISH : Z_NO_FLUSH;
+		strm.next_in   = in_buf;
+		strm.avail_in  = (uInt)read_len;
+
+		do {
+			size_t have;
+
+			strm.next_out  = out_buf;
+			strm.avail_out = M_FILE_COMPRESS_BUF;
+			if (deflate(&strm, flush) == Z_STREAM_ERROR) {
+				goto done;
+			}
+			have = M_FILE_COMPRESS_BUF - strm.avail_out;
+			if (have > 0 && M_fs_file_write(out_fd, out_buf, have, NULL, M_FS_FILE_RW_FULLBUF) != M_FS_ERROR_SUCCESS) {
+				goto done;
+			}
+		} while (strm.avail_out == 0);
+
+		compress_throttle(job, &start, total);
+	} while (flush != Z_FINISH);
+
+	success = M_TRUE;
+
+done:
+	if (z_init) {
+		deflateEnd(&strm);
+	}
+	M_free(in_buf);
+	M_free(out_buf);
+	M_fs_file_close(in_fd);
+	M_fs_file_close(out_fd);
+
+	if (success && M_fs_move(tmp_path, job->out_path, M_FS_FILE_MODE_OVERWRITE, NULL, M_FS_PROGRESS_NOEXTRA)
+		== M_FS_ERROR_SUCCESS) {
+		M_fs_delete(job->in_path, M_FALSE, NULL, M_FS_PROGRESS_NOEXTRA);
+	} else {
+		M_fs_delete(tmp_path, M_FALSE, NULL, M_FS_PROGRESS_NOEXTRA);
+	}
+
+	M_free(tmp_path);
+	return NULL;
+}
+#endif
+
+
+/* Start compressing in_path in the background. Returns the id of the (joinable) compression thread, or 0. */
+static M_threadid_t compress_start(compress_job_t *job)
+{
+#ifdef HAVE_ZLIB
+	M_thread_attr_t *attr;
+	M_threadid_t     id;
+
+	attr = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(attr, M_TRUE);
+	id = M_thread_create(attr, compress_thread, job);
+	M_thread_attr_destroy(attr);
+
+	return id;
+#else
+	(void)job;
+	return 0;
+#endif
+}
 
 /* ---- PRIVATE: callbacks for internal async_writer object. ---- */
 
@@ -50,25 +213,86 @@ typedef struct {
 	M_uint64          autorotate_size;
 	M_uint64          autorotate_time;
 	char             *archive_cmd;
-	char             *archive_file_ext;
+	char             *archive_cmd_ext;  /* Extension added by archive_cmd, as given by the user. */
+	char             *archive_file_ext; /* Extension of archived files on disk for the current compress type. */
 	M_popen_handle_t *archive_process;
+	M_log_file_compress_t compress;     /* Current compress type, only changed by worker thread at rotate. */
+	M_uint64          compress_rate;
+	compress_job_t   *compress_job;
+	M_threadid_t      compress_thread;
 	M_bool            in_err;
 	const char       *line_end_str;
 	M_bool            suspended;
+	M_thread_mutex_t *settings_lock;    /* Protects the settings below, which can be changed by the user. */
+	M_log_file_sync_t sync_policy;
+	M_uint64          sync_value;
+	M_log_file_compress_t new_compress; /* Picked up by worker thread on next rotate. */
+	M_uint64          new_compress_rate;
+	M_uint64          unsynced_bytes;   /* Bytes written to the head logfile since it was last synced. */
+	M_timeval_t       last_sync;
 } writer_thunk_t;
 
 
+/* Wait for the compression thread from a previous rotate (if any) to finish. */
+static void writer_thunk_compress_wait(writer_thunk_t *wdata, M_bool cancel)
+{
+	if (wdata->compress_job == NULL) {
+		return;
+	}
+
+	if (cancel) {
+		M_atomic_store_u32(&wdata->compress_job->cancel, 1);
+	}
+	if (wdata->compress_thread != 0) {
+		M_thread_join(wdata->compress_thread, NULL);
+	}
+	compress_job_destroy(wdata->compress_job);
+	wdata->compress_job    = NULL;
+	wdata->compress_thread = 0;
+}
+
+
+/* Set extension of archived log files and rebuild globbing pattern used to find them. */
+static void writer_thunk_set_archive_ext(writer_thunk_t *wdata, const char *ext)
+{
+	M_buf_t *buf;
+	char    *new_ext;
+
+	/* Copy first, ext may point to archive_file_ext. */
+	new_ext = M_strdup(ext);
+	M_free(wdata->archive_file_ext);
+	wdata->archive_file_ext = new_ext;
+
+	/* Construct globbing pattern for extra log files. */
+	buf = M_buf_create();
+	M_buf_add_str(buf, wdata->log_file_name);
+	M_buf_add_str(buf, ".*");
+	if (!M_str_isempty(wdata->archive_file_ext)) {
+		M_buf_add_str(buf, wdata->archive_file_ext);
+	}
+	M_free(wdata->log_file_pattern);
+	wdata->log_file_pattern = M_buf_finish_str(buf, NULL);
+}
+
+
 static void writer_thunk_destroy(void *ptr)
 {
 	writer_thunk_t *wdata = ptr;
 
+	/* Compression thread is normally finished by stop, this just makes sure it's not left running. Cancelling
+	 * means it only has to finish the chunk it's working on.
+	 */
+	writer_thunk_compress_wait(wdata, M_TRUE);
+
 	M_free(wdata->log_file_path);
 	M_free(wdata->log_file_name);
 	M_free(wdata->log_file_pattern);
 	M_free(wdata->log_file_dir);
 	M_fs_file_close(wdata->fstream);
 	M_free(wdata->archive_cmd);
+	M_free(wdata->archive_cmd_ext);
 	M_free(wdata->archive_file_ext);
+	M_thread_mutex_destroy(wdata->settings_lock);
 
 	/* If internal archive process exists and hasn't been closed yet, try to close it.
 	 * If the process isn't ready to close in M_POPEN_CLOSE_DELAY seconds, force kill it and free resources.
@@ -80,6 +304,50 @@ static void writer_thunk_destroy(void *ptr)
 }
 
 
+/* Sync the head logfile to disk if the sync policy calls for it.
+ *
+ * If is_close is M_TRUE, the file is about to be closed (rotate, suspend or shutdown), so any policy other than
+ * M_LOG_FILE_SYNC_NEVER syncs whatever hasn't been synced yet.
+ */
+static void writer_thunk_sync(writer_thunk_t *wdata, M_bool is_close)
+{
+	M_log_file_sync_t policy;
+	M_uint64          value;
+	M_bool            dosync = M_FALSE;
+
+	if (wdata->fstream == NULL || wdata->unsynced_bytes == 0) {
+		return;
+	}
+
+	M_thread_mutex_lock(wdata->settings_lock);
+	policy = wdata->sync_policy;
+	value  = wdata->sync_value;
+	M_thread_mutex_unlock(wdata->settings_lock);
+
+	switch (policy) {
+		case M_LOG_FILE_SYNC_NEVER:
+			break;
+		case M_LOG_FILE_SYNC_INTERVAL:
+			dosync = (is_close || M_time_elapsed(&wdata->last_sync) >= value)? M_TRUE : M_FALSE;
+			break;
+		case M_LOG_FILE_SYNC_BYTES:
+			dosync = (is_close || wdata->unsynced_bytes >= value)? M_TRUE : M_FALSE;
+			break;
+		case M_LOG_FILE_SYNC_ROTATE:
+			dosync = is_close;
+			break;
+	}
+
+	if (!dosync) {
+		return;
+	}
+
+	M_fs_file_sync(wdata->fstream, M_FS_FILE_SYNC_OS);
+	wdata->unsynced_bytes = 0;
+	M_time_elapsed_start(&wdata->last_sync);
+}
+
+
 /* Open the head logfile, update file creation time. */
 static M_fs_error_t open_head_logfile(writer_thunk_t *wdata, M_bool is_rotate)
 {
@@ -93,9 +361,15 @@ static M_fs_error_t open_head_logfile(writer_thunk_t *wdata, M_bool is_rotate)
 	/* TODO: do we need the extra buf? It's currently turned off. Need to performance test. */
 	buf_size = 0;
 
+	/* Opened in append mode (O_APPEND), so every batch lands at the end of the file even if something else
+	 * writes to it too.
+	 */
 	err = M_fs_file_open(&wdata->fstream, wdata->log_file_path, buf_size,
 		M_FS_FILE_MODE_WRITE | M_FS_FILE_MODE_APPEND, NULL);
 
+	wdata->unsynced_bytes = 0;
+	M_time_elapsed_start(&wdata->last_sync);
+
 	if (is_rotate) {
 		/* We know the file has to be new, so don't bother checking the filesystem for creation time and size.
 		 * NOTE: this is an attempted workaround for a windows logging issue we can't reproduce (one line per file)
@@ -257,6 +531,22 @@ static void writer_thunk_rotate_log_files(writer_thunk_t *wdata)
 		return;
 	}
 
+	/* Wait for compression from previous rotate to finish, it may still be working on the file we're about to
+	 * rename.
+	 */
+	writer_thunk_compress_wait(wdata, M_FALSE);
+
+	/* Pick up any change to the compress type. Files archived with the old type won't be found by the new
+	 * pattern, they're left alone on disk.
+	 */
+	M_thread_mutex_lock(wdata->settings_lock);
+	if (wdata->compress != wdata->new_compress) {
+		wdata->compress = wdata->new_compress;
+		writer_thunk_set_archive_ext(wdata, (wdata->compress == M_LOG_FILE_COMPRESS_GZIP)? ".gz" : wdata->archive_cmd_ext);
+	}
+	wdata->compress_rate = wdata->new_compress_rate;
+	M_thread_mutex_unlock(wdata->settings_lock);
+
 	new_path       = M_buf_create();
 
 	existing_files = writer_thunk_get_log_file_names(wdata);
@@ -309,6 +599,7 @@ static void writer_thunk_rotate_log_files(writer_thunk_t *wdata)
 	wdata->archive_process = NULL;
 
 	/* Close the head log file, rename it to log #1. */
+	writer_thunk_sync(wdata, M_TRUE);
 	M_fs_file_close(wdata->fstream);
 	wdata->fstream = NULL;
 
@@ -323,8 +614,14 @@ static void writer_thunk_rotate_log_files(writer_thunk_t *wdata)
 		res = M_fs_move(wdata->log_file_path, M_buf_peek(new_path), M_FS_FILE_MODE_OVERWRITE, NULL,
 			M_FS_PROGRESS_NOEXTRA);
 
-		/* Handle any required compression in a separate process (only if move was successful). */
-		if (res == M_FS_ERROR_SUCCESS && !M_str_isempty(wdata->archive_file_ext)) {
+		/* Handle any required compression in a background thread or separate process (only if move was successful). */
+		if (res == M_FS_ERROR_SUCCESS && wdata->compress == M_LOG_FILE_COMPRESS_GZIP) {
+			wdata->compress_job                  = M_malloc_zero(sizeof(*wdata->compress_job));
+			wdata->compress_job->in_path         = M_strdup(M_buf_peek(new_path));
+			M_asprintf(&wdata->compress_job->out_path, "%s%s", M_buf_peek(new_path), wdata->archive_file_ext);
+			wdata->compress_job->max_bytes_per_s = wdata->compress_rate;
+			wdata->compress_thread               = compress_start(wdata->compress_job);
+		} else if (res == M_FS_ERROR_SUCCESS && !M_str_isempty(wdata->archive_file_ext)) {
 			M_buf_t *cmd = M_buf_create();
 
 			/* cmd: <archive cmd> <logfilename.1> */
@@ -352,7 +649,6 @@ static writer_thunk_t *writer_thunk_create(const char *log_file_path, M_uint64 n
 	M_uint64 autorotate_time, const char *archive_cmd, const char *archive_file_ext, const char *line_end_str)
 {
 	writer_thunk_t *wdata         = M_malloc_zero(sizeof(*wdata));
-	M_buf_t        *buf           = NULL;
 	M_fs_error_t    err;
 
 	/* Normalize the path - subs in environment variable values, converts to absolute, resolves '~', etc. */
@@ -363,16 +659,8 @@ static writer_thunk_t *writer_thunk_create(const char *log_file_path, M_uint64 n
 		return NULL;
 	}
 
-	/* Construct globbing pattern for extra log files. */
 	wdata->log_file_name = M_fs_path_basename(wdata->log_file_path, M_FS_SYSTEM_AUTO);
-	buf = M_buf_create();
-	M_buf_add_str(buf, wdata->log_file_name);
-	M_buf_add_str(buf, ".*");
-	if (!M_str_isempty(archive_file_ext)) {
-		M_buf_add_str(buf, archive_file_ext);
-	}
-	wdata->log_file_pattern = M_strdup(M_buf_peek(buf));
-	M_buf_cancel(buf);
+	writer_thunk_set_archive_ext(wdata, archive_file_ext);
 
 	/* Set other parameters. */
 	wdata->log_file_dir     = M_fs_path_dirname(wdata->log_file_path, M_FS_SYSTEM_AUTO);
@@ -380,8 +668,12 @@ static writer_thunk_t *writer_thunk_create(const char *log_file_path, M_uint64 n
 	wdata->autorotate_size  = autorotate_size;
 	wdata->autorotate_time  = autorotate_time;
 	wdata->archive_cmd      = M_strdup(archive_cmd);
-	wdata->archive_file_ext = M_strdup(archive_file_ext);
+	wdata->archive_cmd_ext  = M_strdup(archive_file_ext);
 	wdata->line_end_str     = line_end_str;
+	wdata->settings_lock    = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	wdata->sync_policy      = M_LOG_FILE_SYNC_NEVER;
+	wdata->compress         = M_LOG_FILE_COMPRESS_EXTERNAL;
+	wdata->new_compress     = M_LOG_FILE_COMPRESS_EXTERNAL;
 
 	return wdata;
 }
@@ -390,17 +682,20 @@ static writer_thunk_t *writer_thunk_create(const char *log_file_path, M_uint64 n
 static void writer_thunk_stop(void *ptr)
 {
 	writer_thunk_t *wdata = ptr;
-	/* Block until internal archive process finishes (if one was started). */
+	/* Called from the worker thread on stop, so this is the last chance to get written data to disk. */
+	writer_thunk_sync(wdata, M_TRUE);
+	/* Block until internal archive process or compression thread finishes (if one was started). */
+	writer_thunk_compress_wait(wdata, M_FALSE);
 	M_popen_close(wdata->archive_process, NULL);
 	/* Set to NULL so that close won't be called again on destroy. */
 	wdata->archive_process = NULL;
 }
 
 
-static M_bool writer_write_cb(char *msg, M_uint64 cmd, void *thunk)
+static M_bool writer_write_cb(M_buf_t *msgs, size_t num_msgs, M_uint64 cmd, void *thunk)
 {
 	writer_thunk_t *wdata    = thunk;
-	size_t          msg_len  = M_str_len(msg);
+	size_t          msg_len  = (num_msgs == 0)? 0 : M_buf_len(msgs);
 	M_fs_error_t    res;
 	M_bool          ret      = M_TRUE;
 	M_bool          dorotate = M_FALSE;
@@ -427,6 +722,7 @@ static M_bool writer_write_cb(char *msg, M_uint64 cmd, void *thunk)
 	 *       also updates our internal file size counter to match size of file on disk.
 	 */
 	if (wdata->fstream == NULL || (cmd & M_LOG_CMD_FILE_REOPEN) != 0) {
+		writer_thunk_sync(wdata, M_TRUE);
 		M_fs_file_close(wdata->fstream);
 		open_head_logfile(wdata, M_FALSE);
 	}
@@ -453,39 +749,42 @@ static M_bool writer_write_cb(char *msg, M_uint64 cmd, void *thunk)
 	 * This should be the LAST command we process, otherwise we'll lose any commands that are in flight.
 	 */
 	if ((cmd & M_LOG_CMD_SUSPEND) != 0 && (cmd & M_LOG_CMD_RESUME) == 0) {
+		writer_thunk_sync(wdata, M_TRUE);
 		M_fs_file_close(wdata->fstream);
 		wdata->fstream   = NULL;
 		wdata->suspended = M_TRUE;
 		return M_FALSE;
 	}
 
-	/* Write out the current message (if it's not empty). */
+	/* Write out the current batch of messages (if it's not empty) with a single write. */
 	if (msg_len != 0) {
-		unsigned char *to_write     = (unsigned char *)msg;
-		size_t         to_write_len = msg_len;
+		const unsigned char *to_write     = (const unsigned char *)M_buf_peek(msgs);
+		size_t               to_write_len = msg_len;
+		unsigned char       *err_buf      = NULL;
 
 		/* If we just recovered from an error, prepend log line with a separate line documenting this. */
 		if (wdata->in_err) {
 			M_buf_t *buf = M_buf_create();
 			M_buf_add_str(buf, "Log file stream reopened due to I/O error.");
 			M_buf_add_str(buf, wdata->line_end_str);
-			M_buf_add_bytes(buf, msg, msg_len);
-			to_write = M_buf_finish(buf, &to_write_len);
+			M_buf_add_bytes(buf, to_write, msg_len);
+			err_buf  = M_buf_finish(buf, &to_write_len);
+			to_write = err_buf;
 		}
 
 		res = M_fs_file_write(wdata->fstream, to_write, to_write_len, NULL, M_FS_FILE_RW_FULLBUF);
 		wdata->log_file_size += to_write_len;
 
 		/* Free message buffer, if we sent an error message. */
-		if (wdata->in_err) {
-			M_free(to_write);
-		}
+		M_free(err_buf);
 
 		if (res == M_FS_ERROR_SUCCESS) {
 			/* If write succeeded, clear error indicator. */
-			wdata->in_err = M_FALSE;
+			wdata->in_err          = M_FALSE;
+			wdata->unsynced_bytes += to_write_len;
+			writer_thunk_sync(wdata, M_FALSE);
 		} else {
-			/* If we failed to write to the stream, need to push message back onto queue, and try to reopen
+			/* If we failed to write to the stream, need to push messages back onto queue, and try to reopen
 			 * resource on next write.
 			 *
 			 * Note: don't need to update file size here, will be refreshed by checking the disk on reopen.
@@ -662,7 +961,7 @@ M_log_error_t M_log_module_add_file(M_log_t *log, const char *log_file_path, siz
 		return M_LOG_UNREACHABLE;
 	}
 
-	writer = M_async_writer_create(max_queue_bytes, writer_write_cb, writer_thunk,
+	writer = M_async_writer_create_batch(max_queue_bytes, M_FILE_WRITE_BUF, writer_write_cb, writer_thunk,
 		writer_thunk_stop, writer_thunk_destroy, log->line_end_writer_mode);
 
 	/* Create the module, pass the writer to it as its thunk. */
@@ -721,3 +1020,108 @@ M_log_error_t M_log_module_file_rotate(M_log_t *log, M_log_module_t *module)
 
 	return M_LOG_SUCCESS;
 }
+
+
+M_log_error_t M_log_module_file_set_write_delay(M_log_t *log, M_log_module_t *module, size_t flush_bytes,
+	M_uint64 delay_ms)
+{
+	if (log == NULL || module == NULL || module->module_thunk == NULL) {
+		return M_LOG_INVALID_PARAMS;
+	}
+
+	if (module->type != M_LOG_MODULE_FILE) {
+		return M_LOG_WRONG_MODULE;
+	}
+
+	M_thread_mutex_lock(log->lock);
+
+	if (!module_present_locked(log, module)) {
+		M_thread_mutex_unlock(log->lock);
+		return M_LOG_MODULE_NOT_FOUND;
+	}
+
+	if (flush_bytes == 0) {
+		flush_bytes = M_FILE_WRITE_BUF;
+	}
+	M_async_writer_set_batch_delay(module->module_thunk, flush_bytes, delay_ms);
+
+	M_thread_mutex_unlock(log->lock);
+
+	return M_LOG_SUCCESS;
+}
+
+
+M_log_error_t M_log_module_file_set_sync(M_log_t *log, M_log_module_t *module, M_log_file_sync_t policy,
+	M_uint64 value)
+{
+	writer_thunk_t *wdata;
+
+	if (log == NULL || module == NULL || module->module_thunk == NULL) {
+		return M_LOG_INVALID_PARAMS;
+	}
+
+	if ((policy == M_LOG_FILE_SYNC_INTERVAL || policy == M_LOG_FILE_SYNC_BYTES) && value == 0) {
+		return M_LOG_INVALID_PARAMS;
+	}
+
+	if (module->type != M_LOG_MODULE_FILE) {
+		return M_LOG_WRONG_MODULE;
+	}
+
+	M_thread_mutex_lock(log->lock);
+
+	if (!module_present_locked(log, module)) {
+		M_thread_mutex_unlock(log->lock);
+		return M_LOG_MODULE_NOT_FOUND;
+	}
+
+	wdata = M_async_writer_get_thunk(module->module_thunk);
+
+	M_thread_mutex_lock(wdata->settings_lock);
+	wdata->sync_policy = policy;
+	wdata->sync_value  = value;
+	M_thread_mutex_unlock(wdata->settings_lock);
+
+	M_thread_mutex_unlock(log->lock);
+
+	return M_LOG_SUCCESS;
+}
+
+
+M_log_error_t M_log_module_file_set_compress(M_log_t *log, M_log_module_t *module, M_log_file_compress_t type,
+	M_uint64 max_bytes_per_s)
+{
+	writer_thunk_t *wdata;
+
+	if (log == NULL || module == NULL || module->module_thunk == NULL) {
+		return M_LOG_INVALID_PARAMS;
+	}
+
+	if (module->type != M_LOG_MODULE_FILE) {
+		return M_LOG_WRONG_MODULE;
+	}
+
+#ifndef HAVE_ZLIB
+	if (type == M_LOG_FILE_COMPRESS_GZIP) {
+		return M_LOG_MODULE_UNSUPPORTED;
+	}
+#endif
+
+	M_thread_mutex_lock(log->lock);
+
+	if (!module_present_locked(log, module)) {
+		M_thread_mutex_unlock(log->lock);
+		return M_LOG_MODULE_NOT_FOUND;
+	}
+
+	wdata = M_async_writer_get_thunk(module->module_thunk);
+
+	M_thread_mutex_lock(wdata->settings_lock);
+	wdata->new_compress      = type;
+	wdata->new_compress_rate = max_bytes_per_s;
+	M_thread_mutex_unlock(wdata->settings_lock);
+
+	M_thread_mutex_unlock(log->lock);
+
+	return M_LOG_SUCCESS;
+}
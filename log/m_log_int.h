@@ -31,6 +31,9 @@
 
 #define M_LOG_SUSPEND_DELAY   200 /* (ms) Delay used to keep us from busy-waiting during a suspend. */
 
+#define M_LOG_DEFERRED_DELAY        10   /* (ms) Longest a deferred message waits before the formatter picks it up. */
+#define M_LOG_DEFERRED_MAX_THREADS  1024 /* Max number of running threads that can write deferred messages (power of 2). */
+
 #define M_SYSLOG_MAX_CHARS    1024
 #define M_SYSLOG_DEFAULT_PRI  M_SYSLOG_INFO
 #define M_SYSLOG_TAB_REPLACE  "    "
@@ -94,6 +97,10 @@ typedef M_bool (*M_log_destroy_flush_blocking_cb)(void *thunk, M_bool flush, M_u
 
 
 
+/* Deferred formatting state, implemented in m_log_deferred.c. */
+typedef struct M_log_deferred M_log_deferred_t;
+
+
 struct M_log {
 	M_llist_t                      *modules;
 	M_async_writer_line_end_mode_t  line_end_writer_mode;
@@ -104,9 +111,11 @@ struct M_log {
 	M_hash_multi_t                 *name_to_tag;
 	M_thread_mutex_t               *lock;                 /* Lock for list of modules, and per-module settings. */
 	size_t                          max_name_width;       /* Keeps track of length of longest loaded tag name. */
-	M_bool                          pad_names;            /* If true, tag names will be padded out to constant width. */
+	volatile M_uint32               pad_names;            /* If non-zero, tag names will be padded out to constant width. Atomic. */
+	volatile M_uint64               accepted_tags;        /* Union of all modules' accepted tags, checked before taking the lock. Atomic. */
 	M_event_t                      *event;                /* Event loop to use for event-based modules. */
 	M_bool                          suspended;
+	M_log_deferred_t               *deferred;             /* Set if deferred formatting is enabled. */
 } /* M_log_t */;
 
 
@@ -156,6 +165,34 @@ M_bool module_present_locked(M_log_t *log, M_log_module_t *module);
 void module_remove_locked(M_log_t *log, M_log_module_t *module);
 
 
+/* Internal helper that recalculates the union of all modules' accepted tags. Must be called after anything that
+ * changes a module's accepted tags or removes a module. Assumes you've already locked the log.
+ *
+ * Implemented in m_log_common.c
+ */
+void log_update_accepted_tags_locked(M_log_t *log);
+
+
+/* Internal write that uses the given time for the message timestamp instead of the current time
+ * (tv may be NULL to use the current time).
+ *
+ * Implemented in m_log.c
+ */
+M_log_error_t log_write_at(M_log_t *log, M_uint64 tag, void *msg_thunk, const char *msg, const M_timeval_t *tv);
+
+
+/* Deferred formatting. Create starts the formatter thread, destroy stops it and writes anything still queued.
+ * vprintf and write queue a message from the calling thread.
+ *
+ * Implemented in m_log_deferred.c
+ */
+M_log_deferred_t *log_deferred_create(M_log_t *log, size_t ring_size);
+void log_deferred_destroy(M_log_deferred_t *d);
+void log_deferred_flush(M_log_deferred_t *d);
+M_log_error_t log_deferred_vprintf(M_log_deferred_t *d, M_uint64 tag, const char *fmt, va_list ap);
+M_log_error_t log_deferred_write(M_log_deferred_t *d, M_uint64 tag, const char *msg);
+
+
 /* Master list of commands that may be passed internally to m_async_writer.
  *
  * Must be composable, so these should only be powers of two.
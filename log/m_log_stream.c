@@ -42,10 +42,10 @@ M_log_error_t M_log_module_add_stream(M_log_t *log, M_stream_type_t type, size_t
 
 /* ---- PRIVATE: callbacks for internal async_writer object. ---- */
 
-static M_bool writer_write_cb(char *msg, M_uint64 cmd, void *thunk)
+static M_bool writer_write_cb(M_buf_t *msgs, size_t num_msgs, M_uint64 cmd, void *thunk)
 {
 	FILE   *iostream = thunk;
-	size_t  msg_len  = M_str_len(msg);
+	size_t  msg_len  = (num_msgs == 0)? 0 : M_buf_len(msgs);
 
 	(void)cmd;
 
@@ -57,7 +57,8 @@ static M_bool writer_write_cb(char *msg, M_uint64 cmd, void *thunk)
 		return M_FALSE;
 	}
 
-	M_fprintf(iostream, "%s", msg);
+	/* Whole batch goes out in one write. */
+	fwrite(M_buf_peek(msgs), 1, msg_len, iostream);
 
 	return M_TRUE;
 }
@@ -185,8 +186,8 @@ M_log_error_t M_log_module_add_stream(M_log_t *log, M_stream_type_t type, size_t
 	mod->type                             = M_LOG_MODULE_STREAM;
 	mod->flush_on_destroy                 = log->flush_on_destroy;
 	mod->allow_tag_padding                = M_TRUE;
-	mod->module_thunk                     = M_async_writer_create(max_queue_bytes, writer_write_cb, iostream, NULL,
-		NULL, log->line_end_writer_mode);
+	mod->module_thunk                     = M_async_writer_create_batch(max_queue_bytes, 0, writer_write_cb, iostream,
+		NULL, NULL, log->line_end_writer_mode);
 	mod->module_write_cb                  = log_write_cb;
 	mod->module_suspend_cb                = log_suspend_cb;
 	mod->module_resume_cb                 = log_resume_cb;
@@ -0,0 +1,286 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "m_config.h"
+#include <mstdlib/mstdlib_sql.h>
+#include <mstdlib/sql/m_sql_driver.h>
+#include "base/m_defs_int.h"
+#include "m_sql_int.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#define M_SQL_BULKLOAD_DEFAULT_ROWS  10000
+#define M_SQL_BULKLOAD_DEFAULT_BYTES (4 * 1024 * 1024)
+
+struct M_sql_bulkload {
+	M_sql_connpool_t *pool;          /*!< Pool to load into */
+	char             *table;         /*!< Table name */
+	M_list_str_t     *cols;          /*!< Column names, in bind order */
+	M_sql_stmt_t     *stmt;          /*!< Statement holding bound rows not yet sent */
+	M_sql_trans_t    *trans;         /*!< Transaction the load is performed in, started on first flush */
+
+	size_t            max_rows;      /*!< Maximum rows to buffer before flushing */
+	size_t            max_bytes;     /*!< Maximum text/binary bytes to buffer before flushing */
+	size_t            pending_bytes; /*!< Text/binary bytes currently buffered */
+	M_uint64          rows_loaded;   /*!< Rows sent to the server */
+
+	M_sql_error_t     err;           /*!< Sticky error, once set the load is dead */
+	char              error[256];    /*!< Error message matching err */
+};
+
+
+M_sql_bulkload_t *M_sql_bulkload_create(M_sql_connpool_t *pool, const char *table)
+{
+	M_sql_bulkload_t *bl;
+
+	if (pool == NULL || M_str_isempty(table))
+		return NULL;
+
+	bl            = M_malloc_zero(sizeof(*bl));
+	bl->pool      = pool;
+	bl->table     = M_strdup(table);
+	bl->cols      = M_list_str_create(M_LIST_STR_NONE);
+	bl->stmt      = M_sql_stmt_create();
+	bl->max_rows  = M_SQL_BULKLOAD_DEFAULT_ROWS;
+	bl->max_bytes = M_SQL_BULKLOAD_DEFAULT_BYTES;
+	bl->err       = M_SQL_ERROR_SUCCESS;
+
+	return bl;
+}
+
+
+M_bool M_sql_bulkload_add_col(M_sql_bulkload_t *bl, const char *name)
+{
+	/* Columns are fixed once a row has been started */
+	if (bl == NULL || M_str_isempty(name) || bl->stmt->bind_row_cnt != 0 || bl->trans != NULL)
+		return M_FALSE;
+
+	return M_list_str_insert(bl->cols, name);
+}
+
+
+M_bool M_sql_bulkload_set_flush(M_sql_bulkload_t *bl, size_t max_rows, size_t max_bytes)
+{
+	if (bl == NULL)
+		return M_FALSE;
+
+	bl->max_rows  = max_rows  == 0 ? M_SQL_BULKLOAD_DEFAULT_ROWS  : max_rows;
+	bl->max_bytes = max_bytes == 0 ? M_SQL_BULKLOAD_DEFAULT_BYTES : max_bytes;
+	return M_TRUE;
+}
+
+
+M_sql_stmt_t *M_sql_bulkload_stmt(M_sql_bulkload_t *bl)
+{
+	if (bl == NULL)
+		return NULL;
+	return bl->stmt;
+}
+
+
+static M_sql_error_t M_sql_bulkload_fail(M_sql_bulkload_t *bl, M_sql_error_t err, const char *error)
+{
+	if (bl->err == M_SQL_ERROR_SUCCESS) {
+		bl->err = err;
+		M_str_cpy(bl->error, sizeof(bl->error), error);
+	}
+
+	if (bl->trans != NULL) {
+		M_sql_trans_rollback(bl->trans); /* Ignore error, what else could we do? */
+		bl->trans = NULL;
+	}
+
+	M_sql_stmt_bind_clear(bl->stmt);
+	bl->pending_bytes = 0;
+	return bl->err;
+}
+
+
+static void M_sql_bulkload_prepare_insert(M_sql_bulkload_t *bl)
+{
+	M_buf_t *query = M_buf_create();
+	size_t   i;
+
+	M_buf_add_str(query, "INSERT INTO \"");
+	M_buf_add_str(query, bl->table);
+	M_buf_add_str(query, "\" (");
+	for (i=0; i<M_list_str_len(bl->cols); i++) {
+		if (i != 0)
+			M_buf_add_str(query, ", ");
+		M_buf_add_byte(query, '"');
+		M_buf_add_str(query, M_list_str_at(bl->cols, i));
+		M_buf_add_byte(query, '"');
+	}
+	M_buf_add_str(query, ") VALUES (");
+	for (i=0; i<M_list_str_len(bl->cols); i++) {
+		if (i != 0)
+			M_buf_add_str(query, ", ");
+		M_buf_add_byte(query, '?');
+	}
+	M_buf_add_byte(query, ')');
+
+	M_sql_stmt_prepare_buf(bl->stmt, query);
+}
+
+
+static M_sql_error_t M_sql_bulkload_flush(M_sql_bulkload_t *bl)
+{
+	const M_sql_driver_t *driver = M_sql_connpool_get_driver(bl->pool);
+	size_t                rows   = bl->stmt->bind_row_cnt;
+	M_sql_error_t         err;
+
+	if (rows == 0)
+		return M_SQL_ERROR_SUCCESS;
+
+	if (bl->trans == NULL) {
+		err = M_sql_trans_begin(&bl->trans, bl->pool, M_SQL_ISOLATION_READCOMMITTED, bl->error, sizeof(bl->error));
+		if (M_sql_error_is_error(err)) {
+			bl->trans = NULL;
+			return M_sql_bulkload_fail(bl, err, bl->error);
+		}
+	}
+
+	/* Drivers built against an older subsystem version don't have the bulk
+	 * load member at all */
+	if ((driver->driver_sys_version & 0xFF) >= 0x01 && driver->cb_bulkload != NULL) {
+		M_sql_conn_t *conn = M_sql_trans_get_conn(bl->trans);
+
+		bl->stmt->bind_row_offset = 0;
+		err = driver->cb_bulkload(conn, bl->table, bl->cols, bl->stmt, bl->stmt->error_msg, sizeof(bl->stmt->error_msg));
+		M_sql_conn_set_state_from_error(conn, err);
+	} else {
+		if (bl->stmt->query_user == NULL)
+			M_sql_bulkload_prepare_insert(bl);
+		err = M_sql_trans_execute(bl->trans, bl->stmt);
+	}
+
+	if (M_sql_error_is_error(err))
+		return M_sql_bulkload_fail(bl, err, M_sql_stmt_get_error_string(bl->stmt));
+
+	bl->rows_loaded   += rows;
+	bl->pending_bytes  = 0;
+	M_sql_stmt_bind_clear(bl->stmt);
+	return M_SQL_ERROR_SUCCESS;
+}
+
+
+M_sql_error_t M_sql_bulkload_row_finish(M_sql_bulkload_t *bl)
+{
+	M_sql_stmt_bind_row_t *row;
+	size_t                 i;
+
+	if (bl == NULL)
+		return M_SQL_ERROR_INVALID_USE;
+
+	if (bl->err != M_SQL_ERROR_SUCCESS)
+		return bl->err;
+
+	if (M_list_str_len(bl->cols) == 0)
+		return M_sql_bulkload_fail(bl, M_SQL_ERROR_INVALID_USE, "No columns added");
+
+	row = bl->stmt->bind_row_cnt ? &bl->stmt->bind_rows[bl->stmt->bind_row_cnt - 1] : NULL;
+	if (row == NULL || row->col_cnt != M_list_str_len(bl->cols)) {
+		char error[256];
+		M_snprintf(error, sizeof(error), "Row %llu has %zu values, expected %zu", bl->rows_loaded + (M_uint64)bl->stmt->bind_row_cnt,
+		           row == NULL ? 0 : row->col_cnt, M_list_str_len(bl->cols));
+		return M_sql_bulkload_fail(bl, M_SQL_ERROR_QUERY_WRONGNUMPARAMS, error);
+	}
+
+	for (i=0; i<row->col_cnt; i++) {
+		if (row->cols[i].type == M_SQL_DATA_TYPE_TEXT)
+			bl->pending_bytes += row->cols[i].v.text.max_len;
+		if (row->cols[i].type == M_SQL_DATA_TYPE_BINARY)
+			bl->pending_bytes += row->cols[i].v.binary.len;
+	}
+
+	if (bl->stmt->bind_row_cnt >= bl->max_rows || bl->pending_bytes >= bl->max_bytes)
+		return M_sql_bulkload_flush(bl);
+
+	M_sql_stmt_bind_new_row(bl->stmt);
+	return M_SQL_ERROR_SUCCESS;
+}
+
+
+M_sql_error_t M_sql_bulkload_finish(M_sql_bulkload_t *bl)
+{
+	M_sql_error_t err;
+
+	if (bl == NULL)
+		return M_SQL_ERROR_INVALID_USE;
+
+	if (bl->err != M_SQL_ERROR_SUCCESS)
+		return bl->err;
+
+	/* Drop the blank row started by the last M_sql_bulkload_row_finish() */
+	if (bl->stmt->bind_row_cnt && bl->stmt->bind_rows[bl->stmt->bind_row_cnt - 1].col_cnt == 0)
+		bl->stmt->bind_row_cnt--;
+
+	err = M_sql_bulkload_flush(bl);
+	if (M_sql_error_is_error(err))
+		return err;
+
+	/* Nothing was ever sent */
+	if (bl->trans == NULL)
+		return M_SQL_ERROR_SUCCESS;
+
+	err       = M_sql_trans_commit(bl->trans, bl->error, sizeof(bl->error));
+	bl->trans = NULL;
+	if (M_sql_error_is_error(err)) {
+		/* Commit guarantees a rollback on failure */
+		bl->err = err;
+		return err;
+	}
+
+	return M_SQL_ERROR_SUCCESS;
+}
+
+
+M_uint64 M_sql_bulkload_rows_loaded(M_sql_bulkload_t *bl)
+{
+	if (bl == NULL)
+		return 0;
+	return bl->rows_loaded;
+}
+
+
+const char *M_sql_bulkload_get_error_string(M_sql_bulkload_t *bl)
+{
+	if (bl == NULL)
+		return NULL;
+	return bl->error;
+}
+
+
+void M_sql_bulkload_destroy(M_sql_bulkload_t *bl)
+{
+	if (bl == NULL)
+		return;
+
+	if (bl->trans != NULL)
+		M_sql_trans_rollback(bl->trans);
+
+	M_sql_stmt_destroy(bl->stmt);
+	M_list_str_destroy(bl->cols);
+	M_free(bl->table);
+	M_free(bl);
+}
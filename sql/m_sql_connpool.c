@@ -101,6 +101,12 @@ struct M_sql_connpool {
 	M_rand_t                *rand;              /*!< Random state used for generating random ids and timers */
 
 	M_hash_strvp_t          *group_insert;      /*!< Query -> Stmt reference for group insert optimization */
+	M_uint64                 group_linger_ms;   /*!< Time group insert master waits for others to join */
+	size_t                   group_max_rows;    /*!< Maximum callers in a single group insert, 0 is unlimited */
+
+	M_threadpool_t          *async_pool;        /*!< Workers for M_sql_stmt_execute_threaded(), created on first use */
+	M_threadpool_parent_t   *async_parent;      /*!< Parent handle tracking tasks dispatched to async_pool */
+	size_t                   async_pending;     /*!< Number of asynchronous executions not yet completed */
 };
 
 
@@ -664,7 +670,8 @@ static M_sql_error_t M_sql_connpool_stop(M_sql_connpool_t *pool)
 
 	/* If in active use, fail to destroy */
 	if (pool->pool_primary.used_conns || pool->pool_primary.num_waiters ||
-	    pool->pool_readonly.used_conns || pool->pool_readonly.num_waiters) {
+	    pool->pool_readonly.used_conns || pool->pool_readonly.num_waiters ||
+	    pool->async_pending) {
 		M_thread_mutex_unlock(pool->lock);
 		return M_SQL_ERROR_INUSE;
 	}
@@ -778,6 +785,18 @@ void M_sql_connpool_set_timeouts(M_sql_connpool_t *pool, M_time_t reconnect_time
 }
 
 
+void M_sql_connpool_set_groupinsert_linger(M_sql_connpool_t *pool, M_uint64 max_wait_ms, size_t max_rows)
+{
+	if (pool == NULL)
+		return;
+
+	M_thread_mutex_lock(pool->lock);
+	pool->group_linger_ms = max_wait_ms;
+	pool->group_max_rows  = max_rows;
+	M_thread_mutex_unlock(pool->lock);
+}
+
+
 M_sql_error_t M_sql_connpool_destroy(M_sql_connpool_t *pool)
 {
 	M_sql_error_t err;
@@ -789,7 +808,12 @@ M_sql_error_t M_sql_connpool_destroy(M_sql_connpool_t *pool)
 	if (err != M_SQL_ERROR_SUCCESS)
 		return err;
 
-	/* Clean up */
+	/* Clean up.  Asynchronous workers may still be returning from their last task */
+	if (pool->async_parent != NULL) {
+		M_threadpool_parent_wait(pool->async_parent);
+		M_threadpool_parent_destroy(pool->async_parent);
+		M_threadpool_destroy(pool->async_pool);
+	}
 	M_llist_destroy(pool->pool_primary.conns, M_TRUE);
 	M_llist_destroy(pool->pool_readonly.conns, M_TRUE);
 	M_free(pool->pool_primary.info);
@@ -811,6 +835,43 @@ M_sql_error_t M_sql_connpool_destroy(M_sql_connpool_t *pool)
 }
 
 
+M_threadpool_parent_t *M_sql_connpool_async_begin(M_sql_connpool_t *pool)
+{
+	M_threadpool_parent_t *parent = NULL;
+
+	M_thread_mutex_lock(pool->lock);
+
+	if (!pool->started)
+		goto done;
+
+	/* One worker per connection is all that can make progress, anything
+	 * more would just be waiting on the pool to hand out a connection */
+	if (pool->async_parent == NULL) {
+		size_t max_threads = pool->pool_primary.max_conns + pool->pool_readonly.max_conns;
+
+		pool->async_pool   = M_threadpool_create(1, max_threads, 10000, SIZE_MAX);
+		if (pool->async_pool == NULL)
+			goto done;
+		pool->async_parent = M_threadpool_parent_create(pool->async_pool);
+	}
+
+	pool->async_pending++;
+	parent = pool->async_parent;
+
+done:
+	M_thread_mutex_unlock(pool->lock);
+	return parent;
+}
+
+
+void M_sql_connpool_async_end(M_sql_connpool_t *pool)
+{
+	M_thread_mutex_lock(pool->lock);
+	pool->async_pending--;
+	M_thread_mutex_unlock(pool->lock);
+}
+
+
 size_t M_sql_connpool_active_conns(M_sql_connpool_t *pool, M_bool readonly)
 {
 	size_t                 cnt;
@@ -1363,6 +1424,15 @@ M_sql_stmt_t *M_sql_connpool_get_groupinsert(M_sql_connpool_t *pool, const char
 
 	/* Get statement handle lock before releasing pool lock */
 	M_thread_mutex_lock(stmt->group_lock);
+
+	/* Group is full, it will be executing shortly.  Hold lock on pool and
+	 * return so a new group is started in its place. */
+	if (stmt->group_max_rows && stmt->group_cnt >= stmt->group_max_rows) {
+		M_hash_strvp_remove(pool->group_insert, query, M_TRUE);
+		M_thread_mutex_unlock(stmt->group_lock);
+		return NULL;
+	}
+
 	M_thread_mutex_unlock(pool->lock);
 	return stmt;
 }
@@ -1376,6 +1446,10 @@ void M_sql_connpool_set_groupinsert(M_sql_connpool_t *pool, const char *query, M
 	/* Pool is locked on entry, no need to relock */
 	M_hash_strvp_insert(pool->group_insert, query, stmt);
 
+	/* Group behavior is fixed at creation so it doesn't need the pool lock later */
+	stmt->group_linger_ms = pool->group_linger_ms;
+	stmt->group_max_rows  = pool->group_max_rows;
+
 	/* Unlock pool handle as that is what the docs say to do for this function */
 	M_thread_mutex_unlock(pool->lock);
 }
@@ -1392,7 +1466,10 @@ void M_sql_connpool_remove_groupinsert(M_sql_connpool_t *pool, const char *query
 	M_thread_mutex_unlock(stmt->group_lock);
 
 	M_thread_mutex_lock(pool->lock);
-	M_hash_strvp_remove(pool->group_insert, query, M_TRUE);
+	/* May have already been removed when the group filled up, in which case
+	 * a newer group for the same query might be registered */
+	if (M_hash_strvp_get_direct(pool->group_insert, query) == stmt)
+		M_hash_strvp_remove(pool->group_insert, query, M_TRUE);
 
 	/* Re-lock the statement handle so we can execute */
 	M_thread_mutex_lock(stmt->group_lock);
@@ -106,6 +106,19 @@ M_sql_driver_stmt_t *M_sql_conn_get_stmt_cache(M_sql_conn_t *conn, const char *q
  */
 void M_sql_conn_set_stmt_cache(M_sql_conn_t *conn, const char *query, M_sql_driver_stmt_t *stmt);
 
+/*! Execute a sequence of statements in order on a connection, stopping at the first
+ *  error.  Consecutive statements with at most one row of bound parameters are handed
+ *  to the driver's batch callback, if any, to avoid a round trip per statement.
+ *
+ *  Statements not executed due to an earlier failure record the same error.
+ *
+ *  \param[in] conn      Connection acquired with M_sql_connpool_acquireconn()
+ *  \param[in] stmts     Array of prepared statement handles
+ *  \param[in] num_stmts Number of statement handles
+ *  \return #M_SQL_ERROR_SUCCESS if all were executed, otherwise the first error.
+ */
+M_sql_error_t M_sql_conn_execute_batch(M_sql_conn_t *conn, M_sql_stmt_t * const *stmts, size_t num_stmts);
+
 M_bool M_sql_stmt_result_clear(M_sql_stmt_t *stmt);
 M_bool M_sql_stmt_result_clear_data(M_sql_stmt_t *stmt);
 
@@ -124,6 +137,7 @@ void M_sql_trace_message_stmt(M_sql_trace_t type, M_sql_stmt_t *stmt);
 M_sql_trace_cb_t M_sql_connpool_get_cb(M_sql_connpool_t *pool, void **cb_arg);
 
 /*! Retrieve open statement handle from the pool for the same query to append more rows.
+ *  A group that has reached its maximum size is removed and treated as not found.
  *  \note returns LOCKED statement handle if one was found, otherwise returns LOCKED
  *        pool handle.
  */
@@ -140,6 +154,18 @@ void M_sql_connpool_set_groupinsert(M_sql_connpool_t *pool, const char *query, M
  */
 void M_sql_connpool_remove_groupinsert(M_sql_connpool_t *pool, const char *query, M_sql_stmt_t *stmt);
 
+/*! Mark an asynchronous statement execution as pending and retrieve the
+ *  threadpool parent to dispatch it to, creating the workers on first use.
+ *  \note must be paired with M_sql_connpool_async_end() if non-NULL is returned.
+ *  \return NULL if the pool is not started.
+ */
+M_threadpool_parent_t *M_sql_connpool_async_begin(M_sql_connpool_t *pool);
+
+/*! Mark an asynchronous statement execution started with M_sql_connpool_async_begin()
+ *  as completed.
+ */
+void M_sql_connpool_async_end(M_sql_connpool_t *pool);
+
 /* ----- Statement Info ------ */
 
 /*! Definition for statement bind column */
@@ -178,11 +204,22 @@ typedef struct {
 } M_sql_stmt_result_coldef_t;
 
 
+/*! Cell offset marking a native integer rather than data in the result data buffer.  Data
+ *  offsets are always aligned so can never be this value. */
+#define M_SQL_STMT_RESULT_CELL_INT SIZE_MAX
+
+/*! Size of each rendered native integer in the text side buffer, fits any M_int64 */
+#define M_SQL_STMT_RESULT_INT_TEXT_LEN 24
+
 /*! Definition for cell metadata */
 typedef struct {
-	size_t offset; /*!< Start offset in row buffer to cell. Always a multiple of the Alignment (M_SAFE_ALIGNMENT) */
-	size_t length; /*!< Length of data, always in string form, INCLUDING NULL terminator, except for BLOBs.  A
-	                *   length of 0 indicates a NULL column */
+	size_t offset;       /*!< Start offset in data buffer to cell. Always a multiple of the Alignment (M_SAFE_ALIGNMENT),
+	                      *   or M_SQL_STMT_RESULT_CELL_INT for a native integer (also used for booleans) */
+	union {
+		size_t  length;  /*!< Length of data, always in string form, INCLUDING NULL terminator, except for BLOBs.  A
+		                  *   length of 0 indicates a NULL column */
+		M_int64 val;     /*!< Native integer value, when offset is M_SQL_STMT_RESULT_CELL_INT */
+	} v;
 } M_sql_stmt_result_cellinfo_t;
 
 
@@ -196,11 +233,16 @@ typedef struct {
 	size_t                        alloc_rows;    /*!< Number of allocated results rows (allocated in powers of 2),
 	                                              *   but all maybe cleared but not dealloc'd when fetching next
 	                                              *   batch of rows */
-	M_sql_stmt_result_cellinfo_t *cellinfo;      /*!< Array of cells with metadata about the specific cell (start offset, length)
+	M_sql_stmt_result_cellinfo_t *cellinfo;      /*!< Array of cells with metadata about the specific cell (type, and either
+	                                              *   native value or start offset and length of data).
 	                                              *   The count of this array is (alloc_rows * num_cols), and the index to
 	                                              *   a specific cell based on row and col is  (row * num_cols + col) */
-	M_buf_t                     **rows;          /*!< Array of buffers to hold rows.  Multiple columns are stored in the buffer
-	                                              *   at alignment offsets.  The size of the array is equal to alloc_rows */
+	M_buf_t                      *data;          /*!< Buffer holding text and binary data for all cached rows.  Cells are
+	                                              *   stored at alignment offsets.  Native integers aren't stored here. */
+	char                         *int_text;      /*!< Text versions of native integer cells, M_SQL_STMT_RESULT_INT_TEXT_LEN bytes
+	                                              *   per cell indexed the same as cellinfo, empty if not rendered yet.  Only
+	                                              *   allocated once an integer is requested as text so pointers handed out
+	                                              *   stay valid, freed if cellinfo grows. */
 	size_t                        curr_col;      /*!< State Tracking. Current column being added, 1-based */
 	size_t                        total_rows;    /*!< Total number of rows fetched */
 } M_sql_stmt_result_t;
@@ -244,11 +286,14 @@ struct M_sql_stmt {
 	M_sql_trans_t       *trans;    /*!< SQL transaction handle */
 
 	/* Group Insert handling */
-	M_thread_mutex_t    *group_lock;  /*!< Mutex only initialized for M_sql_stmt_groupinsert_prepare() */
-	size_t               group_cnt;   /*!< Number of reference counts on statement handle */
-	M_sql_groupinsert_t  group_state; /*!< Boolean indicating if group operation is done.  Useful to detect a
-	                                   *   spurious wakeup from M_thread_cond_wait() */
-	M_thread_cond_t     *group_cond;  /*!< Group conditional used to let other callers know a result is available */
+	M_thread_mutex_t    *group_lock;      /*!< Mutex only initialized for M_sql_stmt_groupinsert_prepare() */
+	size_t               group_cnt;       /*!< Number of reference counts on statement handle */
+	M_sql_groupinsert_t  group_state;     /*!< Boolean indicating if group operation is done.  Useful to detect a
+	                                       *   spurious wakeup from M_thread_cond_wait() */
+	M_thread_cond_t     *group_cond;      /*!< Group conditional used to let other callers know a result is available,
+	                                       *   and to let the master know the group is full */
+	M_uint64             group_linger_ms; /*!< Time the master waits for others to join */
+	size_t               group_max_rows;  /*!< Maximum callers in the group, 0 is unlimited */
 };
 
 
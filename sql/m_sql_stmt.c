@@ -195,6 +195,28 @@ static M_sql_error_t M_sql_stmt_fetch_int(M_sql_stmt_t *stmt, M_bool is_execute_
 }
 
 
+/*! Format the query for the rows remaining at the current offset and prepare
+ *  the driver statement handle, reusing the connection's cached handle if any.
+ *  The caller is responsible for storing the returned handle in the cache (even
+ *  if NULL, which will clear the cached handle). */
+static M_sql_error_t M_sql_conn_prepare_rows(M_sql_conn_t *conn, M_sql_stmt_t *stmt)
+{
+	const M_sql_driver_t *driver = M_sql_conn_get_driver(conn);
+
+	/* Call query format callback (clear existing format *first* as it may be invalid) */
+	M_free(stmt->query_prepared);
+	stmt->query_prepared = driver->cb_queryformat(conn, stmt->query_user, stmt->query_param_cnt, M_sql_driver_stmt_bind_rows(stmt), stmt->error_msg, sizeof(stmt->error_msg));
+	if (stmt->query_prepared == NULL)
+		return M_SQL_ERROR_QUERY_PREPARE;
+
+	/* Lookup existing driver statement handle for formatted query from connection */
+	stmt->dstmt = M_sql_conn_get_stmt_cache(conn, stmt->query_prepared);
+
+	/* Call the sql driver's prepare callback, passing in existing statement handle if any */
+	return driver->cb_prepare(&stmt->dstmt, conn, stmt, stmt->error_msg, sizeof(stmt->error_msg));
+}
+
+
 /*! Perform actual execution in a loop if there are multiple bound rows while
  *  the prior grouping was successful and there are more rows remaining
  */
@@ -210,20 +232,9 @@ static M_sql_error_t M_sql_conn_execute_rows(M_sql_conn_t *conn, M_sql_stmt_t *s
 	/* Number of rows might be 0 if there are no bound parameters, so we want
 	 * to account for this possibility by making it a do { } while */
 	do {
-		/* Call query format callback (clear existing format *first* as it may be invalid) */
-		M_free(stmt->query_prepared);
-		stmt->query_prepared = driver->cb_queryformat(conn, stmt->query_user, stmt->query_param_cnt, M_sql_driver_stmt_bind_rows(stmt), stmt->error_msg, sizeof(stmt->error_msg));
-		if (stmt->query_prepared == NULL) {
-			err = M_SQL_ERROR_QUERY_PREPARE;
-			goto done;
-		}
-
-		/* Lookup existing driver statement handle for formatted query from connection */
-		stmt->dstmt = M_sql_conn_get_stmt_cache(conn, stmt->query_prepared);
+		err = M_sql_conn_prepare_rows(conn, stmt);
 
-		/* Call the sql driver's prepare callback, passing in existing statement handle if any.
-		 * Add returned handle to cache (even if NULL, which will clear the cached handle). */
-		err = driver->cb_prepare(&stmt->dstmt, conn, stmt, stmt->error_msg, sizeof(stmt->error_msg));
+		/* Add returned handle to cache (even if NULL, which will clear the cached handle). */
 		M_sql_conn_set_stmt_cache(conn, stmt->query_prepared, stmt->dstmt);
 
 		if (err != M_SQL_ERROR_SUCCESS)
@@ -251,14 +262,11 @@ done:
 }
 
 
-M_sql_error_t M_sql_conn_execute(M_sql_conn_t *conn, M_sql_stmt_t *stmt)
+/*! Validate the statement is ready for execution and reset its state. */
+static M_sql_error_t M_sql_conn_execute_start(M_sql_conn_t *conn, M_sql_stmt_t *stmt)
 {
 	M_sql_error_t         err = M_SQL_ERROR_SUCCESS;
 
-	if (conn == NULL || stmt == NULL) {
-		return M_SQL_ERROR_INVALID_USE;
-	}
-
 	/* Cache connection handle, mostly for M_sql_stmt_fetch() */
 	stmt->conn       = conn;
 	stmt->last_error = M_SQL_ERROR_SUCCESS;
@@ -326,17 +334,15 @@ M_sql_error_t M_sql_conn_execute(M_sql_conn_t *conn, M_sql_stmt_t *stmt)
 	/* Clear any existing results */
 	M_sql_stmt_result_clear(stmt);
 
-	/* Make sure if there are rows of bound paramters, and the SQL server can't handle
-	 * all rows in one execution that they are executed back to back until complete or
-	 * error. */
-	err = M_sql_conn_execute_rows(conn, stmt);
-	if (err != M_SQL_ERROR_SUCCESS && err != M_SQL_ERROR_SUCCESS_ROW)
-		goto done;
+done:
+	return err;
+}
 
-	/* Mark time before rows are fetched */
-	M_time_elapsed_start(&stmt->last_tv);
 
-done:
+/*! Record the result of execution, prefetch rows if needed, and release handles
+ *  if no rows remain. */
+static M_sql_error_t M_sql_conn_execute_finish(M_sql_stmt_t *stmt, M_sql_error_t err)
+{
 	stmt->last_error = err;
 
 	M_sql_trace_message_stmt(M_SQL_TRACE_EXECUTE_FINISH, stmt);
@@ -361,6 +367,210 @@ done:
 }
 
 
+/*! Execute a statement that has already passed M_sql_conn_execute_start() */
+static M_sql_error_t M_sql_conn_execute_started(M_sql_conn_t *conn, M_sql_stmt_t *stmt)
+{
+	M_sql_error_t err;
+
+	/* Make sure if there are rows of bound paramters, and the SQL server can't handle
+	 * all rows in one execution that they are executed back to back until complete or
+	 * error. */
+	err = M_sql_conn_execute_rows(conn, stmt);
+
+	/* Mark time before rows are fetched */
+	if (err == M_SQL_ERROR_SUCCESS || err == M_SQL_ERROR_SUCCESS_ROW)
+		M_time_elapsed_start(&stmt->last_tv);
+
+	return M_sql_conn_execute_finish(stmt, err);
+}
+
+
+M_sql_error_t M_sql_conn_execute(M_sql_conn_t *conn, M_sql_stmt_t *stmt)
+{
+	M_sql_error_t err;
+
+	if (conn == NULL || stmt == NULL) {
+		return M_SQL_ERROR_INVALID_USE;
+	}
+
+	err = M_sql_conn_execute_start(conn, stmt);
+	if (err != M_SQL_ERROR_SUCCESS)
+		return M_sql_conn_execute_finish(stmt, err);
+
+	return M_sql_conn_execute_started(conn, stmt);
+}
+
+
+/*! Maximum number of statements sent to the driver in one batch.  Each distinct
+ *  query in a batch holds a handle in the connection's statement cache until the
+ *  batch completes, so this must stay below the cache size. */
+#define M_SQL_BATCH_MAX_STMTS 16
+
+/*! Only statements that execute in a single call to the driver can be batched */
+static M_bool M_sql_stmt_is_batchable(const M_sql_stmt_t *stmt)
+{
+	size_t rows = stmt->bind_row_cnt;
+
+	/* Account for the trailing blank row M_sql_conn_execute_start() will strip */
+	if (rows > 0 && stmt->bind_rows[rows-1].col_cnt == 0)
+		rows--;
+
+	return (rows <= 1)?M_TRUE:M_FALSE;
+}
+
+
+/*! Record a statement as not executed due to an earlier statement failing */
+static void M_sql_conn_execute_skip(M_sql_stmt_t *stmt, M_sql_error_t err, M_bool started)
+{
+	M_snprintf(stmt->error_msg, sizeof(stmt->error_msg), "Not executed, earlier queued statement failed");
+
+	if (started) {
+		M_sql_conn_execute_finish(stmt, err);
+		return;
+	}
+
+	stmt->last_error = err;
+}
+
+
+/*! Check if a driver statement handle is referenced by any of the statements */
+static M_bool M_sql_conn_batch_uses_dstmt(M_sql_stmt_t * const *stmts, size_t num_stmts, const M_sql_driver_stmt_t *dstmt)
+{
+	size_t i;
+
+	for (i=0; i<num_stmts; i++) {
+		if (stmts[i]->dstmt == dstmt)
+			return M_TRUE;
+	}
+	return M_FALSE;
+}
+
+
+/*! Start and prepare as many of the statements as possible, then hand them to the
+ *  driver to execute together.  The number of statements consumed, executed or
+ *  not, is returned in num_done. */
+static M_sql_error_t M_sql_conn_execute_batch_run(M_sql_conn_t *conn, M_sql_stmt_t * const *stmts, size_t num_stmts, size_t *num_done)
+{
+	const M_sql_driver_t *driver        = M_sql_conn_get_driver(conn);
+	M_sql_stmt_t         *stmt          = NULL;
+	M_sql_error_t         prep_err      = M_SQL_ERROR_SUCCESS;
+	M_sql_error_t         err           = M_SQL_ERROR_SUCCESS;
+	M_bool                cache_pending = M_FALSE;
+	size_t                num_prepared;
+	size_t                num_executed  = 0;
+	size_t                i;
+	char                  error[256];
+
+	for (num_prepared=0; num_prepared<num_stmts; num_prepared++) {
+		M_sql_driver_stmt_t *cached;
+
+		stmt     = stmts[num_prepared];
+		prep_err = M_sql_conn_execute_start(conn, stmt);
+		if (prep_err != M_SQL_ERROR_SUCCESS)
+			break;
+
+		stmt->bind_row_offset = 0;
+		prep_err              = M_sql_conn_prepare_rows(conn, stmt);
+
+		/* If the driver replaced a cached handle still needed by an earlier statement
+		 * in this batch, caching the new handle would destroy the old one.  Send what
+		 * we have first and deal with this statement afterwards. */
+		cached = M_sql_conn_get_stmt_cache(conn, stmt->query_prepared);
+		if (cached != NULL && cached != stmt->dstmt && M_sql_conn_batch_uses_dstmt(stmts, num_prepared, cached)) {
+			cache_pending = M_TRUE;
+			break;
+		}
+
+		M_sql_conn_set_stmt_cache(conn, stmt->query_prepared, stmt->dstmt);
+		if (prep_err != M_SQL_ERROR_SUCCESS)
+			break;
+	}
+
+	*num_done = num_prepared;
+
+	if (num_prepared) {
+		M_mem_set(error, 0, sizeof(error));
+		err = driver->cb_execute_batch(conn, stmts, num_prepared, &num_executed, error, sizeof(error));
+
+		for (i=0; i<num_prepared; i++) {
+			if (i < num_executed) {
+				M_time_elapsed_start(&stmts[i]->last_tv);
+				M_sql_conn_execute_finish(stmts[i], M_SQL_ERROR_SUCCESS);
+			} else if (i == num_executed) {
+				M_str_cpy(stmts[i]->error_msg, sizeof(stmts[i]->error_msg), error);
+				/* The prepared handle may not be safe to reuse after a generic failure */
+				if (err == M_SQL_ERROR_QUERY_FAILURE)
+					M_sql_conn_set_stmt_cache(conn, stmts[i]->query_prepared, NULL);
+				M_sql_conn_execute_finish(stmts[i], err);
+			} else {
+				M_sql_conn_execute_skip(stmts[i], err, M_TRUE);
+			}
+		}
+	}
+
+	/* All statements consumed */
+	if (num_prepared == num_stmts)
+		return err;
+
+	/* Deal with the statement that stopped the batch */
+	(*num_done)++;
+
+	if (cache_pending)
+		M_sql_conn_set_stmt_cache(conn, stmt->query_prepared, stmt->dstmt);
+
+	if (M_sql_error_is_error(err)) {
+		M_sql_conn_execute_skip(stmt, err, M_TRUE);
+		return err;
+	}
+
+	if (prep_err != M_SQL_ERROR_SUCCESS)
+		return M_sql_conn_execute_finish(stmt, prep_err);
+
+	return M_sql_conn_execute_started(conn, stmt);
+}
+
+
+M_sql_error_t M_sql_conn_execute_batch(M_sql_conn_t *conn, M_sql_stmt_t * const *stmts, size_t num_stmts)
+{
+	const M_sql_driver_t *driver;
+	M_bool                has_batch;
+	M_sql_error_t         err = M_SQL_ERROR_SUCCESS;
+	size_t                i   = 0;
+
+	if (conn == NULL || stmts == NULL) {
+		return M_SQL_ERROR_INVALID_USE;
+	}
+
+	driver    = M_sql_conn_get_driver(conn);
+	has_batch = ((driver->driver_sys_version & 0xFF) >= 0x02 && driver->cb_execute_batch != NULL)?M_TRUE:M_FALSE;
+
+	while (i < num_stmts && !M_sql_error_is_error(err)) {
+		size_t cnt = 0;
+
+		if (has_batch) {
+			while (i + cnt < num_stmts && cnt < M_SQL_BATCH_MAX_STMTS && M_sql_stmt_is_batchable(stmts[i + cnt]))
+				cnt++;
+		}
+
+		/* Nothing to gain for a single statement */
+		if (cnt < 2) {
+			err = M_sql_conn_execute(conn, stmts[i]);
+			i++;
+			continue;
+		}
+
+		err = M_sql_conn_execute_batch_run(conn, stmts + i, cnt, &cnt);
+		i  += cnt;
+	}
+
+	for ( ; i<num_stmts; i++) {
+		M_sql_conn_execute_skip(stmts[i], err, M_FALSE);
+	}
+
+	return err;
+}
+
+
 M_sql_stmt_t *M_sql_conn_execute_simple(M_sql_conn_t *conn, const char *query, M_bool skip_sanity_checks)
 {
 	M_sql_stmt_t *stmt = M_sql_stmt_create();
@@ -401,6 +611,10 @@ M_sql_error_t M_sql_stmt_execute(M_sql_connpool_t *pool, M_sql_stmt_t *stmt)
 		 * thread, so we just need to wait on a signal from a conditional
 		 * and return the result. */
 		if (stmt->group_cnt != 1) {
+			/* Our row is bound, if the group is now full the master can stop lingering */
+			if (stmt->group_max_rows && stmt->group_cnt >= stmt->group_max_rows)
+				M_thread_cond_broadcast(stmt->group_cond);
+
 			/* Loop in case of spurious wake-up */
 			while (stmt->group_state != M_SQL_GROUPINSERT_FINISHED) {
 				M_thread_cond_wait(stmt->group_cond, stmt->group_lock);
@@ -414,7 +628,21 @@ M_sql_error_t M_sql_stmt_execute(M_sql_connpool_t *pool, M_sql_stmt_t *stmt)
 		/* We must be the master, so we are going to temporarily release our
 		 * hold on the mutex and yeild to potentially allow others to add
 		 * additional rows onto our statement handle before even attempting
-		 * to pull a connection handle */
+		 * to pull a connection handle.  If configured, linger waiting for
+		 * others to join.  The wait releases the lock so they can bind their
+		 * rows, and the one that fills the group wakes us. */
+		if (stmt->group_linger_ms) {
+			M_timeval_t linger_tv;
+			M_uint64    elapsed;
+
+			M_time_elapsed_start(&linger_tv);
+			while (stmt->group_max_rows == 0 || stmt->group_cnt < stmt->group_max_rows) {
+				elapsed = M_time_elapsed(&linger_tv);
+				if (elapsed >= stmt->group_linger_ms)
+					break;
+				M_thread_cond_timedwait(stmt->group_cond, stmt->group_lock, stmt->group_linger_ms - elapsed);
+			}
+		}
 		M_thread_mutex_unlock(stmt->group_lock);
 		M_thread_yield(M_TRUE); /* Forcibly yield */
 	}
@@ -527,6 +755,71 @@ done:
 }
 
 
+typedef struct {
+	M_sql_connpool_t         *pool;
+	M_sql_stmt_t             *stmt;
+	M_sql_stmt_threaded_cb_t  callback;
+	void                     *thunk;
+	M_sql_error_t             err;
+	M_threadpool_future_t    *future;
+} M_sql_stmt_threaded_t;
+
+
+static void *M_sql_stmt_execute_threaded_task(void *arg)
+{
+	M_sql_stmt_threaded_t *exec = arg;
+
+	exec->err = M_sql_stmt_execute(exec->pool, exec->stmt);
+	M_sql_connpool_async_end(exec->pool);
+	return exec;
+}
+
+
+static void M_sql_stmt_execute_threaded_done(M_event_t *event, void *result, void *cb_data)
+{
+	M_sql_stmt_threaded_t *exec = cb_data;
+
+	(void)result;
+
+	M_threadpool_future_destroy(exec->future);
+	exec->callback(event, exec->stmt, exec->err, exec->thunk);
+	M_free(exec);
+}
+
+
+M_bool M_sql_stmt_execute_threaded(M_sql_connpool_t *pool, M_sql_stmt_t *stmt, M_event_t *event, M_sql_stmt_threaded_cb_t callback, void *thunk)
+{
+	M_threadpool_parent_t *parent;
+	M_sql_stmt_threaded_t *exec;
+
+	if (pool == NULL || stmt == NULL || event == NULL || callback == NULL || stmt->group_lock != NULL)
+		return M_FALSE;
+
+	parent = M_sql_connpool_async_begin(pool);
+	if (parent == NULL)
+		return M_FALSE;
+
+	exec           = M_malloc_zero(sizeof(*exec));
+	exec->pool     = pool;
+	exec->stmt     = stmt;
+	exec->callback = callback;
+	exec->thunk    = thunk;
+
+	/* The continuation can't run until it is registered, so the future is
+	 * always recorded before the event loop sees it */
+	exec->future   = M_threadpool_dispatch_future(parent, M_sql_stmt_execute_threaded_task, exec);
+	if (!M_event_queue_future(event, exec->future, M_sql_stmt_execute_threaded_done, exec)) {
+		/* Arguments were validated, this can't happen, but don't leave the task running */
+		M_threadpool_future_wait(exec->future);
+		M_threadpool_future_destroy(exec->future);
+		M_free(exec);
+		return M_FALSE;
+	}
+
+	return M_TRUE;
+}
+
+
 M_bool M_sql_stmt_set_max_fetch_rows(M_sql_stmt_t *stmt, size_t num)
 {
 	if (stmt == NULL)
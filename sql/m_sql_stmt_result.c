@@ -26,10 +26,18 @@
 #include "base/m_defs_int.h"
 #include "m_sql_int.h"
 
-M_bool M_sql_stmt_result_clear_data(M_sql_stmt_t *stmt)
+static M_sql_stmt_result_cellinfo_t *M_sql_stmt_result_cell(M_sql_stmt_t *stmt, size_t row, size_t col)
 {
-	size_t i;
+	return &stmt->result->cellinfo[row * stmt->result->num_cols + col];
+}
+
+static M_bool M_sql_stmt_result_cell_isnull(const M_sql_stmt_result_cellinfo_t *cell)
+{
+	return (cell->offset != M_SQL_STMT_RESULT_CELL_INT && cell->v.length == 0)?M_TRUE:M_FALSE;
+}
 
+M_bool M_sql_stmt_result_clear_data(M_sql_stmt_t *stmt)
+{
 	if (stmt == NULL)
 		return M_FALSE;
 
@@ -42,10 +50,8 @@ M_bool M_sql_stmt_result_clear_data(M_sql_stmt_t *stmt)
 	 * any new rows being added */
 	stmt->result->curr_col = 0;
 
-	if (stmt->result->rows) {
-		for (i=0; i<stmt->result->num_rows; i++)
-			M_buf_truncate(stmt->result->rows[i], 0);
-	}
+	if (stmt->result->data)
+		M_buf_truncate(stmt->result->data, 0);
 
 	stmt->result->num_rows = 0;
 
@@ -53,13 +59,15 @@ M_bool M_sql_stmt_result_clear_data(M_sql_stmt_t *stmt)
 		M_mem_set(stmt->result->cellinfo, 0, sizeof(*stmt->result->cellinfo) * stmt->result->alloc_rows * stmt->result->num_cols);
 	}
 
+	if (stmt->result->int_text) {
+		M_mem_set(stmt->result->int_text, 0, M_SQL_STMT_RESULT_INT_TEXT_LEN * stmt->result->alloc_rows * stmt->result->num_cols);
+	}
+
 	return M_TRUE;
 }
 
 M_bool M_sql_stmt_result_clear(M_sql_stmt_t *stmt)
 {
-	size_t i;
-
 	if (stmt == NULL)
 		return M_FALSE;
 
@@ -73,14 +81,10 @@ M_bool M_sql_stmt_result_clear(M_sql_stmt_t *stmt)
 
 	/* Free Row MetaData */
 	M_free(stmt->result->cellinfo);
+	M_free(stmt->result->int_text);
 
 	/* Free Row Data */
-	if (stmt->result->rows) {
-		for (i=0; i<stmt->result->alloc_rows; i++) {
-			M_buf_cancel(stmt->result->rows[i]);
-		}
-	}
-	M_free(stmt->result->rows);
+	M_buf_cancel(stmt->result->data);
 
 	/* Free full result */
 	M_free(stmt->result);
@@ -161,13 +165,15 @@ M_sql_error_t M_sql_stmt_result_isnull(M_sql_stmt_t *stmt, size_t row, size_t co
 {
 	if (stmt == NULL || stmt->result == NULL || col >= stmt->result->num_cols || row >= stmt->result->num_rows || is_null == NULL)
 		return M_SQL_ERROR_INVALID_USE;
-	*is_null = (stmt->result->cellinfo[row * stmt->result->num_cols + col].length == 0)?M_TRUE:M_FALSE;
+	*is_null = M_sql_stmt_result_cell_isnull(M_sql_stmt_result_cell(stmt, row, col));
 	return M_SQL_ERROR_SUCCESS;
 }
 
 
 M_sql_error_t M_sql_stmt_result_text(M_sql_stmt_t *stmt, size_t row, size_t col, const char **text)
 {
+	M_sql_stmt_result_cellinfo_t *cell;
+
 	if (stmt == NULL || stmt->result == NULL || col >= stmt->result->num_cols || row >= stmt->result->num_rows || text == NULL)
 		return M_SQL_ERROR_INVALID_USE;
 
@@ -176,11 +182,23 @@ M_sql_error_t M_sql_stmt_result_text(M_sql_stmt_t *stmt, size_t row, size_t col,
 	if (stmt->result->col_defs[col].type == M_SQL_DATA_TYPE_UNKNOWN || stmt->result->col_defs[col].type == M_SQL_DATA_TYPE_BINARY)
 		return M_SQL_ERROR_INVALID_TYPE;
 
-	if (stmt->result->cellinfo[row * stmt->result->num_cols + col].length != 0) {
-		*text = M_buf_peek(stmt->result->rows[row]);
+	cell = M_sql_stmt_result_cell(stmt, row, col);
+	if (cell->offset == M_SQL_STMT_RESULT_CELL_INT) {
+		/* Native integer, only render text version once it's asked for */
+		char *buf;
+
+		if (stmt->result->int_text == NULL)
+			stmt->result->int_text = M_malloc_zero(M_SQL_STMT_RESULT_INT_TEXT_LEN * stmt->result->alloc_rows * stmt->result->num_cols);
+
+		buf = stmt->result->int_text + M_SQL_STMT_RESULT_INT_TEXT_LEN * (row * stmt->result->num_cols + col);
+		if (buf[0] == '\0')
+			M_snprintf(buf, M_SQL_STMT_RESULT_INT_TEXT_LEN, "%lld", cell->v.val);
+		*text = buf;
+	} else if (!M_sql_stmt_result_cell_isnull(cell)) {
+		*text = M_buf_peek(stmt->result->data);
 		/* Should never be NULL, but not bad to check anyhow I guess */
 		if (*text != NULL) {
-			(*text) += stmt->result->cellinfo[row * stmt->result->num_cols + col].offset;
+			(*text) += cell->offset;
 		}
 	}
 
@@ -198,6 +216,16 @@ M_sql_error_t M_sql_stmt_result_bool(M_sql_stmt_t *stmt, size_t row, size_t col,
 
 	*val = M_FALSE;
 
+	/* Native integers can skip the string conversion */
+	if (stmt != NULL && stmt->result != NULL && col < stmt->result->num_cols && row < stmt->result->num_rows &&
+	    M_sql_stmt_result_cell(stmt, row, col)->offset == M_SQL_STMT_RESULT_CELL_INT) {
+		M_int64 i64 = M_sql_stmt_result_cell(stmt, row, col)->v.val;
+		if (i64 != 0 && i64 != 1)
+			return M_SQL_ERROR_INVALID_TYPE;
+		*val = (i64 == 1)?M_TRUE:M_FALSE;
+		return M_SQL_ERROR_SUCCESS;
+	}
+
 	err  = M_sql_stmt_result_text(stmt, row, col, &text);
 	if (err != M_SQL_ERROR_SUCCESS)
 		return err;
@@ -247,6 +275,16 @@ M_sql_error_t M_sql_stmt_result_int32(M_sql_stmt_t *stmt, size_t row, size_t col
 
 	*val = 0;
 
+	/* Native integers can skip the string conversion */
+	if (stmt != NULL && stmt->result != NULL && col < stmt->result->num_cols && row < stmt->result->num_rows &&
+	    M_sql_stmt_result_cell(stmt, row, col)->offset == M_SQL_STMT_RESULT_CELL_INT) {
+		M_int64 i64 = M_sql_stmt_result_cell(stmt, row, col)->v.val;
+		if (i64 > M_INT32_MAX || i64 < M_INT32_MIN)
+			return M_SQL_ERROR_INVALID_TYPE;
+		*val = (M_int32)i64;
+		return M_SQL_ERROR_SUCCESS;
+	}
+
 	err  = M_sql_stmt_result_text(stmt, row, col, &text);
 	if (err != M_SQL_ERROR_SUCCESS)
 		return err;
@@ -272,6 +310,13 @@ M_sql_error_t M_sql_stmt_result_int64(M_sql_stmt_t *stmt, size_t row, size_t col
 
 	*val = 0;
 
+	/* Native integers can skip the string conversion */
+	if (stmt != NULL && stmt->result != NULL && col < stmt->result->num_cols && row < stmt->result->num_rows &&
+	    M_sql_stmt_result_cell(stmt, row, col)->offset == M_SQL_STMT_RESULT_CELL_INT) {
+		*val = M_sql_stmt_result_cell(stmt, row, col)->v.val;
+		return M_SQL_ERROR_SUCCESS;
+	}
+
 	err  = M_sql_stmt_result_text(stmt, row, col, &text);
 	if (err != M_SQL_ERROR_SUCCESS)
 		return err;
@@ -289,6 +334,8 @@ M_sql_error_t M_sql_stmt_result_int64(M_sql_stmt_t *stmt, size_t row, size_t col
 
 M_sql_error_t M_sql_stmt_result_binary(M_sql_stmt_t *stmt, size_t row, size_t col, const M_uint8 **bin, size_t *bin_size)
 {
+	M_sql_stmt_result_cellinfo_t *cell;
+
 	if (stmt == NULL || stmt->result == NULL || col >= stmt->result->num_cols || row >= stmt->result->num_rows || bin == NULL || bin_size == NULL)
 		return M_SQL_ERROR_INVALID_USE;
 
@@ -298,12 +345,13 @@ M_sql_error_t M_sql_stmt_result_binary(M_sql_stmt_t *stmt, size_t row, size_t co
 	if (stmt->result->col_defs[col].type != M_SQL_DATA_TYPE_BINARY && stmt->result->col_defs[col].type != M_SQL_DATA_TYPE_NULL)
 		return M_SQL_ERROR_INVALID_TYPE;
 
-	if (stmt->result->cellinfo[row * stmt->result->num_cols + col].length != 0) {
-		*bin = (const M_uint8 *)M_buf_peek(stmt->result->rows[row]);
+	cell = M_sql_stmt_result_cell(stmt, row, col);
+	if (cell->offset != M_SQL_STMT_RESULT_CELL_INT && !M_sql_stmt_result_cell_isnull(cell)) {
+		*bin = (const M_uint8 *)M_buf_peek(stmt->result->data);
 		/* Should never be NULL, but not bad to check anyhow I guess */
 		if (*bin != NULL) {
-			(*bin)   += stmt->result->cellinfo[row * stmt->result->num_cols + col].offset;
-			*bin_size = stmt->result->cellinfo[row * stmt->result->num_cols + col].length - 1; /* Remove NULL term! */
+			(*bin)   += cell->offset;
+			*bin_size = cell->v.length - 1; /* Remove NULL term! */
 		}
 	}
 
@@ -593,9 +641,7 @@ M_bool M_sql_driver_stmt_result_set_col_type(M_sql_stmt_t *stmt, size_t col, M_s
 
 static void M_sql_driver_stmt_result_col_end(M_sql_stmt_t *stmt)
 {
-	size_t col;
-	size_t row;
-	size_t cell;
+	M_sql_stmt_result_cellinfo_t *cell;
 
 	if (stmt == NULL || stmt->result == NULL)
 		return;
@@ -604,10 +650,11 @@ static void M_sql_driver_stmt_result_col_end(M_sql_stmt_t *stmt)
 	if (stmt->result->curr_col == 0 || stmt->result->num_rows == 0 || stmt->result->curr_col-1 >= stmt->result->num_cols)
 		return;
 
-	col                                 = stmt->result->curr_col-1;
-	row                                 = stmt->result->num_rows-1;
-	cell                                = row * stmt->result->num_cols + col;
-	stmt->result->cellinfo[cell].length = M_buf_len(stmt->result->rows[row]) - stmt->result->cellinfo[cell].offset;
+	cell = M_sql_stmt_result_cell(stmt, stmt->result->num_rows-1, stmt->result->curr_col-1);
+
+	/* Native values were already recorded, anything else is NULL unless data was written */
+	if (cell->offset != M_SQL_STMT_RESULT_CELL_INT)
+		cell->v.length = M_buf_len(stmt->result->data) - cell->offset;
 
 	stmt->result->curr_col++;
 
@@ -616,10 +663,9 @@ static void M_sql_driver_stmt_result_col_end(M_sql_stmt_t *stmt)
 
 M_buf_t *M_sql_driver_stmt_result_col_start(M_sql_stmt_t *stmt)
 {
-	size_t row;
-	size_t col;
-	size_t cell;
-	size_t len;
+	M_sql_stmt_result_cellinfo_t *cell;
+	size_t                        col;
+	size_t                        len;
 
 	/* Not initialized */
 	if (stmt == NULL || stmt->result == NULL || stmt->result->num_cols == 0)
@@ -635,13 +681,14 @@ M_buf_t *M_sql_driver_stmt_result_col_start(M_sql_stmt_t *stmt)
 		if (stmt->result->num_rows > stmt->result->alloc_rows) {
 			stmt->result->alloc_rows = M_size_t_round_up_to_power_of_two(stmt->result->num_rows);
 			stmt->result->cellinfo   = M_realloc_zero(stmt->result->cellinfo, (stmt->result->alloc_rows * stmt->result->num_cols) * sizeof(*stmt->result->cellinfo));
-			stmt->result->rows       = M_realloc_zero(stmt->result->rows, stmt->result->alloc_rows * sizeof(*stmt->result->rows));
+			/* Sized to match cellinfo, reallocated on next use */
+			M_free(stmt->result->int_text);
+			stmt->result->int_text   = NULL;
 		}
 
-		row = stmt->result->num_rows-1;
 		/* Allocate buffer if not yet allocated */
-		if (stmt->result->rows[row] == NULL) {
-			stmt->result->rows[row] = M_buf_create();
+		if (stmt->result->data == NULL) {
+			stmt->result->data = M_buf_create();
 		}
 	} else {
 		/* Not starting a new row ... just close the prior column */
@@ -649,9 +696,7 @@ M_buf_t *M_sql_driver_stmt_result_col_start(M_sql_stmt_t *stmt)
 	}
 
 	col   = stmt->result->curr_col-1;
-	row   = stmt->result->num_rows-1;
-	cell  = row * stmt->result->num_cols + col;
-	len   = M_buf_len(stmt->result->rows[row]);
+	len   = M_buf_len(stmt->result->data);
 
 	/* Can't add more columns than we're allowed */
 	if (col >= stmt->result->num_cols)
@@ -660,12 +705,34 @@ M_buf_t *M_sql_driver_stmt_result_col_start(M_sql_stmt_t *stmt)
 	/* Align offset for safety */
 	if (len % M_SAFE_ALIGNMENT != 0) {
 		size_t pad_align = M_SAFE_ALIGNMENT - (len % M_SAFE_ALIGNMENT);
-		M_buf_add_fill(stmt->result->rows[row], 0, pad_align);
+		M_buf_add_fill(stmt->result->data, 0, pad_align);
 	}
 
-	stmt->result->cellinfo[cell].offset = M_buf_len(stmt->result->rows[row]);
+	cell           = M_sql_stmt_result_cell(stmt, stmt->result->num_rows-1, col);
+	cell->offset   = M_buf_len(stmt->result->data);
+	cell->v.length = 0;
+
+	return stmt->result->data;
+}
 
-	return stmt->result->rows[row];
+
+M_bool M_sql_driver_stmt_result_col_int(M_sql_stmt_t *stmt, M_int64 val)
+{
+	M_sql_stmt_result_cellinfo_t *cell;
+
+	if (stmt == NULL || stmt->result == NULL || stmt->result->curr_col == 0 || stmt->result->num_rows == 0 ||
+	    stmt->result->curr_col-1 >= stmt->result->num_cols)
+		return M_FALSE;
+
+	cell = M_sql_stmt_result_cell(stmt, stmt->result->num_rows-1, stmt->result->curr_col-1);
+
+	/* Data was already written for this column */
+	if (cell->offset != M_SQL_STMT_RESULT_CELL_INT && M_buf_len(stmt->result->data) != cell->offset)
+		return M_FALSE;
+
+	cell->offset = M_SQL_STMT_RESULT_CELL_INT;
+	cell->v.val  = val;
+	return M_TRUE;
 }
 
 
@@ -27,10 +27,13 @@
 #include "m_sql_int.h"
 
 struct M_sql_trans {
-	M_timeval_t   start_tv;
-	M_timeval_t   last_tv;
-	M_sql_conn_t *conn;
-	char          error[256];
+	M_timeval_t    start_tv;
+	M_timeval_t    last_tv;
+	M_sql_conn_t  *conn;
+	char           error[256];
+	M_sql_stmt_t **queue;       /*!< Statements queued by M_sql_trans_queue() pending execution */
+	size_t         queue_cnt;   /*!< Number of queued statements */
+	size_t         queue_alloc; /*!< Allocated size of queue */
 };
 
 
@@ -42,6 +45,7 @@ static void M_sql_trans_release(M_sql_trans_t *trans)
 	if (trans->conn)
 		M_sql_connpool_release_conn(trans->conn);
 
+	M_free(trans->queue);
 	M_free(trans);
 }
 
@@ -176,6 +180,14 @@ M_sql_error_t M_sql_trans_commit(M_sql_trans_t *trans, char *error, size_t error
 		return err;
 	}
 
+	/* Anything still queued must be executed before committing */
+	err = M_sql_trans_flush(trans);
+	if (M_sql_error_is_error(err)) {
+		M_str_cpy(error, error_size, trans->error);
+		M_sql_trans_rollback(trans);
+		return err;
+	}
+
 	M_sql_trace_message_trans(M_SQL_TRACE_COMMIT_START, trans, M_SQL_ERROR_SUCCESS, NULL);
 
 	driver = M_sql_conn_get_driver(trans->conn);
@@ -206,6 +218,14 @@ M_sql_error_t M_sql_trans_execute(M_sql_trans_t *trans, M_sql_stmt_t *stmt)
 		return stmt->last_error;
 	}
 
+	/* Queued statements must be executed first to preserve ordering */
+	err = M_sql_trans_flush(trans);
+	if (M_sql_error_is_error(err)) {
+		M_snprintf(stmt->error_msg, sizeof(stmt->error_msg), "Not executed, earlier queued statement failed");
+		stmt->last_error = err;
+		return err;
+	}
+
 	M_time_elapsed_start(&trans->last_tv);
 
 	err = M_sql_conn_execute(trans->conn, stmt);
@@ -223,6 +243,76 @@ M_sql_error_t M_sql_trans_execute(M_sql_trans_t *trans, M_sql_stmt_t *stmt)
 }
 
 
+M_sql_error_t M_sql_trans_queue(M_sql_trans_t *trans, M_sql_stmt_t *stmt)
+{
+	if (trans == NULL || stmt == NULL) {
+		return M_SQL_ERROR_INVALID_USE;
+	}
+
+	/* Results must be complete once flushed, and group inserts are executed by
+	 * whichever caller gets there first so can't be deferred */
+	if (stmt->max_fetch_rows != 0 || stmt->group_lock != NULL) {
+		M_snprintf(stmt->error_msg, sizeof(stmt->error_msg), "statement cannot be queued");
+		stmt->last_error = M_SQL_ERROR_INVALID_USE;
+		return stmt->last_error;
+	}
+
+	if (trans->queue_cnt == trans->queue_alloc) {
+		trans->queue_alloc = (trans->queue_alloc == 0)?16:(trans->queue_alloc * 2);
+		trans->queue       = M_realloc(trans->queue, sizeof(*trans->queue) * trans->queue_alloc);
+	}
+
+	trans->queue[trans->queue_cnt++] = stmt;
+	return M_SQL_ERROR_SUCCESS;
+}
+
+
+M_sql_error_t M_sql_trans_flush(M_sql_trans_t *trans)
+{
+	M_sql_error_t err;
+	size_t        i;
+
+	if (trans == NULL) {
+		return M_SQL_ERROR_INVALID_USE;
+	}
+
+	if (trans->queue_cnt == 0) {
+		return M_SQL_ERROR_SUCCESS;
+	}
+
+	if (M_sql_conn_get_state(trans->conn) != M_SQL_CONN_STATE_OK) {
+		for (i=0; i<trans->queue_cnt; i++) {
+			M_snprintf(trans->queue[i]->error_msg, sizeof(trans->queue[i]->error_msg), "rollback required");
+			trans->queue[i]->last_error = M_SQL_ERROR_QUERY_DEADLOCK;
+		}
+		trans->queue_cnt = 0;
+		return M_SQL_ERROR_QUERY_DEADLOCK;
+	}
+
+	M_time_elapsed_start(&trans->last_tv);
+
+	err = M_sql_conn_execute_batch(trans->conn, trans->queue, trans->queue_cnt);
+
+	/* Capture error message of the statement that failed to the transaction
+	 * handle so we can augment errors in M_sql_trans_process() automatically */
+	if (M_sql_error_is_error(err)) {
+		for (i=0; i<trans->queue_cnt; i++) {
+			if (M_sql_error_is_error(trans->queue[i]->last_error)) {
+				M_str_cpy(trans->error, sizeof(trans->error), M_sql_stmt_get_error_string(trans->queue[i]));
+				break;
+			}
+		}
+	}
+
+	trans->queue_cnt = 0;
+
+	/* Catch a connectivity or rollback error */
+	M_sql_conn_set_state_from_error(trans->conn, err);
+
+	return err;
+}
+
+
 M_uint64 M_sql_trans_duration_start_ms(M_sql_trans_t *trans)
 {
 	if (trans == NULL)
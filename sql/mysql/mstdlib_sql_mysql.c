@@ -836,18 +836,19 @@ static M_sql_error_t mysql_cb_fetch(M_sql_conn_t *conn, M_sql_stmt_t *stmt, char
 			case MYSQL_TYPE_STRING:
 				M_buf_add_bytes(buf, (const char *)result->bind[i].buffer, result->col_length[i]);
 				break;
+			/* Integers are stored natively, nothing is written to buf (not even a NULL terminator) */
 			case MYSQL_TYPE_TINY:
-				M_buf_add_int(buf, *((M_int8 *)result->bind[i].buffer));
-				break;
+				M_sql_driver_stmt_result_col_int(stmt, *((M_int8 *)result->bind[i].buffer));
+				continue;
 			case MYSQL_TYPE_SHORT:
-				M_buf_add_int(buf, *((M_int16 *)result->bind[i].buffer));
-				break;
+				M_sql_driver_stmt_result_col_int(stmt, *((M_int16 *)result->bind[i].buffer));
+				continue;
 			case MYSQL_TYPE_LONG:
-				M_buf_add_int(buf, *((M_int32 *)result->bind[i].buffer));
-				break;
+				M_sql_driver_stmt_result_col_int(stmt, *((M_int32 *)result->bind[i].buffer));
+				continue;
 			case MYSQL_TYPE_LONGLONG:
-				M_buf_add_int(buf, *((M_int64 *)result->bind[i].buffer));
-				break;
+				M_sql_driver_stmt_result_col_int(stmt, *((M_int64 *)result->bind[i].buffer));
+				continue;
 			default:
 				M_snprintf(error, error_size, "column %zu unrecognized data type: %d", i, (int)result->bind[i].buffer_type);
 				return M_SQL_ERROR_INVALID_USE;
@@ -1029,6 +1030,9 @@ static M_sql_driver_t M_sql_mysql = {
 	mysql_cb_append_bitop,        /* Callback used to append a bit operation */
 
 	NULL,                         /* Handle for loaded driver - must be initialized to NULL */
+
+	NULL,                         /* Callback used to load rows using a native bulk mechanism */
+	NULL,                         /* Callback used to execute a sequence of statements in a single round trip */
 };
 
 /*! Defines function that references M_sql_driver_t M_sql_##name for module loading */
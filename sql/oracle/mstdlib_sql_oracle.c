@@ -1416,6 +1416,9 @@ static M_sql_driver_t M_sql_oracle = {
 	oracle_cb_append_bitop,        /* Callback used to append a bit operation */
 
 	NULL,                          /* Handle for loaded driver - must be initialized to NULL */
+
+	NULL,                          /* Callback used to load rows using a native bulk mechanism */
+	NULL,                          /* Callback used to execute a sequence of statements in a single round trip */
 };
 
 /*! Defines function that references M_sql_driver_t M_sql_##name for module loading */
@@ -601,9 +601,9 @@ static M_sql_data_type_t pgsql_get_mtype(PGresult *res, size_t col, size_t *max_
 }
 
 
-static void pgsql_fetch_result_metadata(M_sql_driver_stmt_t *dstmt, M_sql_stmt_t *stmt)
+static void pgsql_fetch_result_metadata(PGresult *res, M_sql_stmt_t *stmt)
 {
-	size_t num_cols = (size_t)PQnfields(dstmt->res);
+	size_t num_cols = (size_t)PQnfields(res);
 	size_t i;
 
 	M_sql_driver_stmt_result_set_num_cols(stmt, num_cols);
@@ -612,9 +612,9 @@ static void pgsql_fetch_result_metadata(M_sql_driver_stmt_t *dstmt, M_sql_stmt_t
 
 	for (i=0; i<num_cols; i++) {
 		size_t            max_len = 0;
-		M_sql_data_type_t mtype   = pgsql_get_mtype(dstmt->res, i, &max_len);
+		M_sql_data_type_t mtype   = pgsql_get_mtype(res, i, &max_len);
 
-		M_sql_driver_stmt_result_set_col_name(stmt, i, PQfname(dstmt->res, (int)i));
+		M_sql_driver_stmt_result_set_col_name(stmt, i, PQfname(res, (int)i));
 		M_sql_driver_stmt_result_set_col_type(stmt, i, mtype, max_len);
 	}
 }
@@ -685,7 +685,7 @@ static M_sql_error_t pgsql_cb_execute(M_sql_conn_t *conn, M_sql_stmt_t *stmt, si
 
 	/* We need to get metadata here for result output (column definitions) */
 	if (err == M_SQL_ERROR_SUCCESS_ROW) {
-		pgsql_fetch_result_metadata(dstmt, stmt);
+		pgsql_fetch_result_metadata(dstmt->res, stmt);
 	}
 
 	if (err != M_SQL_ERROR_SUCCESS_ROW) {
@@ -702,6 +702,43 @@ static M_sql_error_t pgsql_cb_execute(M_sql_conn_t *conn, M_sql_stmt_t *stmt, si
 }
 
 
+/*! Append all rows in a result to the statement's result set, returns the number of rows */
+static size_t pgsql_result_add_rows(PGresult *res, M_sql_stmt_t *stmt)
+{
+	size_t num_cols = M_sql_stmt_result_num_cols(stmt);
+	size_t num_rows = (size_t)PQntuples(res);
+	size_t row;
+	size_t i;
+
+	for (row = 0; row < num_rows; row++) {
+		for (i=0; i < num_cols; i++) {
+			M_buf_t       *buf = M_sql_driver_stmt_result_col_start(stmt);
+			size_t         len = 0;
+			unsigned char *binary = NULL;
+
+			/* Don't write anything at all for NULL fields */
+			if (PQgetisnull(res, (int)row, (int)i))
+				continue;
+
+			/* Non-binary data is already in string form */
+			if (M_sql_stmt_result_col_type(stmt, i, NULL) != M_SQL_DATA_TYPE_BINARY) {
+				M_buf_add_str(buf, PQgetvalue(res, (int)row, (int)i));
+			} else {
+				/* Binary Data */
+				binary = PQunescapeBytea((const unsigned char *)PQgetvalue(res, (int)row, (int)i), &len);
+				M_buf_add_bytes(buf, binary, len);
+				PQfreemem(binary);
+			}
+			/* All columns with data require NULL termination, even binary.  Otherwise its considered a NULL column. */
+			M_buf_add_byte(buf, 0); /* Manually add NULL terminator */
+		}
+		M_sql_driver_stmt_result_row_finish(stmt);
+	}
+
+	return num_rows;
+}
+
+
 /* XXX: Fetch Cancel ? */
 
 static M_sql_error_t pgsql_cb_fetch(M_sql_conn_t *conn, M_sql_stmt_t *stmt, char *error, size_t error_size)
@@ -709,10 +746,7 @@ static M_sql_error_t pgsql_cb_fetch(M_sql_conn_t *conn, M_sql_stmt_t *stmt, char
 	M_sql_driver_stmt_t            *dstmt   = M_sql_driver_stmt_get_stmt(stmt);
 	M_sql_driver_conn_t            *dconn   = M_sql_driver_conn_get_conn(conn);
 	M_sql_error_t                   err     = M_SQL_ERROR_SUCCESS_ROW;
-	size_t                          i;
-	size_t                          row;
 	ExecStatusType                  status;
-	size_t                          num_cols;
 	size_t                          num_rows;
 
 	if (dstmt->res == NULL) {
@@ -729,34 +763,8 @@ static M_sql_error_t pgsql_cb_fetch(M_sql_conn_t *conn, M_sql_stmt_t *stmt, char
 		goto done;
 	}
 
-	num_cols = M_sql_stmt_result_num_cols(stmt);
-	num_rows = (size_t)PQntuples(dstmt->res);
-
 	/* Grab the result set */
-	for (row = 0; row < num_rows; row++) {
-		for (i=0; i < num_cols; i++) {
-			M_buf_t       *buf = M_sql_driver_stmt_result_col_start(stmt);
-			size_t         len = 0;
-			unsigned char *binary = NULL;
-
-			/* Don't write anything at all for NULL fields */
-			if (PQgetisnull(dstmt->res, (int)row, (int)i))
-				continue;
-
-			/* Non-binary data is already in string form */
-			if (M_sql_stmt_result_col_type(stmt, i, NULL) != M_SQL_DATA_TYPE_BINARY) {
-				M_buf_add_str(buf, PQgetvalue(dstmt->res, (int)row, (int)i));
-			} else {
-				/* Binary Data */
-				binary = PQunescapeBytea((const unsigned char *)PQgetvalue(dstmt->res, (int)row, (int)i), &len);
-				M_buf_add_bytes(buf, binary, len);
-				PQfreemem(binary);
-			}
-			/* All columns with data require NULL termination, even binary.  Otherwise its considered a NULL column. */
-			M_buf_add_byte(buf, 0); /* Manually add NULL terminator */
-		}
-		M_sql_driver_stmt_result_row_finish(stmt);
-	}
+	num_rows = pgsql_result_add_rows(dstmt->res, stmt);
 
 	/* Fetch next row */
 	PQclear(dstmt->res);
@@ -860,6 +868,297 @@ static M_sql_error_t pgsql_cb_commit(M_sql_conn_t *conn, char *error, size_t err
 }
 
 
+/* COPY text format, tab delimited, newline terminated rows, \N for NULL */
+static void pgsql_bulkload_add_text(M_buf_t *buf, const char *text, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		switch (text[i]) {
+			case '\\':
+				M_buf_add_str(buf, "\\\\");
+				break;
+			case '\n':
+				M_buf_add_str(buf, "\\n");
+				break;
+			case '\r':
+				M_buf_add_str(buf, "\\r");
+				break;
+			case '\t':
+				M_buf_add_str(buf, "\\t");
+				break;
+			default:
+				M_buf_add_byte(buf, (unsigned char)text[i]);
+				break;
+		}
+	}
+}
+
+
+static void pgsql_bulkload_add_row(M_buf_t *buf, M_sql_stmt_t *stmt, size_t row)
+{
+	size_t num_cols = M_sql_driver_stmt_bind_cnt(stmt);
+	size_t i;
+
+	for (i=0; i<num_cols; i++) {
+		if (i != 0)
+			M_buf_add_byte(buf, '\t');
+
+		switch (M_sql_driver_stmt_bind_get_type(stmt, row, i)) {
+			case M_SQL_DATA_TYPE_BOOL:
+				M_buf_add_byte(buf, M_sql_driver_stmt_bind_get_bool(stmt, row, i)?'t':'f');
+				break;
+			case M_SQL_DATA_TYPE_INT16:
+				M_buf_add_int(buf, M_sql_driver_stmt_bind_get_int16(stmt, row, i));
+				break;
+			case M_SQL_DATA_TYPE_INT32:
+				M_buf_add_int(buf, M_sql_driver_stmt_bind_get_int32(stmt, row, i));
+				break;
+			case M_SQL_DATA_TYPE_INT64:
+				M_buf_add_int(buf, M_sql_driver_stmt_bind_get_int64(stmt, row, i));
+				break;
+			case M_SQL_DATA_TYPE_TEXT:
+				pgsql_bulkload_add_text(buf, M_sql_driver_stmt_bind_get_text(stmt, row, i), M_sql_driver_stmt_bind_get_text_len(stmt, row, i));
+				break;
+			case M_SQL_DATA_TYPE_BINARY:
+				/* bytea hex input format, backslash escaped for COPY */
+				M_buf_add_str(buf, "\\\\x");
+				M_buf_add_str_hex(buf, M_sql_driver_stmt_bind_get_binary(stmt, row, i), M_sql_driver_stmt_bind_get_binary_len(stmt, row, i));
+				break;
+			case M_SQL_DATA_TYPE_NULL:
+			case M_SQL_DATA_TYPE_UNKNOWN:
+				M_buf_add_str(buf, "\\N");
+				break;
+		}
+	}
+	M_buf_add_byte(buf, '\n');
+}
+
+
+static M_sql_error_t pgsql_cb_bulkload(M_sql_conn_t *conn, const char *table, const M_list_str_t *cols, M_sql_stmt_t *stmt, char *error, size_t error_size)
+{
+	M_sql_driver_conn_t *dconn    = M_sql_driver_conn_get_conn(conn);
+	size_t               num_rows = M_sql_driver_stmt_bind_rows(stmt);
+	M_buf_t             *buf      = M_buf_create();
+	PGresult            *res;
+	M_sql_error_t        err      = M_SQL_ERROR_SUCCESS;
+	char                *query;
+	size_t               i;
+
+	M_buf_add_str(buf, "COPY \"");
+	M_buf_add_str(buf, table);
+	M_buf_add_str(buf, "\" (");
+	for (i=0; i<M_list_str_len(cols); i++) {
+		if (i != 0)
+			M_buf_add_str(buf, ", ");
+		M_buf_add_byte(buf, '"');
+		M_buf_add_str(buf, M_list_str_at(cols, i));
+		M_buf_add_byte(buf, '"');
+	}
+	M_buf_add_str(buf, ") FROM STDIN");
+	query = M_buf_finish_str(buf, NULL);
+
+	res = PQexec(dconn->conn, query);
+	M_free(query);
+	if (res == NULL) {
+		M_snprintf(error, error_size, "PQexec failed: %s", PQerrorMessage(dconn->conn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+	if (PQresultStatus(res) != PGRES_COPY_IN) {
+		err = pgsql_resolve_error(PQresultErrorField(res, PG_DIAG_SQLSTATE), 0);
+		M_snprintf(error, error_size, "%s: %s", PQresultErrorField(res, PG_DIAG_SQLSTATE), PQresultErrorMessage(res));
+		PQclear(res);
+		pgsql_clear_remaining_data(conn);
+		return err;
+	}
+	PQclear(res);
+
+	/* Stream the rows in chunks so the encoded copy is never much larger
+	 * than the chunk size, regardless of the number of rows */
+	buf = M_buf_create();
+	for (i=0; i<num_rows; i++) {
+		pgsql_bulkload_add_row(buf, stmt, i);
+		if (M_buf_len(buf) < 64 * 1024 && i != num_rows - 1)
+			continue;
+
+		if (PQputCopyData(dconn->conn, M_buf_peek(buf), (int)M_buf_len(buf)) != 1) {
+			M_snprintf(error, error_size, "PQputCopyData failed: %s", PQerrorMessage(dconn->conn));
+			pgsql_sanitize_error(error);
+			M_buf_cancel(buf);
+			return M_SQL_ERROR_CONN_LOST;
+		}
+		M_buf_truncate(buf, 0);
+	}
+	M_buf_cancel(buf);
+
+	if (PQputCopyEnd(dconn->conn, NULL) != 1) {
+		M_snprintf(error, error_size, "PQputCopyEnd failed: %s", PQerrorMessage(dconn->conn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+
+	res = PQgetResult(dconn->conn);
+	if (res == NULL) {
+		M_snprintf(error, error_size, "PQgetResult failed: %s", PQerrorMessage(dconn->conn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+
+	if (PQresultStatus(res) == PGRES_COMMAND_OK) {
+		M_sql_driver_stmt_result_set_affected_rows(stmt, (size_t)M_str_to_uint64(PQcmdTuples(res)));
+	} else {
+		err = pgsql_resolve_error(PQresultErrorField(res, PG_DIAG_SQLSTATE), 0);
+		M_snprintf(error, error_size, "%s: %s", PQresultErrorField(res, PG_DIAG_SQLSTATE), PQresultErrorMessage(res));
+	}
+	PQclear(res);
+	pgsql_clear_remaining_data(conn);
+
+	return err;
+}
+
+
+#ifdef LIBPQ_HAS_PIPELINING
+/*! Read all results for one statement sent in pipeline mode.  Once a statement
+ *  fails, the server reports each remaining statement as aborted. */
+static M_sql_error_t pgsql_batch_read_result(PGconn *pgconn, M_sql_stmt_t *stmt, char *error, size_t error_size)
+{
+	M_sql_error_t  err        = M_SQL_ERROR_SUCCESS;
+	M_bool         has_result = M_FALSE;
+	PGresult      *res;
+
+	/* Each statement's results are terminated by a NULL result */
+	while ((res = PQgetResult(pgconn)) != NULL) {
+		has_result = M_TRUE;
+
+		switch (PQresultStatus(res)) {
+			case PGRES_COMMAND_OK:
+				M_sql_driver_stmt_result_set_affected_rows(stmt, (size_t)M_str_to_uint32(PQcmdTuples(res)));
+				if (PQnfields(res))
+					pgsql_fetch_result_metadata(res, stmt);
+				break;
+			case PGRES_TUPLES_OK:
+				pgsql_fetch_result_metadata(res, stmt);
+				pgsql_result_add_rows(res, stmt);
+				break;
+			case PGRES_PIPELINE_ABORTED:
+				if (err == M_SQL_ERROR_SUCCESS) {
+					err = M_SQL_ERROR_QUERY_FAILURE;
+					M_snprintf(error, error_size, "pipeline aborted");
+				}
+				break;
+			default:
+				if (err == M_SQL_ERROR_SUCCESS) {
+					err = pgsql_resolve_error(PQresultErrorField(res, PG_DIAG_SQLSTATE), 0);
+					M_snprintf(error, error_size, "%s: %s", PQresultErrorField(res, PG_DIAG_SQLSTATE), PQresultErrorMessage(res));
+				}
+				break;
+		}
+		PQclear(res);
+	}
+
+	if (!has_result) {
+		M_snprintf(error, error_size, "PQgetResult failed: %s", PQerrorMessage(pgconn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+
+	return err;
+}
+
+
+static M_sql_error_t pgsql_cb_execute_batch(M_sql_conn_t *conn, M_sql_stmt_t * const *stmts, size_t num_stmts, size_t *num_executed, char *error, size_t error_size)
+{
+	M_sql_driver_conn_t *dconn    = M_sql_driver_conn_get_conn(conn);
+	M_sql_error_t        err      = M_SQL_ERROR_SUCCESS;
+	M_sql_error_t        send_err = M_SQL_ERROR_SUCCESS;
+	char                 send_error[256];
+	size_t               num_sent;
+	size_t               i;
+	PGresult            *res;
+
+	*num_executed = 0;
+	M_mem_set(send_error, 0, sizeof(send_error));
+
+	if (!PQenterPipelineMode(dconn->conn)) {
+		M_snprintf(error, error_size, "PQenterPipelineMode failed: %s", PQerrorMessage(dconn->conn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+
+	/* Queue all statements.  Repeated queries share a prepared statement, so the parameters
+	 * have to be rebound from each statement right before it is sent. */
+	for (num_sent=0; num_sent<num_stmts; num_sent++) {
+		M_sql_driver_stmt_t *dstmt = M_sql_driver_stmt_get_stmt(stmts[num_sent]);
+		char                 psid[32];
+
+		send_err = pgsql_bind_params(dstmt, stmts[num_sent], M_TRUE /* ReBind */, send_error, sizeof(send_error));
+		if (send_err != M_SQL_ERROR_SUCCESS)
+			break;
+
+		M_snprintf(psid, sizeof(psid), "ps%zu", dstmt->id);
+		if (!PQsendQueryPrepared(dconn->conn, psid, (int)dstmt->bind.cnt, dstmt->bind.values,
+		    dstmt->bind.lengths, dstmt->bind.formats, 0 /* Always text response, we can't handle every OID otherwise */)) {
+			M_snprintf(send_error, sizeof(send_error), "PQsendQueryPrepared failed: %s", PQerrorMessage(dconn->conn));
+			pgsql_sanitize_error(send_error);
+			send_err = M_SQL_ERROR_CONN_LOST;
+			break;
+		}
+	}
+
+	if (!PQpipelineSync(dconn->conn)) {
+		M_snprintf(error, error_size, "PQpipelineSync failed: %s", PQerrorMessage(dconn->conn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+
+	/* Results come back in the order the statements were sent, the first
+	 * failure is the one reported */
+	for (i=0; i<num_sent; i++) {
+		M_sql_error_t stmt_err = pgsql_batch_read_result(dconn->conn, stmts[i], error, error_size);
+
+		if (stmt_err == M_SQL_ERROR_CONN_LOST) {
+			if (err == M_SQL_ERROR_SUCCESS)
+				err = stmt_err;
+			return err;
+		}
+
+		if (err == M_SQL_ERROR_SUCCESS) {
+			if (stmt_err != M_SQL_ERROR_SUCCESS) {
+				err = stmt_err;
+			} else {
+				(*num_executed)++;
+			}
+		}
+	}
+
+	res = PQgetResult(dconn->conn);
+	if (res == NULL || PQresultStatus(res) != PGRES_PIPELINE_SYNC) {
+		if (res != NULL)
+			PQclear(res);
+		M_snprintf(error, error_size, "PQgetResult failed to return pipeline sync: %s", PQerrorMessage(dconn->conn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+	PQclear(res);
+
+	if (!PQexitPipelineMode(dconn->conn)) {
+		M_snprintf(error, error_size, "PQexitPipelineMode failed: %s", PQerrorMessage(dconn->conn));
+		pgsql_sanitize_error(error);
+		return M_SQL_ERROR_CONN_LOST;
+	}
+
+	/* Only report a failure to send if everything sent before it succeeded */
+	if (err == M_SQL_ERROR_SUCCESS && send_err != M_SQL_ERROR_SUCCESS) {
+		M_str_cpy(error, error_size, send_error);
+		err = send_err;
+	}
+
+	return err;
+}
+#endif
+
+
 static M_sql_driver_t M_sql_postgresql = {
 	M_SQL_DRIVER_VERSION,         /* Driver/Module subsystem version */
 	"postgresql",                 /* Short name of module */
@@ -888,6 +1187,13 @@ static M_sql_driver_t M_sql_postgresql = {
 	pgsql_cb_append_bitop,        /* Callback used to append a bit operation */
 
 	NULL,                         /* Handle for loaded driver - must be initialized to NULL */
+
+	pgsql_cb_bulkload,            /* Callback used to load rows using a native bulk mechanism */
+#ifdef LIBPQ_HAS_PIPELINING
+	pgsql_cb_execute_batch,       /* Callback used to execute a sequence of statements in a single round trip */
+#else
+	NULL,                         /* Callback used to execute a sequence of statements in a single round trip */
+#endif
 };
 
 /*! Defines function that references M_sql_driver_t M_sql_##name for module loading */
@@ -809,7 +809,8 @@ static M_sql_error_t sqlite_cb_fetch(M_sql_conn_t *conn, M_sql_stmt_t *stmt, cha
 
 			switch (type) {
 				case SQLITE_INTEGER:
-					M_buf_add_int(buf, sqlite3_column_int64(driver_stmt->stmt, (int)i));
+					/* Stored natively, nothing is written to buf */
+					M_sql_driver_stmt_result_col_int(stmt, sqlite3_column_int64(driver_stmt->stmt, (int)i));
 					break;
 				case SQLITE_BLOB:
 					M_buf_add_bytes(buf, sqlite3_column_blob(driver_stmt->stmt, (int)i), (size_t)sqlite3_column_bytes(driver_stmt->stmt, (int)i));
@@ -822,7 +823,7 @@ static M_sql_error_t sqlite_cb_fetch(M_sql_conn_t *conn, M_sql_stmt_t *stmt, cha
 					break;
 			}
 
-			if (type != SQLITE_NULL) {
+			if (type != SQLITE_NULL && type != SQLITE_INTEGER) {
 				/* All columns with data require NULL termination, even binary.  Otherwise its considered a NULL column. */
 				M_buf_add_byte(buf, 0); /* Manually add NULL terminator */
 			}
@@ -1012,6 +1013,9 @@ static M_sql_driver_t M_sql_sqlite = {
 	sqlite_cb_append_bitop,       /* Callback used to append a bit operation */
 
 	NULL,                         /* Handle for loaded driver - must be initialized to NULL */
+
+	NULL,                         /* Callback used to load rows using a native bulk mechanism */
+	NULL,                         /* Callback used to execute a sequence of statements in a single round trip */
 };
 
 /*! Defines function that references M_sql_driver_t M_sql_##name for module loading */
@@ -5,6 +5,7 @@
 #include <mstdlib/mstdlib.h>
 #include <mstdlib/mstdlib_thread.h>
 #include <mstdlib/mstdlib_io.h>
+#include <mstdlib/io/m_io_layer.h>
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -14,6 +15,7 @@ M_uint64 client_connection_count;
 M_uint64 server_connection_count;
 M_uint64 expected_connections;
 M_thread_mutex_t *debug_lock = NULL;
+M_event_t *client_event = NULL;
 #define DEBUG 0
 
 #if defined(DEBUG) && DEBUG
@@ -54,6 +56,8 @@ static void handle_connection(M_io_t *conn, M_bool is_server)
 		event_debug("%p %s Failed to %s connection: %s", conn, is_server?"netserver":"netclient", is_server?"accept":"perform", msg);
 		goto cleanup;
 	}
+	if (!is_server)
+		client_event = M_io_get_event(conn);
 	if (is_server) {
 		M_atomic_inc_u64(&active_server_connections);
 		/* Delay server connection count until we actually receive a message.
@@ -150,7 +154,7 @@ static void *listener_thread(void *arg)
 	return NULL;
 }
 
-static void check_block_net_test(M_uint64 num_connections)
+static void check_block_net_test(M_uint64 num_connections, M_bool serial)
 {
 	M_io_t          *conn;
 	size_t           i;
@@ -160,6 +164,8 @@ static void check_block_net_test(M_uint64 num_connections)
 	M_io_t          *netserver = NULL;
 	M_uint16         port      = (M_uint16)M_rand_range(NULL, 10000, 50000);
 	M_io_error_t     ioerr;
+	M_event_t       *first_event;
+	M_event_t       *pin_event = NULL;
 
 	active_client_connections = 0;
 	active_server_connections = 0;
@@ -185,13 +191,30 @@ static void check_block_net_test(M_uint64 num_connections)
 	M_thread_attr_destroy(attr);
 
 	M_thread_sleep(10000);
+	first_event = NULL;
 	for (i=0; i<expected_connections; i++) {
 		if (M_io_net_client_create(&conn, dns, "localhost", port, M_IO_NET_ANY) != M_IO_ERROR_SUCCESS)
 			break;
-		M_thread_create(NULL, client_thread, conn);
+		/* Running connections one after another on the same thread lets each one
+		 * reuse the private event handle left behind by the last */
+		if (serial) {
+			handle_connection(conn, M_FALSE);
+			if (first_event == NULL) {
+				first_event = client_event;
+				/* Hold onto a handle of our own so that if the first one was freed
+				 * rather than cached its memory can't be handed out again and make
+				 * the comparison below pass by accident. */
+				pin_event   = M_event_create(M_EVENT_FLAG_NONE);
+			} else {
+				ck_assert_msg(client_event == first_event, "connection %zu did not reuse the cached event handle", i);
+			}
+		} else {
+			M_thread_create(NULL, client_thread, conn);
+		}
 	}
 
 	M_thread_join(thread, NULL);
+	M_event_destroy(pin_event);
 	M_dns_destroy(dns);
 	event_debug("exited");
 	M_thread_mutex_destroy(debug_lock); debug_lock = NULL;
@@ -206,7 +229,18 @@ START_TEST(check_block_net)
 	size_t   i;
 
 	for (i=0; tests[i] != 0; i++) {
-		check_block_net_test(tests[i]);
+		check_block_net_test(tests[i], M_FALSE);
+	}
+}
+END_TEST
+
+START_TEST(check_block_net_serial)
+{
+	M_uint64 tests[] = { 1, 25, 0 };
+	size_t   i;
+
+	for (i=0; tests[i] != 0; i++) {
+		check_block_net_test(tests[i], M_TRUE);
 	}
 }
 END_TEST
@@ -225,6 +259,10 @@ static Suite *block_net_suite(void)
 	tcase_add_test(tc_block_net, check_block_net);
 	suite_add_tcase(suite, tc_block_net);
 
+	tc_block_net = tcase_create("block_net_serial");
+	tcase_add_test(tc_block_net, check_block_net_serial);
+	suite_add_tcase(suite, tc_block_net);
+
 	return suite;
 }
 
@@ -7,6 +7,15 @@
 #include <mstdlib/mstdlib_io.h>
 #include <mstdlib/mstdlib_tls.h>
 
+#ifndef _WIN32
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <arpa/inet.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
 #define USE_SSL
 #define HOST "www.google.com"
 
@@ -278,6 +287,305 @@ END_TEST
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+#ifndef _WIN32
+/* Stub DNS server on loopback.  It's polled from a timer rather than run in a
+ * thread so it works the same with the cooperative thread model.
+ *
+ * Names served:
+ *   host.mstdlib.test   - A of ipv4 below, AAAA ::2
+ *   v4only.mstdlib.test - A 127.0.0.2, AAAA doesn't exist
+ *   anything else       - doesn't exist */
+typedef struct {
+	int           fd;
+	M_uint16      port;
+	size_t        queries;
+	unsigned char ipv4[4];
+} stub_dns_t;
+
+static M_uint16 stub_get16(const unsigned char *buf)
+{
+	return (M_uint16)((buf[0] << 8) | buf[1]);
+}
+
+static void stub_put16(M_buf_t *buf, M_uint16 val)
+{
+	M_buf_add_byte(buf, (unsigned char)(val >> 8));
+	M_buf_add_byte(buf, (unsigned char)(val & 0xFF));
+}
+
+static void stub_answer(const unsigned char *req, size_t req_len, M_buf_t *resp, const stub_dns_t *stub)
+{
+	char          name[256];
+	size_t        name_len = 0;
+	size_t        pos      = 12;
+	M_uint16      qtype;
+	M_uint16      rcode    = 0;
+	M_bool        answer   = M_FALSE;
+	unsigned char ipv6[16] = { 0 };
+
+	if (req_len < 12)
+		return;
+
+	/* Question name as dotted string */
+	name[0] = '\0';
+	while (pos < req_len && req[pos] != 0) {
+		size_t len = req[pos];
+		if (pos + 1 + len > req_len || name_len + len + 2 > sizeof(name))
+			return;
+		if (name_len)
+			name[name_len++] = '.';
+		M_mem_copy(name + name_len, req + pos + 1, len);
+		name_len       += len;
+		name[name_len]  = '\0';
+		pos            += 1 + len;
+	}
+	pos++;
+	if (pos + 4 > req_len)
+		return;
+	qtype  = stub_get16(req + pos);
+	pos   += 4;
+
+	if (M_str_caseeq(name, "host.mstdlib.test")) {
+		answer = (qtype == 1 || qtype == 28)?M_TRUE:M_FALSE;
+	} else if (M_str_caseeq(name, "v4only.mstdlib.test") && qtype == 1) {
+		answer = M_TRUE;
+	} else {
+		rcode = 3; /* NXDOMAIN */
+	}
+
+	/* Header: same id, response with recursion desired copied and available */
+	M_buf_add_bytes(resp, req, 2);
+	stub_put16(resp, (M_uint16)(0x8080 | (stub_get16(req + 2) & 0x0100) | rcode));
+	stub_put16(resp, 1);
+	stub_put16(resp, answer?1:0);
+	stub_put16(resp, 0);
+	stub_put16(resp, 0);
+	M_buf_add_bytes(resp, req + 12, pos - 12);
+
+	if (!answer)
+		return;
+
+	stub_put16(resp, 0xC00C); /* Pointer to question name */
+	stub_put16(resp, qtype);
+	stub_put16(resp, 1);
+	stub_put16(resp, 0);
+	stub_put16(resp, 60);
+	if (qtype == 1) {
+		stub_put16(resp, 4);
+		if (M_str_caseeq(name, "host.mstdlib.test")) {
+			M_buf_add_bytes(resp, stub->ipv4, 4);
+		} else {
+			const unsigned char v4only[4] = { 127, 0, 0, 2 };
+			M_buf_add_bytes(resp, v4only, 4);
+		}
+	} else {
+		ipv6[15] = 2;
+		stub_put16(resp, 16);
+		M_buf_add_bytes(resp, ipv6, 16);
+	}
+}
+
+static void stub_dns_cb(M_event_t *event, M_event_type_t type, M_io_t *io, void *data)
+{
+	stub_dns_t         *stub = data;
+	unsigned char       req[512];
+	struct sockaddr_in  from;
+	socklen_t           from_len;
+	ssize_t             len;
+
+	(void)event;
+	(void)type;
+	(void)io;
+
+	while (1) {
+		M_buf_t *resp;
+
+		from_len = sizeof(from);
+		len      = recvfrom(stub->fd, req, sizeof(req), 0, (struct sockaddr *)&from, &from_len);
+		if (len <= 0)
+			break;
+
+		stub->queries++;
+		resp = M_buf_create();
+		stub_answer(req, (size_t)len, resp, stub);
+		if (M_buf_len(resp))
+			sendto(stub->fd, M_buf_peek(resp), M_buf_len(resp), 0, (struct sockaddr *)&from, from_len);
+		M_buf_cancel(resp);
+	}
+}
+
+static M_bool stub_dns_start(stub_dns_t *stub)
+{
+	struct sockaddr_in addr;
+	socklen_t          addr_len = sizeof(addr);
+
+	M_mem_set(stub, 0, sizeof(*stub));
+	stub->ipv4[0] = 127;
+	stub->ipv4[3] = 1;
+
+	stub->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (stub->fd == -1)
+		return M_FALSE;
+
+	M_mem_set(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(stub->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    getsockname(stub->fd, (struct sockaddr *)&addr, &addr_len) != 0 ||
+	    fcntl(stub->fd, F_SETFL, fcntl(stub->fd, F_GETFL) | O_NONBLOCK) != 0) {
+		close(stub->fd);
+		return M_FALSE;
+	}
+	stub->port = ntohs(addr.sin_port);
+	return M_TRUE;
+}
+
+
+typedef struct {
+	M_bool done;
+	M_bool connected;
+	char   ipaddr[64];
+	char   error[256];
+} lookup_t;
+
+static void lookup_cb(M_event_t *event, M_event_type_t type, M_io_t *io, void *data)
+{
+	lookup_t *lookup = data;
+
+	(void)event;
+
+	switch (type) {
+		case M_EVENT_TYPE_CONNECTED:
+			lookup->connected = M_TRUE;
+			M_str_cpy(lookup->ipaddr, sizeof(lookup->ipaddr), M_io_net_get_ipaddr(io));
+			lookup->done = M_TRUE;
+			M_io_destroy(io);
+			break;
+		case M_EVENT_TYPE_DISCONNECTED:
+		case M_EVENT_TYPE_ERROR:
+			M_io_get_error_string(io, lookup->error, sizeof(lookup->error));
+			lookup->done = M_TRUE;
+			M_io_destroy(io);
+			break;
+		default:
+			break;
+	}
+}
+
+static void lookup_server_cb(M_event_t *event, M_event_type_t type, M_io_t *io, void *data)
+{
+	M_io_t *newio = NULL;
+
+	(void)event;
+	(void)data;
+
+	if (type == M_EVENT_TYPE_ACCEPT && M_io_accept(&newio, io) == M_IO_ERROR_SUCCESS)
+		M_io_destroy(newio);
+}
+
+/* Connect to the host which resolves it, run the event loop (which also runs
+ * the stub server) until connected or failed */
+static M_bool lookup(M_event_t *event, M_dns_t *dns, const char *host, M_uint16 port, M_io_net_type_t type, lookup_t *lookup)
+{
+	M_io_t *io = NULL;
+	size_t  i;
+
+	M_mem_set(lookup, 0, sizeof(*lookup));
+	if (M_io_net_client_create(&io, dns, host, port, type) != M_IO_ERROR_SUCCESS)
+		return M_FALSE;
+	if (!M_event_add(event, io, lookup_cb, lookup)) {
+		M_io_destroy(io);
+		return M_FALSE;
+	}
+	for (i=0; !lookup->done && i<500; i++)
+		M_event_loop(event, 10);
+
+	return lookup->done;
+}
+
+START_TEST(check_dns_cache)
+{
+	M_event_t           *event     = M_event_create(M_EVENT_FLAG_NONE);
+	M_io_t              *netserver = NULL;
+	M_uint16             port      = (M_uint16)M_rand_range(NULL, 10000, 50000);
+	M_event_timer_t     *timer;
+	M_dns_t             *dns;
+	M_dns_cache_stats_t  stats;
+	M_io_error_t         ioerr;
+	stub_dns_t           stub;
+	lookup_t             res;
+	char                 servers[64];
+	size_t               queries;
+
+	ck_assert_msg(stub_dns_start(&stub), "failed to start stub DNS server");
+	timer = M_event_timer_add(event, stub_dns_cb, &stub);
+	M_event_timer_start(timer, 5);
+
+	/* Something to connect to so we can see what the name resolved to */
+	while ((ioerr = M_io_net_server_create(&netserver, port, NULL, M_IO_NET_IPV4)) == M_IO_ERROR_ADDRINUSE) {
+		port = (M_uint16)M_rand_range(NULL, 10000, 50000);
+	}
+	ck_assert_msg(ioerr == M_IO_ERROR_SUCCESS, "failed to create net server");
+	ck_assert_msg(M_event_add(event, netserver, lookup_server_cb, NULL), "failed to add net server to event");
+
+	dns = M_dns_create();
+	ck_assert_msg(dns != NULL, "DNS failed to initialized");
+	M_snprintf(servers, sizeof(servers), "127.0.0.1:%u", (unsigned int)stub.port);
+	ck_assert_msg(M_dns_set_servers(dns, servers), "failed to set DNS servers");
+	ck_assert_msg(M_dns_set_cache_timeout(dns, 2, 3600), "failed to set cache timeout");
+	ck_assert_msg(M_dns_set_cache_revalidate(dns, 60, 0), "failed to set stale window");
+	ck_assert_msg(M_dns_set_cache_negative(dns, 60), "failed to set negative cache");
+
+	/* A name that doesn't exist is only asked for once */
+	ck_assert_msg(lookup(event, dns, "missing.mstdlib.test", port, M_IO_NET_ANY, &res), "missing lookup didn't complete");
+	ck_assert_msg(!res.connected && M_str_eq(res.error, "Host not found"), "missing lookup: %s", res.connected?res.ipaddr:res.error);
+	queries = stub.queries;
+	ck_assert_msg(queries > 0, "stub server wasn't queried");
+	ck_assert_msg(lookup(event, dns, "missing.mstdlib.test", port, M_IO_NET_ANY, &res), "cached missing lookup didn't complete");
+	ck_assert_msg(!res.connected && M_str_eq(res.error, "Host not found"), "cached missing lookup: %s", res.connected?res.ipaddr:res.error);
+	ck_assert_msg(stub.queries == queries, "negative result wasn't served from cache");
+	M_dns_get_cache_stats(dns, &stats);
+	ck_assert_msg(stats.negative_hits == 1, "expected 1 negative hit, got %llu", stats.negative_hits);
+
+	/* No IPv6 address doesn't mean there's no IPv4 address */
+	ck_assert_msg(lookup(event, dns, "v4only.mstdlib.test", port, M_IO_NET_IPV6, &res), "IPv6 lookup didn't complete");
+	ck_assert_msg(!res.connected && M_str_eq(res.error, "Host not found"), "IPv6 lookup of IPv4 only name: %s", res.connected?res.ipaddr:res.error);
+	ck_assert_msg(lookup(event, dns, "v4only.mstdlib.test", port, M_IO_NET_ANY, &res), "lookup didn't complete");
+	ck_assert_msg(res.connected && M_str_eq(res.ipaddr, "127.0.0.2"), "lookup of IPv4 only name: %s", res.connected?res.ipaddr:res.error);
+
+	/* Expired entries are served while being refreshed in the background */
+	ck_assert_msg(lookup(event, dns, "host.mstdlib.test", port, M_IO_NET_IPV4, &res), "host lookup didn't complete");
+	ck_assert_msg(res.connected && M_str_eq(res.ipaddr, "127.0.0.1"), "host lookup: %s", res.connected?res.ipaddr:res.error);
+
+	M_thread_sleep(3100000);
+	stub.ipv4[3] = 3;
+	queries      = stub.queries;
+	ck_assert_msg(lookup(event, dns, "host.mstdlib.test", port, M_IO_NET_IPV4, &res), "stale host lookup didn't complete");
+	ck_assert_msg(res.connected && M_str_eq(res.ipaddr, "127.0.0.1"), "stale host lookup: %s", res.connected?res.ipaddr:res.error);
+	M_dns_get_cache_stats(dns, &stats);
+	ck_assert_msg(stats.stale_hits == 1 && stats.refreshes == 1, "expected 1 stale hit and refresh, got %llu and %llu", stats.stale_hits, stats.refreshes);
+
+	/* Let the refresh finish */
+	M_event_loop(event, 100);
+	ck_assert_msg(stub.queries > queries, "stale entry wasn't refreshed");
+
+	queries = stub.queries;
+	ck_assert_msg(lookup(event, dns, "host.mstdlib.test", port, M_IO_NET_IPV4, &res), "refreshed host lookup didn't complete");
+	ck_assert_msg(res.connected && M_str_eq(res.ipaddr, "127.0.0.3"), "refreshed host lookup: %s", res.connected?res.ipaddr:res.error);
+	ck_assert_msg(stub.queries == queries, "refreshed entry wasn't served from cache");
+
+	M_event_timer_remove(timer);
+	M_io_destroy(netserver);
+	M_event_destroy(event);
+	ck_assert_msg(M_dns_destroy(dns), "DNS failed to destroy");
+	close(stub.fd);
+	M_library_cleanup();
+}
+END_TEST
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static Suite *dns_suite(void)
 {
 	Suite *suite;
@@ -289,6 +597,13 @@ static Suite *dns_suite(void)
 	tcase_add_test(tc_dns, check_dns);
 	suite_add_tcase(suite, tc_dns);
 
+#ifndef _WIN32
+	tc_dns = tcase_create("dns_cache");
+	tcase_add_test(tc_dns, check_dns_cache);
+	tcase_set_timeout(tc_dns, 30);
+	suite_add_tcase(suite, tc_dns);
+#endif
+
 	return suite;
 }
 
@@ -0,0 +1,242 @@
+#include "m_config.h"
+#include <stdlib.h>
+#include <check.h>
+
+#include <mstdlib/mstdlib.h>
+#include <mstdlib/mstdlib_thread.h>
+#include <mstdlib/mstdlib_io.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static M_uint64 expected_connections;
+static M_uint64 client_done_count;
+static M_uint64 client_ok_count;
+static M_uint64 server_done_count;
+
+static void session_coro(M_coro_t *coro, void *arg)
+{
+	M_io_t     *conn   = arg;
+	M_parser_t *parser = M_parser_create(M_PARSER_FLAG_NONE);
+	M_buf_t    *buf    = M_buf_create();
+
+	if (M_io_coro_connect(coro, conn) != M_IO_ERROR_SUCCESS)
+		goto cleanup;
+
+	/* Echo until the client says goodbye */
+	while (M_io_coro_read_into_parser(coro, conn, parser, 5000) == M_IO_ERROR_SUCCESS) {
+		if (M_parser_compare_str(parser, "GoodBye", 0, M_FALSE)) {
+			M_io_coro_disconnect(coro, conn);
+			break;
+		}
+		M_buf_add_bytes(buf, M_parser_peek(parser), M_parser_len(parser));
+		M_parser_truncate(parser, 0);
+		while (M_buf_len(buf)) {
+			if (M_io_coro_write_from_buf(coro, conn, buf, 5000) != M_IO_ERROR_SUCCESS)
+				goto cleanup;
+		}
+	}
+
+cleanup:
+	M_io_destroy(conn);
+	M_parser_destroy(parser);
+	M_buf_cancel(buf);
+	M_atomic_inc_u64(&server_done_count);
+}
+
+static void listener_coro(M_coro_t *coro, void *arg)
+{
+	M_io_t *netserver = arg;
+	M_io_t *newconn;
+
+	while (M_atomic_load_u64(&server_done_count) != expected_connections) {
+		if (M_io_coro_accept(coro, &newconn, netserver, 20) == M_IO_ERROR_SUCCESS) {
+			ck_assert_msg(M_coro_create(M_event_get_pool(M_coro_event(coro)), session_coro, newconn) != NULL, "failed to create session coroutine");
+		}
+	}
+	M_io_destroy(netserver);
+
+	M_event_done(M_event_get_pool(M_coro_event(coro)));
+}
+
+static void client_coro(M_coro_t *coro, void *arg)
+{
+	M_io_t        *conn = arg;
+	unsigned char  buf[64];
+	size_t         len  = 0;
+	size_t         written;
+	M_io_error_t   err;
+
+	if (M_io_coro_connect(coro, conn) != M_IO_ERROR_SUCCESS)
+		goto cleanup;
+
+	/* Let the other clients run before we start talking */
+	M_coro_yield(coro);
+
+	if (M_io_coro_write(coro, conn, (const unsigned char *)"HelloWorld", 10, &written, 5000) != M_IO_ERROR_SUCCESS || written != 10)
+		goto cleanup;
+
+	while (len < 10) {
+		size_t rlen;
+		err = M_io_coro_read(coro, conn, buf + len, sizeof(buf) - len, &rlen, 5000);
+		if (err != M_IO_ERROR_SUCCESS)
+			goto cleanup;
+		len += rlen;
+	}
+
+	if (len == 10 && M_mem_eq(buf, "HelloWorld", 10))
+		M_atomic_inc_u64(&client_ok_count);
+
+	M_io_coro_write(coro, conn, (const unsigned char *)"GoodBye", 7, &written, 5000);
+
+	/* Server closes on us */
+	while (M_io_coro_read(coro, conn, buf, sizeof(buf), &len, 5000) == M_IO_ERROR_SUCCESS)
+		;
+
+cleanup:
+	M_io_destroy(conn);
+	M_atomic_inc_u64(&client_done_count);
+}
+
+static void check_event_coro_net_test(M_event_t *event, M_uint64 num_connections)
+{
+	M_dns_t      *dns       = M_dns_create();
+	M_io_t       *netserver = NULL;
+	M_io_t       *conn;
+	M_uint16      port      = (M_uint16)M_rand_range(NULL, 10000, 50000);
+	M_io_error_t  ioerr;
+	M_uint64      i;
+
+	expected_connections = num_connections;
+	client_done_count    = 0;
+	client_ok_count      = 0;
+	server_done_count    = 0;
+
+	while ((ioerr = M_io_net_server_create(&netserver, port, NULL, M_IO_NET_ANY)) == M_IO_ERROR_ADDRINUSE) {
+		port = (M_uint16)M_rand_range(NULL, 10000, 50000);
+	}
+	ck_assert_msg(ioerr == M_IO_ERROR_SUCCESS, "failed to create net server");
+
+	ck_assert_msg(M_coro_create(event, listener_coro, netserver) != NULL, "failed to create listener coroutine");
+
+	for (i=0; i<num_connections; i++) {
+		ck_assert_msg(M_io_net_client_create(&conn, dns, "localhost", port, M_IO_NET_ANY) == M_IO_ERROR_SUCCESS, "failed to create client");
+		ck_assert_msg(M_coro_create(event, client_coro, conn) != NULL, "failed to create client coroutine");
+	}
+
+	ck_assert_msg(M_event_loop(event, 20000) == M_EVENT_ERR_DONE, "event loop did not exit cleanly");
+	ck_assert_msg(client_done_count == num_connections, "expected %llu clients to finish, got %llu", num_connections, client_done_count);
+	ck_assert_msg(client_ok_count == num_connections, "expected %llu clients to get an echo, got %llu", num_connections, client_ok_count);
+
+	M_event_destroy(event);
+	M_dns_destroy(dns);
+	M_library_cleanup();
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static M_uint64 order_cnt;
+static M_uint64 order_bad;
+
+typedef struct {
+	M_uint64 total;
+	M_uint64 rounds;
+} order_arg_t;
+
+static void order_coro(M_coro_t *coro, void *arg)
+{
+	order_arg_t *oa = arg;
+	M_uint64     i;
+
+	/* Yielding must let the other coroutines run before we're resumed.  Starting
+	 * isn't ordered, so others may not have started by our first yield, and by
+	 * the last one the others may have already moved on to sleeping. */
+	for (i=0; i<oa->rounds; i++) {
+		M_uint64 last = order_cnt;
+		order_cnt++;
+		M_coro_yield(coro);
+		if (i != 0 && i != oa->rounds - 1 && order_cnt == last + 1)
+			order_bad++;
+	}
+
+	M_coro_sleep(coro, 10);
+	order_cnt++;
+	if (order_cnt == oa->total * oa->rounds + oa->total)
+		M_event_done(M_coro_event(coro));
+}
+
+START_TEST(check_event_coro_yield)
+{
+	M_event_t   *event = M_event_create(M_EVENT_FLAG_NONE);
+	order_arg_t  args[16];
+	M_uint64     i;
+
+	order_cnt = 0;
+	order_bad = 0;
+	for (i=0; i<16; i++) {
+		args[i].total  = 16;
+		args[i].rounds = 100;
+		ck_assert_msg(M_coro_create(event, order_coro, &args[i]) != NULL, "failed to create coroutine %llu", i);
+	}
+
+	ck_assert_msg(M_event_loop(event, 10000) == M_EVENT_ERR_DONE, "event loop did not exit cleanly");
+	ck_assert_msg(order_bad == 0, "coroutine resumed without others running %llu times", order_bad);
+	ck_assert_msg(order_cnt == 16 * 100 + 16, "expected %d steps, got %llu", 16 * 100 + 16, order_cnt);
+
+	M_event_destroy(event);
+	M_library_cleanup();
+}
+END_TEST
+
+START_TEST(check_event_coro_net)
+{
+	check_event_coro_net_test(M_event_create(M_EVENT_FLAG_NONE), 50);
+}
+END_TEST
+
+START_TEST(check_event_coro_net_pool)
+{
+	check_event_coro_net_test(M_event_pool_create(0), 50);
+}
+END_TEST
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static Suite *event_coro_suite(void)
+{
+	Suite *suite;
+	TCase *tc;
+
+	suite = suite_create("event_coro");
+
+	tc = tcase_create("event_coro_yield");
+	tcase_add_test(tc, check_event_coro_yield);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("event_coro_net");
+	tcase_add_test(tc, check_event_coro_net);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("event_coro_net_pool");
+	tcase_add_test(tc, check_event_coro_net_pool);
+	suite_add_tcase(suite, tc);
+
+	return suite;
+}
+
+int main(int argc, char **argv)
+{
+	SRunner *sr;
+	int      nf;
+
+	(void)argc;
+	(void)argv;
+
+	sr = srunner_create(event_coro_suite());
+	srunner_set_log(sr, "check_event_coro.log");
+
+	srunner_run_all(sr, CK_NORMAL);
+	nf = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return nf == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
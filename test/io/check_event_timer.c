@@ -179,6 +179,43 @@ START_TEST(check_event_timer)
 }
 END_TEST
 
+static void *future_task(void *arg)
+{
+	return arg;
+}
+
+static void future_cb(M_event_t *event, void *result, void *cb_data)
+{
+	M_threadid_t *thread = cb_data;
+
+	/* Must be delivered on the event loop's thread */
+	if (result == cb_data)
+		*thread = M_thread_self();
+	M_event_done(event);
+}
+
+START_TEST(check_event_future)
+{
+	M_event_t             *event  = M_event_create(M_EVENT_FLAG_NONE);
+	M_threadpool_t        *pool   = M_threadpool_create(1, 1, 0, 0);
+	M_threadpool_parent_t *parent = M_threadpool_parent_create(pool);
+	M_threadpool_future_t *future;
+	M_threadid_t           thread = 0;
+
+	future = M_threadpool_dispatch_future(parent, future_task, &thread);
+	ck_assert_msg(M_event_queue_future(event, future, future_cb, &thread), "failed to queue future");
+	M_threadpool_future_destroy(future);
+
+	ck_assert_msg(M_event_loop(event, 5000) == M_EVENT_ERR_DONE, "event loop did not complete");
+	ck_assert_msg(thread == M_thread_self(), "future not delivered on event thread");
+
+	M_threadpool_parent_wait(parent);
+	M_threadpool_parent_destroy(parent);
+	M_threadpool_destroy(pool);
+	M_event_destroy(event);
+}
+END_TEST
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 static Suite *event_timer_suite(void)
@@ -193,6 +230,11 @@ static Suite *event_timer_suite(void)
 	tcase_set_timeout(tc_event_timer, 60);
 	suite_add_tcase(suite, tc_event_timer);
 
+	tc_event_timer = tcase_create("event_future");
+	tcase_add_test(tc_event_timer, check_event_future);
+	tcase_set_timeout(tc_event_timer, 10);
+	suite_add_tcase(suite, tc_event_timer);
+
 	return suite;
 }
 
@@ -5,6 +5,7 @@
 #include <mstdlib/mstdlib.h>
 #include <mstdlib/mstdlib_sql.h>
 #include <mstdlib/mstdlib_formats.h>
+#include <mstdlib/mstdlib_io.h>
 
 #define DEBUG 1
 #define INSERT_ROWS 10000
@@ -91,6 +92,14 @@ static const char *sql_conn_type(M_sql_conn_type_t type)
 	return "UN";
 }
 
+#define GROUPINSERT_THREADS 16
+#define GROUPINSERT_KEY     2000000000LL
+
+static const char        groupinsert_query[] = "INSERT INTO \"foo\" (\"key\", \"i16col\", \"boolcol\") VALUES (?, ?, ?)";
+static M_sql_connpool_t *groupinsert_pool;
+static M_uint64          groupinsert_ok;
+static M_uint64          groupinsert_execs;
+
 
 static void sql_trace(M_sql_trace_t event_type, const M_sql_trace_data_t *data, void *arg)
 {
@@ -99,6 +108,9 @@ static void sql_trace(M_sql_trace_t event_type, const M_sql_trace_data_t *data,
 
 	(void)arg;
 
+	if (event_type == M_SQL_TRACE_EXECUTE_FINISH && M_str_eq(M_sql_trace_get_query_user(data), groupinsert_query))
+		M_atomic_inc_u64(&groupinsert_execs);
+
 	M_buf_add_str(buf, "(CONN ");
 	M_buf_add_str(buf, sql_conn_type(M_sql_trace_get_conntype(data)));
 	M_buf_add_str(buf, "#");
@@ -293,6 +305,86 @@ static M_sql_error_t check_sql_trans(M_sql_trans_t *trans, void *arg, char *erro
  *      - rollbacks/deadlocks work (multithreaded test?)
  */
 
+#define ASYNC_QUERIES 8
+#define BULKLOAD_ROWS 25000
+#define BULKLOAD_KEY  1000000000LL
+
+static size_t async_done;
+
+static void check_sql_threaded_cb(M_event_t *event, M_sql_stmt_t *stmt, M_sql_error_t err, void *thunk)
+{
+	M_int64 *expected = thunk;
+
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "async SELECT failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+	ck_assert_msg(M_sql_stmt_result_num_rows(stmt) == 1, "async SELECT returned %zu rows, expected 1", M_sql_stmt_result_num_rows(stmt));
+	ck_assert_msg(M_sql_stmt_result_int64_direct(stmt, 0, 0) == *expected, "async SELECT returned %lld, expected %lld", M_sql_stmt_result_int64_direct(stmt, 0, 0), *expected);
+	M_sql_stmt_destroy(stmt);
+
+	if (++async_done == ASYNC_QUERIES)
+		M_event_done(event);
+}
+
+static void *check_sql_groupinsert_thread(void *arg)
+{
+	M_int64       key  = GROUPINSERT_KEY + (M_int64)((size_t)arg);
+	M_sql_stmt_t *stmt = M_sql_stmt_groupinsert_prepare(groupinsert_pool, groupinsert_query);
+
+	M_sql_stmt_bind_int64(stmt, key);
+	M_sql_stmt_bind_int16(stmt, 1);
+	M_sql_stmt_bind_bool(stmt, M_TRUE);
+	if (M_sql_stmt_execute(groupinsert_pool, stmt) == M_SQL_ERROR_SUCCESS)
+		M_atomic_inc_u64(&groupinsert_ok);
+	M_sql_stmt_destroy(stmt);
+	return NULL;
+}
+
+#define QUEUE_STMTS 20
+#define QUEUE_KEY   3000000000LL
+
+static M_sql_stmt_t *check_sql_queue_insert(M_sql_trans_t *trans, M_int64 key)
+{
+	M_sql_stmt_t  *stmt = M_sql_stmt_create();
+	M_sql_error_t  err;
+
+	err = M_sql_stmt_prepare(stmt, "INSERT INTO \"foo\" (\"key\", \"i16col\", \"boolcol\") VALUES (?, ?, ?)");
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_stmt_prepare(queued INSERT) failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+	M_sql_stmt_bind_int64(stmt, key);
+	M_sql_stmt_bind_int16(stmt, 1);
+	M_sql_stmt_bind_bool(stmt, M_TRUE);
+	err = M_sql_trans_queue(trans, stmt);
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_trans_queue(INSERT) failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+	return stmt;
+}
+
+static M_sql_error_t check_sql_queue_trans(M_sql_trans_t *trans, void *arg, char *error, size_t error_size)
+{
+	M_sql_stmt_t  *stmts[QUEUE_STMTS + 1];
+	M_sql_error_t  err;
+	size_t         i;
+	(void)arg;
+
+	for (i=0; i<QUEUE_STMTS; i++)
+		stmts[i] = check_sql_queue_insert(trans, QUEUE_KEY + (M_int64)i);
+
+	/* Results of a queued SELECT must see the queued INSERTs before it */
+	stmts[QUEUE_STMTS] = M_sql_stmt_create();
+	M_sql_stmt_prepare(stmts[QUEUE_STMTS], "SELECT COUNT(*) FROM \"foo\" WHERE \"key\" >= ?");
+	M_sql_stmt_bind_int64(stmts[QUEUE_STMTS], QUEUE_KEY);
+	M_sql_trans_queue(trans, stmts[QUEUE_STMTS]);
+
+	err = M_sql_trans_flush(trans);
+	if (err != M_SQL_ERROR_SUCCESS) {
+		M_snprintf(error, error_size, "M_sql_trans_flush() failed: %s", M_sql_error_string(err));
+	} else {
+		ck_assert_msg(M_sql_stmt_result_int64_direct(stmts[QUEUE_STMTS], 0, 0) == QUEUE_STMTS, "queued SELECT found %lld rows, expected %d", M_sql_stmt_result_int64_direct(stmts[QUEUE_STMTS], 0, 0), QUEUE_STMTS);
+	}
+
+	for (i=0; i<=QUEUE_STMTS; i++)
+		M_sql_stmt_destroy(stmts[i]);
+
+	return err;
+}
+
 START_TEST(check_sql)
 {
 	M_sql_error_t     err;
@@ -306,6 +398,7 @@ START_TEST(check_sql)
 	M_csv_t          *csv     = NULL;
 	char              temp[64];
 	size_t            i;
+	const char       *keytext;
 	const char       *driver;
 	const char       *conn_str;
 	const char       *sql_conns;
@@ -315,6 +408,12 @@ START_TEST(check_sql)
 	M_int64           hugedataid;
 	const M_uint8    *outbincol;
 	size_t            outbincol_size;
+	M_event_t        *event;
+	M_sql_bulkload_t *bulkload;
+	M_thread_attr_t  *tattr;
+	M_threadid_t      threads[GROUPINSERT_THREADS];
+	M_sql_trans_t    *trans;
+	M_sql_stmt_t     *qstmts[3];
 
 
 	driver    = getenv("SQL_DRIVER");
@@ -517,6 +616,142 @@ START_TEST(check_sql)
 	for (i=0; i<outbincol_size; i++) {
 		ck_assert_msg(outbincol[i] == 0x0D, "Binary data index %zu (0x%02X) does not match expected value of 0x0D", i, outbincol[i]);
 	}
+
+	/* Validate integer columns read back the same way as integers and as text */
+	ck_assert_msg(M_sql_stmt_result_int64_byname_direct(stmt, 0, "key") == hugedataid, "key expected %lld got %lld", hugedataid, M_sql_stmt_result_int64_byname_direct(stmt, 0, "key"));
+	M_snprintf(temp, sizeof(temp), "%lld", hugedataid);
+	ck_assert_msg(M_str_eq(M_sql_stmt_result_text_byname_direct(stmt, 0, "key"), temp), "key text expected '%s' got '%s'", temp, M_sql_stmt_result_text_byname_direct(stmt, 0, "key"));
+	keytext = M_sql_stmt_result_text_byname_direct(stmt, 0, "key");
+	ck_assert_msg(M_sql_stmt_result_text_byname_direct(stmt, 0, "i32col") != NULL, "i32col text missing");
+	ck_assert_msg(M_str_eq(keytext, temp), "key text changed after rendering another column, got '%s'", keytext);
+	ck_assert_msg(M_sql_stmt_result_int16_byname_direct(stmt, 0, "i16col") == (M_int16)((5+INSERT_ROWS) & 0xFFFF), "i16col mismatch");
+	ck_assert_msg(M_sql_stmt_result_int32_byname_direct(stmt, 0, "i32col") == (M_int32)((5+INSERT_ROWS) & 0xFFFFFFFF), "i32col mismatch");
+	ck_assert_msg(M_sql_stmt_result_bool_byname_direct(stmt, 0, "boolcol") == (M_bool)((5+INSERT_ROWS) % 2), "boolcol mismatch");
+	ck_assert_msg(!M_sql_stmt_result_isnull_byname_direct(stmt, 0, "i32col"), "i32col should not be NULL");
+	ck_assert_msg(M_sql_stmt_result_isnull_byname_direct(stmt, 0, "bincol"), "bincol should be NULL");
+	M_sql_stmt_destroy(stmt);
+
+	/* Group inserts from many threads, lingering so they batch up */
+	M_sql_connpool_set_groupinsert_linger(pool, 250, GROUPINSERT_THREADS / 2);
+	groupinsert_pool  = pool;
+	groupinsert_ok    = 0;
+	groupinsert_execs = 0;
+	tattr             = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+	for (i=0; i<GROUPINSERT_THREADS; i++)
+		threads[i] = M_thread_create(tattr, check_sql_groupinsert_thread, (void *)i);
+	for (i=0; i<GROUPINSERT_THREADS; i++)
+		M_thread_join(threads[i], NULL);
+	M_thread_attr_destroy(tattr);
+	M_sql_connpool_set_groupinsert_linger(pool, 0, 0);
+	ck_assert_msg(groupinsert_ok == GROUPINSERT_THREADS, "expected %d successful group inserts, got %llu", GROUPINSERT_THREADS, groupinsert_ok);
+	ck_assert_msg(groupinsert_execs > 0 && groupinsert_execs < GROUPINSERT_THREADS, "expected group inserts to be batched into fewer than %d executions, got %llu", GROUPINSERT_THREADS, groupinsert_execs);
+
+	stmt = M_sql_stmt_create();
+	err  = M_sql_stmt_prepare(stmt, "SELECT COUNT(*) FROM \"foo\" WHERE \"key\" >= ?");
+	M_sql_stmt_bind_int64(stmt, GROUPINSERT_KEY);
+	err  = M_sql_stmt_execute(pool, stmt);
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_stmt_execute(SELECT COUNT groupinsert) failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+	ck_assert_msg(M_sql_stmt_result_int64_direct(stmt, 0, 0) == GROUPINSERT_THREADS, "expected %d group inserted rows, found %lld", GROUPINSERT_THREADS, M_sql_stmt_result_int64_direct(stmt, 0, 0));
+	M_sql_stmt_destroy(stmt);
+
+	/* Bulk load rows in multiple flushes, then make sure a failed load leaves nothing behind */
+	bulkload = M_sql_bulkload_create(pool, "foo");
+	ck_assert_msg(bulkload != NULL, "M_sql_bulkload_create() failed");
+	ck_assert_msg(M_sql_bulkload_add_col(bulkload, "key"), "M_sql_bulkload_add_col(key) failed");
+	ck_assert_msg(M_sql_bulkload_add_col(bulkload, "name"), "M_sql_bulkload_add_col(name) failed");
+	ck_assert_msg(M_sql_bulkload_add_col(bulkload, "i16col"), "M_sql_bulkload_add_col(i16col) failed");
+	ck_assert_msg(M_sql_bulkload_add_col(bulkload, "boolcol"), "M_sql_bulkload_add_col(boolcol) failed");
+	ck_assert_msg(M_sql_bulkload_set_flush(bulkload, 1000, 0), "M_sql_bulkload_set_flush() failed");
+	stmt = M_sql_bulkload_stmt(bulkload);
+	for (i=0; i<BULKLOAD_ROWS; i++) {
+		M_sql_stmt_bind_int64(stmt, BULKLOAD_KEY + (M_int64)i);
+		M_snprintf(temp, sizeof(temp), "bulk\t%zu\\", i);
+		M_sql_stmt_bind_text_dup(stmt, temp, 0);
+		M_sql_stmt_bind_int16(stmt, (M_int16)(i & 0x7FFF));
+		M_sql_stmt_bind_bool(stmt, (M_bool)(i % 2));
+		err = M_sql_bulkload_row_finish(bulkload);
+		ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_bulkload_row_finish(%zu) failed: %s: %s", i, M_sql_error_string(err), M_sql_bulkload_get_error_string(bulkload));
+	}
+	err = M_sql_bulkload_finish(bulkload);
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_bulkload_finish() failed: %s: %s", M_sql_error_string(err), M_sql_bulkload_get_error_string(bulkload));
+	ck_assert_msg(M_sql_bulkload_rows_loaded(bulkload) == BULKLOAD_ROWS, "M_sql_bulkload_rows_loaded() returned %llu, expected %d", M_sql_bulkload_rows_loaded(bulkload), BULKLOAD_ROWS);
+	M_sql_bulkload_destroy(bulkload);
+
+	bulkload = M_sql_bulkload_create(pool, "foo");
+	M_sql_bulkload_add_col(bulkload, "key");
+	M_sql_bulkload_add_col(bulkload, "i16col");
+	M_sql_bulkload_add_col(bulkload, "boolcol");
+	M_sql_bulkload_set_flush(bulkload, 10, 0);
+	stmt = M_sql_bulkload_stmt(bulkload);
+	for (i=0; i<20; i++) {
+		M_sql_stmt_bind_int64(stmt, BULKLOAD_KEY + BULKLOAD_ROWS + (M_int64)i);
+		M_sql_stmt_bind_int16(stmt, 1);
+		M_sql_stmt_bind_bool(stmt, M_TRUE);
+		ck_assert_msg(M_sql_bulkload_row_finish(bulkload) == M_SQL_ERROR_SUCCESS, "M_sql_bulkload_row_finish(%zu) failed", i);
+	}
+	M_sql_stmt_bind_int64(stmt, BULKLOAD_KEY + BULKLOAD_ROWS + 20);
+	err = M_sql_bulkload_row_finish(bulkload);
+	ck_assert_msg(err == M_SQL_ERROR_QUERY_WRONGNUMPARAMS, "M_sql_bulkload_row_finish() with missing values returned %s", M_sql_error_string(err));
+	ck_assert_msg(M_sql_bulkload_finish(bulkload) == err, "M_sql_bulkload_finish() after failure should return the same error");
+	M_sql_bulkload_destroy(bulkload);
+
+	stmt = M_sql_stmt_create();
+	err  = M_sql_stmt_prepare(stmt, "SELECT COUNT(*) FROM \"foo\" WHERE \"key\" >= ? AND \"key\" < ?");
+	M_sql_stmt_bind_int64(stmt, BULKLOAD_KEY);
+	M_sql_stmt_bind_int64(stmt, GROUPINSERT_KEY);
+	err  = M_sql_stmt_execute(pool, stmt);
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_stmt_execute(SELECT COUNT bulkload) failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+	ck_assert_msg(M_sql_stmt_result_int64_direct(stmt, 0, 0) == BULKLOAD_ROWS, "expected %d bulk loaded rows, found %lld", BULKLOAD_ROWS, M_sql_stmt_result_int64_direct(stmt, 0, 0));
+	M_sql_stmt_destroy(stmt);
+
+	stmt = M_sql_stmt_create();
+	err  = M_sql_stmt_prepare(stmt, "SELECT \"name\" FROM \"foo\" WHERE \"key\" = ?");
+	M_sql_stmt_bind_int64(stmt, BULKLOAD_KEY + BULKLOAD_ROWS - 1);
+	err  = M_sql_stmt_execute(pool, stmt);
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_stmt_execute(SELECT bulkload) failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+	M_snprintf(temp, sizeof(temp), "bulk\t%d\\", BULKLOAD_ROWS - 1);
+	ck_assert_msg(M_str_eq(M_sql_stmt_result_text_direct(stmt, 0, 0), temp), "bulk loaded text mangled, got '%s'", M_sql_stmt_result_text_direct(stmt, 0, 0));
+	M_sql_stmt_destroy(stmt);
+
+	/* Execute queries from an event loop without blocking it */
+	event      = M_event_create(M_EVENT_FLAG_NONE);
+	async_done = 0;
+	for (i=0; i<ASYNC_QUERIES; i++) {
+		stmt = M_sql_stmt_create();
+		err  = M_sql_stmt_prepare(stmt, "SELECT \"key\" FROM \"foo\" WHERE \"key\" = ?");
+		ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_stmt_prepare(async SELECT) failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+		M_sql_stmt_bind_int64(stmt, hugedataid);
+		ck_assert_msg(M_sql_stmt_execute_threaded(pool, stmt, event, check_sql_threaded_cb, &hugedataid), "M_sql_stmt_execute_threaded() failed");
+	}
+	ck_assert_msg(M_event_loop(event, 10000) == M_EVENT_ERR_DONE, "event loop did not exit cleanly");
+	ck_assert_msg(async_done == ASYNC_QUERIES, "expected %d async results, got %zu", ASYNC_QUERIES, async_done);
+	M_event_destroy(event);
+
+	/* Queue statements in a transaction so they can be sent to the server together */
+	err = M_sql_trans_process(pool, M_SQL_ISOLATION_READCOMMITTED, check_sql_queue_trans, NULL, error, sizeof(error));
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_trans_process(queue) failed: %s: %s", M_sql_error_string(err), error);
+
+	/* A failure while flushing on commit stops at the failed statement and rolls back */
+	err = M_sql_trans_begin(&trans, pool, M_SQL_ISOLATION_READCOMMITTED, error, sizeof(error));
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_trans_begin() failed: %s: %s", M_sql_error_string(err), error);
+	qstmts[0] = check_sql_queue_insert(trans, QUEUE_KEY + QUEUE_STMTS);
+	qstmts[1] = check_sql_queue_insert(trans, QUEUE_KEY); /* Duplicate key */
+	qstmts[2] = check_sql_queue_insert(trans, QUEUE_KEY + QUEUE_STMTS + 1);
+	err = M_sql_trans_commit(trans, error, sizeof(error));
+	ck_assert_msg(M_sql_error_is_error(err), "M_sql_trans_commit() with duplicate key queued should fail");
+	ck_assert_msg(M_sql_stmt_get_error(qstmts[0]) == M_SQL_ERROR_SUCCESS, "first queued INSERT should have succeeded: %s", M_sql_stmt_get_error_string(qstmts[0]));
+	ck_assert_msg(M_sql_stmt_get_error(qstmts[1]) == err, "duplicate queued INSERT returned %s, expected %s", M_sql_error_string(M_sql_stmt_get_error(qstmts[1])), M_sql_error_string(err));
+	ck_assert_msg(M_sql_stmt_get_error(qstmts[2]) == err, "queued INSERT after failure returned %s, expected %s", M_sql_error_string(M_sql_stmt_get_error(qstmts[2])), M_sql_error_string(err));
+	for (i=0; i<3; i++)
+		M_sql_stmt_destroy(qstmts[i]);
+
+	stmt = M_sql_stmt_create();
+	err  = M_sql_stmt_prepare(stmt, "SELECT COUNT(*) FROM \"foo\" WHERE \"key\" >= ?");
+	M_sql_stmt_bind_int64(stmt, QUEUE_KEY);
+	err  = M_sql_stmt_execute(pool, stmt);
+	ck_assert_msg(err == M_SQL_ERROR_SUCCESS, "M_sql_stmt_execute(SELECT COUNT queue) failed: %s: %s", M_sql_error_string(err), M_sql_stmt_get_error_string(stmt));
+	ck_assert_msg(M_sql_stmt_result_int64_direct(stmt, 0, 0) == QUEUE_STMTS, "expected %d queued rows after rollback, found %lld", QUEUE_STMTS, M_sql_stmt_result_int64_direct(stmt, 0, 0));
 	M_sql_stmt_destroy(stmt);
 
 	/* Close connections */
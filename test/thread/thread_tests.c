@@ -243,6 +243,7 @@ START_TEST(check_atomic)
 {
 	M_uint32 val;
 	M_uint64 val64;
+	void    *ptr;
 
 	/* cas32 */
 	val = 0;
@@ -263,6 +264,44 @@ START_TEST(check_atomic)
 	val64 = 0;
 	ck_assert_msg(M_atomic_inc_u64(&val64) == 0 && val64 == 1, "inc64 failed");
 	ck_assert_msg(M_atomic_dec_u64(&val64) == 1 && val64 == 0, "dec64 failed");
+
+	M_atomic_store_u32(&val, 7);
+	ck_assert_msg(M_atomic_load_u32(&val) == 7, "load/store32 failed");
+
+	M_atomic_store_u64(&val64, M_UINT64_MAX - 1);
+	ck_assert_msg(M_atomic_load_u64(&val64) == M_UINT64_MAX - 1, "load/store64 failed");
+
+	M_atomic_store_u32_explicit(&val, 3, M_ATOMIC_ORDER_RELEASE);
+	ck_assert_msg(M_atomic_load_u32_explicit(&val, M_ATOMIC_ORDER_ACQUIRE) == 3, "explicit load/store32 failed");
+	ck_assert_msg(M_atomic_add_u32_explicit(&val, 2, M_ATOMIC_ORDER_RELAXED) == 3 && val == 5, "explicit add32 failed");
+	M_atomic_store_u64_explicit(&val64, 3, M_ATOMIC_ORDER_RELAXED);
+	ck_assert_msg(M_atomic_add_u64_explicit(&val64, 2, M_ATOMIC_ORDER_ACQ_REL) == 3 && val64 == 5, "explicit add64 failed");
+
+	/* Bitwise */
+	val = 0x0F;
+	ck_assert_msg(M_atomic_or_u32(&val, 0xF0) == 0x0F && val == 0xFF, "or32 failed");
+	ck_assert_msg(M_atomic_and_u32(&val, 0x3C) == 0xFF && val == 0x3C, "and32 failed");
+	val64 = 1;
+	ck_assert_msg(M_atomic_or_u64(&val64, (M_uint64)1 << 40) == 1 && val64 == (((M_uint64)1 << 40) | 1), "or64 failed");
+	ck_assert_msg(M_atomic_and_u64(&val64, (M_uint64)1 << 40) == (((M_uint64)1 << 40) | 1) && val64 == (M_uint64)1 << 40, "and64 failed");
+
+	/* Exchange */
+	val = 1;
+	ck_assert_msg(M_atomic_exchange_u32(&val, 2) == 1 && val == 2, "exchange32 failed");
+	val64 = 1;
+	ck_assert_msg(M_atomic_exchange_u64(&val64, M_UINT64_MAX) == 1 && val64 == M_UINT64_MAX, "exchange64 failed");
+
+	/* Pointers */
+	ptr = NULL;
+	ck_assert_msg(M_atomic_cas_ptr(&ptr, NULL, &val) && ptr == &val, "cas_ptr failed to set ptr");
+	ck_assert_msg(!M_atomic_cas_ptr(&ptr, NULL, &val64) && ptr == &val, "cas_ptr passed expected failure");
+	ck_assert_msg(M_atomic_exchange_ptr(&ptr, &val64) == &val && ptr == &val64, "exchange_ptr failed");
+	M_atomic_store_ptr_explicit(&ptr, NULL, M_ATOMIC_ORDER_RELEASE);
+	ck_assert_msg(M_atomic_load_ptr_explicit(&ptr, M_ATOMIC_ORDER_ACQUIRE) == NULL, "load/store ptr failed");
+	M_atomic_store_ptr(&ptr, &val);
+	ck_assert_msg(M_atomic_load_ptr(&ptr) == &val, "load/store ptr failed");
+
+	M_atomic_fence(M_ATOMIC_ORDER_SEQ_CST);
 }
 END_TEST
 
@@ -284,6 +323,44 @@ START_TEST(check_cpu_cores)
 }
 END_TEST
 
+START_TEST(check_cpu_affinity)
+{
+	M_thread_attr_t *tattr;
+	M_threadid_t     thread;
+	M_threadid_t     id    = 0;
+	size_t           cores = M_thread_num_cpu_cores();
+	size_t           i;
+	int              cpu;
+
+	if (cores == 0)
+		cores = 1;
+
+	ck_assert_msg(M_thread_num_numa_nodes() >= 1, "no NUMA nodes");
+	ck_assert_msg(M_thread_cpu_numa_node(0) < M_thread_num_numa_nodes(), "cpu 0 node out of range");
+
+	for (i=0; i<cores*2; i++) {
+		cpu = M_thread_cpu_for_index(i, M_FALSE);
+		ck_assert_msg(cpu >= 0 && (size_t)cpu < cores, "index %zu: cpu %d out of range", i, cpu);
+		cpu = M_thread_cpu_for_index(i, M_TRUE);
+		ck_assert_msg(cpu >= 0 && (size_t)cpu < cores, "index %zu: numa cpu %d out of range", i, cpu);
+	}
+
+	tattr = M_thread_attr_create();
+	ck_assert_msg(M_thread_attr_get_cpu_affinity(tattr) == -1, "affinity set by default");
+	M_thread_attr_set_cpu_affinity(tattr, -5);
+	ck_assert_msg(M_thread_attr_get_cpu_affinity(tattr) == -1, "negative affinity not normalized");
+	M_thread_attr_set_cpu_affinity(tattr, M_thread_cpu_for_index(cores - 1, M_FALSE));
+	ck_assert_msg(M_thread_attr_get_cpu_affinity(tattr) == (int)(cores - 1), "affinity not set");
+
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+	thread = M_thread_create(tattr, thread_selfer, &id);
+	ck_assert_msg(thread != 0, "pinned thread create failed");
+	M_thread_join(thread, NULL);
+	ck_assert_msg(id == thread, "pinned thread did not run");
+	M_thread_attr_destroy(tattr);
+}
+END_TEST
+
 START_TEST(check_sleeper)
 {
 #define NUM_SLEEPER_THREADS 100
@@ -391,6 +468,8 @@ START_TEST(check_sched)
 }
 END_TEST
 
+static M_uint32 check_mutex_attrs[] = { M_THREAD_MUTEXATTR_NONE, M_THREAD_MUTEXATTR_ADAPTIVE };
+
 START_TEST(check_mutex)
 {
 	M_threadid_t      thread1;
@@ -433,7 +512,7 @@ START_TEST(check_mutex)
 		M_FALSE
 	};
 
-	mutex = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	mutex = M_thread_mutex_create(check_mutex_attrs[_i]);
 	sdm1.mutex = mutex;
 	sdm2.mutex = mutex;
 	sdm3.mutex = mutex;
@@ -467,6 +546,77 @@ START_TEST(check_mutex)
 }
 END_TEST
 
+#define CHECK_MUTEX_CONTEND_THREADS 4
+#define CHECK_MUTEX_CONTEND_LOOPS   20000
+typedef struct {
+	M_thread_mutex_t *mutex;
+	M_thread_cond_t  *cond;
+	M_uint64          count;
+	size_t            done;
+} mutex_contend_t;
+
+static void *thread_mutex_contend(void *arg)
+{
+	mutex_contend_t *mc = arg;
+	size_t           i;
+
+	for (i=0; i<CHECK_MUTEX_CONTEND_LOOPS; i++) {
+		M_thread_mutex_lock(mc->mutex);
+		/* Recursive, a second lock must not block. */
+		M_thread_mutex_lock(mc->mutex);
+		mc->count++;
+		M_thread_mutex_unlock(mc->mutex);
+		if ((i & 0x3FF) == 0)
+			M_thread_yield(M_TRUE);
+		M_thread_mutex_unlock(mc->mutex);
+	}
+
+	M_thread_mutex_lock(mc->mutex);
+	mc->done++;
+	M_thread_cond_signal(mc->cond);
+	M_thread_mutex_unlock(mc->mutex);
+	return NULL;
+}
+
+START_TEST(check_mutex_adaptive)
+{
+	M_threadid_t     threads[CHECK_MUTEX_CONTEND_THREADS];
+	M_thread_attr_t *tattr;
+	mutex_contend_t  mc;
+	size_t           i;
+
+	M_mem_set(&mc, 0, sizeof(mc));
+	mc.mutex = M_thread_mutex_create(M_THREAD_MUTEXATTR_ADAPTIVE|M_THREAD_MUTEXATTR_RECURSIVE);
+	mc.cond  = M_thread_cond_create(M_THREAD_CONDATTR_NONE);
+
+	/* Timed wait with nothing to signal should time out with the lock held. */
+	M_thread_mutex_lock(mc.mutex);
+	ck_assert_msg(!M_thread_cond_timedwait(mc.cond, mc.mutex, 10), "timed wait did not time out");
+	ck_assert_msg(M_thread_mutex_trylock(mc.mutex), "recursive trylock failed after timed wait");
+	M_thread_mutex_unlock(mc.mutex);
+	M_thread_mutex_unlock(mc.mutex);
+
+	tattr = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+	for (i=0; i<CHECK_MUTEX_CONTEND_THREADS; i++)
+		threads[i] = M_thread_create(tattr, thread_mutex_contend, &mc);
+
+	M_thread_mutex_lock(mc.mutex);
+	while (mc.done != CHECK_MUTEX_CONTEND_THREADS)
+		M_thread_cond_wait(mc.cond, mc.mutex);
+	M_thread_mutex_unlock(mc.mutex);
+
+	for (i=0; i<CHECK_MUTEX_CONTEND_THREADS; i++)
+		M_thread_join(threads[i], NULL);
+
+	ck_assert_msg(mc.count == CHECK_MUTEX_CONTEND_THREADS * CHECK_MUTEX_CONTEND_LOOPS, "count (%llu) != %u", (llu)mc.count, CHECK_MUTEX_CONTEND_THREADS * CHECK_MUTEX_CONTEND_LOOPS);
+
+	M_thread_attr_destroy(tattr);
+	M_thread_cond_destroy(mc.cond);
+	M_thread_mutex_destroy(mc.mutex);
+}
+END_TEST
+
 
 typedef struct M_spinlock_data {
 	M_uint32            thread_count;
@@ -857,6 +1007,729 @@ START_TEST(check_pool)
 }
 END_TEST
 
+#define CHECK_POOL_STEAL_THREAD_CNT 4
+#define CHECK_POOL_STEAL_TASK_CNT   10000
+static void pool_steal_task(void *arg)
+{
+	M_uint32 *count = arg;
+
+	/* Every so often a task takes longer, leaving tasks queued behind it on
+	 * this thread for idle threads to steal */
+	if (M_atomic_inc_u32(count) % 500 == 0)
+		M_thread_sleep(1000);
+}
+
+START_TEST(check_pool_steal)
+{
+	M_threadpool_t        *pool;
+	M_threadpool_parent_t *parent;
+	void                 **args;
+	M_uint32               count = 0;
+	size_t                 i;
+
+	pool   = M_threadpool_create(CHECK_POOL_STEAL_THREAD_CNT, CHECK_POOL_STEAL_THREAD_CNT, 0, SIZE_MAX);
+	parent = M_threadpool_parent_create(pool);
+
+	args = M_malloc(sizeof(*args) * CHECK_POOL_STEAL_TASK_CNT);
+	for (i=0; i<CHECK_POOL_STEAL_TASK_CNT; i++)
+		args[i] = &count;
+
+	/* Queue in a few separate batches so threads are pulling from the global
+	 * queue while it is still being filled */
+	for (i=0; i<CHECK_POOL_STEAL_TASK_CNT; i+=CHECK_POOL_STEAL_TASK_CNT/4)
+		M_threadpool_dispatch(parent, pool_steal_task, args+i, CHECK_POOL_STEAL_TASK_CNT/4);
+
+	M_threadpool_parent_wait(parent);
+	ck_assert_msg(count == CHECK_POOL_STEAL_TASK_CNT, "count (%u) != %u", count, CHECK_POOL_STEAL_TASK_CNT);
+	ck_assert_msg(M_threadpool_parent_destroy(parent), "Parent still has tasks remaining");
+
+	M_threadpool_destroy(pool);
+	M_free(args);
+}
+END_TEST
+
+START_TEST(check_pool_pinned)
+{
+	M_threadpool_t        *pool;
+	M_threadpool_parent_t *parent;
+	void                  *args[100];
+	M_uint32               count = 0;
+	size_t                 i;
+
+	pool   = M_threadpool_create_ex(CHECK_POOL_STEAL_THREAD_CNT, CHECK_POOL_STEAL_THREAD_CNT, 0, SIZE_MAX, M_THREADPOOL_FLAG_PIN_CPU|M_THREADPOOL_FLAG_NUMA_SPREAD);
+	ck_assert_msg(pool != NULL, "pinned pool create failed");
+	ck_assert_msg(M_threadpool_num_threads(pool) == CHECK_POOL_STEAL_THREAD_CNT, "pinned pool thread count wrong");
+	parent = M_threadpool_parent_create(pool);
+
+	for (i=0; i<sizeof(args)/sizeof(*args); i++)
+		args[i] = &count;
+	M_threadpool_dispatch(parent, pool_steal_task, args, sizeof(args)/sizeof(*args));
+	M_threadpool_parent_wait(parent);
+	ck_assert_msg(count == sizeof(args)/sizeof(*args), "count (%u) != %zu", count, sizeof(args)/sizeof(*args));
+
+	M_threadpool_parent_destroy(parent);
+	M_threadpool_destroy(pool);
+}
+END_TEST
+
+#define CHECK_POOL_STATS_TASK_CNT 20
+static void pool_stats_task(void *arg)
+{
+	M_atomic_inc_u32(arg);
+	M_thread_sleep(2000);
+}
+
+static M_uint64 pool_stats_bucket_sum(const M_threadpool_histogram_t *hist)
+{
+	M_uint64 sum = 0;
+	size_t   i;
+
+	for (i=0; i<M_THREADPOOL_HISTOGRAM_BUCKETS; i++)
+		sum += hist->buckets[i];
+	return sum;
+}
+
+START_TEST(check_pool_stats)
+{
+	M_threadpool_t        *pool;
+	M_threadpool_parent_t *parent;
+	M_threadpool_stats_t   stats;
+	void                  *args[CHECK_POOL_STATS_TASK_CNT];
+	M_uint32               count = 0;
+	size_t                 i;
+
+	/* Small queue so dispatching has to wait on the slow tasks */
+	pool   = M_threadpool_create_ex(0, 2, 10, 2, M_THREADPOOL_FLAG_TIMING);
+	parent = M_threadpool_parent_create(pool);
+
+	for (i=0; i<CHECK_POOL_STATS_TASK_CNT; i++)
+		args[i] = &count;
+	M_threadpool_dispatch(parent, pool_stats_task, args, CHECK_POOL_STATS_TASK_CNT);
+	M_threadpool_parent_wait(parent);
+
+	M_threadpool_stats(pool, &stats);
+	ck_assert_msg(stats.tasks_dispatched == CHECK_POOL_STATS_TASK_CNT, "tasks_dispatched %llu", (llu)stats.tasks_dispatched);
+	ck_assert_msg(stats.tasks_completed == CHECK_POOL_STATS_TASK_CNT, "tasks_completed %llu", (llu)stats.tasks_completed);
+	ck_assert_msg(stats.queue_max_size == 2 && stats.peak_queue_len <= 2 && stats.peak_queue_len > 0, "peak_queue_len %zu", stats.peak_queue_len);
+	ck_assert_msg(stats.threads_spawned >= 1 && stats.peak_threads <= 2, "threads_spawned %llu, peak %zu", (llu)stats.threads_spawned, stats.peak_threads);
+	ck_assert_msg(stats.dispatch_blocked >= 1, "dispatch never blocked");
+	ck_assert_msg(stats.dispatch_wait.count == stats.dispatch_blocked, "dispatch_wait count %llu != blocked %llu", (llu)stats.dispatch_wait.count, (llu)stats.dispatch_blocked);
+	ck_assert_msg(stats.run_time.count == CHECK_POOL_STATS_TASK_CNT, "run_time count %llu", (llu)stats.run_time.count);
+	ck_assert_msg(stats.queue_wait.count == CHECK_POOL_STATS_TASK_CNT, "queue_wait count %llu", (llu)stats.queue_wait.count);
+	ck_assert_msg(stats.run_time.total_us >= CHECK_POOL_STATS_TASK_CNT * 1000, "run_time total %llu us too short", (llu)stats.run_time.total_us);
+	ck_assert_msg(stats.run_time.max_us >= 1000 && stats.run_time.max_us <= stats.run_time.total_us, "run_time max %llu us", (llu)stats.run_time.max_us);
+	ck_assert_msg(pool_stats_bucket_sum(&stats.run_time) == stats.run_time.count, "run_time buckets don't add up");
+	ck_assert_msg(pool_stats_bucket_sum(&stats.queue_wait) == stats.queue_wait.count, "queue_wait buckets don't add up");
+
+	/* Idle threads exit and what they did needs to stay counted */
+	for (i=0; i<100 && M_threadpool_num_threads(pool) != 0; i++)
+		M_thread_sleep(10000);
+	M_threadpool_stats(pool, &stats);
+	ck_assert_msg(stats.num_threads == 0, "threads didn't exit when idle");
+	ck_assert_msg(stats.threads_idle_exit == stats.threads_spawned, "idle exits %llu != spawned %llu", (llu)stats.threads_idle_exit, (llu)stats.threads_spawned);
+	ck_assert_msg(stats.tasks_completed == CHECK_POOL_STATS_TASK_CNT, "tasks_completed %llu after exit", (llu)stats.tasks_completed);
+	ck_assert_msg(stats.run_time.count == CHECK_POOL_STATS_TASK_CNT, "run_time count %llu after exit", (llu)stats.run_time.count);
+
+	M_threadpool_parent_destroy(parent);
+	M_threadpool_destroy(pool);
+}
+END_TEST
+
+static void *pool_future_task(void *arg)
+{
+	M_uint32 *val = arg;
+	*val *= 2;
+	return val;
+}
+
+static void pool_future_then(void *result, void *thunk)
+{
+	M_uint32 *seen = thunk;
+	*seen = *((M_uint32 *)result);
+}
+
+START_TEST(check_pool_future)
+{
+	M_threadpool_t        *pool;
+	M_threadpool_parent_t *parent;
+	M_threadpool_future_t *future;
+	M_uint32               val  = 21;
+	M_uint32               val2 = 50;
+	M_uint32               seen = 0;
+
+	pool   = M_threadpool_create(2, 2, 0, 0);
+	parent = M_threadpool_parent_create(pool);
+
+	future = M_threadpool_dispatch_future(parent, pool_future_task, &val);
+	ck_assert_msg(M_threadpool_future_wait(future) == &val, "future returned wrong result");
+	ck_assert_msg(val == 42, "task did not run, val = %u", val);
+	ck_assert_msg(M_threadpool_future_is_done(future), "future not marked done");
+
+	/* Continuation registered after completion runs immediately */
+	ck_assert_msg(M_threadpool_future_then(future, pool_future_then, &seen), "could not register continuation");
+	ck_assert_msg(seen == 42, "continuation not called, seen = %u", seen);
+	ck_assert_msg(!M_threadpool_future_then(future, pool_future_then, &seen), "registered second continuation");
+	M_threadpool_future_destroy(future);
+
+	/* Destroy before completion, continuation must still run */
+	future = M_threadpool_dispatch_future(parent, pool_future_task, &val2);
+	M_threadpool_future_then(future, pool_future_then, &seen);
+	M_threadpool_future_destroy(future);
+	M_threadpool_parent_wait(parent);
+	ck_assert_msg(seen == 100, "continuation not called, seen = %u", seen);
+
+	M_threadpool_parent_destroy(parent);
+	M_threadpool_destroy(pool);
+}
+END_TEST
+
+#define CHECK_POOL_PFOR_CNT 100000
+static void pool_pfor_task(size_t start, size_t end, void *thunk)
+{
+	M_uint8 *marks = thunk;
+	size_t   i;
+
+	for (i=start; i<end; i++)
+		marks[i]++;
+}
+
+START_TEST(check_pool_parallel_for)
+{
+	M_threadpool_t        *pool;
+	M_threadpool_parent_t *parent;
+	M_uint8               *marks;
+	size_t                 grains[] = { 0, 1, 1000, CHECK_POOL_PFOR_CNT * 2 };
+	size_t                 i;
+	size_t                 j;
+
+	/* Small queue so some pieces have to be run inline */
+	pool   = M_threadpool_create(4, 4, 0, 4);
+	parent = M_threadpool_parent_create(pool);
+	marks  = M_malloc(CHECK_POOL_PFOR_CNT);
+
+	for (i=0; i<sizeof(grains)/sizeof(*grains); i++) {
+		M_mem_set(marks, 0, CHECK_POOL_PFOR_CNT);
+		ck_assert_msg(M_threadpool_parallel_for(parent, 0, CHECK_POOL_PFOR_CNT, grains[i], pool_pfor_task, marks), "parallel for failed");
+		for (j=0; j<CHECK_POOL_PFOR_CNT; j++) {
+			if (marks[j] != 1)
+				break;
+		}
+		ck_assert_msg(j == CHECK_POOL_PFOR_CNT, "grain %zu: index %zu processed %u times", grains[i], j, (unsigned int)marks[j]);
+	}
+
+	M_free(marks);
+	ck_assert_msg(M_threadpool_parent_destroy(parent), "Parent still has tasks remaining");
+	M_threadpool_destroy(pool);
+}
+END_TEST
+
+START_TEST(check_ringbuf)
+{
+	M_ringbuf_t *rb;
+	M_uint32     flags[] = { M_RINGBUF_NONE, M_RINGBUF_SPSC };
+	void        *ptrs[16];
+	void        *val;
+	size_t       i;
+	size_t       j;
+
+	ck_assert_msg(M_ringbuf_create(0, M_RINGBUF_NONE) == NULL, "created zero capacity ring");
+
+	for (j=0; j<sizeof(flags)/sizeof(*flags); j++) {
+		rb = M_ringbuf_create(5, flags[j]);
+		ck_assert_msg(M_ringbuf_capacity(rb) == 8, "%zu: capacity (%zu) != 8", j, M_ringbuf_capacity(rb));
+		ck_assert_msg(!M_ringbuf_pop(rb, &val), "%zu: pop from empty ring", j);
+
+		/* Run enough laps to wrap the positions a few times. */
+		for (i=0; i<100; i++) {
+			ck_assert_msg(M_ringbuf_push(rb, (void *)(i+1)), "%zu: push %zu failed", j, i);
+			ck_assert_msg(M_ringbuf_len(rb) == 1, "%zu: len (%zu) != 1", j, M_ringbuf_len(rb));
+			ck_assert_msg(M_ringbuf_pop(rb, &val) && val == (void *)(i+1), "%zu: pop %zu failed", j, i);
+		}
+
+		for (i=0; i<16; i++)
+			ptrs[i] = (void *)(i+1);
+		ck_assert_msg(M_ringbuf_push_batch(rb, ptrs, 16) == 8, "%zu: batch push not limited to capacity", j);
+		ck_assert_msg(!M_ringbuf_push(rb, ptrs[0]), "%zu: push into full ring", j);
+		ck_assert_msg(M_ringbuf_len(rb) == 8, "%zu: len (%zu) != 8", j, M_ringbuf_len(rb));
+
+		M_mem_set(ptrs, 0, sizeof(ptrs));
+		ck_assert_msg(M_ringbuf_pop_batch(rb, ptrs, 3) == 3, "%zu: batch pop 3 failed", j);
+		ck_assert_msg(M_ringbuf_push_batch(rb, ptrs, 3) == 3, "%zu: batch push 3 failed", j);
+		ck_assert_msg(M_ringbuf_pop_batch(rb, ptrs, 16) == 8, "%zu: batch pop all failed", j);
+		for (i=0; i<5; i++)
+			ck_assert_msg(ptrs[i] == (void *)(i+4), "%zu: order wrong at %zu", j, i);
+		for (i=0; i<3; i++)
+			ck_assert_msg(ptrs[i+5] == (void *)(i+1), "%zu: order wrong at %zu", j, i+5);
+		ck_assert_msg(M_ringbuf_len(rb) == 0, "%zu: ring not empty", j);
+
+		M_ringbuf_destroy(rb);
+	}
+}
+END_TEST
+
+typedef struct {
+	M_epoch_t         *epoch;
+	volatile M_uint32  entered;
+	volatile M_uint32  exited;
+} epoch_reader_t;
+
+static void *epoch_reader(void *arg)
+{
+	epoch_reader_t *r = arg;
+	M_uint32        token;
+
+	token = M_epoch_enter(r->epoch);
+	M_atomic_store_u32(&r->entered, 1);
+	M_thread_sleep(200000);
+	M_atomic_store_u32(&r->exited, 1);
+	M_epoch_exit(r->epoch, token);
+	return NULL;
+}
+
+static void epoch_free(void *arg)
+{
+	epoch_reader_t *r = arg;
+
+	/* Must only be called once the reader has left */
+	ck_assert_msg(M_atomic_load_u32(&r->exited), "deferred free ran while reader was active");
+	M_atomic_inc_u32(&r->entered);
+}
+
+START_TEST(check_epoch)
+{
+	M_thread_attr_t *tattr;
+	M_threadid_t     thread;
+	epoch_reader_t   r;
+	M_uint32         token;
+
+	M_mem_set(&r, 0, sizeof(r));
+	r.epoch = M_epoch_create();
+
+	/* Nested sections on one thread */
+	token = M_epoch_enter(r.epoch);
+	M_epoch_exit(r.epoch, M_epoch_enter(r.epoch));
+	M_epoch_exit(r.epoch, token);
+
+	/* Nothing to wait for */
+	M_epoch_synchronize(r.epoch);
+
+	tattr = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+	thread = M_thread_create(tattr, epoch_reader, &r);
+	M_thread_attr_destroy(tattr);
+
+	while (!M_atomic_load_u32(&r.entered))
+		M_thread_yield(M_TRUE);
+
+	M_epoch_defer(r.epoch, epoch_free, &r);
+	M_epoch_synchronize(r.epoch);
+	ck_assert_msg(M_atomic_load_u32(&r.entered) == 2, "deferred free did not run on synchronize");
+
+	M_thread_join(thread, NULL);
+	M_epoch_destroy(r.epoch);
+}
+END_TEST
+
+#define CHECK_HASH_RCU_KEYS 500
+
+typedef struct {
+	M_hash_strvp_rcu_t *h;
+	volatile M_uint32   done;
+	M_bool              bad;
+} hash_rcu_reader_t;
+
+static void *hash_rcu_reader(void *arg)
+{
+	hash_rcu_reader_t *r = arg;
+	char               key[32];
+	size_t             i;
+	M_uint32           token;
+	M_uint64          *val;
+
+	while (!M_atomic_load_u32(&r->done)) {
+		for (i=0; i<CHECK_HASH_RCU_KEYS; i++) {
+			M_snprintf(key, sizeof(key), "key%zu", i);
+			token = M_hash_strvp_rcu_read_lock(r->h);
+			val   = M_hash_strvp_rcu_get_direct(r->h, key);
+			/* Values are either missing or hold their own index */
+			if (val != NULL && *val != i)
+				r->bad = M_TRUE;
+			M_hash_strvp_rcu_read_unlock(r->h, token);
+		}
+		M_thread_yield(M_TRUE);
+	}
+	return NULL;
+}
+
+static void *hash_rcu_val(size_t i)
+{
+	M_uint64 *val = M_malloc(sizeof(*val));
+	*val = i;
+	return val;
+}
+
+START_TEST(check_hash_strvp_rcu)
+{
+	M_hash_strvp_rcu_t *h;
+	M_thread_attr_t    *tattr;
+	M_threadid_t        threads[4];
+	hash_rcu_reader_t   r;
+	char                key[32];
+	void               *val;
+	size_t              i;
+	size_t              j;
+
+	h = M_hash_strvp_rcu_create(8, 75, M_HASH_STRVP_CASECMP, M_free);
+
+	ck_assert_msg(M_hash_strvp_rcu_insert(h, "Key", hash_rcu_val(1)), "insert failed");
+	ck_assert_msg(M_hash_strvp_rcu_get(h, "KEY", &val) && *((M_uint64 *)val) == 1, "casecmp get failed");
+	ck_assert_msg(M_hash_strvp_rcu_insert(h, "key", hash_rcu_val(2)), "replace failed");
+	ck_assert_msg(M_hash_strvp_rcu_num_keys(h) == 1, "replace added key");
+	ck_assert_msg(*((M_uint64 *)M_hash_strvp_rcu_get_direct(h, "key")) == 2, "value not replaced");
+	ck_assert_msg(M_hash_strvp_rcu_remove(h, "kEy", M_TRUE), "remove failed");
+	ck_assert_msg(!M_hash_strvp_rcu_get(h, "key", NULL), "removed key found");
+	ck_assert_msg(!M_hash_strvp_rcu_remove(h, "key", M_TRUE), "removed missing key");
+
+	/* Grows several times */
+	for (i=0; i<CHECK_HASH_RCU_KEYS; i++) {
+		M_snprintf(key, sizeof(key), "key%zu", i);
+		M_hash_strvp_rcu_insert(h, key, hash_rcu_val(i));
+	}
+	ck_assert_msg(M_hash_strvp_rcu_num_keys(h) == CHECK_HASH_RCU_KEYS, "num keys (%zu) != %d", M_hash_strvp_rcu_num_keys(h), CHECK_HASH_RCU_KEYS);
+	for (i=0; i<CHECK_HASH_RCU_KEYS; i++) {
+		M_snprintf(key, sizeof(key), "KEY%zu", i);
+		ck_assert_msg(M_hash_strvp_rcu_get(h, key, &val) && *((M_uint64 *)val) == i, "%s not found after grow", key);
+	}
+
+	/* Readers while the table is modified */
+	M_mem_set(&r, 0, sizeof(r));
+	r.h   = h;
+	tattr = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+	for (i=0; i<sizeof(threads)/sizeof(*threads); i++)
+		threads[i] = M_thread_create(tattr, hash_rcu_reader, &r);
+	M_thread_attr_destroy(tattr);
+
+	for (j=0; j<5; j++) {
+		for (i=0; i<CHECK_HASH_RCU_KEYS; i++) {
+			M_snprintf(key, sizeof(key), "key%zu", i);
+			if ((i + j) % 3 == 0) {
+				M_hash_strvp_rcu_remove(h, key, M_TRUE);
+			} else {
+				M_hash_strvp_rcu_insert(h, key, hash_rcu_val(i));
+			}
+		}
+		M_thread_yield(M_TRUE);
+	}
+	M_hash_strvp_rcu_clear(h, M_TRUE);
+	ck_assert_msg(M_hash_strvp_rcu_num_keys(h) == 0, "clear left keys");
+
+	M_atomic_store_u32(&r.done, 1);
+	for (i=0; i<sizeof(threads)/sizeof(*threads); i++)
+		M_thread_join(threads[i], NULL);
+	ck_assert_msg(!r.bad, "reader saw wrong value");
+
+	M_hash_strvp_rcu_insert(h, "last", hash_rcu_val(0));
+	M_hash_strvp_rcu_destroy(h, M_TRUE);
+}
+END_TEST
+
+#define CHECK_RINGBUF_ITEMS 200000
+#define CHECK_RINGBUF_BATCH 32
+
+typedef struct {
+	M_ringbuf_t       *rb;
+	size_t             id;
+	size_t             producers;
+	size_t             count;
+	volatile M_uint32 *producers_done;
+	M_uint64           sum;
+	size_t             received;
+	M_bool             ordered;
+} ringbuf_worker_t;
+
+static void *ringbuf_producer(void *arg)
+{
+	ringbuf_worker_t *w = arg;
+	void             *ptrs[CHECK_RINGBUF_BATCH];
+	size_t            seq = 0;
+	size_t            n;
+	size_t            i;
+
+	while (seq < w->count) {
+		/* Values encode the producer so consumers can verify per producer order. */
+		n = M_MIN(CHECK_RINGBUF_BATCH, w->count - seq);
+		for (i=0; i<n; i++)
+			ptrs[i] = (void *)(((seq + i) * w->producers) + w->id + 1);
+
+		i = 0;
+		while (i < n) {
+			size_t cnt = (seq & 1)?M_ringbuf_push_batch(w->rb, ptrs+i, n-i):(size_t)M_ringbuf_push(w->rb, ptrs[i]);
+			if (cnt == 0)
+				M_thread_yield(M_TRUE);
+			i   += cnt;
+			seq += cnt;
+		}
+	}
+
+	M_atomic_inc_u32(w->producers_done);
+	return NULL;
+}
+
+static void *ringbuf_consumer(void *arg)
+{
+	ringbuf_worker_t *w = arg;
+	void             *ptrs[CHECK_RINGBUF_BATCH];
+	size_t           *last;
+	size_t            n;
+	size_t            i;
+
+	last = M_malloc_zero(sizeof(*last) * w->producers);
+	while (1) {
+		n = M_ringbuf_pop_batch(w->rb, ptrs, CHECK_RINGBUF_BATCH);
+		if (n == 0) {
+			/* Check done before the final pop so nothing pushed is missed. */
+			if (M_atomic_load_u32(w->producers_done) == w->producers && M_ringbuf_len(w->rb) == 0)
+				break;
+			M_thread_yield(M_TRUE);
+			continue;
+		}
+
+		for (i=0; i<n; i++) {
+			size_t v   = (size_t)ptrs[i];
+			size_t pid = (v - 1) % w->producers;
+			if (v <= last[pid])
+				w->ordered = M_FALSE;
+			last[pid]  = v;
+			w->sum    += v;
+			w->received++;
+		}
+	}
+	M_free(last);
+	return NULL;
+}
+
+static void ringbuf_run(M_uint32 flags, size_t producers, size_t consumers)
+{
+	M_ringbuf_t       *rb;
+	M_thread_attr_t   *tattr;
+	M_threadid_t      *threads;
+	ringbuf_worker_t  *workers;
+	M_timeval_t        tv;
+	volatile M_uint32  producers_done = 0;
+	M_uint64           elapsed;
+	M_uint64           sum      = 0;
+	M_uint64           expected = 0;
+	size_t             received = 0;
+	size_t             total;
+	size_t             i;
+
+	total = (CHECK_RINGBUF_ITEMS / producers) * producers;
+	for (i=1; i<=total; i++)
+		expected += i;
+
+	rb      = M_ringbuf_create(1024, flags);
+	threads = M_malloc_zero(sizeof(*threads) * (producers + consumers));
+	workers = M_malloc_zero(sizeof(*workers) * (producers + consumers));
+	tattr   = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+
+	M_time_elapsed_start(&tv);
+	for (i=0; i<producers+consumers; i++) {
+		workers[i].rb             = rb;
+		workers[i].id             = i;
+		workers[i].producers      = producers;
+		workers[i].count          = CHECK_RINGBUF_ITEMS / producers;
+		workers[i].producers_done = &producers_done;
+		workers[i].ordered        = M_TRUE;
+		threads[i] = M_thread_create(tattr, i < producers ? ringbuf_producer : ringbuf_consumer, &workers[i]);
+		ck_assert_msg(threads[i] != 0, "thread %zu create failed", i);
+	}
+
+	for (i=0; i<producers+consumers; i++)
+		M_thread_join(threads[i], NULL);
+	elapsed = M_time_elapsed(&tv);
+
+	for (i=producers; i<producers+consumers; i++) {
+		sum      += workers[i].sum;
+		received += workers[i].received;
+		ck_assert_msg(workers[i].ordered, "%zu:%zu consumer %zu saw out of order entries", producers, consumers, i);
+	}
+
+	ck_assert_msg(received == total, "%zu:%zu received (%zu) != %zu", producers, consumers, received, total);
+	ck_assert_msg(sum == expected, "%zu:%zu sum (%llu) != %llu", producers, consumers, (llu)sum, (llu)expected);
+
+	M_printf("ringbuf %s %zu:%zu: %zu items in %llu ms (%llu/ms)\n", (flags & M_RINGBUF_SPSC)?"spsc":"mpmc",
+		producers, consumers, total, (llu)elapsed, (llu)(total / (elapsed == 0 ? 1 : elapsed)));
+
+	M_thread_attr_destroy(tattr);
+	M_free(workers);
+	M_free(threads);
+	M_ringbuf_destroy(rb);
+}
+
+static struct {
+	M_uint32 flags;
+	size_t   producers;
+	size_t   consumers;
+} ringbuf_speed_tests[] = {
+	{ M_RINGBUF_SPSC, 1, 1 },
+	{ M_RINGBUF_NONE, 1, 1 },
+	{ M_RINGBUF_NONE, 4, 1 },
+	{ M_RINGBUF_NONE, 4, 4 },
+};
+
+START_TEST(check_ringbuf_speed)
+{
+	ringbuf_run(ringbuf_speed_tests[_i].flags, ringbuf_speed_tests[_i].producers, ringbuf_speed_tests[_i].consumers);
+}
+END_TEST
+
+#define CHECK_RWLOCK_READS 20000
+#define CHECK_RWLOCK_WRITES 100
+
+typedef struct {
+	M_thread_rwlock_t  *rwlock;
+	M_rwlock_striped_t *striped;
+	size_t              reads;
+	size_t              writes;
+	volatile M_uint64   a;
+	volatile M_uint64   b;
+	volatile M_uint32   torn;
+} rwlock_bench_t;
+
+static void rwlock_bench_lock(rwlock_bench_t *rb, M_thread_rwlock_type_t type)
+{
+	if (rb->striped != NULL) {
+		M_rwlock_striped_lock(rb->striped, type);
+	} else {
+		M_thread_rwlock_lock(rb->rwlock, type);
+	}
+}
+
+static void rwlock_bench_unlock(rwlock_bench_t *rb)
+{
+	if (rb->striped != NULL) {
+		M_rwlock_striped_unlock(rb->striped);
+	} else {
+		M_thread_rwlock_unlock(rb->rwlock);
+	}
+}
+
+static void *rwlock_bench_reader(void *arg)
+{
+	rwlock_bench_t *rb = arg;
+	size_t          i;
+
+	for (i=0; i<rb->reads; i++) {
+		rwlock_bench_lock(rb, M_THREAD_RWLOCK_TYPE_READ);
+		if (rb->a != rb->b)
+			M_atomic_inc_u32(&rb->torn);
+		/* Let other threads in while holding the lock on cooperative threads. */
+		if ((i & 0xFF) == 0)
+			M_thread_yield(M_TRUE);
+		rwlock_bench_unlock(rb);
+	}
+	return NULL;
+}
+
+static void *rwlock_bench_writer(void *arg)
+{
+	rwlock_bench_t *rb = arg;
+	size_t          i;
+
+	for (i=0; i<rb->writes; i++) {
+		rwlock_bench_lock(rb, M_THREAD_RWLOCK_TYPE_WRITE);
+		rb->a++;
+		M_thread_yield(M_TRUE);
+		rb->b++;
+		rwlock_bench_unlock(rb);
+		M_thread_yield(M_TRUE);
+	}
+	return NULL;
+}
+
+static M_uint64 rwlock_bench_run(M_bool striped, size_t readers, size_t reads, size_t writes)
+{
+	rwlock_bench_t   rb;
+	M_thread_attr_t *tattr;
+	M_threadid_t    *threads;
+	M_timeval_t      tv;
+	M_uint64         elapsed;
+	size_t           i;
+
+	M_mem_set(&rb, 0, sizeof(rb));
+	if (striped) {
+		rb.striped = M_rwlock_striped_create();
+	} else {
+		rb.rwlock  = M_thread_rwlock_create();
+	}
+	rb.reads  = reads;
+	rb.writes = writes;
+
+	threads = M_malloc_zero(sizeof(*threads) * (readers + 1));
+	tattr   = M_thread_attr_create();
+	M_thread_attr_set_create_joinable(tattr, M_TRUE);
+
+	M_time_elapsed_start(&tv);
+	for (i=0; i<readers; i++) {
+		threads[i] = M_thread_create(tattr, rwlock_bench_reader, &rb);
+		ck_assert_msg(threads[i] != 0, "thread %zu create failed", i);
+	}
+	threads[readers] = M_thread_create(tattr, rwlock_bench_writer, &rb);
+
+	for (i=0; i<readers+1; i++)
+		M_thread_join(threads[i], NULL);
+	elapsed = M_time_elapsed(&tv);
+
+	ck_assert_msg(rb.torn == 0, "%s %zu readers: %u reads saw a partial write", striped?"striped":"rwlock", readers, rb.torn);
+	ck_assert_msg(rb.a == writes && rb.b == writes, "%s %zu readers: writes (%llu/%llu) != %zu", striped?"striped":"rwlock", readers, (llu)rb.a, (llu)rb.b, writes);
+
+	M_thread_attr_destroy(tattr);
+	M_free(threads);
+	M_rwlock_striped_destroy(rb.striped);
+	M_thread_rwlock_destroy(rb.rwlock);
+
+	return elapsed;
+}
+
+START_TEST(check_rwlock_striped)
+{
+	M_rwlock_striped_t *rwlock;
+
+	ck_assert_msg(!M_rwlock_striped_lock(NULL, M_THREAD_RWLOCK_TYPE_READ), "locked NULL lock");
+
+	rwlock = M_rwlock_striped_create();
+
+	/* Multiple read holders on one thread are only an issue with a waiting writer. */
+	ck_assert_msg(M_rwlock_striped_lock(rwlock, M_THREAD_RWLOCK_TYPE_READ), "read lock failed");
+	ck_assert_msg(M_rwlock_striped_unlock(rwlock), "read unlock failed");
+	ck_assert_msg(M_rwlock_striped_lock(rwlock, M_THREAD_RWLOCK_TYPE_WRITE), "write lock failed");
+	ck_assert_msg(M_rwlock_striped_unlock(rwlock), "write unlock failed");
+	ck_assert_msg(M_rwlock_striped_lock(rwlock, M_THREAD_RWLOCK_TYPE_READ), "read lock after write failed");
+	ck_assert_msg(M_rwlock_striped_unlock(rwlock), "read unlock after write failed");
+
+	M_rwlock_striped_destroy(rwlock);
+
+	rwlock_bench_run(M_TRUE, 4, 2000, 50);
+}
+END_TEST
+
+static size_t rwlock_speed_readers[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+START_TEST(check_rwlock_speed)
+{
+	size_t   readers = rwlock_speed_readers[_i];
+	M_uint64 plain;
+	M_uint64 striped;
+
+	plain   = rwlock_bench_run(M_FALSE, readers, CHECK_RWLOCK_READS, CHECK_RWLOCK_WRITES);
+	striped = rwlock_bench_run(M_TRUE, readers, CHECK_RWLOCK_READS, CHECK_RWLOCK_WRITES);
+
+	M_printf("rwlock %zu readers: %zu reads each, rwlock %llu ms, striped %llu ms\n", readers, (size_t)CHECK_RWLOCK_READS, (llu)plain, (llu)striped);
+}
+END_TEST
+
 START_TEST(check_innerd)
 {
 	M_uint32       count = 0;
@@ -980,6 +1853,10 @@ static Suite *M_thread_suite(M_thread_model_t model, const char *name)
 	tcase_add_test(tc, check_cpu_cores);
 	suite_add_tcase(suite, tc);
 
+	tc = tcase_create("check_cpu_affinity");
+	tcase_add_test(tc, check_cpu_affinity);
+	suite_add_tcase(suite, tc);
+
 	tc = tcase_create("check_sleeper");
 	tcase_add_test(tc, check_sleeper);
 	tcase_set_timeout(tc, 10);
@@ -999,10 +1876,15 @@ static Suite *M_thread_suite(M_thread_model_t model, const char *name)
 	suite_add_tcase(suite, tc);
 
 	tc = tcase_create("check_mutex");
-	tcase_add_test(tc, check_mutex);
+	tcase_add_loop_test(tc, check_mutex, 0, sizeof(check_mutex_attrs)/sizeof(*check_mutex_attrs));
 	tcase_set_timeout(tc, 15);
 	suite_add_tcase(suite, tc);
 
+	tc = tcase_create("check_mutex_adaptive");
+	tcase_add_test(tc, check_mutex_adaptive);
+	tcase_set_timeout(tc, 30);
+	suite_add_tcase(suite, tc);
+
 	tc = tcase_create("check_spinlock");
 	tcase_add_test(tc, check_spinlock);
 	tcase_set_timeout(tc, 30);
@@ -1033,6 +1915,60 @@ static Suite *M_thread_suite(M_thread_model_t model, const char *name)
 	tcase_set_timeout(tc, 10);
 	suite_add_tcase(suite, tc);
 
+	tc = tcase_create("check_pool_steal");
+	tcase_add_test(tc, check_pool_steal);
+	tcase_set_timeout(tc, 10);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_pool_pinned");
+	tcase_add_test(tc, check_pool_pinned);
+	tcase_set_timeout(tc, 10);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_pool_stats");
+	tcase_add_test(tc, check_pool_stats);
+	tcase_set_timeout(tc, 10);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_pool_future");
+	tcase_add_test(tc, check_pool_future);
+	tcase_set_timeout(tc, 10);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_pool_parallel_for");
+	tcase_add_test(tc, check_pool_parallel_for);
+	tcase_set_timeout(tc, 10);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_epoch");
+	tcase_add_test(tc, check_epoch);
+	tcase_set_timeout(tc, 10);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_hash_strvp_rcu");
+	tcase_add_test(tc, check_hash_strvp_rcu);
+	tcase_set_timeout(tc, 30);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_ringbuf");
+	tcase_add_test(tc, check_ringbuf);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_ringbuf_speed");
+	tcase_add_loop_test(tc, check_ringbuf_speed, 0, sizeof(ringbuf_speed_tests)/sizeof(*ringbuf_speed_tests));
+	tcase_set_timeout(tc, 30);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_rwlock_striped");
+	tcase_add_test(tc, check_rwlock_striped);
+	tcase_set_timeout(tc, 10);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("check_rwlock_speed");
+	tcase_add_loop_test(tc, check_rwlock_speed, 0, sizeof(rwlock_speed_readers)/sizeof(*rwlock_speed_readers));
+	tcase_set_timeout(tc, 60);
+	suite_add_tcase(suite, tc);
+
 	tc = tcase_create("check_innerd");
 	tcase_add_test(tc, check_innerd);
 	tcase_set_timeout(tc, 10);
@@ -7,6 +7,17 @@
 #include <mstdlib/mstdlib_io.h>
 #include <mstdlib/mstdlib_tls.h>
 
+#ifdef __linux__
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <arpa/inet.h>
+#  include <unistd.h>
+#  ifndef TCP_ULP
+#    define TCP_ULP 31
+#  endif
+#endif
+
 // Enable below to cycle between localhost, 127.0.0.1, and ::1 to verify they all work as expected
 //#define RANDOMIZE_HOSTS
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -15,6 +26,7 @@ M_uint64 active_client_connections;
 M_uint64 active_server_connections;
 M_uint64 client_connection_count;
 M_uint64 server_connection_count;
+M_uint64 ktls_offload_count;
 M_uint64 expected_connections;
 M_io_t  *netserver;
 M_thread_mutex_t *debug_lock = NULL;
@@ -170,6 +182,8 @@ static void net_client_cb(M_event_t *event, M_event_type_t type, M_io_t *comm, v
 		case M_EVENT_TYPE_CONNECTED:
 			M_atomic_inc_u64(&active_client_connections);
 			M_atomic_inc_u64(&client_connection_count);
+			if (M_tls_get_ktls_offload(comm, M_IO_LAYER_FIND_FIRST_ID))
+				M_atomic_inc_u64(&ktls_offload_count);
 			event_debug("net client Connected to %s %s [%s]:%u:%u (DNS: %llums, IPConnect: %llums) (TLS: %llums %s %s %s)",
 				M_io_net_get_host(comm), net_type(M_io_net_get_type(comm)), M_io_net_get_ipaddr(comm), M_io_net_get_port(comm), M_io_net_get_ephemeral_port(comm), 
 				M_io_net_time_dns_ms(comm), M_io_net_time_connect_ms(comm),
@@ -231,6 +245,8 @@ static void net_serverconn_cb(M_event_t *event, M_event_type_t type, M_io_t *com
 		case M_EVENT_TYPE_CONNECTED:
 			M_atomic_inc_u64(&active_server_connections);
 			M_atomic_inc_u64(&server_connection_count);
+			if (M_tls_get_ktls_offload(comm, M_IO_LAYER_FIND_FIRST_ID))
+				M_atomic_inc_u64(&ktls_offload_count);
 			event_debug("net serverconn Connected %s [%s]:%u:%u, (TLS: %llums %s %s %s)",
 				net_type(M_io_net_get_type(comm)), M_io_net_get_ipaddr(comm), M_io_net_get_port(comm), M_io_net_get_ephemeral_port(comm), 
 				M_tls_get_negotiation_time_ms(comm, M_IO_LAYER_FIND_FIRST_ID),
@@ -327,7 +343,7 @@ static const char *event_err_msg(M_event_err_t err)
 }
 
 
-static M_event_err_t check_tls_test(M_uint64 num_connections)
+static M_event_err_t check_tls_test(M_uint64 num_connections, M_bool ktls, M_threadpool_t *hs_pool, M_tls_session_stats_t *session_stats)
 {
 	M_event_t          *event = M_event_pool_create(0);
 	//M_event_t        *event = M_event_create(M_EVENT_FLAG_NONE);
@@ -356,6 +372,7 @@ static M_event_err_t check_tls_test(M_uint64 num_connections)
 	active_server_connections = 0;
 	client_connection_count   = 0;
 	server_connection_count   = 0;
+	ktls_offload_count        = 0;
 	debug_lock                = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
 
 	/* GENERATE CERTIFICATES */
@@ -453,6 +470,10 @@ M_printf("ServerCert: %s\n", realcert);
 
 	M_tls_clientctx_set_applications(clientctx, applist);
 
+	/* kTLS falls back to userspace if unavailable, so the test must pass either way */
+	if (ktls)
+		M_tls_clientctx_set_ktls(clientctx, M_TRUE);
+
 	/* GENERATE SERVER CTX */
 	M_list_str_remove_first(applist); /* Alter app list */
 
@@ -464,6 +485,13 @@ M_printf("ServerCert: %s\n", realcert);
 
 	M_tls_serverctx_set_applications(serverctx, applist);
 
+	if (ktls)
+		M_tls_serverctx_set_ktls(serverctx, M_TRUE);
+	if (hs_pool != NULL && !M_tls_serverctx_set_handshake_pool(serverctx, hs_pool)) {
+		event_debug("failed to set handshake pool");
+		return M_EVENT_ERR_RETURN;
+	}
+
 	child_serverctx = M_tls_serverctx_create((const M_uint8 *)realkey, M_str_len(realkey), (const M_uint8 *)realcert, M_str_len(realcert), NULL, 0);
 	if (child_serverctx == NULL) {
 		event_debug("failed to create child serverctx");
@@ -540,6 +568,9 @@ M_printf("ServerCert: %s\n", realcert);
 
 	M_event_destroy(event);
 
+	if (session_stats != NULL)
+		M_tls_clientctx_get_session_stats(clientctx, session_stats);
+
 	M_tls_clientctx_destroy(clientctx);
 	M_tls_serverctx_destroy(serverctx);
 	event_debug("exited");
@@ -558,12 +589,116 @@ START_TEST(check_tls)
 	size_t   i;
 
 	for (i=0; tests[i] != 0; i++) {
-		M_event_err_t err = check_tls_test(tests[i]);
+		M_event_err_t err = check_tls_test(tests[i], M_FALSE, NULL, NULL);
+		ck_assert_msg(err == M_EVENT_ERR_DONE, "%d cnt%d expected M_EVENT_ERR_DONE got %s", (int)i, (int)tests[i], event_err_msg(err));
+	}
+}
+END_TEST
+
+/* Returns M_TRUE if both the library and the kernel can offload TLS records.
+ * OpenSSL only attempts offload when the "tls" TCP ULP can be attached to an
+ * established socket, so probe that directly over loopback. */
+static M_bool check_tls_ktls_supported(const char **reason)
+{
+	M_tls_clientctx_t *ctx = M_tls_clientctx_create();
+	M_bool             ret;
+
+	ret = M_tls_clientctx_set_ktls(ctx, M_TRUE);
+	M_tls_clientctx_destroy(ctx);
+	if (!ret) {
+		*reason = "not built with kTLS support";
+		return M_FALSE;
+	}
+
+#ifdef __linux__
+	{
+		struct sockaddr_in sin;
+		socklen_t          sin_len = sizeof(sin);
+		int                lfd;
+		int                cfd     = -1;
+
+		ret = M_FALSE;
+		M_mem_set(&sin, 0, sizeof(sin));
+		sin.sin_family      = AF_INET;
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		lfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (lfd != -1 &&
+		    bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) == 0 &&
+		    listen(lfd, 1) == 0 &&
+		    getsockname(lfd, (struct sockaddr *)&sin, &sin_len) == 0) {
+			cfd = socket(AF_INET, SOCK_STREAM, 0);
+			if (cfd != -1 && connect(cfd, (struct sockaddr *)&sin, sizeof(sin)) == 0 &&
+			    setsockopt(cfd, IPPROTO_TCP, TCP_ULP, "tls", 3) == 0) {
+				ret = M_TRUE;
+			}
+		}
+		if (cfd != -1)
+			close(cfd);
+		if (lfd != -1)
+			close(lfd);
+
+		if (!ret)
+			*reason = "kernel tls ULP unavailable";
+		return ret;
+	}
+#else
+	*reason = "kTLS is only supported on Linux";
+	return M_FALSE;
+#endif
+}
+
+START_TEST(check_tls_ktls)
+{
+	M_uint64    tests[] = { 1, 25, 0 };
+	size_t      i;
+	const char *reason  = NULL;
+	M_bool      offload = check_tls_ktls_supported(&reason);
+
+	/* Connections must succeed either way since kTLS falls back to userspace,
+	 * offload can only be asserted where the platform supports it. */
+	if (!offload)
+		M_printf("check_tls_ktls: skipping offload assertions: %s\n", reason);
+
+	for (i=0; tests[i] != 0; i++) {
+		M_event_err_t err = check_tls_test(tests[i], M_TRUE, NULL, NULL);
+		ck_assert_msg(err == M_EVENT_ERR_DONE, "%d cnt%d expected M_EVENT_ERR_DONE got %s", (int)i, (int)tests[i], event_err_msg(err));
+		if (offload) {
+			ck_assert_msg(ktls_offload_count == tests[i] * 2, "%d cnt%d expected %llu kTLS offloaded connections got %llu",
+				(int)i, (int)tests[i], tests[i] * 2, ktls_offload_count);
+		}
+	}
+}
+END_TEST
+
+START_TEST(check_tls_handshake_pool)
+{
+	M_uint64 tests[] = { 1, 25, 0 };
+	size_t   i;
+
+	for (i=0; tests[i] != 0; i++) {
+		M_threadpool_t *pool = M_threadpool_create(2, 2, 0, SIZE_MAX);
+		M_event_err_t   err  = check_tls_test(tests[i], M_FALSE, pool, NULL);
+		M_threadpool_destroy(pool);
 		ck_assert_msg(err == M_EVENT_ERR_DONE, "%d cnt%d expected M_EVENT_ERR_DONE got %s", (int)i, (int)tests[i], event_err_msg(err));
 	}
 }
 END_TEST
 
+START_TEST(check_tls_session_stats)
+{
+	M_tls_session_stats_t stats;
+	M_event_err_t         err;
+
+	err = check_tls_test(5, M_FALSE, NULL, &stats);
+	ck_assert_msg(err == M_EVENT_ERR_DONE, "expected M_EVENT_ERR_DONE got %s", event_err_msg(err));
+	/* Every connection looks for a session, all start at the same time so none are found */
+	ck_assert_msg(stats.hits + stats.misses == 5, "expected 5 lookups got %llu", (unsigned long long)(stats.hits + stats.misses));
+	ck_assert_msg(stats.stored != 0, "expected sessions to be stored");
+	ck_assert_msg(stats.entries == 1, "expected 1 host cached got %zu", stats.entries);
+}
+END_TEST
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 static Suite *tls_suite(void)
@@ -578,6 +713,21 @@ static Suite *tls_suite(void)
 	tcase_add_test(tc, check_tls);
 	suite_add_tcase(suite, tc);
 
+	tc = tcase_create("tls_ktls");
+	tcase_set_timeout(tc, 60);
+	tcase_add_test(tc, check_tls_ktls);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("tls_handshake_pool");
+	tcase_set_timeout(tc, 60);
+	tcase_add_test(tc, check_tls_handshake_pool);
+	suite_add_tcase(suite, tc);
+
+	tc = tcase_create("tls_session_stats");
+	tcase_set_timeout(tc, 60);
+	tcase_add_test(tc, check_tls_session_stats);
+	suite_add_tcase(suite, tc);
+
 	return suite;
 }
 
@@ -234,6 +234,16 @@
 #endif
 
 
+/* GCC 4.7+ and clang provide the __atomic builtins which take a memory order,
+ * only use them where the __sync builtins are already known to work. */
+#if defined(__ATOMIC_SEQ_CST) && ATOMIC_CAS32 == ATOMIC_OP_GCC_BUILTIN && ATOMIC_INC32 == ATOMIC_OP_GCC_BUILTIN
+#  define ATOMIC_ORDERED32
+#endif
+#if defined(__ATOMIC_SEQ_CST) && ATOMIC_CAS64 == ATOMIC_OP_GCC_BUILTIN && ATOMIC_INC64 == ATOMIC_OP_GCC_BUILTIN
+#  define ATOMIC_ORDERED64
+#endif
+
+
 /* Spinlock helpers */
 #if ATOMIC_CAS32 == ATOMIC_OP_SPINLOCK || ATOMIC_INC32 == ATOMIC_OP_SPINLOCK || ATOMIC_INC64 == ATOMIC_OP_SPINLOCK
 static volatile M_uint32 M_atomic_lock = 0;
@@ -758,3 +768,327 @@ M_uint64 M_atomic_dec_u64(volatile M_uint64 *ptr)
 {
 	return M_atomic_sub_u64(ptr, 1);
 }
+
+/* -------------------------------------------------------------------------------------
+ * Memory order helpers
+ * ------------------------------------------------------------------------------------- */
+
+#if defined(ATOMIC_ORDERED32) || defined(ATOMIC_ORDERED64)
+/* The builtins only honor the order when it's a constant, so every use goes
+ * through a switch.  Orders that aren't valid for the operation fall through
+ * to sequentially consistent. */
+#  define M_ATOMIC_ORDER_SWITCH_LOAD(order, EXPR) \
+	switch (order) { \
+		case M_ATOMIC_ORDER_RELAXED: EXPR(__ATOMIC_RELAXED); \
+		case M_ATOMIC_ORDER_ACQUIRE: \
+		case M_ATOMIC_ORDER_ACQ_REL: EXPR(__ATOMIC_ACQUIRE); \
+		default: break; \
+	} \
+	EXPR(__ATOMIC_SEQ_CST);
+
+#  define M_ATOMIC_ORDER_SWITCH_STORE(order, EXPR) \
+	switch (order) { \
+		case M_ATOMIC_ORDER_RELAXED: EXPR(__ATOMIC_RELAXED); \
+		case M_ATOMIC_ORDER_RELEASE: \
+		case M_ATOMIC_ORDER_ACQ_REL: EXPR(__ATOMIC_RELEASE); \
+		default: break; \
+	} \
+	EXPR(__ATOMIC_SEQ_CST);
+
+#  define M_ATOMIC_ORDER_SWITCH(order, EXPR) \
+	switch (order) { \
+		case M_ATOMIC_ORDER_RELAXED: EXPR(__ATOMIC_RELAXED); \
+		case M_ATOMIC_ORDER_ACQUIRE: EXPR(__ATOMIC_ACQUIRE); \
+		case M_ATOMIC_ORDER_RELEASE: EXPR(__ATOMIC_RELEASE); \
+		case M_ATOMIC_ORDER_ACQ_REL: EXPR(__ATOMIC_ACQ_REL); \
+		default: break; \
+	} \
+	EXPR(__ATOMIC_SEQ_CST);
+#endif
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_or_u32
+ * ------------------------------------------------------------------------------------- */
+
+M_uint32 M_atomic_or_u32(volatile M_uint32 *ptr, M_uint32 val)
+{
+#if ATOMIC_INC32 == ATOMIC_OP_GCC_BUILTIN
+	return __sync_fetch_and_or(ptr, val);
+#else
+	M_uint32 compare;
+	do {
+		compare = *ptr;
+	} while (!M_atomic_cas32(ptr, compare, compare | val));
+	return compare;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_or_u64
+ * ------------------------------------------------------------------------------------- */
+
+M_uint64 M_atomic_or_u64(volatile M_uint64 *ptr, M_uint64 val)
+{
+#if ATOMIC_INC64 == ATOMIC_OP_GCC_BUILTIN
+	return __sync_fetch_and_or(ptr, val);
+#else
+	M_uint64 compare;
+	do {
+		compare = *ptr;
+	} while (!M_atomic_cas64(ptr, compare, compare | val));
+	return compare;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_and_u32
+ * ------------------------------------------------------------------------------------- */
+
+M_uint32 M_atomic_and_u32(volatile M_uint32 *ptr, M_uint32 val)
+{
+#if ATOMIC_INC32 == ATOMIC_OP_GCC_BUILTIN
+	return __sync_fetch_and_and(ptr, val);
+#else
+	M_uint32 compare;
+	do {
+		compare = *ptr;
+	} while (!M_atomic_cas32(ptr, compare, compare & val));
+	return compare;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_and_u64
+ * ------------------------------------------------------------------------------------- */
+
+M_uint64 M_atomic_and_u64(volatile M_uint64 *ptr, M_uint64 val)
+{
+#if ATOMIC_INC64 == ATOMIC_OP_GCC_BUILTIN
+	return __sync_fetch_and_and(ptr, val);
+#else
+	M_uint64 compare;
+	do {
+		compare = *ptr;
+	} while (!M_atomic_cas64(ptr, compare, compare & val));
+	return compare;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_exchange_u32
+ * ------------------------------------------------------------------------------------- */
+
+M_uint32 M_atomic_exchange_u32(volatile M_uint32 *ptr, M_uint32 val)
+{
+#if defined(ATOMIC_ORDERED32)
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+#else
+	M_uint32 compare;
+	do {
+		compare = *ptr;
+	} while (!M_atomic_cas32(ptr, compare, val));
+	return compare;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_exchange_u64
+ * ------------------------------------------------------------------------------------- */
+
+M_uint64 M_atomic_exchange_u64(volatile M_uint64 *ptr, M_uint64 val)
+{
+#if defined(ATOMIC_ORDERED64)
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+#else
+	M_uint64 compare;
+	do {
+		compare = *ptr;
+	} while (!M_atomic_cas64(ptr, compare, val));
+	return compare;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_load_u32
+ * ------------------------------------------------------------------------------------- */
+
+M_uint32 M_atomic_load_u32_explicit(volatile M_uint32 *ptr, M_atomic_order_t order)
+{
+#if defined(ATOMIC_ORDERED32)
+#  define LOAD(o) return __atomic_load_n(ptr, o)
+	M_ATOMIC_ORDER_SWITCH_LOAD(order, LOAD)
+#  undef LOAD
+#else
+	(void)order;
+	/* Adding 0 is a full barrier read on every implementation */
+	return M_atomic_add_u32(ptr, 0);
+#endif
+}
+
+M_uint32 M_atomic_load_u32(volatile M_uint32 *ptr)
+{
+	return M_atomic_load_u32_explicit(ptr, M_ATOMIC_ORDER_SEQ_CST);
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_load_u64
+ * ------------------------------------------------------------------------------------- */
+
+M_uint64 M_atomic_load_u64_explicit(volatile M_uint64 *ptr, M_atomic_order_t order)
+{
+#if defined(ATOMIC_ORDERED64)
+#  define LOAD(o) return __atomic_load_n(ptr, o)
+	M_ATOMIC_ORDER_SWITCH_LOAD(order, LOAD)
+#  undef LOAD
+#else
+	(void)order;
+	return M_atomic_add_u64(ptr, 0);
+#endif
+}
+
+M_uint64 M_atomic_load_u64(volatile M_uint64 *ptr)
+{
+	return M_atomic_load_u64_explicit(ptr, M_ATOMIC_ORDER_SEQ_CST);
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_store_u32
+ * ------------------------------------------------------------------------------------- */
+
+void M_atomic_store_u32_explicit(volatile M_uint32 *ptr, M_uint32 val, M_atomic_order_t order)
+{
+#if defined(ATOMIC_ORDERED32)
+#  define STORE(o) __atomic_store_n(ptr, val, o); return
+	M_ATOMIC_ORDER_SWITCH_STORE(order, STORE)
+#  undef STORE
+#else
+	(void)order;
+	M_atomic_exchange_u32(ptr, val);
+#endif
+}
+
+void M_atomic_store_u32(volatile M_uint32 *ptr, M_uint32 val)
+{
+	M_atomic_store_u32_explicit(ptr, val, M_ATOMIC_ORDER_SEQ_CST);
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_store_u64
+ * ------------------------------------------------------------------------------------- */
+
+void M_atomic_store_u64_explicit(volatile M_uint64 *ptr, M_uint64 val, M_atomic_order_t order)
+{
+#if defined(ATOMIC_ORDERED64)
+#  define STORE(o) __atomic_store_n(ptr, val, o); return
+	M_ATOMIC_ORDER_SWITCH_STORE(order, STORE)
+#  undef STORE
+#else
+	(void)order;
+	M_atomic_exchange_u64(ptr, val);
+#endif
+}
+
+void M_atomic_store_u64(volatile M_uint64 *ptr, M_uint64 val)
+{
+	M_atomic_store_u64_explicit(ptr, val, M_ATOMIC_ORDER_SEQ_CST);
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_add_u32_explicit
+ * ------------------------------------------------------------------------------------- */
+
+M_uint32 M_atomic_add_u32_explicit(volatile M_uint32 *ptr, M_uint32 val, M_atomic_order_t order)
+{
+#if defined(ATOMIC_ORDERED32)
+#  define ADD(o) return __atomic_fetch_add(ptr, val, o)
+	M_ATOMIC_ORDER_SWITCH(order, ADD)
+#  undef ADD
+#else
+	(void)order;
+	return M_atomic_add_u32(ptr, val);
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_add_u64_explicit
+ * ------------------------------------------------------------------------------------- */
+
+M_uint64 M_atomic_add_u64_explicit(volatile M_uint64 *ptr, M_uint64 val, M_atomic_order_t order)
+{
+#if defined(ATOMIC_ORDERED64)
+#  define ADD(o) return __atomic_fetch_add(ptr, val, o)
+	M_ATOMIC_ORDER_SWITCH(order, ADD)
+#  undef ADD
+#else
+	(void)order;
+	return M_atomic_add_u64(ptr, val);
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+ * Pointers
+ *
+ * Pointers are operated on as a 32 or 64bit integer of the same size so every
+ * platform implementation of the integer operations is reused.
+ * ------------------------------------------------------------------------------------- */
+
+M_bool M_atomic_cas_ptr(void * volatile *ptr, void *expected, void *newval)
+{
+	if (sizeof(void *) == sizeof(M_uint32))
+		return M_atomic_cas32((volatile M_uint32 *)ptr, (M_uint32)((M_uintptr)expected), (M_uint32)((M_uintptr)newval));
+	return M_atomic_cas64((volatile M_uint64 *)ptr, (M_uint64)((M_uintptr)expected), (M_uint64)((M_uintptr)newval));
+}
+
+void *M_atomic_exchange_ptr(void * volatile *ptr, void *val)
+{
+	if (sizeof(void *) == sizeof(M_uint32))
+		return (void *)((M_uintptr)M_atomic_exchange_u32((volatile M_uint32 *)ptr, (M_uint32)((M_uintptr)val)));
+	return (void *)((M_uintptr)M_atomic_exchange_u64((volatile M_uint64 *)ptr, (M_uint64)((M_uintptr)val)));
+}
+
+void *M_atomic_load_ptr_explicit(void * volatile *ptr, M_atomic_order_t order)
+{
+	if (sizeof(void *) == sizeof(M_uint32))
+		return (void *)((M_uintptr)M_atomic_load_u32_explicit((volatile M_uint32 *)ptr, order));
+	return (void *)((M_uintptr)M_atomic_load_u64_explicit((volatile M_uint64 *)ptr, order));
+}
+
+void *M_atomic_load_ptr(void * volatile *ptr)
+{
+	return M_atomic_load_ptr_explicit(ptr, M_ATOMIC_ORDER_SEQ_CST);
+}
+
+void M_atomic_store_ptr_explicit(void * volatile *ptr, void *val, M_atomic_order_t order)
+{
+	if (sizeof(void *) == sizeof(M_uint32)) {
+		M_atomic_store_u32_explicit((volatile M_uint32 *)ptr, (M_uint32)((M_uintptr)val), order);
+		return;
+	}
+	M_atomic_store_u64_explicit((volatile M_uint64 *)ptr, (M_uint64)((M_uintptr)val), order);
+}
+
+void M_atomic_store_ptr(void * volatile *ptr, void *val)
+{
+	M_atomic_store_ptr_explicit(ptr, val, M_ATOMIC_ORDER_SEQ_CST);
+}
+
+/* -------------------------------------------------------------------------------------
+ * M_atomic_fence
+ * ------------------------------------------------------------------------------------- */
+
+void M_atomic_fence(M_atomic_order_t order)
+{
+#if defined(ATOMIC_ORDERED32)
+#  define FENCE(o) __atomic_thread_fence(o); return
+	M_ATOMIC_ORDER_SWITCH(order, FENCE)
+#  undef FENCE
+#else
+	static volatile M_uint32 fence = 0;
+
+	if (order == M_ATOMIC_ORDER_RELAXED)
+		return;
+
+	/* Every read-modify-write implementation is a full barrier. */
+	M_atomic_add_u32(&fence, 0);
+#endif
+}
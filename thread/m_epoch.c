@@ -0,0 +1,213 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "m_config.h"
+
+#include <mstdlib/mstdlib_thread.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Implementation notes:
+ *   Readers increment a counter for the current phase (0 or 1) when entering
+ *   and decrement the same counter when exiting.  A grace period flips the
+ *   phase and waits for the old phase's counters to drain.  A reader may have
+ *   read the phase just before the flip and incremented the old counter just
+ *   after the writer saw it drain, so the flip is done twice; after the second
+ *   drain no reader that started before the grace period can remain.
+ *
+ *   Counters are split into stripes each on its own cache line, a reader picks
+ *   one based on its thread id and the stripe is stored in the token so exit
+ *   always decrements the counter that was incremented.
+ */
+
+/*! Assumed cache line size. */
+#define M_EPOCH_CACHELINE 64
+
+/*! Number of reader counter stripes, must be a power of 2. */
+#define M_EPOCH_STRIPES 16
+
+/*! Number of deferred callbacks queued before a writer runs a grace period. */
+#define M_EPOCH_DEFER_BATCH 64
+
+typedef struct {
+	volatile M_uint32 cnt[2];
+	unsigned char     pad[M_EPOCH_CACHELINE - (sizeof(M_uint32) * 2)];
+} M_epoch_stripe_t;
+
+typedef struct M_epoch_deferred {
+	void                   (*free_cb)(void *);
+	void                    *ptr;
+	struct M_epoch_deferred *next;
+} M_epoch_deferred_t;
+
+struct M_epoch {
+	M_epoch_stripe_t    stripes[M_EPOCH_STRIPES];
+	volatile M_uint32   phase;        /*!< Phase new readers use, only low bit is meaningful */
+	unsigned char       pad[M_EPOCH_CACHELINE - sizeof(M_uint32)];
+
+	M_thread_mutex_t   *sync_lock;    /*!< Serializes grace periods */
+	M_thread_mutex_t   *defer_lock;   /*!< Protects deferred list */
+	M_epoch_deferred_t *deferred;     /*!< Callbacks waiting for a grace period */
+	size_t              num_deferred;
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static M_uint32 M_epoch_stripe_idx(void)
+{
+	M_uint64 id = (M_uint64)M_thread_self();
+
+	/* Thread ids are often pointers, mix in the high bits. */
+	id *= 0x9E3779B97F4A7C15ULL;
+	return (M_uint32)(id >> 32) & (M_EPOCH_STRIPES - 1);
+}
+
+static M_bool M_epoch_phase_drained(M_epoch_t *epoch, M_uint32 phase)
+{
+	size_t i;
+
+	for (i=0; i<M_EPOCH_STRIPES; i++) {
+		if (M_atomic_load_u32(&epoch->stripes[i].cnt[phase]) != 0) {
+			return M_FALSE;
+		}
+	}
+	return M_TRUE;
+}
+
+static void M_epoch_run_deferred(M_epoch_deferred_t *deferred)
+{
+	M_epoch_deferred_t *next;
+
+	while (deferred != NULL) {
+		next = deferred->next;
+		deferred->free_cb(deferred->ptr);
+		M_free(deferred);
+		deferred = next;
+	}
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+M_epoch_t *M_epoch_create(void)
+{
+	M_epoch_t *epoch;
+
+	epoch             = M_malloc_zero(sizeof(*epoch));
+	epoch->sync_lock  = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	epoch->defer_lock = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+
+	return epoch;
+}
+
+void M_epoch_destroy(M_epoch_t *epoch)
+{
+	if (epoch == NULL)
+		return;
+
+	/* No readers, nothing to wait for. */
+	M_epoch_run_deferred(epoch->deferred);
+
+	M_thread_mutex_destroy(epoch->sync_lock);
+	M_thread_mutex_destroy(epoch->defer_lock);
+	M_free(epoch);
+}
+
+M_uint32 M_epoch_enter(M_epoch_t *epoch)
+{
+	M_uint32 stripe;
+	M_uint32 phase;
+
+	if (epoch == NULL)
+		return 0;
+
+	stripe = M_epoch_stripe_idx();
+	phase  = M_atomic_load_u32(&epoch->phase) & 1;
+
+	/* Full barrier, reads of shared data can't move above this. */
+	M_atomic_inc_u32(&epoch->stripes[stripe].cnt[phase]);
+
+	return (stripe << 1) | phase;
+}
+
+void M_epoch_exit(M_epoch_t *epoch, M_uint32 token)
+{
+	if (epoch == NULL)
+		return;
+
+	/* Full barrier, reads of shared data can't move below this. */
+	M_atomic_dec_u32(&epoch->stripes[(token >> 1) & (M_EPOCH_STRIPES - 1)].cnt[token & 1]);
+}
+
+void M_epoch_defer(M_epoch_t *epoch, void (*free_cb)(void *), void *ptr)
+{
+	M_epoch_deferred_t *deferred;
+	M_bool              sync;
+
+	if (epoch == NULL || free_cb == NULL)
+		return;
+
+	deferred          = M_malloc_zero(sizeof(*deferred));
+	deferred->free_cb = free_cb;
+	deferred->ptr     = ptr;
+
+	M_thread_mutex_lock(epoch->defer_lock);
+	deferred->next  = epoch->deferred;
+	epoch->deferred = deferred;
+	epoch->num_deferred++;
+	sync            = (epoch->num_deferred >= M_EPOCH_DEFER_BATCH) ? M_TRUE : M_FALSE;
+	M_thread_mutex_unlock(epoch->defer_lock);
+
+	if (sync)
+		M_epoch_synchronize(epoch);
+}
+
+void M_epoch_synchronize(M_epoch_t *epoch)
+{
+	M_epoch_deferred_t *deferred;
+	M_uint32            phase;
+	size_t              i;
+
+	if (epoch == NULL)
+		return;
+
+	/* Take the callbacks now, anything deferred after this point may still be
+	 * visible to readers that start during our grace period. */
+	M_thread_mutex_lock(epoch->defer_lock);
+	deferred            = epoch->deferred;
+	epoch->deferred     = NULL;
+	epoch->num_deferred = 0;
+	M_thread_mutex_unlock(epoch->defer_lock);
+
+	M_thread_mutex_lock(epoch->sync_lock);
+	for (i=0; i<2; i++) {
+		phase = M_atomic_load_u32(&epoch->phase) & 1;
+		M_atomic_store_u32(&epoch->phase, phase ^ 1);
+
+		while (!M_epoch_phase_drained(epoch, phase)) {
+			M_thread_yield(M_TRUE);
+		}
+	}
+	M_thread_mutex_unlock(epoch->sync_lock);
+
+	M_epoch_run_deferred(deferred);
+}
@@ -0,0 +1,374 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "m_config.h"
+
+#include <mstdlib/mstdlib_thread.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Implementation notes:
+ *   Chained buckets.  Readers walk the chains with acquire loads and no lock.
+ *   Writers hold the lock and only ever publish fully initialized nodes, so a
+ *   reader sees either the old or the new chain.  Unlinked nodes and replaced
+ *   values are handed to the epoch.
+ *
+ *   Growing can't be done in place without readers missing entries, so a new
+ *   table with copies of every node is built and published, and the old table
+ *   with its nodes (but not the values) is freed through the epoch.
+ */
+
+typedef struct M_hash_strvp_rcu_node {
+	void * volatile  next;  /*!< M_hash_strvp_rcu_node_t */
+	void * volatile  value;
+	M_uint32         hash;
+	char            *key;
+} M_hash_strvp_rcu_node_t;
+
+typedef struct {
+	size_t           size;  /*!< Power of 2 */
+	void * volatile *buckets;
+} M_hash_strvp_rcu_table_t;
+
+struct M_hash_strvp_rcu {
+	void * volatile     table;     /*!< M_hash_strvp_rcu_table_t */
+	M_epoch_t          *epoch;
+	M_thread_mutex_t   *lock;      /*!< Serializes writers */
+	M_uint32            flags;
+	M_uint32            seed;
+	M_uint8             fillpct;
+	volatile M_uint64   num_keys;
+	void              (*value_free)(void *);
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static M_uint32 M_hash_strvp_rcu_hash(const M_hash_strvp_rcu_t *h, const char *key)
+{
+	if (h->flags & M_HASH_STRVP_CASECMP)
+		return M_hash_func_hash_str_casecmp(key, h->seed);
+	return M_hash_func_hash_str(key, h->seed);
+}
+
+static M_bool M_hash_strvp_rcu_key_eq(const M_hash_strvp_rcu_t *h, const char *key1, const char *key2)
+{
+	if (h->flags & M_HASH_STRVP_CASECMP)
+		return M_str_caseeq(key1, key2);
+	return M_str_eq(key1, key2);
+}
+
+static M_hash_strvp_rcu_table_t *M_hash_strvp_rcu_table_create(size_t size)
+{
+	M_hash_strvp_rcu_table_t *table;
+
+	table          = M_malloc_zero(sizeof(*table));
+	table->size    = size;
+	table->buckets = M_malloc_zero(sizeof(*table->buckets) * size);
+
+	return table;
+}
+
+static void M_hash_strvp_rcu_node_free(void *arg)
+{
+	M_hash_strvp_rcu_node_t *node = arg;
+
+	M_free(node->key);
+	M_free(node);
+}
+
+/* Frees the table and nodes, values belong to whoever still references them */
+static void M_hash_strvp_rcu_table_free(void *arg)
+{
+	M_hash_strvp_rcu_table_t *table = arg;
+	M_hash_strvp_rcu_node_t  *node;
+	M_hash_strvp_rcu_node_t  *next;
+	size_t                    i;
+
+	for (i=0; i<table->size; i++) {
+		for (node=table->buckets[i]; node != NULL; node=next) {
+			next = node->next;
+			M_hash_strvp_rcu_node_free(node);
+		}
+	}
+	M_free((void *)table->buckets);
+	M_free(table);
+}
+
+/* Readers can be anywhere in the old table, so it's copied rather than rehashed in place */
+static void M_hash_strvp_rcu_grow(M_hash_strvp_rcu_t *h)
+{
+	M_hash_strvp_rcu_table_t *table = h->table;
+	M_hash_strvp_rcu_table_t *newtable;
+	M_hash_strvp_rcu_node_t  *node;
+	M_hash_strvp_rcu_node_t  *copy;
+	size_t                    i;
+
+	if (h->fillpct == 0 || h->num_keys * 100 < (M_uint64)table->size * h->fillpct)
+		return;
+
+	newtable = M_hash_strvp_rcu_table_create(table->size << 1);
+	for (i=0; i<table->size; i++) {
+		for (node=table->buckets[i]; node != NULL; node=node->next) {
+			size_t idx = node->hash & (newtable->size - 1);
+
+			copy                   = M_malloc_zero(sizeof(*copy));
+			copy->hash             = node->hash;
+			copy->key              = M_strdup(node->key);
+			copy->value            = node->value;
+			copy->next             = newtable->buckets[idx];
+			newtable->buckets[idx] = copy;
+		}
+	}
+
+	M_atomic_store_ptr_explicit(&h->table, newtable, M_ATOMIC_ORDER_RELEASE);
+	M_epoch_defer(h->epoch, M_hash_strvp_rcu_table_free, table);
+}
+
+static void M_hash_strvp_rcu_value_free(M_hash_strvp_rcu_t *h, void *value, M_bool destroy_vals)
+{
+	if (!destroy_vals || h->value_free == NULL || value == NULL)
+		return;
+	M_epoch_defer(h->epoch, h->value_free, value);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+M_hash_strvp_rcu_t *M_hash_strvp_rcu_create(size_t size, M_uint8 fillpct, M_uint32 flags, void (*destroy_func)(void *))
+{
+	M_hash_strvp_rcu_t *h;
+
+	if (fillpct > 99)
+		fillpct = 99;
+	if (size < 16)
+		size = 16;
+	size = M_size_t_round_up_to_power_of_two(size);
+
+	h             = M_malloc_zero(sizeof(*h));
+	h->table      = M_hash_strvp_rcu_table_create(size);
+	h->epoch      = M_epoch_create();
+	h->lock       = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	h->flags      = flags;
+	h->seed       = (M_uint32)M_rand_range(NULL, 1, (M_uint64)(M_UINT32_MAX)+1);
+	h->fillpct    = fillpct;
+	h->value_free = destroy_func;
+
+	return h;
+}
+
+void M_hash_strvp_rcu_destroy(M_hash_strvp_rcu_t *h, M_bool destroy_vals)
+{
+	M_hash_strvp_rcu_table_t *table;
+	M_hash_strvp_rcu_node_t  *node;
+	size_t                    i;
+
+	if (h == NULL)
+		return;
+
+	/* Runs anything already deferred. */
+	M_epoch_destroy(h->epoch);
+
+	table = h->table;
+	if (destroy_vals && h->value_free != NULL) {
+		for (i=0; i<table->size; i++) {
+			for (node=table->buckets[i]; node != NULL; node=node->next) {
+				if (node->value != NULL) {
+					h->value_free(node->value);
+				}
+			}
+		}
+	}
+	M_hash_strvp_rcu_table_free(table);
+
+	M_thread_mutex_destroy(h->lock);
+	M_free(h);
+}
+
+M_bool M_hash_strvp_rcu_insert(M_hash_strvp_rcu_t *h, const char *key, void *value)
+{
+	M_hash_strvp_rcu_table_t *table;
+	M_hash_strvp_rcu_node_t  *node;
+	M_uint32                  hash;
+	size_t                    idx;
+
+	if (h == NULL || key == NULL)
+		return M_FALSE;
+
+	hash = M_hash_strvp_rcu_hash(h, key);
+
+	M_thread_mutex_lock(h->lock);
+
+	table = h->table;
+	idx   = hash & (table->size - 1);
+
+	for (node=table->buckets[idx]; node != NULL; node=node->next) {
+		if (node->hash == hash && M_hash_strvp_rcu_key_eq(h, node->key, key)) {
+			void *old = M_atomic_exchange_ptr(&node->value, value);
+			M_thread_mutex_unlock(h->lock);
+			if (old != value)
+				M_hash_strvp_rcu_value_free(h, old, M_TRUE);
+			return M_TRUE;
+		}
+	}
+
+	node        = M_malloc_zero(sizeof(*node));
+	node->hash  = hash;
+	node->key   = M_strdup(key);
+	node->value = value;
+	node->next  = table->buckets[idx];
+	M_atomic_store_ptr_explicit(&table->buckets[idx], node, M_ATOMIC_ORDER_RELEASE);
+	M_atomic_inc_u64(&h->num_keys);
+
+	M_hash_strvp_rcu_grow(h);
+
+	M_thread_mutex_unlock(h->lock);
+	return M_TRUE;
+}
+
+M_bool M_hash_strvp_rcu_remove(M_hash_strvp_rcu_t *h, const char *key, M_bool destroy_vals)
+{
+	M_hash_strvp_rcu_table_t  *table;
+	M_hash_strvp_rcu_node_t   *node;
+	void * volatile           *link;
+	M_uint32                   hash;
+	void                      *value;
+
+	if (h == NULL || key == NULL)
+		return M_FALSE;
+
+	hash = M_hash_strvp_rcu_hash(h, key);
+
+	M_thread_mutex_lock(h->lock);
+
+	table = h->table;
+	link  = &table->buckets[hash & (table->size - 1)];
+	for (node=*link; node != NULL; link=&node->next, node=*link) {
+		if (node->hash == hash && M_hash_strvp_rcu_key_eq(h, node->key, key)) {
+			break;
+		}
+	}
+
+	if (node == NULL) {
+		M_thread_mutex_unlock(h->lock);
+		return M_FALSE;
+	}
+
+	/* Readers already on this node can still follow its next pointer. */
+	M_atomic_store_ptr_explicit(link, node->next, M_ATOMIC_ORDER_RELEASE);
+	M_atomic_dec_u64(&h->num_keys);
+	value = node->value;
+
+	M_thread_mutex_unlock(h->lock);
+
+	M_epoch_defer(h->epoch, M_hash_strvp_rcu_node_free, node);
+	M_hash_strvp_rcu_value_free(h, value, destroy_vals);
+	return M_TRUE;
+}
+
+void M_hash_strvp_rcu_clear(M_hash_strvp_rcu_t *h, M_bool destroy_vals)
+{
+	M_hash_strvp_rcu_table_t *table;
+	M_hash_strvp_rcu_node_t  *node;
+	size_t                    i;
+
+	if (h == NULL)
+		return;
+
+	M_thread_mutex_lock(h->lock);
+
+	table = h->table;
+	M_atomic_store_ptr_explicit(&h->table, M_hash_strvp_rcu_table_create(table->size), M_ATOMIC_ORDER_RELEASE);
+	M_atomic_store_u64(&h->num_keys, 0);
+
+	M_thread_mutex_unlock(h->lock);
+
+	if (destroy_vals) {
+		for (i=0; i<table->size; i++) {
+			for (node=table->buckets[i]; node != NULL; node=node->next) {
+				M_hash_strvp_rcu_value_free(h, node->value, destroy_vals);
+			}
+		}
+	}
+	M_epoch_defer(h->epoch, M_hash_strvp_rcu_table_free, table);
+}
+
+M_bool M_hash_strvp_rcu_get(M_hash_strvp_rcu_t *h, const char *key, void **value)
+{
+	M_hash_strvp_rcu_table_t *table;
+	M_hash_strvp_rcu_node_t  *node;
+	M_uint32                  token;
+	M_uint32                  hash;
+	M_bool                    found = M_FALSE;
+
+	if (value != NULL)
+		*value = NULL;
+
+	if (h == NULL || key == NULL)
+		return M_FALSE;
+
+	hash  = M_hash_strvp_rcu_hash(h, key);
+	token = M_epoch_enter(h->epoch);
+
+	table = M_atomic_load_ptr_explicit(&h->table, M_ATOMIC_ORDER_ACQUIRE);
+	node  = M_atomic_load_ptr_explicit(&table->buckets[hash & (table->size - 1)], M_ATOMIC_ORDER_ACQUIRE);
+	while (node != NULL) {
+		if (node->hash == hash && M_hash_strvp_rcu_key_eq(h, node->key, key)) {
+			if (value != NULL)
+				*value = M_atomic_load_ptr_explicit(&node->value, M_ATOMIC_ORDER_ACQUIRE);
+			found = M_TRUE;
+			break;
+		}
+		node = M_atomic_load_ptr_explicit(&node->next, M_ATOMIC_ORDER_ACQUIRE);
+	}
+
+	M_epoch_exit(h->epoch, token);
+	return found;
+}
+
+void *M_hash_strvp_rcu_get_direct(M_hash_strvp_rcu_t *h, const char *key)
+{
+	void *value = NULL;
+
+	M_hash_strvp_rcu_get(h, key, &value);
+	return value;
+}
+
+M_uint32 M_hash_strvp_rcu_read_lock(M_hash_strvp_rcu_t *h)
+{
+	if (h == NULL)
+		return 0;
+	return M_epoch_enter(h->epoch);
+}
+
+void M_hash_strvp_rcu_read_unlock(M_hash_strvp_rcu_t *h, M_uint32 token)
+{
+	if (h == NULL)
+		return;
+	M_epoch_exit(h->epoch, token);
+}
+
+size_t M_hash_strvp_rcu_num_keys(M_hash_strvp_rcu_t *h)
+{
+	if (h == NULL)
+		return 0;
+	return (size_t)M_atomic_load_u64_explicit(&h->num_keys, M_ATOMIC_ORDER_RELAXED);
+}
@@ -0,0 +1,299 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "m_config.h"
+
+#include <mstdlib/mstdlib_thread.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/*! Assumed cache line size.  Indexes written by producers and consumers are
+ *  kept this far apart so they don't bounce the same line between cores. */
+#define M_RINGBUF_CACHELINE 64
+
+/*! Hard limit so positions never get close to wrapping. */
+#define M_RINGBUF_MAX_CAPACITY ((size_t)1 << 30)
+
+/* MPMC cell.  The sequence number tells the state of the slot relative to a
+ * position: seq == pos means free for the producer claiming pos, seq == pos+1
+ * means filled for the consumer claiming pos. */
+typedef struct {
+	volatile M_uint64  seq;
+	void              *data;
+} M_ringbuf_cell_t;
+
+struct M_ringbuf {
+	unsigned char      pad0[M_RINGBUF_CACHELINE];
+
+	/* Producer side.  For MPMC only tail is used and it is shared between
+	 * producers. For SPSC head_cache is the producer's last view of head. */
+	volatile M_uint64  tail;
+	M_uint64           head_cache;
+	unsigned char      pad1[M_RINGBUF_CACHELINE - (sizeof(M_uint64) * 2)];
+
+	/* Consumer side. */
+	volatile M_uint64  head;
+	M_uint64           tail_cache;
+	unsigned char      pad2[M_RINGBUF_CACHELINE - (sizeof(M_uint64) * 2)];
+
+	/* Read only after create. */
+	M_uint32           flags;
+	M_uint64           mask;
+	M_ringbuf_cell_t  *cells; /* MPMC */
+	void             **slots; /* SPSC */
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static size_t M_ringbuf_spsc_push(M_ringbuf_t *rb, void * const *ptrs, size_t cnt)
+{
+	M_uint64 tail = rb->tail; /* Only written by us. */
+	M_uint64 cap  = rb->mask + 1;
+	M_uint64 avail;
+	size_t   i;
+
+	avail = cap - (tail - rb->head_cache);
+	if (avail < cnt) {
+		rb->head_cache = M_atomic_load_u64(&rb->head);
+		avail          = cap - (tail - rb->head_cache);
+	}
+
+	if (cnt > avail)
+		cnt = (size_t)avail;
+	if (cnt == 0)
+		return 0;
+
+	for (i=0; i<cnt; i++) {
+		rb->slots[(tail + i) & rb->mask] = ptrs[i];
+	}
+
+	/* Publish all entries at once. */
+	M_atomic_store_u64(&rb->tail, tail + cnt);
+	return cnt;
+}
+
+static size_t M_ringbuf_spsc_pop(M_ringbuf_t *rb, void **ptrs, size_t cnt)
+{
+	M_uint64 head = rb->head; /* Only written by us. */
+	M_uint64 avail;
+	size_t   i;
+
+	avail = rb->tail_cache - head;
+	if (avail < cnt) {
+		rb->tail_cache = M_atomic_load_u64(&rb->tail);
+		avail          = rb->tail_cache - head;
+	}
+
+	if (cnt > avail)
+		cnt = (size_t)avail;
+	if (cnt == 0)
+		return 0;
+
+	for (i=0; i<cnt; i++) {
+		ptrs[i] = rb->slots[(head + i) & rb->mask];
+	}
+
+	M_atomic_store_u64(&rb->head, head + cnt);
+	return cnt;
+}
+
+static size_t M_ringbuf_mpmc_push(M_ringbuf_t *rb, void * const *ptrs, size_t cnt)
+{
+	M_uint64 pos;
+	size_t   n;
+	size_t   i;
+
+	pos = M_atomic_load_u64(&rb->tail);
+	while (1) {
+		/* Count how many consecutive cells starting at pos are free. A cell
+		 * that is free for pos+n can't be claimed by anyone else until tail
+		 * moves past it, so if the CAS succeeds they're all ours. */
+		for (n=0; n<cnt; n++) {
+			M_uint64 seq = M_atomic_load_u64(&rb->cells[(pos + n) & rb->mask].seq);
+			if (seq != pos + n)
+				break;
+		}
+
+		if (n == 0) {
+			M_uint64 seq = M_atomic_load_u64(&rb->cells[pos & rb->mask].seq);
+			/* Slot still holds an entry from the previous lap, full. */
+			if ((M_int64)(seq - pos) < 0)
+				return 0;
+			/* Another producer claimed pos. */
+			pos = M_atomic_load_u64(&rb->tail);
+			continue;
+		}
+
+		if (M_atomic_cas64(&rb->tail, pos, pos + n))
+			break;
+		pos = M_atomic_load_u64(&rb->tail);
+	}
+
+	for (i=0; i<n; i++) {
+		M_ringbuf_cell_t *cell = &rb->cells[(pos + i) & rb->mask];
+		cell->data = ptrs[i];
+		M_atomic_store_u64(&cell->seq, pos + i + 1);
+	}
+
+	return n;
+}
+
+static size_t M_ringbuf_mpmc_pop(M_ringbuf_t *rb, void **ptrs, size_t cnt)
+{
+	M_uint64 pos;
+	size_t   n;
+	size_t   i;
+
+	pos = M_atomic_load_u64(&rb->head);
+	while (1) {
+		for (n=0; n<cnt; n++) {
+			M_uint64 seq = M_atomic_load_u64(&rb->cells[(pos + n) & rb->mask].seq);
+			if (seq != pos + n + 1)
+				break;
+		}
+
+		if (n == 0) {
+			M_uint64 seq = M_atomic_load_u64(&rb->cells[pos & rb->mask].seq);
+			/* Slot hasn't been filled for this lap, empty. */
+			if ((M_int64)(seq - (pos + 1)) < 0)
+				return 0;
+			pos = M_atomic_load_u64(&rb->head);
+			continue;
+		}
+
+		if (M_atomic_cas64(&rb->head, pos, pos + n))
+			break;
+		pos = M_atomic_load_u64(&rb->head);
+	}
+
+	for (i=0; i<n; i++) {
+		M_ringbuf_cell_t *cell = &rb->cells[(pos + i) & rb->mask];
+		ptrs[i] = cell->data;
+		/* Mark free for the producer one lap ahead. */
+		M_atomic_store_u64(&cell->seq, pos + i + rb->mask + 1);
+	}
+
+	return n;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+M_ringbuf_t *M_ringbuf_create(size_t capacity, M_uint32 flags)
+{
+	M_ringbuf_t *rb;
+	size_t       i;
+
+	if (capacity == 0 || capacity > M_RINGBUF_MAX_CAPACITY)
+		return NULL;
+
+	if (capacity < 2)
+		capacity = 2;
+	capacity = M_size_t_round_up_to_power_of_two(capacity);
+
+	rb        = M_malloc_zero(sizeof(*rb));
+	rb->flags = flags;
+	rb->mask  = capacity - 1;
+
+	if (flags & M_RINGBUF_SPSC) {
+		rb->slots = M_malloc_zero(sizeof(*rb->slots) * capacity);
+	} else {
+		rb->cells = M_malloc_zero(sizeof(*rb->cells) * capacity);
+		for (i=0; i<capacity; i++) {
+			rb->cells[i].seq = i;
+		}
+	}
+
+	return rb;
+}
+
+void M_ringbuf_destroy(M_ringbuf_t *rb)
+{
+	if (rb == NULL)
+		return;
+
+	M_free(rb->slots);
+	M_free(rb->cells);
+	M_free(rb);
+}
+
+M_bool M_ringbuf_push(M_ringbuf_t *rb, void *ptr)
+{
+	return M_ringbuf_push_batch(rb, &ptr, 1) == 1 ? M_TRUE : M_FALSE;
+}
+
+M_bool M_ringbuf_pop(M_ringbuf_t *rb, void **ptr)
+{
+	void *val = NULL;
+
+	if (M_ringbuf_pop_batch(rb, &val, 1) != 1)
+		return M_FALSE;
+
+	if (ptr != NULL)
+		*ptr = val;
+	return M_TRUE;
+}
+
+size_t M_ringbuf_push_batch(M_ringbuf_t *rb, void * const *ptrs, size_t cnt)
+{
+	if (rb == NULL || ptrs == NULL || cnt == 0)
+		return 0;
+
+	if (rb->flags & M_RINGBUF_SPSC)
+		return M_ringbuf_spsc_push(rb, ptrs, cnt);
+	return M_ringbuf_mpmc_push(rb, ptrs, cnt);
+}
+
+size_t M_ringbuf_pop_batch(M_ringbuf_t *rb, void **ptrs, size_t cnt)
+{
+	if (rb == NULL || ptrs == NULL || cnt == 0)
+		return 0;
+
+	if (rb->flags & M_RINGBUF_SPSC)
+		return M_ringbuf_spsc_pop(rb, ptrs, cnt);
+	return M_ringbuf_mpmc_pop(rb, ptrs, cnt);
+}
+
+size_t M_ringbuf_capacity(const M_ringbuf_t *rb)
+{
+	if (rb == NULL)
+		return 0;
+	return (size_t)(rb->mask + 1);
+}
+
+size_t M_ringbuf_len(M_ringbuf_t *rb)
+{
+	M_uint64 head;
+	M_uint64 tail;
+
+	if (rb == NULL)
+		return 0;
+
+	/* Read head first so a concurrent pop can't make it pass tail. */
+	head = M_atomic_load_u64(&rb->head);
+	tail = M_atomic_load_u64(&rb->tail);
+
+	/* MPMC tail counts claimed but not yet filled slots. */
+	if (tail - head > rb->mask + 1)
+		return (size_t)(rb->mask + 1);
+	return (size_t)(tail - head);
+}
@@ -0,0 +1,173 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "m_config.h"
+
+#include <mstdlib/mstdlib_thread.h>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Implementation notes:
+ *   A reader increments the counter for its stripe then checks the writer
+ *   flag.  A writer sets the writer flag then checks every stripe.  Both sides
+ *   use sequentially consistent operations so at least one of them sees the
+ *   other: either the reader backs out, or the writer waits for it.
+ *
+ *   Writers are serialized by write_lock which they hold for the entire write
+ *   section.  A reader that backs out blocks on write_lock, which is the same
+ *   as waiting for the writer to finish, then tries again.
+ */
+
+/*! Assumed cache line size. */
+#define M_RWLOCK_STRIPED_CACHELINE 64
+
+/*! Minimum and maximum number of reader stripes, must be powers of 2. */
+#define M_RWLOCK_STRIPED_MIN 8
+#define M_RWLOCK_STRIPED_MAX 128
+
+typedef struct {
+	volatile M_uint32 readers;
+	unsigned char     pad[M_RWLOCK_STRIPED_CACHELINE - sizeof(M_uint32)];
+} M_rwlock_striped_stripe_t;
+
+struct M_rwlock_striped {
+	M_rwlock_striped_stripe_t *stripes;
+	M_uint32                   stripe_mask;
+
+	M_thread_mutex_t          *write_lock; /*!< Held by the writer for the entire write section */
+	volatile M_uint32          writer;     /*!< Set while a writer is waiting or holds the lock */
+	volatile M_threadid_t      writer_id;  /*!< Thread holding the write lock, 0 otherwise */
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static M_rwlock_striped_stripe_t *M_rwlock_striped_stripe(M_rwlock_striped_t *rwlock)
+{
+	M_uint64 id = (M_uint64)M_thread_self();
+
+	/* Thread ids are often pointers, mix in the high bits. */
+	id *= 0x9E3779B97F4A7C15ULL;
+	return &rwlock->stripes[(M_uint32)(id >> 32) & rwlock->stripe_mask];
+}
+
+static M_bool M_rwlock_striped_has_readers(M_rwlock_striped_t *rwlock)
+{
+	M_uint32 i;
+
+	for (i=0; i<=rwlock->stripe_mask; i++) {
+		if (M_atomic_load_u32(&rwlock->stripes[i].readers) != 0) {
+			return M_TRUE;
+		}
+	}
+	return M_FALSE;
+}
+
+static void M_rwlock_striped_lock_read(M_rwlock_striped_t *rwlock)
+{
+	M_rwlock_striped_stripe_t *stripe = M_rwlock_striped_stripe(rwlock);
+
+	while (1) {
+		M_atomic_inc_u32(&stripe->readers);
+		if (M_atomic_load_u32(&rwlock->writer) == 0)
+			return;
+
+		/* Writer active, back out and wait for it to finish. */
+		M_atomic_dec_u32(&stripe->readers);
+		M_thread_mutex_lock(rwlock->write_lock);
+		M_thread_mutex_unlock(rwlock->write_lock);
+	}
+}
+
+static void M_rwlock_striped_lock_write(M_rwlock_striped_t *rwlock)
+{
+	M_thread_mutex_lock(rwlock->write_lock);
+	M_atomic_store_u32(&rwlock->writer, 1);
+
+	/* New readers will back out, wait for the ones already in. */
+	while (M_rwlock_striped_has_readers(rwlock))
+		M_thread_yield(M_TRUE);
+
+	rwlock->writer_id = M_thread_self();
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+M_rwlock_striped_t *M_rwlock_striped_create(void)
+{
+	M_rwlock_striped_t *rwlock;
+	size_t              num = M_RWLOCK_STRIPED_MIN;
+	size_t              cores;
+
+	/* Twice the cores to keep threads from sharing a stripe by chance. */
+	cores = M_thread_num_cpu_cores() * 2;
+	while (num < cores && num < M_RWLOCK_STRIPED_MAX)
+		num <<= 1;
+
+	rwlock              = M_malloc_zero(sizeof(*rwlock));
+	rwlock->stripes     = M_malloc_zero(sizeof(*rwlock->stripes) * num);
+	rwlock->stripe_mask = (M_uint32)num - 1;
+	rwlock->write_lock  = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+
+	return rwlock;
+}
+
+void M_rwlock_striped_destroy(M_rwlock_striped_t *rwlock)
+{
+	if (rwlock == NULL)
+		return;
+
+	M_thread_mutex_destroy(rwlock->write_lock);
+	M_free(rwlock->stripes);
+	M_free(rwlock);
+}
+
+M_bool M_rwlock_striped_lock(M_rwlock_striped_t *rwlock, M_thread_rwlock_type_t type)
+{
+	if (rwlock == NULL)
+		return M_FALSE;
+
+	if (type == M_THREAD_RWLOCK_TYPE_WRITE) {
+		M_rwlock_striped_lock_write(rwlock);
+	} else {
+		M_rwlock_striped_lock_read(rwlock);
+	}
+	return M_TRUE;
+}
+
+M_bool M_rwlock_striped_unlock(M_rwlock_striped_t *rwlock)
+{
+	if (rwlock == NULL)
+		return M_FALSE;
+
+	/* writer_id is only set once all readers have drained, so a thread
+	 * holding a read lock can never match it. */
+	if (rwlock->writer_id != 0 && rwlock->writer_id == M_thread_self()) {
+		rwlock->writer_id = 0;
+		M_atomic_store_u32(&rwlock->writer, 0);
+		M_thread_mutex_unlock(rwlock->write_lock);
+		return M_TRUE;
+	}
+
+	M_atomic_dec_u32(&M_rwlock_striped_stripe(rwlock)->readers);
+	return M_TRUE;
+}
@@ -31,6 +31,9 @@
 #else
 #  include <unistd.h>
 #endif
+#ifdef HAVE_SCHED_GETAFFINITY
+#  include <sched.h>
+#endif
 #include "m_defs_int.h"
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -284,6 +287,137 @@ size_t M_thread_num_cpu_cores(void)
 }
 
 
+/* NUMA layout is only known on Linux where sysfs has a directory per node
+ * containing an entry for each cpu in the node.  Elsewhere the system is
+ * treated as a single node. */
+#define M_THREAD_NUMA_MAX_NODES 64
+
+size_t M_thread_num_numa_nodes(void)
+{
+#ifdef __linux__
+	char   path[64];
+	size_t i;
+
+	for (i=0; i<M_THREAD_NUMA_MAX_NODES; i++) {
+		M_snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu", i);
+		if (M_fs_perms_can_access(path, 0) != M_FS_ERROR_SUCCESS) {
+			break;
+		}
+	}
+	if (i > 0)
+		return i;
+#endif
+	return 1;
+}
+
+
+size_t M_thread_cpu_numa_node(size_t cpu)
+{
+#ifdef __linux__
+	char   path[96];
+	size_t num_nodes = M_thread_num_numa_nodes();
+	size_t i;
+
+	if (num_nodes == 1)
+		return 0;
+
+	for (i=0; i<num_nodes; i++) {
+		M_snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpu%zu", i, cpu);
+		if (M_fs_perms_can_access(path, 0) == M_FS_ERROR_SUCCESS) {
+			return i;
+		}
+	}
+#else
+	(void)cpu;
+#endif
+	return 0;
+}
+
+
+/* CPUs this process is allowed to run on, in ascending order.  Cores may be
+ * restricted by a cpuset or container, or have gaps from offline CPUs, so the
+ * Nth usable core isn't necessarily core N. */
+static size_t M_thread_allowed_cpus(size_t **cpus)
+{
+	size_t num_cores = M_thread_num_cpu_cores();
+	size_t cnt       = 0;
+	size_t i;
+
+	if (num_cores == 0)
+		num_cores = 1;
+
+#ifdef HAVE_SCHED_GETAFFINITY
+	if (num_cores > 1) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+			*cpus = M_malloc(sizeof(**cpus) * (size_t)CPU_COUNT(&set));
+			for (i=0; i<CPU_SETSIZE; i++) {
+				if (CPU_ISSET(i, &set)) {
+					(*cpus)[cnt++] = i;
+				}
+			}
+			return cnt;
+		}
+	}
+#endif
+
+	*cpus = M_malloc(sizeof(**cpus) * num_cores);
+	for (i=0; i<num_cores; i++) {
+		(*cpus)[cnt++] = i;
+	}
+	return cnt;
+}
+
+
+int M_thread_cpu_for_index(size_t idx, M_bool numa_spread)
+{
+	size_t *cpus;
+	size_t  num_cpus;
+	size_t  num_nodes;
+	size_t  node;
+	size_t  nth;
+	size_t  cnt = 0;
+	size_t  cpu;
+	size_t  i;
+
+	num_cpus = M_thread_allowed_cpus(&cpus);
+	cpu      = cpus[idx % num_cpus];
+
+	num_nodes = numa_spread ? M_thread_num_numa_nodes() : 1;
+	if (num_nodes <= 1)
+		goto done;
+
+	/* Round robin across nodes, then across the cores within the node. */
+	node = idx % num_nodes;
+	nth  = idx / num_nodes;
+
+	for (i=0; i<num_cpus; i++) {
+		if (M_thread_cpu_numa_node(cpus[i]) == node) {
+			cnt++;
+		}
+	}
+	if (cnt == 0)
+		goto done;
+
+	nth %= cnt;
+	for (i=0; i<num_cpus; i++) {
+		if (M_thread_cpu_numa_node(cpus[i]) != node)
+			continue;
+		if (nth == 0) {
+			cpu = cpus[i];
+			break;
+		}
+		nth--;
+	}
+
+done:
+	M_free(cpus);
+	return (int)cpu;
+}
+
+
 
 M_bool M_thread_destructor_insert(void (*destructor)(void))
 {
@@ -31,6 +31,7 @@ struct M_thread_attr {
 	M_bool create_joinable;
 	size_t stack_size;
 	int    priority;
+	int    cpu_affinity;
 };
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -39,6 +40,7 @@ M_thread_attr_t *M_thread_attr_create(void)
 {
 	M_thread_attr_t *attr;
 	attr = M_malloc_zero(sizeof(*attr));
+	attr->cpu_affinity = -1;
 	return attr;
 }
 
@@ -70,6 +72,13 @@ int M_thread_attr_get_priority(const M_thread_attr_t *attr)
 	return attr->priority;
 }
 
+int M_thread_attr_get_cpu_affinity(const M_thread_attr_t *attr)
+{
+	if (attr == NULL)
+		return -1;
+	return attr->cpu_affinity;
+}
+
 void M_thread_attr_set_create_joinable(M_thread_attr_t *attr, M_bool val)
 {
 	if (attr == NULL)
@@ -90,3 +99,12 @@ void M_thread_attr_set_priority(M_thread_attr_t *attr, int val)
 		return;
 	attr->priority = val;
 }
+
+void M_thread_attr_set_cpu_affinity(M_thread_attr_t *attr, int cpu)
+{
+	if (attr == NULL)
+		return;
+	if (cpu < 0)
+		cpu = -1;
+	attr->cpu_affinity = cpu;
+}
@@ -49,14 +49,34 @@
 #  include <time.h>
 #endif
 
+#ifdef HAVE_LINUX_FUTEX_H
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  define M_THREAD_PTHREAD_FUTEX 1
+#endif
+
 #include <mstdlib/mstdlib_thread.h>
 #include <mstdlib/thread/m_thread_system.h>
 #include "base/time/m_time_int.h"
 #include "m_thread_int.h"
 #include <errno.h>
+
+/* Hint to the CPU that we're spinning on a lock. */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#  define M_THREAD_PTHREAD_CPU_RELAX() __asm__ __volatile__("pause")
+#elif defined(__GNUC__) && defined(__aarch64__)
+#  define M_THREAD_PTHREAD_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#  define M_THREAD_PTHREAD_CPU_RELAX()
+#endif
+
+#ifdef M_THREAD_PTHREAD_FUTEX
+static size_t M_thread_pthread_num_cores = 0;
+#endif
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-static void M_thread_pthread_attr_topattr(const M_thread_attr_t *attr, pthread_attr_t *tattr)
+static void M_thread_pthread_attr_topattr(const M_thread_attr_t *attr, pthread_attr_t *tattr, M_bool with_affinity)
 {
 	struct sched_param tparam;
 
@@ -83,6 +103,19 @@ static void M_thread_pthread_attr_topattr(const M_thread_attr_t *attr, pthread_a
 	M_mem_set(&tparam, 0, sizeof(tparam));
 	tparam.sched_priority = M_thread_attr_get_priority(attr);
 	pthread_attr_setschedparam(tattr, &tparam);
+
+#ifdef HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+	if (with_affinity && M_thread_attr_get_cpu_affinity(attr) >= 0 && M_thread_attr_get_cpu_affinity(attr) < CPU_SETSIZE) {
+		size_t    cpu = (size_t)M_thread_attr_get_cpu_affinity(attr);
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		pthread_attr_setaffinity_np(tattr, sizeof(cpus), &cpus);
+	}
+#else
+	(void)with_affinity;
+#endif
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -92,6 +125,9 @@ static void M_thread_pthread_init(void)
 #ifdef HAVE_PTHREAD_INIT
 	pthread_init();
 #endif
+#if defined(M_THREAD_PTHREAD_FUTEX) && defined(_SC_NPROCESSORS_ONLN)
+	M_thread_pthread_num_cores = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
 }
 
 static M_thread_t *M_thread_pthread_create(M_threadid_t *id, const M_thread_attr_t *attr, void *(*func)(void *), void *arg)
@@ -107,9 +143,18 @@ static M_thread_t *M_thread_pthread_create(M_threadid_t *id, const M_thread_attr
 		return NULL;
 	}
 
-	M_thread_pthread_attr_topattr(attr, &tattr);
+	M_thread_pthread_attr_topattr(attr, &tattr, M_TRUE);
 	ret = pthread_create(&thread, &tattr, func, arg);
 	pthread_attr_destroy(&tattr);
+
+	/* Binding isn't fatal.  The CPU may not be usable by this process (e.g. restricted
+	 * by a cpuset), in which case the thread is created without being bound. */
+	if (ret == EINVAL && attr != NULL && M_thread_attr_get_cpu_affinity(attr) >= 0) {
+		M_thread_pthread_attr_topattr(attr, &tattr, M_FALSE);
+		ret = pthread_create(&thread, &tattr, func, arg);
+		pthread_attr_destroy(&tattr);
+	}
+
 	if (ret != 0) {
 		return NULL;
 	}
@@ -195,22 +240,154 @@ static M_bool M_thread_pthread_sigmask(int how, const sigset_t *set, sigset_t *o
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Adaptive mutexes and conditionals use futexes directly when available.
+ *
+ * Mutex state is 0 unlocked, 1 locked, 2 locked with threads parked in the
+ * kernel.  Unlock only needs a system call if the state was 2.
+ *
+ * Userspace can't tell if the thread holding a lock is running, so waiters
+ * use what they can see.  Spinning is skipped on a single core, where the
+ * holder can't make progress while we spin, and when threads are already
+ * parked, which means the lock has been held longer than a spin.  Otherwise
+ * the spin limit follows a moving average of how many spins successful
+ * acquisitions took.  Spins that give up pull the average down, so locks held
+ * too long to spin for drop to the minimum spin rather than the maximum.
+ *
+ * Conditionals are a sequence number that waiters sleep on.  Signalling
+ * changes it so a waiter that hasn't gone to sleep yet returns immediately
+ * rather than missing the wake up. */
+#ifdef M_THREAD_PTHREAD_FUTEX
+#  define M_THREAD_PTHREAD_SPIN_MAX 100
+#  define M_THREAD_PTHREAD_SPIN_MIN 10
+
+static int M_thread_pthread_futex(volatile M_uint32 *uaddr, int op, M_uint32 val, const struct timespec *ts, M_uint32 val3)
+{
+	return (int)syscall(SYS_futex, uaddr, op|FUTEX_PRIVATE_FLAG, val, ts, NULL, val3);
+}
+#endif
+
+/* Both conditional implementations need to get at the pthread mutex or futex
+ * so the mutex is a real struct rather than aliasing pthread_mutex_t */
+struct M_thread_mutex {
+	pthread_mutex_t       mutex;    /*!< Used unless adaptive */
+#ifdef M_THREAD_PTHREAD_FUTEX
+	M_bool                adaptive;
+	M_bool                recursive;
+	volatile M_uint32     state;    /*!< 0 unlocked, 1 locked, 2 locked with parked waiters */
+	volatile M_uint32     spin_avg; /*!< Moving average of spins it took to acquire */
+	volatile M_threadid_t owner;    /*!< Thread holding an adaptive recursive lock */
+	M_uint32              count;    /*!< Recursion depth, only touched by owner */
+#endif
+};
+
+struct M_thread_cond {
+#ifdef M_THREAD_PTHREAD_FUTEX
+	volatile M_uint32 seq;     /*!< Changed on every signal or broadcast */
+	volatile M_uint32 waiters; /*!< Threads waiting, lets signal skip the system call */
+#else
+	pthread_cond_t    cond;
+#endif
+};
+
+#ifdef M_THREAD_PTHREAD_FUTEX
+static M_bool M_thread_pthread_mutex_adaptive_trylock(M_thread_mutex_t *mutex)
+{
+	if (mutex->recursive && mutex->owner == M_thread_pthread_self()) {
+		mutex->count++;
+		return M_TRUE;
+	}
+
+	if (!M_atomic_cas32(&mutex->state, 0, 1))
+		return M_FALSE;
+
+	if (mutex->recursive) {
+		mutex->owner = M_thread_pthread_self();
+		mutex->count = 1;
+	}
+	return M_TRUE;
+}
+
+static void M_thread_pthread_mutex_adaptive_lock(M_thread_mutex_t *mutex)
+{
+	M_uint32 limit;
+	M_uint32 avg;
+	M_uint32 c;
+	M_uint32 i;
+
+	if (M_thread_pthread_mutex_adaptive_trylock(mutex))
+		return;
+
+	if (M_thread_pthread_num_cores > 1 && M_atomic_load_u32(&mutex->state) != 2) {
+		avg   = M_atomic_load_u32_explicit(&mutex->spin_avg, M_ATOMIC_ORDER_RELAXED);
+		limit = M_MIN(avg * 2 + M_THREAD_PTHREAD_SPIN_MIN, M_THREAD_PTHREAD_SPIN_MAX);
+		for (i=0; i<limit; i++) {
+			M_THREAD_PTHREAD_CPU_RELAX();
+			if (M_atomic_load_u32_explicit(&mutex->state, M_ATOMIC_ORDER_RELAXED) == 0 && M_atomic_cas32(&mutex->state, 0, 1))
+				break;
+		}
+		/* Racy update is fine, it's only a hint.  Only spins that got the
+		 * lock feed the average, a spin that ran out decays it so a lock
+		 * held longer than the limit settles at the minimum spin. */
+		if (i < limit) {
+			M_atomic_store_u32_explicit(&mutex->spin_avg, (M_uint32)((M_int32)avg + ((M_int32)i - (M_int32)avg) / 8), M_ATOMIC_ORDER_RELAXED);
+			goto done;
+		}
+		M_atomic_store_u32_explicit(&mutex->spin_avg, avg - avg / 8, M_ATOMIC_ORDER_RELAXED);
+	}
+
+	/* Mark that there are waiters so unlock wakes us, then park. */
+	c = M_atomic_exchange_u32(&mutex->state, 2);
+	while (c != 0) {
+		M_thread_pthread_futex(&mutex->state, FUTEX_WAIT, 2, NULL, 0);
+		c = M_atomic_exchange_u32(&mutex->state, 2);
+	}
+
+done:
+	if (mutex->recursive) {
+		mutex->owner = M_thread_pthread_self();
+		mutex->count = 1;
+	}
+}
+
+static M_bool M_thread_pthread_mutex_adaptive_unlock(M_thread_mutex_t *mutex)
+{
+	if (mutex->recursive) {
+		if (mutex->owner != M_thread_pthread_self())
+			return M_FALSE;
+		if (--mutex->count > 0)
+			return M_TRUE;
+		mutex->owner = 0;
+	}
+
+	if (M_atomic_exchange_u32(&mutex->state, 0) == 2)
+		M_thread_pthread_futex(&mutex->state, FUTEX_WAKE, 1, NULL, 0);
+	return M_TRUE;
+}
+#endif
+
 static M_thread_mutex_t *M_thread_pthread_mutex_create(M_uint32 attr)
 {
 	M_thread_mutex_t    *mutex;
 	pthread_mutexattr_t  myattr;
 	int                  ret;
 
+	mutex = M_malloc_zero(sizeof(*mutex));
+
+#ifdef M_THREAD_PTHREAD_FUTEX
+	if (attr & M_THREAD_MUTEXATTR_ADAPTIVE) {
+		mutex->adaptive  = M_TRUE;
+		mutex->recursive = (attr & M_THREAD_MUTEXATTR_RECURSIVE) ? M_TRUE : M_FALSE;
+		return mutex;
+	}
+#endif
+
 	pthread_mutexattr_init(&myattr);
 	if (attr & M_THREAD_MUTEXATTR_RECURSIVE) {
 		pthread_mutexattr_settype(&myattr, PTHREAD_MUTEX_RECURSIVE);
 	} else {
 		pthread_mutexattr_settype(&myattr, PTHREAD_MUTEX_DEFAULT);
 	}
-	/* NOTE: we never define "struct M_thread_mutex", as we're aliasing it to a
-	 *       different type.  Bad style, but keeps our type safety */
-	mutex = M_malloc_zero(sizeof(pthread_mutex_t));
-	ret   = pthread_mutex_init((pthread_mutex_t *)mutex, &myattr);
+	ret = pthread_mutex_init(&mutex->mutex, &myattr);
 	pthread_mutexattr_destroy(&myattr);
 
 	if (ret == 0)
@@ -224,7 +401,10 @@ static void M_thread_pthread_mutex_destroy(M_thread_mutex_t *mutex)
 	if (mutex == NULL)
 		return;
 
-	pthread_mutex_destroy((pthread_mutex_t *)mutex);
+#ifdef M_THREAD_PTHREAD_FUTEX
+	if (!mutex->adaptive)
+#endif
+		pthread_mutex_destroy(&mutex->mutex);
 	M_free(mutex);
 }
 
@@ -233,7 +413,14 @@ static M_bool M_thread_pthread_mutex_lock(M_thread_mutex_t *mutex)
 	if (mutex == NULL)
 		return M_FALSE;
 
-	if (pthread_mutex_lock((pthread_mutex_t *)mutex) == 0)
+#ifdef M_THREAD_PTHREAD_FUTEX
+	if (mutex->adaptive) {
+		M_thread_pthread_mutex_adaptive_lock(mutex);
+		return M_TRUE;
+	}
+#endif
+
+	if (pthread_mutex_lock(&mutex->mutex) == 0)
 		return M_TRUE;
 	return M_FALSE;
 }
@@ -243,7 +430,12 @@ static M_bool M_thread_pthread_mutex_trylock(M_thread_mutex_t *mutex)
 	if (mutex == NULL)
 		return M_FALSE;
 
-	if (pthread_mutex_trylock((pthread_mutex_t *)mutex) == 0)
+#ifdef M_THREAD_PTHREAD_FUTEX
+	if (mutex->adaptive)
+		return M_thread_pthread_mutex_adaptive_trylock(mutex);
+#endif
+
+	if (pthread_mutex_trylock(&mutex->mutex) == 0)
 		return M_TRUE;
 	return M_FALSE;
 }
@@ -253,7 +445,12 @@ static M_bool M_thread_pthread_mutex_unlock(M_thread_mutex_t *mutex)
 	if (mutex == NULL)
 		return M_FALSE;
 
-	if (pthread_mutex_unlock((pthread_mutex_t *)mutex) == 0)
+#ifdef M_THREAD_PTHREAD_FUTEX
+	if (mutex->adaptive)
+		return M_thread_pthread_mutex_adaptive_unlock(mutex);
+#endif
+
+	if (pthread_mutex_unlock(&mutex->mutex) == 0)
 		return M_TRUE;
 	return M_FALSE;
 }
@@ -265,23 +462,66 @@ static M_thread_cond_t *M_thread_pthread_cond_create(M_uint32 attr)
 	M_thread_cond_t *cond;
 
 	(void)attr;
-	/* NOTE: we never define "struct M_thread_cond", as we're aliasing it to a
-	 *       different type.  Bad style, but keeps our type safety */
-	cond = M_malloc_zero(sizeof(pthread_cond_t));
-	if (pthread_cond_init((pthread_cond_t *)cond, NULL) == 0)
+	cond = M_malloc_zero(sizeof(*cond));
+#ifdef M_THREAD_PTHREAD_FUTEX
+	return cond;
+#else
+	if (pthread_cond_init(&cond->cond, NULL) == 0)
 		return cond;
 	M_free(cond);
 	return NULL;
+#endif
 }
 
 static void M_thread_pthread_cond_destroy(M_thread_cond_t *cond)
 {
 	if (cond == NULL)
 		return;
-	pthread_cond_destroy((pthread_cond_t *)cond);
+#ifndef M_THREAD_PTHREAD_FUTEX
+	pthread_cond_destroy(&cond->cond);
+#endif
 	M_free(cond);
 }
 
+#ifdef M_THREAD_PTHREAD_FUTEX
+static M_bool M_thread_pthread_cond_futex_wait(M_thread_cond_t *cond, M_thread_mutex_t *mutex, const struct timespec *abstime)
+{
+	M_uint32 seq;
+	int      ret;
+
+	/* Waiter count must be visible before the sequence is read, signal
+	 * changes the sequence before checking for waiters. */
+	M_atomic_inc_u32(&cond->waiters);
+	seq = M_atomic_load_u32(&cond->seq);
+
+	M_thread_pthread_mutex_unlock(mutex);
+	if (abstime == NULL) {
+		ret = M_thread_pthread_futex(&cond->seq, FUTEX_WAIT, seq, NULL, 0);
+	} else {
+		ret = M_thread_pthread_futex(&cond->seq, FUTEX_WAIT_BITSET|FUTEX_CLOCK_REALTIME, seq, abstime, FUTEX_BITSET_MATCH_ANY);
+	}
+	if (ret != 0)
+		ret = errno;
+	M_thread_pthread_mutex_lock(mutex);
+
+	M_atomic_dec_u32(&cond->waiters);
+
+	/* EAGAIN means we were signalled before sleeping, EINTR is a spurious
+	 * wake up which callers must already handle. */
+	if (ret == ETIMEDOUT)
+		return M_FALSE;
+	return M_TRUE;
+}
+
+static void M_thread_pthread_cond_futex_wake(M_thread_cond_t *cond, int num)
+{
+	M_atomic_inc_u32(&cond->seq);
+	if (M_atomic_load_u32(&cond->waiters) == 0)
+		return;
+	M_thread_pthread_futex(&cond->seq, FUTEX_WAKE, (M_uint32)num, NULL, 0);
+}
+#endif
+
 static M_bool M_thread_pthread_cond_timedwait(M_thread_cond_t *cond, M_thread_mutex_t *mutex, const M_timeval_t *abstime)
 {
 	struct timespec ts;
@@ -293,28 +533,44 @@ static M_bool M_thread_pthread_cond_timedwait(M_thread_cond_t *cond, M_thread_mu
 	ts.tv_sec  = (M_time_tv_sec_t)(abstime->tv_sec);
 	ts.tv_nsec = (M_time_tv_usec_t)(abstime->tv_usec * 1000);
 
-	return pthread_cond_timedwait((pthread_cond_t *)cond, (pthread_mutex_t *)mutex, &ts)==0?M_TRUE:M_FALSE;
+#ifdef M_THREAD_PTHREAD_FUTEX
+	return M_thread_pthread_cond_futex_wait(cond, mutex, &ts);
+#else
+	return pthread_cond_timedwait(&cond->cond, &mutex->mutex, &ts)==0?M_TRUE:M_FALSE;
+#endif
 }
 
 static M_bool M_thread_pthread_cond_wait(M_thread_cond_t *cond, M_thread_mutex_t *mutex)
 {
 	if (cond == NULL || mutex == NULL)
 		return M_FALSE;
-	return pthread_cond_wait((pthread_cond_t *)cond, (pthread_mutex_t *)mutex)==0?M_TRUE:M_FALSE;
+#ifdef M_THREAD_PTHREAD_FUTEX
+	return M_thread_pthread_cond_futex_wait(cond, mutex, NULL);
+#else
+	return pthread_cond_wait(&cond->cond, &mutex->mutex)==0?M_TRUE:M_FALSE;
+#endif
 }
 
 static void M_thread_pthread_cond_broadcast(M_thread_cond_t *cond)
 {
 	if (cond == NULL)
 		return;
-	pthread_cond_broadcast((pthread_cond_t *)cond);
+#ifdef M_THREAD_PTHREAD_FUTEX
+	M_thread_pthread_cond_futex_wake(cond, M_INT32_MAX);
+#else
+	pthread_cond_broadcast(&cond->cond);
+#endif
 }
 
 static void M_thread_pthread_cond_signal(M_thread_cond_t *cond)
 {
 	if (cond == NULL)
 		return;
-	pthread_cond_signal((pthread_cond_t *)cond);
+#ifdef M_THREAD_PTHREAD_FUTEX
+	M_thread_pthread_cond_futex_wake(cond, 1);
+#else
+	pthread_cond_signal(&cond->cond);
+#endif
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -79,9 +79,18 @@ static M_thread_t *M_thread_win_create(M_threadid_t *id, const M_thread_attr_t *
 	if (func == NULL)
 		return NULL;
 
-	hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)func, arg, 0, &dwThreadId);
-	if (hThread == NULL)
-		return NULL;
+	if (attr != NULL && M_thread_attr_get_cpu_affinity(attr) >= 0 && M_thread_attr_get_cpu_affinity(attr) < (int)(sizeof(DWORD_PTR) * 8)) {
+		/* Bind before the thread runs anything. */
+		hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)func, arg, CREATE_SUSPENDED, &dwThreadId);
+		if (hThread == NULL)
+			return NULL;
+		SetThreadAffinityMask(hThread, ((DWORD_PTR)1) << M_thread_attr_get_cpu_affinity(attr));
+		ResumeThread(hThread);
+	} else {
+		hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)func, arg, 0, &dwThreadId);
+		if (hThread == NULL)
+			return NULL;
+	}
 
 	if (id)
 		*id = dwThreadId;
@@ -144,11 +153,15 @@ static M_thread_mutex_t *M_thread_win_mutex_create(M_uint32 attr)
 {
 	M_thread_mutex_t *mutex;
 
-	(void)attr;
 	/* NOTE: we never define "struct M_thread_mutex", as we're aliasing it to a 
 	 *       different type.  Bad style, but keeps our type safety */
 	mutex = M_malloc_zero(sizeof(CRITICAL_SECTION));
-	InitializeCriticalSection((LPCRITICAL_SECTION)mutex);
+	if (attr & M_THREAD_MUTEXATTR_ADAPTIVE) {
+		/* Spin count is ignored by the OS on single processor systems. */
+		InitializeCriticalSectionAndSpinCount((LPCRITICAL_SECTION)mutex, 4000);
+	} else {
+		InitializeCriticalSection((LPCRITICAL_SECTION)mutex);
+	}
 
 	return mutex;
 }
@@ -24,6 +24,7 @@
 #include "m_config.h"
 
 #include <mstdlib/mstdlib_thread.h>
+#include "m_defs_int.h"
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -32,35 +33,87 @@
  * to sleep and have to be woken back up */
 #define THREADQUEUE_MULTIPLIER 8
 
+/*! Initial number of slots in the global queue ring if the maximum size is
+ *  larger.  The ring grows on demand up to the maximum queue size. */
+#define THREADQUEUE_INITIAL_SIZE 64
+
+/*! Number of tasks each thread may hold in its own local queue.  Threads pull
+ *  tasks from the global queue in batches up to this size, which means the
+ *  global lock is taken once per batch rather than once per task.  Idle threads
+ *  steal from the local queues of busy threads. */
+#define THREADQUEUE_LOCAL_SIZE 32
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-/*! Queue holding tasks to be run */
+/*! Queued task */
 typedef struct M_threadpool_queue_st {
 	void                 (*task)(void *); /*!< Task callback */
 	void                  *task_arg;      /*!< Argument for task callback */
 	M_threadpool_parent_t *parent;        /*!< Handle of threadpool user */
+	M_uint64               queued_us;     /*!< When the task was queued, only with M_THREADPOOL_FLAG_TIMING */
 } M_threadpool_queue_t;
 
+/*! Statistics kept by each thread.  Only the owning thread writes these, using
+ *  relaxed atomics so a snapshot can read them without stopping the thread. */
+typedef struct {
+	M_uint64                 tasks_completed; /*!< Tasks run by the thread */
+	M_threadpool_histogram_t queue_wait;      /*!< Time from queued to started */
+	M_threadpool_histogram_t run_time;        /*!< Time spent running tasks */
+} M_threadpool_worker_stats_t;
+
+/*! Per-thread state.  Each thread owns a small bounded queue of tasks it has
+ *  taken from the global queue.  The owning thread takes from the head, idle
+ *  threads steal from the tail. */
+typedef struct {
+	M_threadpool_t              *pool;                          /*!< Pool thread belongs to */
+	M_thread_mutex_t            *lock;                          /*!< Protects local queue */
+	M_threadpool_queue_t         queue[THREADQUEUE_LOCAL_SIZE]; /*!< Local queue ring */
+	size_t                       head;                          /*!< Index of first task in local queue */
+	size_t                       len;                           /*!< Number of tasks in local queue */
+	M_threadpool_worker_stats_t  stats;                         /*!< Statistics for tasks run by this thread */
+	size_t                       cpu_idx;                       /*!< Placement index the thread was pinned with,
+	                                                                 only with M_THREADPOOL_FLAG_PIN_CPU */
+} M_threadpool_worker_t;
+
 /*! Main structure holding metadata for threadpool */
 struct M_threadpool {
-	size_t                min_threads;      /*!< Min count of threads */
-	size_t                max_threads;      /*!< Max count of threads */
-	size_t                num_threads;      /*!< Current number of threads */
-	size_t                num_idle_threads; /*!< The current number of threads that are idle */
+	size_t                       min_threads;       /*!< Min count of threads */
+	size_t                       max_threads;       /*!< Max count of threads */
+	size_t                       num_threads;       /*!< Current number of threads */
+	size_t                       num_idle_threads;  /*!< The current number of threads that are idle */
+
+	M_uint64                     idle_time_ms;      /*!< Thread idle timeout in ms */
+	M_uint32                     flags;             /*!< M_THREADPOOL_FLAGS */
 
-	M_uint64              idle_time_ms;     /*!< Thread idle timeout in ms */
+	M_bool                       up;                /*!< M_FALSE if threadpool is shutting down */
 
-	M_bool                up;               /*!< M_FALSE if threadpool is shutting down */
+	/* Threads */
+	M_threadpool_worker_t      **workers;           /*!< Running threads, used to find work to steal */
+	size_t                       workers_alloc;     /*!< Allocated size of workers array */
+	size_t                       steal_idx;         /*!< Rotating index of where to start looking for work to steal */
 
 	/* Queue */
-	M_llist_t            *queue;            /*!< Task queue. */
-	M_thread_mutex_t     *queue_lock;       /*!< Lock used for inserting and removing tasks */
-	M_thread_cond_t      *queue_icond;      /*!< Conditional for users waiting to put tasks
-	                                             into the queue */
-	M_thread_cond_t      *queue_ocond;      /*!< Conditional for threads waiting to take tasks
-	                                             out of the queue */
-	size_t                queue_max_size;   /*!< Maximum queue size */
-	size_t                queue_waiters;    /*!< Number of users waiting to insert tasks into the queue */
+	M_threadpool_queue_t        *queue;             /*!< Global task queue ring */
+	size_t                       queue_alloc;       /*!< Allocated size of global queue ring */
+	size_t                       queue_head;        /*!< Index of first task in global queue ring */
+	size_t                       queue_len;         /*!< Number of tasks in global queue ring */
+	M_thread_mutex_t            *queue_lock;        /*!< Lock used for inserting and removing tasks */
+	M_thread_cond_t             *queue_icond;       /*!< Conditional for users waiting to put tasks
+	                                                     into the queue */
+	M_thread_cond_t             *queue_ocond;       /*!< Conditional for threads waiting to take tasks
+	                                                     out of the queue */
+	size_t                       queue_max_size;    /*!< Maximum queue size */
+	size_t                       queue_waiters;     /*!< Number of users waiting to insert tasks into the queue */
+
+	/* Statistics, protected by queue_lock */
+	size_t                       peak_threads;      /*!< Largest num_threads seen */
+	size_t                       peak_queue_len;    /*!< Largest queue_len seen */
+	M_uint64                     tasks_dispatched;  /*!< Tasks put into the global queue */
+	M_uint64                     dispatch_blocked;  /*!< Times a dispatch had to wait for a queue slot */
+	M_uint64                     threads_spawned;   /*!< Threads started */
+	M_uint64                     threads_idle_exit; /*!< Threads that exited due to the idle timeout */
+	M_threadpool_histogram_t     dispatch_wait;     /*!< Time dispatches spent waiting for queue slots */
+	M_threadpool_worker_stats_t  retired;           /*!< Statistics from threads that have exited */
 };
 
 /*! Each Parent/User/Consumer needs a handle to manage their own state */
@@ -69,12 +122,106 @@ struct M_threadpool_parent {
 	                                        to be emptied */
 	M_thread_mutex_t *lock;            /*!< Lock used in conjunction with conditional */
 	M_bool            is_waiting;      /*!< Whether or not the parent is waiting to be signalled */
-	size_t            tasks_remaining; /*!< Number of tasks remaining to be processed for parent */
+	volatile M_uint64 tasks_remaining; /*!< Number of tasks remaining to be processed for parent,
+	                                        atomic. Only the decrement to 0 is done under lock */
 	M_threadpool_t   *pool;            /*!< Pointer to the threadpool handle */
 };
 
+/*! Result of a single task */
+struct M_threadpool_future {
+	M_thread_mutex_t  *lock;                          /*!< Protects the members below */
+	M_thread_cond_t   *cond;                          /*!< Signalled when the task completes */
+	void            *(*task)(void *);                 /*!< Task callback */
+	void              *task_arg;                      /*!< Argument for task callback */
+	void              *result;                        /*!< Value returned by the task */
+	volatile M_uint32  done;                          /*!< Whether the task has completed, set with release
+	                                                       semantics after result */
+	void             (*then_cb)(void *, void *);      /*!< Continuation to call on completion */
+	void              *then_thunk;                    /*!< Argument for continuation */
+	M_bool             then_set;                      /*!< Whether a continuation has been registered */
+	volatile M_uint32  refcnt;                        /*!< Held by the caller and by the queued task, atomic */
+};
+
+/*! State shared by all pieces of a single M_threadpool_parallel_for() call */
+typedef struct {
+	M_threadpool_parent_t  *parent;                   /*!< Parent tasks are dispatched with */
+	void                  (*func)(size_t, size_t, void *); /*!< User callback */
+	void                   *thunk;                    /*!< Argument for user callback */
+	size_t                  grain;                    /*!< Largest range to pass to the callback */
+	M_thread_mutex_t       *lock;                     /*!< Held while outstanding reaches 0 */
+	M_thread_cond_t        *cond;                     /*!< Signalled when outstanding reaches 0 */
+	volatile M_uint64       outstanding;              /*!< Number of ranges dispatched but not yet complete, atomic */
+} M_threadpool_pfor_t;
+
+/*! Range of a M_threadpool_parallel_for() call dispatched as a task */
+typedef struct {
+	M_threadpool_pfor_t *pfor;
+	size_t               start;
+	size_t               end;
+} M_threadpool_pfor_range_t;
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/*! Monotonic time in microseconds, for measuring task timings */
+static M_uint64 M_threadpool_time_us(void)
+{
+	M_timeval_t tv;
+
+	M_time_elapsed_start(&tv);
+	return ((M_uint64)tv.tv_sec * 1000000) + (M_uint64)tv.tv_usec;
+}
+
+
+/*! Microseconds between two M_threadpool_time_us() values */
+static M_uint64 M_threadpool_time_diff(M_uint64 start_us, M_uint64 end_us)
+{
+	if (end_us < start_us)
+		return 0;
+	return end_us - start_us;
+}
+
+
+/*! Add a sample to a histogram.  There must only be a single writer, readers
+ *  use M_threadpool_hist_merge(). */
+static void M_threadpool_hist_add(M_threadpool_histogram_t *hist, M_uint64 us)
+{
+	size_t idx = 0;
+
+	if (us != 0)
+		idx = M_MIN((size_t)M_uint64_log2(us) + 1, M_THREADPOOL_HISTOGRAM_BUCKETS - 1);
+
+	M_atomic_store_u64_explicit(&hist->count, hist->count + 1, M_ATOMIC_ORDER_RELAXED);
+	M_atomic_store_u64_explicit(&hist->total_us, hist->total_us + us, M_ATOMIC_ORDER_RELAXED);
+	if (us > hist->max_us)
+		M_atomic_store_u64_explicit(&hist->max_us, us, M_ATOMIC_ORDER_RELAXED);
+	M_atomic_store_u64_explicit(&hist->buckets[idx], hist->buckets[idx] + 1, M_ATOMIC_ORDER_RELAXED);
+}
+
+
+/*! Add the samples of one histogram to another */
+static void M_threadpool_hist_merge(M_threadpool_histogram_t *dest, M_threadpool_histogram_t *src)
+{
+	M_uint64 max_us;
+	size_t   i;
+
+	dest->count    += M_atomic_load_u64_explicit(&src->count, M_ATOMIC_ORDER_RELAXED);
+	dest->total_us += M_atomic_load_u64_explicit(&src->total_us, M_ATOMIC_ORDER_RELAXED);
+	max_us          = M_atomic_load_u64_explicit(&src->max_us, M_ATOMIC_ORDER_RELAXED);
+	if (max_us > dest->max_us)
+		dest->max_us = max_us;
+	for (i=0; i<M_THREADPOOL_HISTOGRAM_BUCKETS; i++)
+		dest->buckets[i] += M_atomic_load_u64_explicit(&src->buckets[i], M_ATOMIC_ORDER_RELAXED);
+}
+
+
+static void M_threadpool_worker_stats_merge(M_threadpool_worker_stats_t *dest, M_threadpool_worker_stats_t *src)
+{
+	dest->tasks_completed += M_atomic_load_u64_explicit(&src->tasks_completed, M_ATOMIC_ORDER_RELAXED);
+	M_threadpool_hist_merge(&dest->queue_wait, &src->queue_wait);
+	M_threadpool_hist_merge(&dest->run_time, &src->run_time);
+}
+
+
 /*! Initialize the threadpool queue.
  *  \param pool           handle to initialized threadpool
  *  \param queue_max_size Max size of the queue.  Must be at least the size
@@ -95,7 +242,10 @@ static void M_threadpool_queue_init(M_threadpool_t *pool, size_t queue_max_size)
 		}
 	}
 
-	pool->queue          = M_llist_create(NULL, M_LLIST_NONE);
+	pool->queue_alloc    = M_MIN(size, THREADQUEUE_INITIAL_SIZE);
+	pool->queue          = M_malloc_zero(sizeof(*pool->queue) * pool->queue_alloc);
+	pool->queue_head     = 0;
+	pool->queue_len      = 0;
 	pool->queue_max_size = size;
 	pool->queue_waiters  = 0;
 	pool->queue_lock     = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
@@ -108,42 +258,185 @@ static void M_threadpool_queue_init(M_threadpool_t *pool, size_t queue_max_size)
  *  \param pool handle to initialized threadpool */
 static void M_threadpool_queue_finish(M_threadpool_t *pool)
 {
-	M_threadpool_queue_t *q;
-
-	/* Destroy any queue entries that still exist */
-	while ((q = M_llist_take_node(M_llist_first(pool->queue))) != NULL)
-		M_free(q);
-
-	M_llist_destroy(pool->queue, M_TRUE);
+	M_free(pool->queue);
 	pool->queue          = NULL;
+	pool->queue_alloc    = 0;
+	pool->queue_len      = 0;
 	pool->queue_max_size = 0;
 	M_thread_mutex_destroy(pool->queue_lock);
 	M_thread_cond_destroy(pool->queue_icond);
 	M_thread_cond_destroy(pool->queue_ocond);
+
+	M_free(pool->workers);
+	pool->workers       = NULL;
+	pool->workers_alloc = 0;
+}
+
+
+/*! Add a task to the end of the global queue, growing it if necessary.
+ *  pool->queue_lock must be locked and the caller must have verified the
+ *  queue is not at its maximum size. */
+static void M_threadpool_queue_push(M_threadpool_t *pool, const M_threadpool_queue_t *q)
+{
+	if (pool->queue_len == pool->queue_alloc) {
+		M_threadpool_queue_t *queue;
+		size_t                alloc = pool->queue_alloc * 2;
+		size_t                i;
+
+		if (alloc < pool->queue_alloc || alloc > pool->queue_max_size)
+			alloc = pool->queue_max_size;
+
+		/* Unwrap the ring while copying so the head is at the start */
+		queue = M_malloc_zero(sizeof(*queue) * alloc);
+		for (i=0; i<pool->queue_len; i++)
+			queue[i] = pool->queue[(pool->queue_head + i) % pool->queue_alloc];
+		M_free(pool->queue);
+		pool->queue       = queue;
+		pool->queue_alloc = alloc;
+		pool->queue_head  = 0;
+	}
+
+	pool->queue[(pool->queue_head + pool->queue_len) % pool->queue_alloc] = *q;
+	pool->queue_len++;
+
+	pool->tasks_dispatched++;
+	if (pool->queue_len > pool->peak_queue_len)
+		pool->peak_queue_len = pool->queue_len;
+}
+
+
+/*! Take a task from the front of the global queue.
+ *  pool->queue_lock must be locked and the queue must not be empty */
+static void M_threadpool_queue_pop(M_threadpool_t *pool, M_threadpool_queue_t *q)
+{
+	*q               = pool->queue[pool->queue_head];
+	pool->queue_head = (pool->queue_head + 1) % pool->queue_alloc;
+	pool->queue_len--;
+}
+
+
+/*! Take the next task from the thread's own local queue.
+ *  \param worker          Thread state
+ *  \param queue_copy[out] Copy of queue task to perform
+ *  \return M_TRUE if a task was taken, M_FALSE if the local queue was empty */
+static M_bool M_threadpool_local_fetch(M_threadpool_worker_t *worker, M_threadpool_queue_t *queue_copy)
+{
+	M_bool acquired = M_FALSE;
+
+	M_thread_mutex_lock(worker->lock);
+	if (worker->len) {
+		*queue_copy  = worker->queue[worker->head];
+		worker->head = (worker->head + 1) % THREADQUEUE_LOCAL_SIZE;
+		worker->len--;
+		acquired     = M_TRUE;
+	}
+	M_thread_mutex_unlock(worker->lock);
+
+	return acquired;
+}
+
+
+/*! Move tasks from the global queue to the thread's local queue.  The first task is
+ *  returned to be run rather than being put into the local queue.
+ *  pool->queue_lock must be locked and the global queue must not be empty.
+ *  \param pool            Initialized threadpool handle
+ *  \param worker          Thread state
+ *  \param queue_copy[out] Copy of queue task to perform */
+static void M_threadpool_global_fetch(M_threadpool_t *pool, M_threadpool_worker_t *worker, M_threadpool_queue_t *queue_copy)
+{
+	size_t cnt;
+
+	M_threadpool_queue_pop(pool, queue_copy);
+
+	/* Take our share of what's left so the other threads have something
+	 * to do as well */
+	cnt = pool->queue_len / (pool->num_threads ? pool->num_threads : 1);
+	if (cnt == 0)
+		return;
+
+	M_thread_mutex_lock(worker->lock);
+	cnt = M_MIN(cnt, THREADQUEUE_LOCAL_SIZE - worker->len);
+	while (cnt--) {
+		M_threadpool_queue_pop(pool, &worker->queue[(worker->head + worker->len) % THREADQUEUE_LOCAL_SIZE]);
+		worker->len++;
+	}
+	M_thread_mutex_unlock(worker->lock);
+}
+
+
+/*! Steal tasks from another thread's local queue.  Half of the tasks queued on the
+ *  first thread found with any are taken from the tail of its local queue, the first
+ *  is returned to be run and the rest are put in our own local queue.
+ *  pool->queue_lock must be locked.
+ *  \param pool            Initialized threadpool handle
+ *  \param worker          Thread state
+ *  \param queue_copy[out] Copy of queue task to perform
+ *  \return M_TRUE if a task was stolen, M_FALSE if there was nothing to steal */
+static M_bool M_threadpool_steal(M_threadpool_t *pool, M_threadpool_worker_t *worker, M_threadpool_queue_t *queue_copy)
+{
+	size_t i;
+
+	for (i=0; i<pool->num_threads; i++) {
+		M_threadpool_worker_t *victim = pool->workers[(pool->steal_idx + i) % pool->num_threads];
+		size_t                 cnt;
+
+		if (victim == worker)
+			continue;
+
+		M_thread_mutex_lock(victim->lock);
+		if (victim->len == 0) {
+			M_thread_mutex_unlock(victim->lock);
+			continue;
+		}
+
+		/* Round up so a single task can still be stolen */
+		cnt = (victim->len + 1) / 2;
+		victim->len--;
+		*queue_copy = victim->queue[(victim->head + victim->len) % THREADQUEUE_LOCAL_SIZE];
+		cnt--;
+
+		/* Our own local queue is always empty if we're stealing */
+		M_thread_mutex_lock(worker->lock);
+		while (cnt--) {
+			victim->len--;
+			worker->head = (worker->head + THREADQUEUE_LOCAL_SIZE - 1) % THREADQUEUE_LOCAL_SIZE;
+			worker->queue[worker->head] = victim->queue[(victim->head + victim->len) % THREADQUEUE_LOCAL_SIZE];
+			worker->len++;
+		}
+		M_thread_mutex_unlock(worker->lock);
+		M_thread_mutex_unlock(victim->lock);
+
+		/* Spread out where the next thread starts looking */
+		pool->steal_idx = (pool->steal_idx + i + 1) % pool->num_threads;
+		return M_TRUE;
+	}
+
+	return M_FALSE;
 }
 
 
 /*! Fetch the next task to perform from the pool.  Used by the threads in the
  *  threadpool
- *  \param pool            Initialized threadpool handle
+ *  \param worker          Thread state
  *  \param queue_copy[out] Copy of queue task to perform
  *  \return M_TRUE on success, M_FALSE on queue shutdown or thread idle timeout expired */
-static M_bool M_threadpool_queue_fetch(M_threadpool_t *pool, M_threadpool_queue_t *queue_copy)
+static M_bool M_threadpool_queue_fetch(M_threadpool_worker_t *worker, M_threadpool_queue_t *queue_copy)
 {
-	M_bool acquired   = M_FALSE;
-	M_bool is_timeout = M_FALSE;
+	M_threadpool_t *pool       = worker->pool;
+	M_bool          acquired   = M_FALSE;
+	M_bool          is_timeout = M_FALSE;
 
 	M_mem_set(queue_copy, 0, sizeof(*queue_copy));
 
+	/* Our own queue first, this doesn't touch the global lock */
+	if (pool->up && M_threadpool_local_fetch(worker, queue_copy))
+		return M_TRUE;
+
 	M_thread_mutex_lock(pool->queue_lock);
 
 	while (pool->up) {
-		M_threadpool_queue_t *q = M_llist_take_node(M_llist_first(pool->queue));
-		if (q != NULL) {
-			queue_copy->parent   = q->parent;
-			queue_copy->task     = q->task;
-			queue_copy->task_arg = q->task_arg;
-			M_free(q);
+		if (pool->queue_len) {
+			M_threadpool_global_fetch(pool, worker, queue_copy);
 
 			/* Signal someone waiting for a queue slot to put a task in */
 			if (pool->queue_waiters) {
@@ -154,9 +447,18 @@ static M_bool M_threadpool_queue_fetch(M_threadpool_t *pool, M_threadpool_queue_
 			break;
 		}
 
+		/* Tasks only ever get put into a local queue while holding queue_lock so
+		 * if there is nothing to steal now there won't be until the global queue
+		 * has something in it again, which will signal us */
+		if (M_threadpool_steal(pool, worker, queue_copy)) {
+			acquired = M_TRUE;
+			break;
+		}
+
 		/* NOTE: even on a timeout condition, we'll look for a task first before
 		 *       exiting just to make sure we don't have an accidental stall */
 		if (is_timeout && pool->num_threads > pool->min_threads) {
+			pool->threads_idle_exit++;
 			break;
 		}
 		is_timeout = M_FALSE;
@@ -192,56 +494,159 @@ static M_bool M_threadpool_queue_fetch(M_threadpool_t *pool, M_threadpool_queue_
 }
 
 
+/*! Decrement a counter that is waited on with a lock and conditional until it
+ *  reaches 0.  Only the final decrement takes the lock; it must happen while
+ *  holding it so a waiter can't see 0 and free the lock and conditional while
+ *  we're still signalling.
+ *  \param cnt        counter to decrement
+ *  \param lock       lock the waiter checks the counter under
+ *  \param cond       conditional the waiter sleeps on
+ *  \param is_waiting if not NULL, only signal if this is set
+ */
+static void M_threadpool_counter_done(volatile M_uint64 *cnt, M_thread_mutex_t *lock, M_thread_cond_t *cond, const M_bool *is_waiting)
+{
+	M_uint64 val;
+
+	do {
+		val = M_atomic_load_u64_explicit(cnt, M_ATOMIC_ORDER_RELAXED);
+		if (val == 1) {
+			M_thread_mutex_lock(lock);
+			/* More may have been added since we looked */
+			if (M_atomic_sub_u64(cnt, 1) == 1 && (is_waiting == NULL || *is_waiting)) {
+				/* use broadcast instead of signal incase multiple threads are
+				 * calling the wait function even though it isn't recommended */
+				M_thread_cond_broadcast(cond);
+			}
+			M_thread_mutex_unlock(lock);
+			return;
+		}
+	} while (!M_atomic_cas64(cnt, val, val - 1));
+}
+
 /*! Function implementing an individual thread.  Loops looking for and
  *  performing tasks until the threadpool is shutdown
- * \param arg is the initialized threadpool handle
+ * \param arg is the thread state
  * \return always returns NULL, return value is meaningless
  */
 static void *M_threadpool_thread(void *arg)
 {
-	M_threadpool_t       *pool = arg;
-	M_threadpool_queue_t  task;
+	M_threadpool_worker_t *worker = arg;
+	M_threadpool_t        *pool   = worker->pool;
+	M_threadpool_queue_t   task;
+	M_bool                 timing = (pool->flags & M_THREADPOOL_FLAG_TIMING) ? M_TRUE : M_FALSE;
+	M_uint64               start_us = 0;
+	size_t                 i;
 
 	while (1) {
 		/* The only reason this would fail is on shutdown or idle timeout */
-		if (!M_threadpool_queue_fetch(pool, &task))
+		if (!M_threadpool_queue_fetch(worker, &task))
 			break;
 
+		if (timing) {
+			start_us = M_threadpool_time_us();
+			M_threadpool_hist_add(&worker->stats.queue_wait, M_threadpool_time_diff(task.queued_us, start_us));
+		}
+
 		/* Perform task */
 		task.task(task.task_arg);
 
+		if (timing)
+			M_threadpool_hist_add(&worker->stats.run_time, M_threadpool_time_diff(start_us, M_threadpool_time_us()));
+		M_atomic_store_u64_explicit(&worker->stats.tasks_completed, worker->stats.tasks_completed + 1, M_ATOMIC_ORDER_RELAXED);
+
 		/* Tell the parent the task is done, and wake them up if we were the
 		 * last task left */
-		M_thread_mutex_lock(task.parent->lock);
-		task.parent->tasks_remaining--;
-		if (task.parent->is_waiting && task.parent->tasks_remaining == 0) {
-			/* use broadcast instead of signal incase multiple threads are
-			 * calling the parent wait function even though it isn't recommended */
-			M_thread_cond_broadcast(task.parent->cond);
-		}
-		M_thread_mutex_unlock(task.parent->lock);
+		M_threadpool_counter_done(&task.parent->tasks_remaining, task.parent->lock, task.parent->cond, &task.parent->is_waiting);
 	}
 
 	M_thread_mutex_lock(pool->queue_lock);
+
+	/* Remove ourselves from the list of threads others can steal from.  Our local
+	 * queue is always empty at this point unless we're shutting down. */
+	for (i=0; i<pool->num_threads; i++) {
+		if (pool->workers[i] == worker) {
+			pool->workers[i] = pool->workers[pool->num_threads-1];
+			break;
+		}
+	}
 	pool->num_threads--;
+	if (pool->steal_idx >= pool->num_threads)
+		pool->steal_idx = 0;
+
+	/* Keep what we did around for M_threadpool_stats() */
+	M_threadpool_worker_stats_merge(&pool->retired, &worker->stats);
+
 	/* On M_threadpool_destroy() it will block on queue_icond until woken up
 	 * with the thread count at 0 */
 	if (!pool->up && pool->num_threads == 0)
 		M_thread_cond_broadcast(pool->queue_icond);
 	M_thread_mutex_unlock(pool->queue_lock);
 
+	M_thread_mutex_destroy(worker->lock);
+	M_free(worker);
+
 	return NULL;
 }
 
 
+/*! Lowest placement index not held by a running thread.  Threads exit in any
+ *  order when idle so the thread count isn't a free index, reusing the index of
+ *  the thread that exited keeps a new thread off cores still in use.
+ *  pool->queue_lock must be locked before calling this function */
+static size_t M_threadpool_cpu_idx_free(const M_threadpool_t *pool)
+{
+	size_t idx;
+	size_t i;
+
+	for (idx=0; ; idx++) {
+		for (i=0; i<pool->num_threads; i++) {
+			if (pool->workers[i]->cpu_idx == idx)
+				break;
+		}
+		if (i == pool->num_threads)
+			return idx;
+	}
+}
+
+
 /*! pool->queue_lock must be locked before calling this function */
 static M_bool M_threadpool_thread_spawn(M_threadpool_t *pool)
 {
-	M_threadid_t threadid = M_thread_create(NULL, M_threadpool_thread, pool);
-	if (threadid == 0)
+	M_threadpool_worker_t *worker;
+	M_thread_attr_t       *attr = NULL;
+	M_threadid_t           threadid;
+
+	if (pool->num_threads == pool->workers_alloc) {
+		pool->workers_alloc = (pool->workers_alloc == 0) ? 8 : pool->workers_alloc * 2;
+		pool->workers       = M_realloc(pool->workers, sizeof(*pool->workers) * pool->workers_alloc);
+	}
+
+	worker       = M_malloc_zero(sizeof(*worker));
+	worker->pool = pool;
+	worker->lock = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+
+	/* The thread can't do anything until we release the queue_lock so we can
+	 * register it after it starts */
+	if (pool->flags & M_THREADPOOL_FLAG_PIN_CPU) {
+		worker->cpu_idx = M_threadpool_cpu_idx_free(pool);
+		attr            = M_thread_attr_create();
+		M_thread_attr_set_cpu_affinity(attr, M_thread_cpu_for_index(worker->cpu_idx, (pool->flags & M_THREADPOOL_FLAG_NUMA_SPREAD) ? M_TRUE : M_FALSE));
+	}
+
+	threadid = M_thread_create(attr, M_threadpool_thread, worker);
+	M_thread_attr_destroy(attr);
+	if (threadid == 0) {
+		M_thread_mutex_destroy(worker->lock);
+		M_free(worker);
 		return M_FALSE;
+	}
 
+	pool->workers[pool->num_threads] = worker;
 	pool->num_threads++;
+
+	pool->threads_spawned++;
+	if (pool->num_threads > pool->peak_threads)
+		pool->peak_threads = pool->num_threads;
 	return M_TRUE;
 }
 
@@ -257,6 +662,13 @@ static void M_threadpool_queue_insert(M_threadpool_parent_t *parent, void (*task
 {
 	M_bool          i_just_woke_up = M_FALSE;
 	M_threadpool_t *pool           = parent->pool;
+	M_bool          timing         = (pool->flags & M_THREADPOOL_FLAG_TIMING) ? M_TRUE : M_FALSE;
+	M_bool          blocked        = M_FALSE;
+	M_uint64        now_us         = 0;
+	M_uint64        blocked_us     = 0;
+
+	if (timing)
+		now_us = M_threadpool_time_us();
 
 	M_thread_mutex_lock(pool->queue_lock);
 	while (1) {
@@ -266,14 +678,17 @@ static void M_threadpool_queue_insert(M_threadpool_parent_t *parent, void (*task
 			M_threadpool_thread_spawn(pool);
 
 		if (pool->queue_waiters == 0 || i_just_woke_up) {
-			if (pool->queue_max_size > M_llist_len(pool->queue)) {
-				M_threadpool_queue_t *q = M_malloc_zero(sizeof(*q));
-				q->parent   = parent;
-				q->task     = task;
+			if (pool->queue_max_size > pool->queue_len) {
+				M_threadpool_queue_t q;
+
+				q.parent    = parent;
+				q.task      = task;
+				q.task_arg  = NULL;
+				q.queued_us = now_us;
 				if (task_args != NULL)
-					q->task_arg = *task_args;
+					q.task_arg = *task_args;
 
-				M_llist_insert(pool->queue, q);
+				M_threadpool_queue_push(pool, &q);
 
 				/* Wake up a thread waiting for things to be queued */
 				M_thread_cond_signal(pool->queue_ocond);
@@ -284,6 +699,8 @@ static void M_threadpool_queue_insert(M_threadpool_parent_t *parent, void (*task
 
 				/* Allow us to keep looping while we have tasks to queue */
 				if (num_tasks == 0) {
+					if (blocked && timing)
+						M_threadpool_hist_add(&pool->dispatch_wait, M_threadpool_time_diff(blocked_us, now_us));
 					break;
 				} else {
 					i_just_woke_up = M_TRUE;
@@ -292,15 +709,153 @@ static void M_threadpool_queue_insert(M_threadpool_parent_t *parent, void (*task
 			}
 		}
 
+		if (!blocked) {
+			blocked = M_TRUE;
+			pool->dispatch_blocked++;
+			if (timing)
+				blocked_us = M_threadpool_time_us();
+		}
+
 		pool->queue_waiters++;
 		M_thread_cond_wait(pool->queue_icond, pool->queue_lock);
 		pool->queue_waiters--;
 		i_just_woke_up = M_TRUE;
+
+		/* Tasks queued from here on were queued now, not when we were called */
+		if (timing)
+			now_us = M_threadpool_time_us();
+	}
+	M_thread_mutex_unlock(pool->queue_lock);
+}
+
+
+
+/*! Insert a single task into the threadpool only if there is a free slot.
+ *  Unlike M_threadpool_queue_insert() this never blocks, which makes it safe
+ *  to call from within a task.
+ *  \param parent    initialized parent (user/consumer) of threadpool
+ *  \param task      Callback for task to perform
+ *  \param task_arg  Argument passed to task
+ *  \return M_TRUE if queued, M_FALSE if the queue is full */
+static M_bool M_threadpool_queue_try_insert(M_threadpool_parent_t *parent, void (*task)(void *), void *task_arg)
+{
+	M_threadpool_t       *pool = parent->pool;
+	M_threadpool_queue_t  q;
+
+	M_thread_mutex_lock(pool->queue_lock);
+
+	if (pool->num_idle_threads == 0 && pool->num_threads < pool->max_threads)
+		M_threadpool_thread_spawn(pool);
+
+	/* Don't jump ahead of anyone already waiting on a slot */
+	if (pool->queue_waiters != 0 || pool->queue_max_size <= pool->queue_len) {
+		M_thread_mutex_unlock(pool->queue_lock);
+		return M_FALSE;
 	}
+
+	q.parent    = parent;
+	q.task      = task;
+	q.task_arg  = task_arg;
+	q.queued_us = 0;
+	if (pool->flags & M_THREADPOOL_FLAG_TIMING)
+		q.queued_us = M_threadpool_time_us();
+	M_threadpool_queue_push(pool, &q);
+	M_thread_cond_signal(pool->queue_ocond);
+
 	M_thread_mutex_unlock(pool->queue_lock);
+	return M_TRUE;
+}
+
+
+static void M_threadpool_future_release(M_threadpool_future_t *future)
+{
+	if (M_atomic_dec_u32(&future->refcnt) != 1)
+		return;
+
+	M_thread_cond_destroy(future->cond);
+	M_thread_mutex_destroy(future->lock);
+	M_free(future);
+}
+
+
+static void M_threadpool_future_task(void *arg)
+{
+	M_threadpool_future_t *future = arg;
+	void                  *result;
+	void                 (*then_cb)(void *, void *) = NULL;
+	void                  *then_thunk               = NULL;
+
+	result = future->task(future->task_arg);
+
+	M_thread_mutex_lock(future->lock);
+	future->result = result;
+	M_atomic_store_u32_explicit(&future->done, 1, M_ATOMIC_ORDER_RELEASE);
+	if (future->then_set) {
+		then_cb    = future->then_cb;
+		then_thunk = future->then_thunk;
+	}
+	M_thread_cond_broadcast(future->cond);
+	M_thread_mutex_unlock(future->lock);
+
+	/* Continuation runs outside of the lock so it's free to do anything,
+	 * including destroying the future */
+	if (then_cb != NULL)
+		then_cb(result, then_thunk);
+
+	M_threadpool_future_release(future);
 }
 
 
+static void M_threadpool_pfor_run(M_threadpool_pfor_t *pfor, size_t start, size_t end);
+
+static void M_threadpool_pfor_task(void *arg)
+{
+	M_threadpool_pfor_range_t *range = arg;
+	M_threadpool_pfor_t       *pfor  = range->pfor;
+
+	M_threadpool_pfor_run(pfor, range->start, range->end);
+	M_free(range);
+
+	M_threadpool_counter_done(&pfor->outstanding, pfor->lock, pfor->cond, NULL);
+}
+
+
+/*! Split the range in half, handing the upper half to the pool, until it is no
+ *  larger than the grain then process what's left.  If the pool can't take any
+ *  more work the remainder is processed in this thread instead. */
+static void M_threadpool_pfor_run(M_threadpool_pfor_t *pfor, size_t start, size_t end)
+{
+	while (end - start > pfor->grain) {
+		M_threadpool_pfor_range_t *range;
+		size_t                     mid = start + (end - start) / 2;
+
+		range        = M_malloc_zero(sizeof(*range));
+		range->pfor  = pfor;
+		range->start = mid;
+		range->end   = end;
+
+		M_atomic_inc_u64(&pfor->outstanding);
+		M_atomic_inc_u64(&pfor->parent->tasks_remaining);
+
+		if (!M_threadpool_queue_try_insert(pfor->parent, M_threadpool_pfor_task, range)) {
+			M_threadpool_counter_done(&pfor->parent->tasks_remaining, pfor->parent->lock, pfor->parent->cond, &pfor->parent->is_waiting);
+			M_threadpool_counter_done(&pfor->outstanding, pfor->lock, pfor->cond, NULL);
+
+			M_free(range);
+			break;
+		}
+
+		end = mid;
+	}
+
+	/* Still honor the grain if we had to stop splitting early */
+	while (start < end) {
+		size_t len = M_MIN(end - start, pfor->grain);
+		pfor->func(start, start + len, pfor->thunk);
+		start += len;
+	}
+}
+
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -333,12 +888,19 @@ void M_threadpool_destroy(M_threadpool_t *pool)
 
 
 M_threadpool_t *M_threadpool_create(size_t min_threads, size_t max_threads, M_uint64 idle_time_ms, size_t queue_max_size)
+{
+	return M_threadpool_create_ex(min_threads, max_threads, idle_time_ms, queue_max_size, M_THREADPOOL_FLAG_NONE);
+}
+
+
+M_threadpool_t *M_threadpool_create_ex(size_t min_threads, size_t max_threads, M_uint64 idle_time_ms, size_t queue_max_size, M_uint32 flags)
 {
 	M_threadpool_t  *pool;
 	size_t           i;
 
 	pool = M_malloc_zero(sizeof(*pool));
 
+	pool->flags       = flags;
 	pool->min_threads = min_threads;
 	pool->max_threads = max_threads;
 	if (pool->max_threads < pool->min_threads)
@@ -387,7 +949,7 @@ M_bool M_threadpool_parent_destroy(M_threadpool_parent_t *parent)
 		return M_FALSE;
 
 	M_thread_mutex_lock(parent->lock);
-	if (parent->tasks_remaining) {
+	if (M_atomic_load_u64(&parent->tasks_remaining) != 0) {
 		M_thread_mutex_unlock(parent->lock);
 		return M_FALSE;
 	}
@@ -407,7 +969,7 @@ size_t M_threadpool_available_slots(const M_threadpool_t *pool)
 		return 0;
 
 	M_thread_mutex_lock(pool->queue_lock);
-	cnt = pool->queue_max_size - M_llist_len(pool->queue);
+	cnt = pool->queue_max_size - pool->queue_len;
 	M_thread_mutex_unlock(pool->queue_lock);
 	return cnt;
 }
@@ -427,6 +989,49 @@ size_t M_threadpool_num_threads(const M_threadpool_t *pool)
 }
 
 
+void M_threadpool_stats(const M_threadpool_t *pool, M_threadpool_stats_t *stats)
+{
+	M_threadpool_t              *p = M_CAST_OFF_CONST(M_threadpool_t *, pool);
+	M_threadpool_worker_stats_t  wstats;
+	size_t                       i;
+
+	if (stats == NULL)
+		return;
+
+	M_mem_set(stats, 0, sizeof(*stats));
+	if (pool == NULL)
+		return;
+
+	M_mem_set(&wstats, 0, sizeof(wstats));
+
+	M_thread_mutex_lock(p->queue_lock);
+
+	stats->num_threads       = p->num_threads;
+	stats->num_idle_threads  = p->num_idle_threads;
+	stats->queue_len         = p->queue_len;
+	stats->queue_max_size    = p->queue_max_size;
+	stats->peak_threads      = p->peak_threads;
+	stats->peak_queue_len    = p->peak_queue_len;
+	stats->tasks_dispatched  = p->tasks_dispatched;
+	stats->dispatch_blocked  = p->dispatch_blocked;
+	stats->threads_spawned   = p->threads_spawned;
+	stats->threads_idle_exit = p->threads_idle_exit;
+	M_threadpool_hist_merge(&stats->dispatch_wait, &p->dispatch_wait);
+
+	/* Threads can't exit while we hold the lock, but they keep running tasks
+	 * and updating their own statistics */
+	M_threadpool_worker_stats_merge(&wstats, &p->retired);
+	for (i=0; i<p->num_threads; i++)
+		M_threadpool_worker_stats_merge(&wstats, &p->workers[i]->stats);
+
+	M_thread_mutex_unlock(p->queue_lock);
+
+	stats->tasks_completed = wstats.tasks_completed;
+	M_mem_copy(&stats->queue_wait, &wstats.queue_wait, sizeof(stats->queue_wait));
+	M_mem_copy(&stats->run_time, &wstats.run_time, sizeof(stats->run_time));
+}
+
+
 void M_threadpool_wait_available_thread(M_threadpool_parent_t *parent)
 {
 	M_threadpool_t *pool;
@@ -464,9 +1069,7 @@ void M_threadpool_dispatch(M_threadpool_parent_t *parent, void (*task)(void *),
 	if (parent == NULL || task == NULL || num_tasks == 0)
 		return;
 
-	M_thread_mutex_lock(parent->lock);
-	parent->tasks_remaining += num_tasks;
-	M_thread_mutex_unlock(parent->lock);
+	M_atomic_add_u64(&parent->tasks_remaining, num_tasks);
 	M_threadpool_queue_insert(parent, task, task_args, num_tasks);
 }
 
@@ -478,7 +1081,7 @@ void M_threadpool_parent_wait(M_threadpool_parent_t *parent)
 
 	M_thread_mutex_lock(parent->lock);
 	while (1) {
-		if (parent->tasks_remaining == 0)
+		if (M_atomic_load_u64(&parent->tasks_remaining) == 0)
 			break;
 		parent->is_waiting = M_TRUE;
 		M_thread_cond_wait(parent->cond, parent->lock);
@@ -487,3 +1090,124 @@ void M_threadpool_parent_wait(M_threadpool_parent_t *parent)
 	M_thread_mutex_unlock(parent->lock);
 }
 
+
+
+M_threadpool_future_t *M_threadpool_dispatch_future(M_threadpool_parent_t *parent, void *(*task)(void *), void *task_arg)
+{
+	M_threadpool_future_t *future;
+	void                  *arg;
+
+	if (parent == NULL || task == NULL)
+		return NULL;
+
+	future           = M_malloc_zero(sizeof(*future));
+	future->lock     = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	future->cond     = M_thread_cond_create(M_THREAD_CONDATTR_NONE);
+	future->task     = task;
+	future->task_arg = task_arg;
+	future->refcnt   = 2; /* Caller + task */
+
+	arg = future;
+	M_threadpool_dispatch(parent, M_threadpool_future_task, &arg, 1);
+	return future;
+}
+
+
+M_bool M_threadpool_future_is_done(M_threadpool_future_t *future)
+{
+	if (future == NULL)
+		return M_FALSE;
+
+	return M_atomic_load_u32_explicit(&future->done, M_ATOMIC_ORDER_ACQUIRE) ? M_TRUE : M_FALSE;
+}
+
+
+void *M_threadpool_future_wait(M_threadpool_future_t *future)
+{
+	void *result;
+
+	if (future == NULL)
+		return NULL;
+
+	M_thread_mutex_lock(future->lock);
+	while (!M_atomic_load_u32_explicit(&future->done, M_ATOMIC_ORDER_RELAXED))
+		M_thread_cond_wait(future->cond, future->lock);
+	result = future->result;
+	M_thread_mutex_unlock(future->lock);
+	return result;
+}
+
+
+M_bool M_threadpool_future_then(M_threadpool_future_t *future, void (*callback)(void *result, void *thunk), void *thunk)
+{
+	M_bool done;
+	void  *result;
+
+	if (future == NULL || callback == NULL)
+		return M_FALSE;
+
+	M_thread_mutex_lock(future->lock);
+	if (future->then_set) {
+		M_thread_mutex_unlock(future->lock);
+		return M_FALSE;
+	}
+	future->then_set   = M_TRUE;
+	future->then_cb    = callback;
+	future->then_thunk = thunk;
+	done               = future->done ? M_TRUE : M_FALSE;
+	result             = future->result;
+	M_thread_mutex_unlock(future->lock);
+
+	/* Task already finished, it won't be calling the continuation */
+	if (done)
+		callback(result, thunk);
+
+	return M_TRUE;
+}
+
+
+void M_threadpool_future_destroy(M_threadpool_future_t *future)
+{
+	if (future == NULL)
+		return;
+	M_threadpool_future_release(future);
+}
+
+
+M_bool M_threadpool_parallel_for(M_threadpool_parent_t *parent, size_t start, size_t end, size_t grain, void (*func)(size_t start, size_t end, void *thunk), void *thunk)
+{
+	M_threadpool_pfor_t pfor;
+
+	if (parent == NULL || func == NULL || start > end)
+		return M_FALSE;
+
+	if (start == end)
+		return M_TRUE;
+
+	if (grain == 0) {
+		/* Aim for a few pieces per thread so uneven pieces even out */
+		grain = (end - start) / (M_MAX(parent->pool->max_threads, 1) * 4);
+		if (grain == 0)
+			grain = 1;
+	}
+
+	M_mem_set(&pfor, 0, sizeof(pfor));
+	pfor.parent = parent;
+	pfor.func   = func;
+	pfor.thunk  = thunk;
+	pfor.grain  = grain;
+	pfor.lock   = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+	pfor.cond   = M_thread_cond_create(M_THREAD_CONDATTR_NONE);
+
+	/* We do our share of the work rather than sitting idle */
+	M_threadpool_pfor_run(&pfor, start, end);
+
+	M_thread_mutex_lock(pfor.lock);
+	while (M_atomic_load_u64(&pfor.outstanding) != 0)
+		M_thread_cond_wait(pfor.cond, pfor.lock);
+	M_thread_mutex_unlock(pfor.lock);
+
+	M_thread_cond_destroy(pfor.cond);
+	M_thread_mutex_destroy(pfor.lock);
+	return M_TRUE;
+}
@@ -39,6 +39,15 @@
 #include "m_tls_serverctx_int.h"
 #include "m_tls_hostvalidate.h"
 
+/* M_TLS_USE_KTLS is decided in m_tls_ctx_common.h */
+#ifdef M_TLS_USE_KTLS
+#  include <linux/tls.h>
+/* OpenSSL-internal BIO controls used to hand kTLS state to a BIO, they're not in the public headers */
+#  define M_TLS_BIO_CTRL_SET_KTLS                72
+#  define M_TLS_BIO_CTRL_SET_KTLS_TX_CTRL_MSG    74
+#  define M_TLS_BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG  75
+#endif
+
 typedef enum {
 	M_TLS_STATE_INIT         = 0,
 	M_TLS_STATE_CONNECTING   = 1,
@@ -59,6 +68,7 @@ struct M_io_handle {
 	M_tls_clientctx_t *clientctx;
 	M_tls_serverctx_t *serverctx;
 	char              *hostname;
+	char              *session_key;      /*!< host:port used to cache client sessions */
 	SSL               *ssl;
 	BIO               *bio_glue;
 	M_tls_state_t      state;
@@ -68,6 +78,22 @@ struct M_io_handle {
 	M_io_error_t       last_io_err;
 	M_timeval_t        negotiation_start;
 	M_uint64           negotiation_time;
+	M_bool             ktls_tx;          /*!< Kernel is performing record protection for outbound data */
+	int                ktls_record_type; /*!< Record type for next write if not application data, 0 if none */
+	M_io_layer_t      *layer;            /*!< Layer this handle is attached to */
+
+	/* Server handshake offload, only used if the server ctx has a handshake pool */
+	M_threadpool_parent_t *hs_parent;    /*!< Pool handshake steps are dispatched to, NULL if disabled */
+	M_tls_serverctx_t *hs_ctx;           /*!< Server ctx owning hs_parent, referenced while a step is in flight */
+	M_thread_mutex_t  *hs_lock;          /*!< Protects hs_inflight/hs_orphaned between the pool and event threads */
+	M_event_t         *hs_event;         /*!< Event loop completions are delivered to */
+	M_buf_t           *hs_in;            /*!< Data read from the peer not yet consumed by OpenSSL */
+	M_buf_t           *hs_out;           /*!< Data produced by OpenSSL not yet written to the peer */
+	M_bool             hs_active;        /*!< OpenSSL is reading/writing via hs_in/hs_out rather than the lower layer */
+	M_bool             hs_inflight;      /*!< A handshake step is running in the pool or waiting on delivery */
+	M_bool             hs_orphaned;      /*!< Layer destroyed while in flight, completion frees the handle */
+	int                hs_rv;            /*!< Result of SSL_accept() from the last step */
+	int                hs_err;           /*!< SSL_get_error() from the last step */
 	char               error[256];
 };
 
@@ -76,6 +102,7 @@ static M_tls_init_t       M_tls_initialized       = 0;
 static BIO_METHOD        *M_tls_bio_method        = NULL;
 
 static void M_tls_bio_method_new(void);
+static M_io_error_t M_io_tls_handshake_flush(M_io_handle_t *handle);
 
 static M_uint64 M_tls_get_negotiation_timeout_ms(M_io_handle_t *handle)
 {
@@ -84,6 +111,17 @@ static M_uint64 M_tls_get_negotiation_timeout_ms(M_io_handle_t *handle)
 	return handle->serverctx->negotiation_timeout_ms;
 }
 
+static void M_tls_ktls_set_options(SSL *ssl, M_bool enable)
+{
+#ifdef M_TLS_USE_KTLS
+	if (enable)
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#else
+	(void)ssl;
+	(void)enable;
+#endif
+}
+
 #if OPENSSL_VERSION_NUMBER < 0x1010000fL || defined(LIBRESSL_VERSION_NUMBER)
 static M_thread_mutex_t **M_tls_openssl_locks     = NULL;
 static size_t             M_tls_openssl_locks_num = 0;
@@ -415,11 +453,205 @@ cert_err:
 }
 
 
+static void M_io_tls_handle_free(M_io_handle_t *handle)
+{
+	if (handle->ssl != NULL)
+		SSL_free(handle->ssl);
+	/* SSL_free() auto-frees the bio BIO_free(handle->bio_glue); */
+
+	M_thread_mutex_destroy(handle->hs_lock);
+	M_buf_cancel(handle->hs_in);
+	M_buf_cancel(handle->hs_out);
+	M_free(handle->hostname);
+	M_free(handle->session_key);
+	M_free(handle);
+}
+
+
+/* SSL_accept() succeeded, used by both the inline and the offloaded handshake.  The
+ * connected event is relayed by rewriting type if given, otherwise it is queued as a
+ * soft event since the offloaded handshake completes outside of event processing. */
+static void M_io_tls_accept_connected(M_io_layer_t *layer, M_event_type_t *type)
+{
+	M_io_handle_t *handle = M_io_layer_get_handle(layer);
+
+	handle->state = M_TLS_STATE_CONNECTED;
+/* XXX: Verify peer */
+	M_event_timer_remove(handle->timer);
+	handle->timer            = NULL;
+	handle->negotiation_time = M_time_elapsed(&handle->negotiation_start);
+
+	if (type != NULL) {
+		*type = M_EVENT_TYPE_CONNECTED;
+	} else {
+		M_io_layer_softevent_add(layer, M_TRUE, M_EVENT_TYPE_CONNECTED);
+	}
+}
+
+
+static void M_io_tls_handshake_complete_cb(M_event_t *event, M_event_type_t type, M_io_t *io_dummy, void *cb_data);
+
+static void M_io_tls_handshake_task(void *arg)
+{
+	M_io_handle_t *handle = arg;
+
+	/* Error queue is per-thread, so the error has to be recorded here */
+	ERR_clear_error();
+	handle->hs_rv  = SSL_accept(handle->ssl);
+	handle->hs_err = SSL_ERROR_NONE;
+	if (handle->hs_rv != 1) {
+		handle->hs_err = SSL_get_error(handle->ssl, handle->hs_rv);
+		if (handle->hs_err != SSL_ERROR_WANT_READ && handle->hs_err != SSL_ERROR_WANT_WRITE) {
+			M_io_tls_error_string(handle->hs_err, handle->error, sizeof(handle->error));
+		}
+	}
+
+	/* Always hand back to the event loop, even if the layer was destroyed in the meantime, as
+	 * releasing the server ctx from here could end up waiting on ourselves */
+	M_event_queue_task(handle->hs_event, M_io_tls_handshake_complete_cb, handle);
+}
+
+
+/* Collect what the peer has sent and hand the next handshake step to the pool.  Returns
+ * M_TRUE if the event was consumed, or M_FALSE if it was rewritten to an error. */
+static M_bool M_io_tls_handshake_step(M_io_layer_t *layer, M_event_type_t *type)
+{
+	M_io_handle_t *handle = M_io_layer_get_handle(layer);
+	M_io_t        *io     = M_io_layer_get_io(layer);
+	unsigned char  buf[4096];
+	size_t         len;
+	M_io_error_t   err;
+	void          *arg;
+
+	/* The peer has to see our last flight before it will send anything more */
+	err = M_io_tls_handshake_flush(handle);
+	if (err == M_IO_ERROR_WOULDBLOCK)
+		return M_TRUE;
+
+	while (err == M_IO_ERROR_SUCCESS) {
+		len = sizeof(buf);
+		err = M_io_layer_read(io, M_io_layer_get_index(layer)-1, buf, &len, NULL);
+		if (err == M_IO_ERROR_SUCCESS)
+			M_buf_add_bytes(handle->hs_in, buf, len);
+	}
+
+	if (err != M_IO_ERROR_WOULDBLOCK) {
+		handle->last_io_err      = err;
+		handle->negotiation_time = M_time_elapsed(&handle->negotiation_start);
+		if (err == M_IO_ERROR_DISCONNECT) {
+			handle->state = M_TLS_STATE_DISCONNECTED;
+			*type         = M_EVENT_TYPE_DISCONNECTED;
+		} else {
+			handle->state = M_TLS_STATE_ERROR;
+			*type         = M_EVENT_TYPE_ERROR;
+			M_snprintf(handle->error, sizeof(handle->error), "TLS server negotiation failed: %s", M_io_error_string(err));
+		}
+		return M_FALSE;
+	}
+
+	/* Nothing new, OpenSSL would just ask for more */
+	if (M_buf_len(handle->hs_in) == 0)
+		return M_TRUE;
+
+	/* The step keeps the ctx, and therefore the pool, alive even if the layer is destroyed */
+	M_tls_serverctx_upref(handle->hs_ctx);
+	handle->hs_event    = M_io_get_event(io);
+	handle->hs_active   = M_TRUE;
+	handle->hs_inflight = M_TRUE;
+	arg                 = handle;
+	M_threadpool_dispatch(handle->hs_parent, M_io_tls_handshake_task, &arg, 1);
+	return M_TRUE;
+}
+
+
+static void M_io_tls_handshake_complete_cb(M_event_t *event, M_event_type_t type, M_io_t *io_dummy, void *cb_data)
+{
+	M_io_handle_t     *handle = cb_data;
+	M_tls_serverctx_t *ctx    = handle->hs_ctx;
+	M_io_layer_t      *layer;
+	M_event_type_t     etype  = M_EVENT_TYPE_READ;
+	M_bool             orphaned;
+	(void)event;
+	(void)type;
+	(void)io_dummy;
+
+	M_thread_mutex_lock(handle->hs_lock);
+	handle->hs_inflight = M_FALSE;
+	orphaned            = handle->hs_orphaned;
+	M_thread_mutex_unlock(handle->hs_lock);
+
+	if (orphaned) {
+		M_io_tls_handle_free(handle);
+		M_tls_serverctx_destroy(ctx);
+		return;
+	}
+
+	layer = M_io_layer_acquire(M_io_layer_get_io(handle->layer), M_io_layer_get_index(handle->layer), "TLS");
+	handle->hs_active = M_FALSE;
+
+	/* Timed out or otherwise failed while the step was running */
+	if (layer == NULL || handle->state != M_TLS_STATE_ACCEPTING)
+		goto done;
+
+	if (handle->hs_rv == 1) {
+		/* Anything left over in hs_out is flushed before the next write, or on the next write event */
+		M_io_tls_handshake_flush(handle);
+		M_io_tls_accept_connected(layer, NULL);
+
+		/* Peer may have already sent application data */
+		if (M_buf_len(handle->hs_in) != 0)
+			M_io_layer_softevent_add(layer, M_TRUE, M_EVENT_TYPE_READ);
+	} else if (handle->hs_err == SSL_ERROR_WANT_READ || handle->hs_err == SSL_ERROR_WANT_WRITE) {
+		if (!M_io_tls_handshake_step(layer, &etype))
+			M_io_layer_softevent_add(layer, M_TRUE, etype);
+	} else {
+		/* Still try to send any alert OpenSSL generated */
+		M_io_tls_handshake_flush(handle);
+		handle->state            = M_TLS_STATE_ERROR;
+		handle->negotiation_time = M_time_elapsed(&handle->negotiation_start);
+		M_io_layer_softevent_add(layer, M_TRUE, M_EVENT_TYPE_ERROR);
+	}
+
+done:
+	M_io_layer_release(layer);
+	M_tls_serverctx_destroy(ctx);
+}
+
+
+static M_bool M_io_tls_process_state_accepting_offload(M_io_layer_t *layer, M_event_type_t *type)
+{
+	M_io_handle_t *handle   = M_io_layer_get_handle(layer);
+
+	switch (*type) {
+		case M_EVENT_TYPE_CONNECTED:
+		case M_EVENT_TYPE_READ:
+		case M_EVENT_TYPE_WRITE:
+			/* Step in progress, we'll look at the connection again when it completes */
+			if (handle->hs_inflight)
+				return M_TRUE;
+			return M_io_tls_handshake_step(layer, type);
+		case M_EVENT_TYPE_DISCONNECTED:
+		case M_EVENT_TYPE_ERROR:
+			handle->state            = M_TLS_STATE_DISCONNECTED; /* An error from a different layer isn't really an error for us */
+			handle->negotiation_time = M_time_elapsed(&handle->negotiation_start);
+			return M_FALSE;
+		default:
+			break;
+	}
+
+	return M_TRUE; /* eat anything unknown */
+}
+
+
 static M_bool M_io_tls_process_state_accepting(M_io_layer_t *layer, M_event_type_t *type)
 {
 	M_io_handle_t *handle   = M_io_layer_get_handle(layer);
 	int            rv;
 	int            err;
+
+	if (handle->hs_parent != NULL)
+		return M_io_tls_process_state_accepting_offload(layer, type);
+
 //M_printf("SSL_accept(%p) enter\n", M_io_layer_get_io(layer));
 	switch (*type) {
 		case M_EVENT_TYPE_CONNECTED:
@@ -429,13 +661,7 @@ static M_bool M_io_tls_process_state_accepting(M_io_layer_t *layer, M_event_type
 			rv = SSL_accept(handle->ssl);
 			if (rv == 1) {
 //M_printf("SSL_accept(%p) successful\n", M_io_layer_get_io(layer));
-				handle->state = M_TLS_STATE_CONNECTED;
-				*type         = M_EVENT_TYPE_CONNECTED;
-/* XXX: Verify peer */
-				M_event_timer_remove(handle->timer);
-				handle->timer            = NULL;
-				handle->negotiation_time = M_time_elapsed(&handle->negotiation_start);
-
+				M_io_tls_accept_connected(layer, type);
 				return M_FALSE; /* Not consumed, relay rewritten connect message */
 			}
 			err = SSL_get_error(handle->ssl, rv);
@@ -488,6 +714,8 @@ static M_bool M_io_tls_process_state_connected(M_io_layer_t *layer, M_event_type
 			}
 			return M_FALSE;
 		case M_EVENT_TYPE_WRITE:
+			/* Finish sending the last flight of an offloaded handshake */
+			M_io_tls_handshake_flush(handle);
 			if (handle->state_flags & M_TLS_STATEFLAG_READ_WANT_WRITE) {
 				/* Prefer rewriting this event to a "read" which will get processed
 				 * immediately as a higher priority, but still trigger a "write" event
@@ -618,21 +846,38 @@ static int M_tls_bio_destroy(BIO *b)
 static int M_tls_bio_read(BIO *b, char *buf, int len)
 {
 #if OPENSSL_VERSION_NUMBER >= 0x1010000fL && !defined(LIBRESSL_VERSION_NUMBER)
-	M_io_layer_t  *layer  = BIO_get_data(b);
+	M_io_handle_t *handle = BIO_get_data(b);
 #else
-	M_io_layer_t  *layer  = b->ptr;
+	M_io_handle_t *handle = b->ptr;
 #endif
-	M_io_handle_t *handle = M_io_layer_get_handle(layer);
+	M_io_layer_t  *layer;
 	M_io_error_t   err;
 	size_t         read_len;
 
-	if (buf == NULL || len <= 0 || layer == NULL)
+	if (buf == NULL || len <= 0 || handle == NULL)
 		return 0;
 
+	BIO_clear_retry_flags(b);
+
+	/* Data collected for an offloaded handshake step is always consumed first, OpenSSL
+	 * may not have needed all of it before the handshake completed */
+	if (handle->hs_in != NULL && M_buf_len(handle->hs_in) != 0) {
+		read_len = M_MIN((size_t)len, M_buf_len(handle->hs_in));
+		M_mem_copy(buf, M_buf_peek(handle->hs_in), read_len);
+		M_buf_drop(handle->hs_in, read_len);
+		return (int)read_len;
+	}
+
+	/* Running in the pool, the event loop will collect more data and run another step */
+	if (handle->hs_active) {
+		BIO_set_retry_read(b);
+		return -1;
+	}
+
+	layer    = handle->layer;
 	read_len = (size_t)len;
 	err      = M_io_layer_read(M_io_layer_get_io(layer), M_io_layer_get_index(layer)-1, (unsigned char *)buf, &read_len, NULL);
 	handle->last_io_err = err;
-	BIO_clear_retry_flags(b);
 
 	if (err != M_IO_ERROR_SUCCESS) {
 		if (err == M_IO_ERROR_WOULDBLOCK) {
@@ -649,24 +894,66 @@ static int M_tls_bio_read(BIO *b, char *buf, int len)
 }
 
 
+/* Write out anything an offloaded handshake step produced.  Must be called from the event thread. */
+static M_io_error_t M_io_tls_handshake_flush(M_io_handle_t *handle)
+{
+	M_io_layer_t *layer = handle->layer;
+	M_io_error_t  err   = M_IO_ERROR_SUCCESS;
+	size_t        len;
+
+	while (handle->hs_out != NULL && M_buf_len(handle->hs_out) != 0) {
+		len = M_buf_len(handle->hs_out);
+		err = M_io_layer_write(M_io_layer_get_io(layer), M_io_layer_get_index(layer)-1, (const unsigned char *)M_buf_peek(handle->hs_out), &len, NULL);
+		handle->last_io_err = err;
+		if (err != M_IO_ERROR_SUCCESS)
+			break;
+		M_buf_drop(handle->hs_out, len);
+	}
+
+	return err;
+}
+
+
 static int M_tls_bio_write(BIO *b, const char *buf, int len)
 {
 #if OPENSSL_VERSION_NUMBER >= 0x1010000fL && !defined(LIBRESSL_VERSION_NUMBER)
-	M_io_layer_t  *layer = BIO_get_data(b);
+	M_io_handle_t *handle = BIO_get_data(b);
 #else
-	M_io_layer_t  *layer = b->ptr;
+	M_io_handle_t *handle = b->ptr;
 #endif
+	M_io_layer_t  *layer;
 	M_io_error_t   err;
-	M_io_handle_t *handle = M_io_layer_get_handle(layer);
 	size_t         write_len;
 
-	if (buf == NULL || len <= 0 || layer == NULL)
+	if (buf == NULL || len <= 0 || handle == NULL)
 		return 0;
 
+	BIO_clear_retry_flags(b);
+
+	/* Running in the pool, the event loop writes this out once the step completes */
+	if (handle->hs_active) {
+		M_buf_add_bytes(handle->hs_out, buf, (size_t)len);
+		return len;
+	}
+
+	layer     = handle->layer;
 	write_len = (size_t)len;
-	err       = M_io_layer_write(M_io_layer_get_io(layer), M_io_layer_get_index(layer)-1, (const unsigned char *)buf, &write_len, NULL);
+
+	/* Handshake output must reach the peer before anything written after it */
+	err = M_io_tls_handshake_flush(handle);
+
+	if (err != M_IO_ERROR_SUCCESS) {
+		/* Nothing to do, error handled below */
+	} else if (handle->ktls_record_type != 0) {
+		/* kTLS is framing our records, anything other than application data has to tell
+		 * the kernel the record type, so bypasses the normal write path. */
+		err = M_io_net_ktls_write_record(M_io_layer_get_io(layer), (M_uint8)handle->ktls_record_type, (const unsigned char *)buf, &write_len);
+		if (err == M_IO_ERROR_SUCCESS && write_len == (size_t)len)
+			handle->ktls_record_type = 0;
+	} else {
+		err = M_io_layer_write(M_io_layer_get_io(layer), M_io_layer_get_index(layer)-1, (const unsigned char *)buf, &write_len, NULL);
+	}
 	handle->last_io_err = err;
-	BIO_clear_retry_flags(b);
 
 	if (err != M_IO_ERROR_SUCCESS) {
 		if (err == M_IO_ERROR_WOULDBLOCK) {
@@ -683,15 +970,103 @@ static int M_tls_bio_write(BIO *b, const char *buf, int len)
 }
 
 
+#ifdef M_TLS_USE_KTLS
+static size_t M_tls_ktls_crypto_info_len(const void *crypto_info)
+{
+	const struct tls_crypto_info *info = crypto_info;
+
+	/* OpenSSL hands us a union sized for every cipher it knows about, figure out
+	 * how much of it the kernel actually wants from the header. */
+	switch (info->cipher_type) {
+		case TLS_CIPHER_AES_GCM_128:
+			return sizeof(struct tls12_crypto_info_aes_gcm_128);
+#  ifdef TLS_CIPHER_AES_GCM_256
+		case TLS_CIPHER_AES_GCM_256:
+			return sizeof(struct tls12_crypto_info_aes_gcm_256);
+#  endif
+#  ifdef TLS_CIPHER_AES_CCM_128
+		case TLS_CIPHER_AES_CCM_128:
+			return sizeof(struct tls12_crypto_info_aes_ccm_128);
+#  endif
+#  ifdef TLS_CIPHER_CHACHA20_POLY1305
+		case TLS_CIPHER_CHACHA20_POLY1305:
+			return sizeof(struct tls12_crypto_info_chacha20_poly1305);
+#  endif
+		default:
+			break;
+	}
+	return 0;
+}
+
+
+static M_bool M_tls_bio_ktls_start(M_io_handle_t *handle, M_bool is_tx, const void *crypto_info)
+{
+	M_io_layer_t  *layer  = handle->layer;
+	M_io_t        *io     = M_io_layer_get_io(layer);
+	size_t         len;
+
+	/* Receive offload would require reading with recvmsg() to retrieve record types, which
+	 * bypasses the layers below us, so we only offload transmit. */
+	if (!is_tx || crypto_info == NULL)
+		return M_FALSE;
+
+	/* An offloaded handshake step runs on a pool thread and must not touch the io
+	 * layers, and its output is still buffered in hs_out in plaintext record form.
+	 * Sending that through the kernel would encrypt it a second time, so stay in
+	 * userspace for the rest of this connection. */
+	if (handle->hs_active || (handle->hs_out != NULL && M_buf_len(handle->hs_out) != 0))
+		return M_FALSE;
+
+	/* Records must go straight to the socket, nothing can sit between us and the network layer */
+	if (M_io_layer_get_index(layer) != 1 || !M_str_eq(M_io_layer_name(io, 0), "NET"))
+		return M_FALSE;
+
+	len = M_tls_ktls_crypto_info_len(crypto_info);
+	if (len == 0)
+		return M_FALSE;
+
+	if (!M_io_net_ktls_start(io, M_TRUE, crypto_info, len))
+		return M_FALSE;
+
+	handle->ktls_tx = M_TRUE;
+	return M_TRUE;
+}
+#endif
+
+
 static long M_tls_bio_ctrl(BIO *b, int cmd, long num, void *ptr)
 {
+#ifdef M_TLS_USE_KTLS
+	M_io_handle_t *handle = BIO_get_data(b);
+#else
 	(void)b;
+#endif
 	(void)num;
 	(void)ptr;
 	switch (cmd) {
 		case BIO_CTRL_FLUSH:
 			/* Required internally by OpenSSL, no-op though */
 			return 1;
+#ifdef M_TLS_USE_KTLS
+		case M_TLS_BIO_CTRL_SET_KTLS:
+			if (handle == NULL)
+				return 0;
+			return M_tls_bio_ktls_start(handle, num?M_TRUE:M_FALSE, ptr)?1:0;
+		case BIO_CTRL_GET_KTLS_SEND:
+			return (handle != NULL && handle->ktls_tx)?1:0;
+		case BIO_CTRL_GET_KTLS_RECV:
+			return 0;
+		case M_TLS_BIO_CTRL_SET_KTLS_TX_CTRL_MSG:
+			if (handle == NULL)
+				return 0;
+			handle->ktls_record_type = (int)num;
+			return 1;
+		case M_TLS_BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+			if (handle == NULL)
+				return 0;
+			handle->ktls_record_type = 0;
+			return 1;
+#endif
 	}
 	return 0;
 }
@@ -729,18 +1104,18 @@ static void M_tls_bio_method_new(void)
 }
 
 
-static BIO *M_tls_bio_new(M_io_layer_t *layer)
+static BIO *M_tls_bio_new(M_io_handle_t *handle)
 {
 	BIO *bio;
 
-	if (layer == NULL)
+	if (handle == NULL)
 		return NULL;
 
 	bio      = BIO_new(M_tls_bio_method);
 #if OPENSSL_VERSION_NUMBER >= 0x1010000fL && !defined(LIBRESSL_VERSION_NUMBER)
-	BIO_set_data(bio, layer);
+	BIO_set_data(bio, handle);
 #else
-	bio->ptr = layer;
+	bio->ptr = handle;
 #endif
 
 	return bio;
@@ -927,7 +1302,6 @@ static M_bool M_io_tls_disconnect_cb(M_io_layer_t *layer)
 static void M_io_tls_destroy_cb(M_io_layer_t *layer)
 {
 	M_io_handle_t *handle = M_io_layer_get_handle(layer);
-	M_io_t        *io     = M_io_layer_get_io(layer);
 
 	if (handle == NULL)
 		return;
@@ -938,29 +1312,13 @@ static void M_io_tls_destroy_cb(M_io_layer_t *layer)
 		SSL_set_shutdown(handle->ssl, SSL_SENT_SHUTDOWN|SSL_RECEIVED_SHUTDOWN);
 	}
 
-	/* If client connection, we have additional work to do to save the session */
-	if (handle->is_client && handle->clientctx->sessions_enabled) {
-		if (!M_str_isempty(handle->hostname)) {
-			char        *hostport = NULL;
-			SSL_SESSION *session;
-
-			M_asprintf(&hostport, "%s:%u", handle->hostname, (unsigned int)M_io_net_get_port(io));
-	
-			session = SSL_get1_session(handle->ssl);
-			if (session != NULL) {
-				M_thread_mutex_lock(handle->clientctx->lock);
-				M_hash_strvp_insert(handle->clientctx->sessions, hostport, session);
-				M_thread_mutex_unlock(handle->clientctx->lock);
-			}
-			M_free(hostport);
-		}
+	/* New sessions are cached as OpenSSL receives them.  A resumed TLS 1.2 session can be
+	 * resumed again, but TLS 1.3 tickets are single use, so only the former goes back. */
+	if (handle->is_client && handle->clientctx->sessions_enabled && handle->ssl != NULL &&
+		SSL_session_reused(handle->ssl) && SSL_version(handle->ssl) <= TLS1_2_VERSION) {
+		M_tls_sessioncache_insert(handle->clientctx->sessions, handle->session_key, SSL_get1_session(handle->ssl));
 	}
 
-	if (handle->ssl != NULL) {
-		SSL_free(handle->ssl);
-	}
-
-	handle->ssl = NULL;
 	if (handle->is_client) {
 		M_tls_clientctx_destroy(handle->clientctx);
 		handle->clientctx = NULL;
@@ -969,15 +1327,24 @@ static void M_io_tls_destroy_cb(M_io_layer_t *layer)
 		handle->serverctx = NULL;
 	}
 
-	M_free(handle->hostname);
-	handle->hostname = NULL;
-
-	/* SSL_free() auto-frees the bio BIO_free(handle->bio_glue); */
-	handle->bio_glue = NULL;
 	M_event_timer_remove(handle->timer);
 	handle->timer = NULL;
 
-	M_free(handle);
+	/* A handshake step still owns the SSL object, its completion frees the handle */
+	if (handle->hs_lock != NULL) {
+		M_bool inflight;
+
+		M_thread_mutex_lock(handle->hs_lock);
+		inflight = handle->hs_inflight;
+		if (inflight)
+			handle->hs_orphaned = M_TRUE;
+		M_thread_mutex_unlock(handle->hs_lock);
+
+		if (inflight)
+			return;
+	}
+
+	M_io_tls_handle_free(handle);
 }
 
 
@@ -1045,22 +1412,21 @@ M_io_error_t M_io_tls_client_add(M_io_t *io, M_tls_clientctx_t *ctx, const char
 
 	handle->hostname    = M_strdup(hostname);
 	handle->ssl         = SSL_new(handle->clientctx->ctx);
+	M_tls_ktls_set_options(handle->ssl, ctx->ktls_enabled);
 
 	/* Attempt to look up session object to use */
 	if (!M_str_isempty(hostname) && ctx->sessions_enabled) {
-		char *hostport = NULL;
-		M_asprintf(&hostport, "%s:%u", handle->hostname, (unsigned int)M_io_net_get_port(io));
+		M_asprintf(&handle->session_key, "%s:%u", handle->hostname, (unsigned int)M_io_net_get_port(io));
+
+		/* Tells the new session callback where to cache sessions from this connection */
+		SSL_set_app_data(handle->ssl, handle->session_key);
 
-		/* Attempt to resume session */
-		M_thread_mutex_lock(ctx->lock);
-		session = M_hash_strvp_multi_get_direct(ctx->sessions, hostport, 0);
+		/* Attempt to resume session, this removes it from the cache */
+		session = M_tls_sessioncache_take(ctx->sessions, handle->session_key);
 		if (session) {
 			SSL_set_session(handle->ssl, session);
-			/* This will also reduce the reference count on thet session */
-			M_hash_strvp_multi_remove(ctx->sessions, hostport, 0, M_TRUE);
+			SSL_SESSION_free(session);
 		}
-		M_thread_mutex_unlock(ctx->lock);
-		M_free(hostport);
 	}
 
 	if (!M_str_isempty(handle->hostname)) {
@@ -1084,8 +1450,9 @@ M_io_error_t M_io_tls_client_add(M_io_t *io, M_tls_clientctx_t *ctx, const char
 	if (layer_id != NULL)
 		*layer_id = M_io_layer_get_index(layer);
 
-	/* Set the layer as the 'thunk' data for the custom bio */
-	handle->bio_glue = M_tls_bio_new(layer);
+	/* Set the handle as the 'thunk' data for the custom bio */
+	handle->layer    = layer;
+	handle->bio_glue = M_tls_bio_new(handle);
 	SSL_set_bio(handle->ssl, handle->bio_glue, handle->bio_glue);
 
 	return M_IO_ERROR_SUCCESS;
@@ -1113,15 +1480,27 @@ static M_io_error_t M_io_tls_accept_cb(M_io_t *io, M_io_layer_t *orig_layer)
 
 	/* Initialize SSL handle */
 	handle->ssl         = SSL_new(handle->serverctx->ctx);
+	M_tls_ktls_set_options(handle->ssl, handle->serverctx->ktls_enabled);
 
 	/* If DHE negotiation is enabled, set it up now */
 	if (handle->serverctx->dh) 
 		SSL_set_tmp_dh(handle->ssl, handle->serverctx->dh);
 
-	/* Set the layer as the 'thunk' data for the custom bio */
-	handle->bio_glue    = M_tls_bio_new(layer);
+	/* Set the handle as the 'thunk' data for the custom bio */
+	handle->bio_glue    = M_tls_bio_new(handle);
 	SSL_set_bio(handle->ssl, handle->bio_glue, handle->bio_glue);
 
+	/* Handshakes are run in a thread pool, I/O is buffered for OpenSSL while a step is running */
+	M_thread_mutex_lock(handle->serverctx->lock);
+	handle->hs_parent   = handle->serverctx->hs_parent;
+	M_thread_mutex_unlock(handle->serverctx->lock);
+	if (handle->hs_parent != NULL) {
+		handle->hs_ctx  = handle->serverctx;
+		handle->hs_lock = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+		handle->hs_in   = M_buf_create();
+		handle->hs_out  = M_buf_create();
+	}
+
 	M_io_layer_release(layer);
 	return M_IO_ERROR_SUCCESS;
 }
@@ -1158,6 +1537,7 @@ M_io_error_t M_io_tls_server_add(M_io_t *io, M_tls_serverctx_t *ctx, size_t *lay
 	layer = M_io_layer_add(io, "TLS", handle, callbacks);
 	M_io_callbacks_destroy(callbacks);
 
+	handle->layer = layer;
 	if (layer_id != NULL)
 		*layer_id = M_io_layer_get_index(layer);
 
@@ -1357,6 +1737,22 @@ char *M_tls_get_application(M_io_t *io, size_t id)
 #endif
 }
 
+M_bool M_tls_get_ktls_offload(M_io_t *io, size_t id)
+{
+	M_io_layer_t  *layer  = M_io_layer_acquire(io, id, "TLS");
+	M_io_handle_t *handle = M_io_layer_get_handle(layer);
+	M_bool         ret;
+
+	if (layer == NULL)
+		return M_FALSE;
+
+	ret = handle->ktls_tx;
+
+	M_io_layer_release(layer);
+
+	return ret;
+}
+
 M_uint64 M_tls_get_negotiation_time_ms(M_io_t *io, size_t id)
 {
 	M_io_layer_t        *layer  = M_io_layer_acquire(io, id, "TLS");
@@ -34,11 +34,18 @@
 #include "m_tls_clientctx_int.h"
 
 
-/*! Used when destroying the hashtable */
-static void M_tls_clientctx_session_destroy(void *session)
+/*! Called by OpenSSL for every new session, including each TLS 1.3 ticket as it arrives */
+static int M_tls_clientctx_session_new_cb(SSL *ssl, SSL_SESSION *session)
 {
-	if (session != NULL)
-		SSL_SESSION_free(session);
+	M_tls_clientctx_t *ctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	const char        *key = SSL_get_app_data(ssl);
+
+	if (ctx == NULL || M_str_isempty(key) || !ctx->sessions_enabled)
+		return 0;
+
+	/* Cache takes our reference */
+	M_tls_sessioncache_insert(ctx->sessions, key, session);
+	return 1;
 }
 
 
@@ -56,10 +63,14 @@ M_tls_clientctx_t *M_tls_clientctx_create(void)
 	}
 	ctx->lock                   = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
 
-	/* Session support */
-	ctx->sessions               = M_hash_strvp_create(16, 75, M_HASH_STRVP_MULTI_VALUE, M_tls_clientctx_session_destroy);
+	/* Session support, we keep our own cache so OpenSSL's internal one isn't used */
+	ctx->sessions               = M_tls_sessioncache_create();
+	SSL_CTX_set_app_data(ctx->ctx, ctx);
+	SSL_CTX_set_session_cache_mode(ctx->ctx, SSL_SESS_CACHE_CLIENT|SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx->ctx, M_tls_clientctx_session_new_cb);
 
 	ctx->verify_level           = M_TLS_VERIFY_FULL;
+	ctx->sessions_enabled       = M_TRUE;
 
 	ctx->ref_cnt                = 1;
 	ctx->negotiation_timeout_ms = 10000;
@@ -82,7 +93,7 @@ M_bool M_tls_clientctx_upref(M_tls_clientctx_t *ctx)
 
 static void M_tls_clientctx_destroy_real(M_tls_clientctx_t *ctx)
 {
-	M_hash_strvp_destroy(ctx->sessions, M_TRUE);
+	M_tls_sessioncache_destroy(ctx->sessions);
 	M_tls_ctx_destroy(ctx->ctx);
 	/* Locked when we entered */
 	M_thread_mutex_unlock(ctx->lock);
@@ -348,6 +359,41 @@ M_bool M_tls_clientctx_set_session_resumption(M_tls_clientctx_t *ctx, M_bool ena
 	return M_TRUE;
 }
 
+M_bool M_tls_clientctx_set_session_cache(M_tls_clientctx_t *ctx, size_t max_hosts, M_uint64 ttl_s)
+{
+	if (ctx == NULL)
+		return M_FALSE;
+
+	/* Cache has its own locking */
+	M_tls_sessioncache_set_limits(ctx->sessions, max_hosts, ttl_s);
+	return M_TRUE;
+}
+
+M_bool M_tls_clientctx_get_session_stats(M_tls_clientctx_t *ctx, M_tls_session_stats_t *stats)
+{
+	if (ctx == NULL || stats == NULL)
+		return M_FALSE;
+
+	M_tls_sessioncache_get_stats(ctx->sessions, stats);
+	return M_TRUE;
+}
+
+M_bool M_tls_clientctx_set_ktls(M_tls_clientctx_t *ctx, M_bool enable)
+{
+	if (ctx == NULL)
+		return M_FALSE;
+
+#ifndef M_TLS_USE_KTLS
+	if (enable)
+		return M_FALSE;
+#endif
+
+	M_thread_mutex_lock(ctx->lock);
+	ctx->ktls_enabled = enable;
+	M_thread_mutex_unlock(ctx->lock);
+	return M_TRUE;
+}
+
 char *M_tls_clientctx_get_cipherlist(M_tls_clientctx_t *ctx)
 {
 	char *ret = NULL;
@@ -25,14 +25,16 @@
 #define __M_TLS_CLIENTCTX_INT_H__
 
 #include "m_tls_ctx_common.h"
+#include "m_tls_sessioncache.h"
 
 struct M_tls_clientctx {
 	M_thread_mutex_t    *lock;                   /*!< Mutex to protect concurrent access                                 */
 	SSL_CTX             *ctx;                    /*!< OpenSSL's context                                                  */
 	size_t               ref_cnt;                /*!< Reference count to prevent destroy of CTX while connections active */
-	M_hash_strvp_t      *sessions;               /*!< Storage of session handles for future renegotiation                */
+	M_tls_sessioncache_t *sessions;              /*!< Storage of session handles for future renegotiation                */
 	M_tls_verify_level_t verify_level;           /*!< Certificate verification level                                     */
 	M_bool               sessions_enabled;       /*!< Whether or not session resumption is desired                       */
+	M_bool               ktls_enabled;           /*!< Whether or not to attempt kernel TLS offload                       */
 	M_uint64             negotiation_timeout_ms; /*!< Amount of time negotiation can take                                */
 };
 
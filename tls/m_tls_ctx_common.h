@@ -26,6 +26,15 @@
 
 #include <openssl/ssl.h>
 
+/* Kernel TLS offload requires OpenSSL 3's BIO hooks and the Linux kernel headers.  OpenSSL
+ * hands the kTLS state to our BIO using ctrl numbers that aren't in its public headers, so
+ * it's only enabled for the releases those numbers were checked against (they're listed as
+ * reserved in bio.h for 3.0 through 3.5).  Anything else gets no kTLS at all. */
+#if defined(HAVE_LINUX_TLS_H) && !defined(OPENSSL_NO_KTLS) && !defined(LIBRESSL_VERSION_NUMBER) && \
+    OPENSSL_VERSION_NUMBER >= 0x30000000L && OPENSSL_VERSION_NUMBER < 0x30600000L
+#  define M_TLS_USE_KTLS 1
+#endif
+
 SSL_CTX *M_tls_ctx_init(M_bool is_server);
 
 /* Duplicates a server ctx, except for the server key/cert */
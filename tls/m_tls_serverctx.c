@@ -35,12 +35,17 @@
 #include "m_tls_serverctx_int.h"
 #include "m_tls_hostvalidate.h"
 
+/*! Maximum number of hostnames remembered for SNI lookups.  Wildcard certificates
+ *  match an unbounded number of client supplied names so this must be limited. */
+#define M_TLS_SERVERCTX_SNI_CACHE_MAX 1024
+
 static int M_tls_serverctx_sni_cb(SSL *ssl, int *ad, void *arg)
 {
-	M_tls_serverctx_t *ctx      = arg;
-	M_tls_serverctx_t *child    = NULL;
-	const char        *hostname;
-	int                retval   = SSL_TLSEXT_ERR_OK;
+	M_tls_serverctx_t  *ctx      = arg;
+	M_tls_serverctx_t  *child    = NULL;
+	M_hash_strvp_rcu_t *cache;
+	const char         *hostname;
+	int                 retval   = SSL_TLSEXT_ERR_OK;
 
 	(void)ad;
 
@@ -55,6 +60,24 @@ static int M_tls_serverctx_sni_cb(SSL *ssl, int *ad, void *arg)
 	if (ctx->parent)
 		ctx = ctx->parent;
 
+	/* Hostnames that matched before are resolved without taking any lock since this
+	 * happens on every connection.  Removing a child waits for the epoch, so a child
+	 * found here stays valid until we exit. */
+	cache = M_atomic_load_ptr_explicit(&ctx->sni_cache, M_ATOMIC_ORDER_ACQUIRE);
+	if (cache != NULL) {
+		M_uint32 token = M_epoch_enter(ctx->sni_epoch);
+
+		child = M_hash_strvp_rcu_get_direct(cache, hostname);
+		if (child != NULL && ctx != child && !SSL_set_SSL_CTX(ssl, child->ctx)) {
+			retval = SSL_TLSEXT_ERR_NOACK;
+		}
+		M_epoch_exit(ctx->sni_epoch, token);
+
+		if (child != NULL)
+			return retval;
+	}
+
+	/* Not cached, do the full lookup which will cache the match */
 	M_thread_mutex_lock(ctx->lock);
 
 	child = M_tls_serverctx_SNI_lookup(ctx, hostname);
@@ -261,7 +284,10 @@ M_bool M_tls_serverctx_SNI_ctx_add(M_tls_serverctx_t *ctx, M_tls_serverctx_t *ch
 			NULL,
 			M_tls_serverctx_child_destroy
 		};
-		ctx->children = M_list_create(&list_cbs, M_LIST_NONE);
+		ctx->children  = M_list_create(&list_cbs, M_LIST_NONE);
+		ctx->sni_epoch = M_epoch_create();
+		/* Lookups read this without the lock, the epoch must be visible first */
+		M_atomic_store_ptr_explicit(&ctx->sni_cache, M_hash_strvp_rcu_create(16, 75, M_HASH_STRVP_CASECMP, NULL), M_ATOMIC_ORDER_RELEASE);
 	}
 
 	M_list_insert(ctx->children, child);
@@ -290,13 +316,23 @@ size_t M_tls_serverctx_SNI_count(M_tls_serverctx_t *ctx)
 
 M_tls_serverctx_t *M_tls_serverctx_SNI_lookup(M_tls_serverctx_t *ctx, const char *hostname)
 {
-	M_tls_serverctx_t *child = NULL;
-	size_t             i;
-	X509              *x509;
+	M_tls_serverctx_t  *child = NULL;
+	M_hash_strvp_rcu_t *cache;
+	size_t              i;
+	X509               *x509;
 
 	if (ctx == NULL)
 		return NULL;
 
+	/* Hostnames that matched before skip certificate verification without
+	 * taking the lock.  The caller is responsible for the child staying valid */
+	cache = M_atomic_load_ptr_explicit(&ctx->sni_cache, M_ATOMIC_ORDER_ACQUIRE);
+	if (cache != NULL && hostname != NULL) {
+		child = M_hash_strvp_rcu_get_direct(cache, hostname);
+		if (child != NULL)
+			return child;
+	}
+
 	M_thread_mutex_lock(ctx->lock);
 
 	/* Check self */
@@ -306,6 +342,8 @@ M_tls_serverctx_t *M_tls_serverctx_SNI_lookup(M_tls_serverctx_t *ctx, const char
 	x509 = ctx->x509;
 #endif
 	if (M_tls_verify_host(x509, hostname, M_TLS_VERIFY_HOST_FLAG_NORMAL)) {
+		if (cache != NULL && M_hash_strvp_rcu_num_keys(cache) < M_TLS_SERVERCTX_SNI_CACHE_MAX)
+			M_hash_strvp_rcu_insert(cache, hostname, ctx);
 		M_thread_mutex_unlock(ctx->lock);
 		return ctx;
 	}
@@ -329,6 +367,11 @@ M_tls_serverctx_t *M_tls_serverctx_SNI_lookup(M_tls_serverctx_t *ctx, const char
 		M_thread_mutex_unlock(child->lock);
 		child = NULL;
 	}
+
+	/* New children are added at the end so they can't change existing
+	 * matches, only removal needs to clear the cache */
+	if (child != NULL && cache != NULL && M_hash_strvp_rcu_num_keys(cache) < M_TLS_SERVERCTX_SNI_CACHE_MAX)
+		M_hash_strvp_rcu_insert(cache, hostname, child);
 	M_thread_mutex_unlock(ctx->lock);
 
 	return child;
@@ -413,10 +456,18 @@ M_bool M_tls_serverctx_upref(M_tls_serverctx_t *ctx)
 
 static void M_tls_serverctx_destroy_real(M_tls_serverctx_t *ctx)
 {
+	/* Every in-flight handshake holds a reference, so the pool is idle at this point */
+	if (ctx->hs_parent != NULL) {
+		M_threadpool_parent_wait(ctx->hs_parent);
+		M_threadpool_parent_destroy(ctx->hs_parent);
+	}
+
 	SSL_CTX_free(ctx->ctx);
 	if (ctx->dh)
 		DH_free(ctx->dh);
 	M_list_destroy(ctx->children, M_TRUE);
+	M_hash_strvp_rcu_destroy(ctx->sni_cache, M_FALSE);
+	M_epoch_destroy(ctx->sni_epoch);
 	M_free(ctx->alpn_apps);
 
 	/* Locked when entered */
@@ -437,7 +488,10 @@ void M_tls_serverctx_destroy(M_tls_serverctx_t *ctx)
 		M_thread_mutex_lock(parent->lock);
 		M_thread_mutex_unlock(ctx->lock);
 
-		/* Detach from parent, parent will clean up child */
+		/* Detach from parent, parent will clean up child.  Handshakes that found
+		 * the child in the SNI cache without the lock must be done with it first */
+		M_hash_strvp_rcu_clear(parent->sni_cache, M_FALSE);
+		M_epoch_synchronize(parent->sni_epoch);
 		M_list_remove_val(parent->children, ctx, M_LIST_MATCH_PTR);
 
 		M_thread_mutex_unlock(parent->lock);
@@ -720,6 +774,82 @@ M_bool M_tls_serverctx_set_session_resumption(M_tls_serverctx_t *ctx, M_bool ena
 }
 
 
+M_bool M_tls_serverctx_set_session_cache(M_tls_serverctx_t *ctx, size_t max_sessions, M_uint64 ttl_s)
+{
+	/* OpenSSL looks up and stores sessions in the ctx the connection was created with, even
+	 * after the SNI callback switches it to a child, so only the parent's cache is used */
+	if (ctx == NULL || ctx->parent)
+		return M_FALSE;
+
+	if (max_sessions == 0)
+		max_sessions = SSL_SESSION_CACHE_MAX_SIZE_DEFAULT;
+	if (ttl_s == 0)
+		ttl_s = 300;
+
+	M_thread_mutex_lock(ctx->lock);
+	SSL_CTX_sess_set_cache_size(ctx->ctx, (long)max_sessions);
+	SSL_CTX_set_timeout(ctx->ctx, (long)ttl_s);
+	M_thread_mutex_unlock(ctx->lock);
+	return M_TRUE;
+}
+
+
+M_bool M_tls_serverctx_get_session_stats(M_tls_serverctx_t *ctx, M_tls_session_stats_t *stats)
+{
+	if (ctx == NULL || ctx->parent || stats == NULL)
+		return M_FALSE;
+
+	M_mem_set(stats, 0, sizeof(*stats));
+
+	M_thread_mutex_lock(ctx->lock);
+	stats->hits    = (M_uint64)SSL_CTX_sess_hits(ctx->ctx);
+	stats->misses  = (M_uint64)SSL_CTX_sess_misses(ctx->ctx);
+	/* Every full handshake adds a session */
+	stats->stored  = (M_uint64)(SSL_CTX_sess_accept_good(ctx->ctx) - SSL_CTX_sess_hits(ctx->ctx));
+	stats->expired = (M_uint64)SSL_CTX_sess_timeouts(ctx->ctx);
+	stats->evicted = (M_uint64)SSL_CTX_sess_cache_full(ctx->ctx);
+	stats->entries = (size_t)SSL_CTX_sess_number(ctx->ctx);
+	M_thread_mutex_unlock(ctx->lock);
+
+	return M_TRUE;
+}
+
+
+M_bool M_tls_serverctx_set_ktls(M_tls_serverctx_t *ctx, M_bool enable)
+{
+	if (ctx == NULL || ctx->parent)
+		return M_FALSE;
+
+#ifndef M_TLS_USE_KTLS
+	if (enable)
+		return M_FALSE;
+#endif
+
+	M_thread_mutex_lock(ctx->lock);
+	ctx->ktls_enabled = enable;
+	M_thread_mutex_unlock(ctx->lock);
+	return M_TRUE;
+}
+
+
+M_bool M_tls_serverctx_set_handshake_pool(M_tls_serverctx_t *ctx, M_threadpool_t *pool)
+{
+	M_bool ret = M_FALSE;
+
+	if (ctx == NULL || ctx->parent || pool == NULL)
+		return M_FALSE;
+
+	/* Connections keep using the pool they were accepted with, so it can't be swapped out */
+	M_thread_mutex_lock(ctx->lock);
+	if (ctx->hs_parent == NULL) {
+		ctx->hs_parent = M_threadpool_parent_create(pool);
+		ret            = M_TRUE;
+	}
+	M_thread_mutex_unlock(ctx->lock);
+	return ret;
+}
+
+
 M_bool M_tls_serverctx_set_negotiation_timeout_ms(M_tls_serverctx_t *ctx, M_uint64 timeout_ms)
 {
 	if (ctx == NULL || ctx->parent)
@@ -31,6 +31,8 @@ struct M_tls_serverctx {
 	M_thread_mutex_t   *lock;                   /*!< Mutex to protect concurrent access                                 */
 	M_list_t           *children;               /*!< List of M_tls_serverctx_t children for SNI                         */
 	M_tls_serverctx_t  *parent;                 /*!< If this CTX is an SNI child, this will be set                      */
+	void * volatile     sni_cache;              /*!< M_hash_strvp_rcu_t of hostname to matched CTX, created with children */
+	M_epoch_t          *sni_epoch;              /*!< Keeps children found in sni_cache alive until lock free readers exit */
 #if OPENSSL_VERSION_NUMBER < 0x1000200fL
 	X509               *x509;                   /*!< OpenSSL < 1.0.2 doesn't allow retrieval of certs from a CTX, cache */
 #endif
@@ -39,6 +41,8 @@ struct M_tls_serverctx {
 	size_t              ref_cnt;                /*!< Reference count to prevent destroy of CTX while connections active */
 	M_uint64            negotiation_timeout_ms; /*!< Amount of time negotiation can take                                */
 	M_bool              sessions_enabled;       /*!< Whether or not to enable session resumption support                */
+	M_bool              ktls_enabled;           /*!< Whether or not to attempt kernel TLS offload                       */
+	M_threadpool_parent_t *hs_parent;           /*!< Thread pool handshakes are offloaded to, NULL if disabled          */
 	unsigned char      *alpn_apps;              /*!< ALPN supported applications                                        */
 	size_t              alpn_apps_len;          /*!< ALPN supported applications length                                 */
 };
@@ -0,0 +1,270 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "m_config.h"
+#include <mstdlib/mstdlib_thread.h>
+#include <mstdlib/mstdlib_tls.h>
+#include <openssl/ssl.h>
+#include "base/m_defs_int.h"
+#include "m_tls_sessioncache.h"
+
+#define M_TLS_SESSIONCACHE_SHARDS      16
+#define M_TLS_SESSIONCACHE_PER_HOST    4
+#define M_TLS_SESSIONCACHE_MAX_HOSTS   1024
+
+typedef struct {
+	SSL_SESSION *session;
+	M_time_t     expires;
+} M_tls_sessioncache_session_t;
+
+typedef struct {
+	M_tls_sessioncache_session_t sessions[M_TLS_SESSIONCACHE_PER_HOST]; /*!< Oldest first */
+	size_t                       cnt;
+} M_tls_sessioncache_host_t;
+
+typedef struct {
+	M_thread_mutex_t *lock;
+	M_cache_strvp_t  *hosts;
+} M_tls_sessioncache_shard_t;
+
+struct M_tls_sessioncache {
+	M_tls_sessioncache_shard_t shards[M_TLS_SESSIONCACHE_SHARDS];
+	M_uint64                   ttl_s;
+	volatile M_uint64          hits;
+	volatile M_uint64          misses;
+	volatile M_uint64          stored;
+	volatile M_uint64          expired;
+	volatile M_uint64          evicted;
+};
+
+
+static void M_tls_sessioncache_host_destroy(void *arg)
+{
+	M_tls_sessioncache_host_t *host = arg;
+	size_t                     i;
+
+	if (host == NULL)
+		return;
+
+	for (i=0; i<host->cnt; i++) {
+		SSL_SESSION_free(host->sessions[i].session);
+	}
+	M_free(host);
+}
+
+
+static size_t M_tls_sessioncache_shard_size(size_t max_hosts)
+{
+	if (max_hosts == 0)
+		max_hosts = M_TLS_SESSIONCACHE_MAX_HOSTS;
+
+	return (max_hosts + M_TLS_SESSIONCACHE_SHARDS - 1) / M_TLS_SESSIONCACHE_SHARDS;
+}
+
+
+static M_tls_sessioncache_shard_t *M_tls_sessioncache_shard(M_tls_sessioncache_t *cache, const char *key)
+{
+	return &cache->shards[M_hash_func_hash_str_casecmp(key, 0) % M_TLS_SESSIONCACHE_SHARDS];
+}
+
+
+static M_bool M_tls_sessioncache_session_usable(const M_tls_sessioncache_session_t *s, M_time_t now)
+{
+	if (s->expires <= now)
+		return M_FALSE;
+
+#if OPENSSL_VERSION_NUMBER >= 0x1010100fL && !defined(LIBRESSL_VERSION_NUMBER)
+	if (!SSL_SESSION_is_resumable(s->session))
+		return M_FALSE;
+#endif
+
+	return M_TRUE;
+}
+
+
+M_tls_sessioncache_t *M_tls_sessioncache_create(void)
+{
+	M_tls_sessioncache_t *cache;
+	size_t                i;
+
+	cache = M_malloc_zero(sizeof(*cache));
+	for (i=0; i<M_TLS_SESSIONCACHE_SHARDS; i++) {
+		cache->shards[i].lock  = M_thread_mutex_create(M_THREAD_MUTEXATTR_NONE);
+		cache->shards[i].hosts = M_cache_strvp_create(M_tls_sessioncache_shard_size(0), M_CACHE_STRVP_CASECMP, M_tls_sessioncache_host_destroy);
+	}
+
+	return cache;
+}
+
+
+void M_tls_sessioncache_destroy(M_tls_sessioncache_t *cache)
+{
+	size_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i=0; i<M_TLS_SESSIONCACHE_SHARDS; i++) {
+		M_cache_strvp_destroy(cache->shards[i].hosts);
+		M_thread_mutex_destroy(cache->shards[i].lock);
+	}
+	M_free(cache);
+}
+
+
+void M_tls_sessioncache_set_limits(M_tls_sessioncache_t *cache, size_t max_hosts, M_uint64 ttl_s)
+{
+	size_t shard_size = M_tls_sessioncache_shard_size(max_hosts);
+	size_t i;
+
+	if (cache == NULL)
+		return;
+
+	cache->ttl_s = ttl_s;
+
+	for (i=0; i<M_TLS_SESSIONCACHE_SHARDS; i++) {
+		M_thread_mutex_lock(cache->shards[i].lock);
+		M_cache_strvp_set_max_size(cache->shards[i].hosts, shard_size);
+		M_thread_mutex_unlock(cache->shards[i].lock);
+	}
+}
+
+
+void M_tls_sessioncache_insert(M_tls_sessioncache_t *cache, const char *key, SSL_SESSION *session)
+{
+	M_tls_sessioncache_shard_t *shard;
+	M_tls_sessioncache_host_t  *host;
+	M_time_t                    expires;
+	size_t                      i;
+
+	if (cache == NULL || M_str_isempty(key) || session == NULL) {
+		if (session != NULL)
+			SSL_SESSION_free(session);
+		return;
+	}
+
+	/* Never keep a session longer than the server said it was good for */
+	expires = (M_time_t)SSL_SESSION_get_time(session) + (M_time_t)SSL_SESSION_get_timeout(session);
+	if (cache->ttl_s != 0 && M_time() + (M_time_t)cache->ttl_s < expires)
+		expires = M_time() + (M_time_t)cache->ttl_s;
+
+	shard = M_tls_sessioncache_shard(cache, key);
+	M_thread_mutex_lock(shard->lock);
+
+	host = M_cache_strvp_get_direct(shard->hosts, key);
+	if (host == NULL) {
+		if (M_cache_strvp_size(shard->hosts) >= M_cache_strvp_max_size(shard->hosts))
+			M_atomic_inc_u64(&cache->evicted);
+		host = M_malloc_zero(sizeof(*host));
+		M_cache_strvp_insert(shard->hosts, key, host);
+	}
+
+	/* A session that was resumed and is being returned may already be here */
+	for (i=0; i<host->cnt; i++) {
+		if (host->sessions[i].session == session) {
+			M_thread_mutex_unlock(shard->lock);
+			SSL_SESSION_free(session);
+			return;
+		}
+	}
+
+	/* Full, drop the oldest */
+	if (host->cnt == M_TLS_SESSIONCACHE_PER_HOST) {
+		SSL_SESSION_free(host->sessions[0].session);
+		M_mem_move(host->sessions, host->sessions+1, sizeof(*host->sessions) * (host->cnt - 1));
+		host->cnt--;
+	}
+
+	host->sessions[host->cnt].session = session;
+	host->sessions[host->cnt].expires = expires;
+	host->cnt++;
+
+	M_thread_mutex_unlock(shard->lock);
+
+	M_atomic_inc_u64(&cache->stored);
+}
+
+
+SSL_SESSION *M_tls_sessioncache_take(M_tls_sessioncache_t *cache, const char *key)
+{
+	M_tls_sessioncache_shard_t *shard;
+	M_tls_sessioncache_host_t  *host;
+	SSL_SESSION                *session = NULL;
+	M_time_t                    now     = M_time();
+
+	if (cache == NULL || M_str_isempty(key))
+		return NULL;
+
+	shard = M_tls_sessioncache_shard(cache, key);
+	M_thread_mutex_lock(shard->lock);
+
+	host = M_cache_strvp_get_direct(shard->hosts, key);
+	while (host != NULL && host->cnt > 0 && session == NULL) {
+		M_tls_sessioncache_session_t *s = &host->sessions[--host->cnt];
+
+		/* Newest first, TLS 1.3 tickets are single use so it's removed either way */
+		if (M_tls_sessioncache_session_usable(s, now)) {
+			session = s->session;
+		} else {
+			SSL_SESSION_free(s->session);
+			M_atomic_inc_u64(&cache->expired);
+		}
+		s->session = NULL;
+	}
+
+	if (host != NULL && host->cnt == 0)
+		M_cache_strvp_remove(shard->hosts, key);
+
+	M_thread_mutex_unlock(shard->lock);
+
+	if (session != NULL) {
+		M_atomic_inc_u64(&cache->hits);
+	} else {
+		M_atomic_inc_u64(&cache->misses);
+	}
+
+	return session;
+}
+
+
+void M_tls_sessioncache_get_stats(M_tls_sessioncache_t *cache, M_tls_session_stats_t *stats)
+{
+	size_t i;
+
+	M_mem_set(stats, 0, sizeof(*stats));
+	if (cache == NULL)
+		return;
+
+	stats->hits    = M_atomic_load_u64(&cache->hits);
+	stats->misses  = M_atomic_load_u64(&cache->misses);
+	stats->stored  = M_atomic_load_u64(&cache->stored);
+	stats->expired = M_atomic_load_u64(&cache->expired);
+	stats->evicted = M_atomic_load_u64(&cache->evicted);
+
+	for (i=0; i<M_TLS_SESSIONCACHE_SHARDS; i++) {
+		M_thread_mutex_lock(cache->shards[i].lock);
+		stats->entries += M_cache_strvp_size(cache->shards[i].hosts);
+		M_thread_mutex_unlock(cache->shards[i].lock);
+	}
+}
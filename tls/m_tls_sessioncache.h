@@ -0,0 +1,51 @@
+/* The MIT License (MIT)
+ * 
+ * Copyright (c) 2017 Main Street Softworks, Inc.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef __M_TLS_SESSIONCACHE_H__
+#define __M_TLS_SESSIONCACHE_H__
+
+#include <openssl/ssl.h>
+
+/* Client session cache.  Keyed by host:port, split into independently locked shards so
+ * connections to different hosts don't contend.  Each shard is an LRU bounded by host
+ * count, and each host keeps a small number of sessions since TLS 1.3 tickets are
+ * single use and servers normally issue more than one per connection. */
+
+typedef struct M_tls_sessioncache M_tls_sessioncache_t;
+
+M_tls_sessioncache_t *M_tls_sessioncache_create(void);
+void M_tls_sessioncache_destroy(M_tls_sessioncache_t *cache);
+
+/* max_hosts of 0 uses the default, ttl_s of 0 uses only the lifetime of the session itself */
+void M_tls_sessioncache_set_limits(M_tls_sessioncache_t *cache, size_t max_hosts, M_uint64 ttl_s);
+
+/* Takes ownership of the reference on session */
+void M_tls_sessioncache_insert(M_tls_sessioncache_t *cache, const char *key, SSL_SESSION *session);
+
+/* Removes and returns the newest usable session for the key, caller must SSL_SESSION_free() */
+SSL_SESSION *M_tls_sessioncache_take(M_tls_sessioncache_t *cache, const char *key);
+
+void M_tls_sessioncache_get_stats(M_tls_sessioncache_t *cache, M_tls_session_stats_t *stats);
+
+#endif